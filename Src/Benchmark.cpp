@@ -0,0 +1,2940 @@
+#include <algorithm>
+#include <math.h>
+#include <omp.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include "Benchmark.h"
+#include "BrushKernel.h"
+#include "BrushMask.h"
+#include "BrushStroke.h"
+#include "ClipmapLandscapeShader.h"
+#include "ClipmapCache.h"
+#include "ClipmapPrefetcher.h"
+#include "ClipmapScheduler.h"
+#include "EditWorker.h"
+#include "Heightmap.h"
+#include "HeightmapPyramid.h"
+#include "HeightmapQuadtree.h"
+#include "HeightmapTileStats.h"
+#include "HydraulicErosion.h"
+#include "Landscape.h"
+#include "StrokeRecording.h"
+#include "TerrainGenerator.h"
+#include "TileCodec.h"
+#include "Timer.h"
+#include "UploadRing.h"
+#include "LandscapeEditor.h"
+
+// --------------------------------------------------------------------
+static float TestHeight(int x, int y)
+{
+	return 70.0f + sin(float(x) / 10.0f) * 2.0f + sin(float(y) / 25.6f) * 10.6f;
+}
+
+// --------------------------------------------------------------------
+static int FlatWrap(int Coord, int Size)
+{
+	// Same float modulo the TBO code used on the flat array
+	return int(Coord - Size * floor(float(Coord) / float(Size)));
+}
+
+// --------------------------------------------------------------------
+static float BrushFalloff(float DistanceFactor)
+{
+	return 0.15f * ((DistanceFactor < 0.5f) ? (DistanceFactor * DistanceFactor) : (0.5f - (1.0f - DistanceFactor) * (1.0f - DistanceFactor)));
+}
+
+// --------------------------------------------------------------------
+/** Hidden frame with a GL context current on its canvas - benchmarks run from OnRun(), before any window of the editor exists */
+class BenchmarkGLContext
+{
+	wxFrame *Frame;
+	wxGLCanvas *Canvas;
+	wxGLContext *Context;
+	bool bValid;
+
+public:
+	BenchmarkGLContext():
+	Frame(0), Canvas(0), Context(0), bValid(false)
+	{
+		Frame = new wxFrame((wxFrame *) NULL, wxID_ANY, wxT("Benchmark"), wxDefaultPosition, wxSize(256, 256));
+		Canvas = new wxGLCanvas(Frame, wxID_ANY, NULL, wxDefaultPosition, wxSize(256, 256));
+		Context = new wxGLContext(Canvas);
+
+		bValid = Context->SetCurrent(*Canvas) && glewInit() == GLEW_OK;
+	};
+
+	~BenchmarkGLContext()
+	{
+		delete Context;
+		Frame->Destroy();
+	};
+
+	bool IsValid() const {return bValid;};
+
+private:
+	BenchmarkGLContext(const BenchmarkGLContext &other);
+	BenchmarkGLContext & operator= (const BenchmarkGLContext &other);
+};
+
+// --------------------------------------------------------------------
+bool Benchmark::Run(const std::string &Name)
+{
+	bool bAll = (Name == "all");
+	bool bFound = false;
+
+	if (bAll || Name == "heightmap")
+	{
+		HeightmapLayout();
+		bFound = true;
+	}
+
+	if (bAll || Name == "paging")
+	{
+		HeightmapPaging();
+		bFound = true;
+	}
+
+	if (bAll || Name == "quantization")
+	{
+		HeightmapQuantization();
+		bFound = true;
+	}
+
+	if (bAll || Name == "codec")
+	{
+		TileCompression();
+		bFound = true;
+	}
+
+	if (bAll || Name == "pyramid")
+	{
+		HeightmapMipPyramid();
+		bFound = true;
+	}
+
+	if (bAll || Name == "edits")
+	{
+		EditPropagation();
+		bFound = true;
+	}
+
+	if (bAll || Name == "picking")
+	{
+		TerrainPicking();
+		bFound = true;
+	}
+
+	if (bAll || Name == "generator")
+	{
+		TerrainGeneration();
+		bFound = true;
+	}
+
+	if (bAll || Name == "erosion")
+	{
+		Erosion();
+		bFound = true;
+	}
+
+	if (bAll || Name == "creation")
+	{
+		LandscapeCreation();
+		bFound = true;
+	}
+
+	if (bAll || Name == "brush")
+	{
+		BrushStamps();
+		bFound = true;
+	}
+
+	if (bAll || Name == "stroke")
+	{
+		BrushStrokes();
+		bFound = true;
+	}
+
+	if (bAll || Name == "brushthreads")
+	{
+		BrushThreadScaling();
+		bFound = true;
+	}
+
+	if (bAll || Name == "brushmask")
+	{
+		BrushMasks();
+		bFound = true;
+	}
+
+	if (bAll || Name == "filterbrush")
+	{
+		FilterBrushes();
+		bFound = true;
+	}
+
+	if (bAll || Name == "brushmodes")
+	{
+		BrushModes();
+		bFound = true;
+	}
+
+	if (bAll || Name == "editworker")
+	{
+		EditWorkerFrames();
+		bFound = true;
+	}
+
+	if (bAll || Name == "clipmapcache")
+	{
+		ClipmapCacheFlight();
+		bFound = true;
+	}
+
+	if (bAll || Name == "prefetch")
+	{
+		ClipmapPrefetchFlight();
+		bFound = true;
+	}
+
+	if (bAll || Name == "schedule")
+	{
+		ClipmapSchedule();
+		bFound = true;
+	}
+
+	if (bAll || Name == "upload")
+	{
+		ClipmapUploads();
+		bFound = true;
+	}
+
+	if (bAll || Name == "texturearray")
+	{
+		ClipmapTextureArray();
+		bFound = true;
+	}
+
+	if (!bFound)
+		ERR("Unknown benchmark: " << Name);
+
+	return bFound;
+}
+
+// --------------------------------------------------------------------
+void Benchmark::HeightmapLayout()
+{
+	const int Sizes[] = {2048, 8192};
+	const int Radii[] = {8, 32, 128, 512};
+	const int TBOSize = 4 * 63 + 5;
+	const int ClipmapsAmount = 8;
+	const int Repeats = 4;
+
+	float *TBOData = new float[TBOSize * TBOSize];
+	volatile float Sink = 0.0f;
+
+	for (int s = 0; s < sizeof(Sizes) / sizeof(Sizes[0]); ++s)
+	{
+		const int Size = Sizes[s];
+		const int Center = Size / 2;
+
+		LOG("==== Heightmap layout " << Size << " x " << Size << " ====");
+
+		float *Flat = new float[Size * Size];
+		Heightmap Tiled(Size);
+
+		for (int y = 0; y < Size; ++y)
+		{
+			for (int x = 0; x < Size; ++x)
+			{
+				Flat[y * Size + x] = TestHeight(x, y);
+				Tiled.Set(x, y, TestHeight(x, y));
+			}
+		}
+
+		Tiled.UpdateAllAprons();
+
+		// ---------------------- Full level gather (InitTBO) ----------------------
+		for (int lvl = 0, Scale = 1; lvl < ClipmapsAmount; ++lvl, Scale *= 2)
+		{
+			const int First = Center - (TBOSize / 2) * Scale;
+
+			double Start = GetTime();
+			for (int r = 0; r < Repeats; ++r)
+				for (int x = 0; x < TBOSize; ++x)
+					for (int y = 0; y < TBOSize; ++y)
+						TBOData[y * TBOSize + x] = Flat[FlatWrap(First + y * Scale, Size) * Size + FlatWrap(First + x * Scale, Size)];
+			double FlatTime = (GetTime() - Start) / Repeats;
+
+			Start = GetTime();
+			for (int r = 0; r < Repeats; ++r)
+				for (int y = 0; y < TBOSize; ++y)
+					Tiled.GatherRow(First, First + y * Scale, Scale, TBOSize, TBOData + y * TBOSize);
+			double TiledTime = (GetTime() - Start) / Repeats;
+
+			LOG("Level " << lvl << " gather: flat " << FlatTime * 1000.0 << " ms, tiled " << TiledTime * 1000.0 << " ms ("
+				<< TBOSize * TBOSize / TiledTime / 1000000.0 << " Msamples/s)");
+		}
+
+		// ---------------------- Column gather (UpdateTBO moving along X) ----------------------
+		for (int lvl = 0, Scale = 1; lvl < ClipmapsAmount; ++lvl, Scale *= 2)
+		{
+			const int First = Center - (TBOSize / 2) * Scale;
+			const int Columns = 256;
+
+			double Start = GetTime();
+			for (int c = 0; c < Columns; ++c)
+				for (int y = 0; y < TBOSize; ++y)
+					TBOData[y * TBOSize + (c % TBOSize)] = Flat[FlatWrap(First + y * Scale, Size) * Size + FlatWrap(First + c * Scale, Size)];
+			double FlatTime = GetTime() - Start;
+
+			Start = GetTime();
+			for (int c = 0; c < Columns; ++c)
+				Tiled.GatherColumn(First + c * Scale, First, Scale, TBOSize, TBOData + (c % TBOSize), TBOSize);
+			double TiledTime = GetTime() - Start;
+
+			LOG("Level " << lvl << " " << Columns << " columns: flat " << FlatTime * 1000.0 << " ms, tiled " << TiledTime * 1000.0 << " ms");
+		}
+
+		// ---------------------- Brush pass ----------------------
+		for (int b = 0; b < sizeof(Radii) / sizeof(Radii[0]); ++b)
+		{
+			const int Radius = Radii[b];
+			const int Stamps = max(1, 4096 / Radius);
+
+			double Start = GetTime();
+			for (int r = 0; r < Stamps; ++r)
+			{
+				for (int y = Center - Radius; y <= Center + Radius; ++y)
+				{
+					float *Row = Flat + y * Size;
+
+					for (int x = Center - Radius; x <= Center + Radius; ++x)
+					{
+						float Distance = sqrt(float((x - Center) * (x - Center) + (y - Center) * (y - Center)));
+
+						if (Distance <= Radius)
+							Row[x] += BrushFalloff(1.0f - Distance / Radius);
+					}
+				}
+			}
+			double FlatTime = (GetTime() - Start) / Stamps;
+
+			const int Shift = Tiled.GetTileShift();
+			const int TileSize = Tiled.GetTileSize();
+			const int Stride = Tiled.GetTileStride();
+
+			Start = GetTime();
+			for (int r = 0; r < Stamps; ++r)
+			{
+				for (int TileY = (Center - Radius) >> Shift; TileY <= (Center + Radius) >> Shift; ++TileY)
+				{
+					for (int TileX = (Center - Radius) >> Shift; TileX <= (Center + Radius) >> Shift; ++TileX)
+					{
+						float *Tile = Tiled.WriteTile(TileX, TileY);
+						int MinY = max(0, Center - Radius - TileY * TileSize), MaxY = min(TileSize - 1, Center + Radius - TileY * TileSize);
+						int MinX = max(0, Center - Radius - TileX * TileSize), MaxX = min(TileSize - 1, Center + Radius - TileX * TileSize);
+
+						for (int y = MinY; y <= MaxY; ++y)
+						{
+							for (int x = MinX; x <= MaxX; ++x)
+							{
+								int dx = TileX * TileSize + x - Center;
+								int dy = TileY * TileSize + y - Center;
+								float Distance = sqrt(float(dx * dx + dy * dy));
+
+								if (Distance <= Radius)
+									Tile[y * Stride + x] += BrushFalloff(1.0f - Distance / Radius);
+							}
+						}
+					}
+				}
+			}
+			double TiledTime = (GetTime() - Start) / Stamps;
+
+			LOG("Brush radius " << Radius << ": flat " << 1.0 / FlatTime << " stamps/s, tiled " << 1.0 / TiledTime << " stamps/s");
+
+			// 3x3 neighbourhood over the brush box - wrapped flat lookups vs tile aprons
+			Start = GetTime();
+			for (int r = 0; r < Stamps; ++r)
+			{
+				float Sum = 0.0f;
+
+				for (int y = Center - Radius; y <= Center + Radius; ++y)
+					for (int x = Center - Radius; x <= Center + Radius; ++x)
+						Sum += fabs(Flat[FlatWrap(y, Size) * Size + FlatWrap(x + 1, Size)] - Flat[FlatWrap(y, Size) * Size + FlatWrap(x - 1, Size)]) +
+							   fabs(Flat[FlatWrap(y + 1, Size) * Size + FlatWrap(x, Size)] - Flat[FlatWrap(y - 1, Size) * Size + FlatWrap(x, Size)]);
+
+				Sink = Sink + Sum;
+			}
+			FlatTime = (GetTime() - Start) / Stamps;
+
+			Start = GetTime();
+			for (int r = 0; r < Stamps; ++r)
+			{
+				float Sum = 0.0f;
+
+				for (int TileY = (Center - Radius) >> Shift; TileY <= (Center + Radius) >> Shift; ++TileY)
+				{
+					for (int TileX = (Center - Radius) >> Shift; TileX <= (Center + Radius) >> Shift; ++TileX)
+					{
+						const float *Tile = Tiled.ReadTile(TileX, TileY);
+						int MinY = max(0, Center - Radius - TileY * TileSize), MaxY = min(TileSize - 1, Center + Radius - TileY * TileSize);
+						int MinX = max(0, Center - Radius - TileX * TileSize), MaxX = min(TileSize - 1, Center + Radius - TileX * TileSize);
+
+						for (int y = MinY; y <= MaxY; ++y)
+							for (int x = MinX; x <= MaxX; ++x)
+								Sum += fabs(Tile[y * Stride + x + 1] - Tile[y * Stride + x - 1]) + fabs(Tile[(y + 1) * Stride + x] - Tile[(y - 1) * Stride + x]);
+					}
+				}
+
+				Sink = Sink + Sum;
+			}
+			TiledTime = (GetTime() - Start) / Stamps;
+
+			LOG("3x3 filter radius " << Radius << ": flat " << 1.0 / FlatTime << " stamps/s, tiled " << 1.0 / TiledTime << " stamps/s");
+		}
+
+		delete [] Flat;
+	}
+
+	delete [] TBOData;
+}
+
+// --------------------------------------------------------------------
+void Benchmark::HeightmapPaging()
+{
+	const char *PageFilePath = "BenchmarkPaging.tmp";
+	const int Size = 16384;
+	const int TBOSize = 4 * 63 + 5;
+	const int ClipmapsAmount = 6;
+	const int FlightSteps = 2048;
+	const unsigned long long Budgets[] = {32ull << 20, 128ull << 20};
+
+	LOG("==== Paged heightmap " << Size << " x " << Size << " (" << (unsigned long long)Size * Size * sizeof(float) / (1 << 20) << " MB) ====");
+
+	// Write the map out once through a small budget, then fly over it with the others
+	{
+		HeightmapPageFile *PageFile = new HeightmapPageFile(PageFilePath, Heightmap::DefaultTileSize + 2 * Heightmap::Apron, true);
+
+		if (!PageFile->IsOpen())
+		{
+			ERR("Failed to create " << PageFilePath);
+			delete PageFile;
+			return;
+		}
+
+		Heightmap Paged(Size, PageFile, Budgets[0]);
+		const unsigned int TileSize = Paged.GetTileSize();
+		const unsigned int Stride = Paged.GetTileStride();
+
+		double Start = GetTime();
+		for (unsigned int TileY = 0; TileY < Paged.GetTilesPerRow(); ++TileY)
+		{
+			for (unsigned int TileX = 0; TileX < Paged.GetTilesPerRow(); ++TileX)
+			{
+				float *Tile = Paged.WriteTile(TileX, TileY);
+
+				for (unsigned int y = 0; y < TileSize; ++y)
+					for (unsigned int x = 0; x < TileSize; ++x)
+						Tile[y * Stride + x] = TestHeight(TileX * TileSize + x, TileY * TileSize + y);
+			}
+		}
+
+		Paged.UpdateAllAprons();
+		Paged.Flush();
+
+		HeightmapPagingStats Stats = Paged.GetPagingStats();
+		LOG("Fill: " << GetTime() - Start << " s, " << Stats.WriteBacks << " write backs, " << Stats.Evictions << " evictions");
+	}
+
+	float *TBOData = new float[TBOSize * TBOSize];
+	float *Column = new float[TBOSize];
+
+	for (int b = 0; b < sizeof(Budgets) / sizeof(Budgets[0]); ++b)
+	{
+		Heightmap Paged(Size, new HeightmapPageFile(PageFilePath, Heightmap::DefaultTileSize + 2 * Heightmap::Apron, false), Budgets[b]);
+
+		// InitTBO equivalent around the start point, then a diagonal flight gathering the new column and row of every level
+		const int Start = Size / 4;
+
+		double StartTime = GetTime();
+		for (int lvl = 0, Scale = 1; lvl < ClipmapsAmount; ++lvl, Scale *= 2)
+			for (int y = 0; y < TBOSize; ++y)
+				Paged.GatherRow(Start - (TBOSize / 2) * Scale, Start + (y - TBOSize / 2) * Scale, Scale, TBOSize, TBOData + y * TBOSize);
+		double InitTime = GetTime() - StartTime;
+
+		HeightmapPagingStats InitStats = Paged.GetPagingStats();
+
+		StartTime = GetTime();
+		for (int Step = 1; Step <= FlightSteps; ++Step)
+		{
+			for (int lvl = 0, Scale = 1; lvl < ClipmapsAmount; ++lvl, Scale *= 2)
+			{
+				if (Step % Scale != 0)
+					continue;
+
+				int Center = Start + Step;
+				Paged.GatherColumn(Center + (TBOSize / 2) * Scale, Center - (TBOSize / 2) * Scale, Scale, TBOSize, Column);
+				Paged.GatherRow(Center - (TBOSize / 2) * Scale, Center + (TBOSize / 2) * Scale, Scale, TBOSize, Column);
+			}
+		}
+		double FlightTime = GetTime() - StartTime;
+
+		HeightmapPagingStats Stats = Paged.GetPagingStats();
+
+		LOG("Budget " << (Budgets[b] >> 20) << " MB (" << Stats.MaxResidentTiles << " tiles): init " << InitTime * 1000.0 << " ms, "
+			<< InitStats.Misses << " misses");
+		LOG("    flight " << FlightSteps << " steps: " << FlightSteps / FlightTime << " steps/s, hits " << Stats.Hits - InitStats.Hits
+			<< ", misses " << Stats.Misses - InitStats.Misses << ", evictions " << Stats.Evictions << ", write backs " << Stats.WriteBacks);
+	}
+
+	delete [] Column;
+	delete [] TBOData;
+
+	remove(PageFilePath);
+}
+
+// --------------------------------------------------------------------
+void Benchmark::HeightmapQuantization()
+{
+	const int Size = 4096;
+	const int TBOSize = 4 * 63 + 5;
+	const int ClipmapsAmount = 8;
+	const unsigned long long WorkingSet = 16ull << 20;
+
+	LOG("==== Quantized heightmap " << Size << " x " << Size << " ====");
+
+	Heightmap Resident(Size);
+
+	for (int y = 0; y < Size; ++y)
+		for (int x = 0; x < Size; ++x)
+			Resident.Set(x, y, TestHeight(x, y) + 400.0f * sin(float(x + 2 * y) / 1500.0f));
+
+	Resident.UpdateAllAprons();
+
+	const unsigned int TilesPerRow = Resident.GetTilesPerRow();
+	const unsigned int TilesAmount = TilesPerRow * TilesPerRow;
+	const unsigned int TileSamples = Resident.GetTileStride() * Resident.GetTileStride();
+	const double FloatBytes = double(TilesAmount) * TileSamples * sizeof(float);
+
+	QuantizedHeightmapStorage *Storage = new QuantizedHeightmapStorage(TilesAmount, Resident.GetTileStride());
+	float *Decoded = new float[TileSamples];
+
+	// ---------------------- Encode / decode ----------------------
+	double Start = GetTime();
+	for (unsigned int TileY = 0; TileY < TilesPerRow; ++TileY)
+		for (unsigned int TileX = 0; TileX < TilesPerRow; ++TileX)
+			Storage->StoreTile(TileY * TilesPerRow + TileX, Resident.ReadTile(TileX, TileY) - Heightmap::Apron * (Resident.GetTileStride() + 1));
+	double EncodeTime = GetTime() - Start;
+
+	float MaxError = 0.0f, MaxMeasured = 0.0f;
+	double ErrorSum = 0.0;
+
+	Start = GetTime();
+	for (unsigned int i = 0; i < TilesAmount; ++i)
+		Storage->LoadTile(i, Decoded);
+	double DecodeTime = GetTime() - Start;
+
+	for (unsigned int TileY = 0; TileY < TilesPerRow; ++TileY)
+	{
+		for (unsigned int TileX = 0; TileX < TilesPerRow; ++TileX)
+		{
+			const float *Original = Resident.ReadTile(TileX, TileY) - Heightmap::Apron * (Resident.GetTileStride() + 1);
+
+			Storage->LoadTile(TileY * TilesPerRow + TileX, Decoded);
+
+			for (unsigned int i = 0; i < TileSamples; ++i)
+			{
+				float Error = fabs(Decoded[i] - Original[i]);
+				MaxMeasured = max(MaxMeasured, Error);
+				ErrorSum += Error;
+			}
+
+			MaxError = max(MaxError, Storage->GetTileError(TileY * TilesPerRow + TileX));
+		}
+	}
+
+	LOG("Footprint: float " << FloatBytes / (1 << 20) << " MB, quantized " << Storage->GetMemoryUsage() / double(1 << 20) << " MB");
+	LOG("Encode " << FloatBytes / EncodeTime / (1 << 20) << " MB/s, decode " << FloatBytes / DecodeTime / (1 << 20) << " MB/s (float MB)");
+	LOG("Error: reported bound " << MaxError << ", measured max " << MaxMeasured << ", mean " << ErrorSum / (double(TilesAmount) * TileSamples)
+		<< (MaxMeasured <= MaxError ? "" : " - BOUND VIOLATED"));
+
+	// ---------------------- Edited tiles evicted over and over ----------------------
+	const unsigned int Cycles = 200;
+	const unsigned int CycleTiles = 16;
+	const unsigned int EditsPerCycle = 8;
+
+	QuantizedHeightmapStorage Requantized(CycleTiles, Resident.GetTileStride());
+	std::vector<float> Truth(CycleTiles * TileSamples);
+	unsigned int Seed = 12345;
+
+	for (unsigned int t = 0; t < CycleTiles; ++t)
+	{
+		const float *Original = Resident.ReadTile(t, 0) - Heightmap::Apron * (Resident.GetTileStride() + 1);
+
+		memcpy(&Truth[t * TileSamples], Original, TileSamples * sizeof(float));
+		Requantized.StoreTile(t, Original);
+	}
+
+	for (unsigned int c = 0; c < Cycles; ++c)
+	{
+		for (unsigned int t = 0; t < CycleTiles; ++t)
+		{
+			// Paged in, a few samples painted over, written back
+			Requantized.LoadTile(t, Decoded);
+
+			for (unsigned int e = 0; e < EditsPerCycle; ++e)
+			{
+				Seed = Seed * 1664525u + 1013904223u;
+				unsigned int Sample = (Seed >> 8) % TileSamples;
+
+				// Every tenth cycle raises a sample over the tile's range, so it gets a new grid
+				Seed = Seed * 1664525u + 1013904223u;
+				float Delta = (c % 10 == 0 && e == 0) ? (5.0f) : ((Seed >> 8) / float(1 << 24) - 0.5f);
+
+				Decoded[Sample] += Delta;
+				Truth[t * TileSamples + Sample] = Decoded[Sample];
+			}
+
+			Requantized.StoreTile(t, Decoded);
+		}
+	}
+
+	float CycleBound = 0.0f, CycleMeasured = 0.0f;
+
+	for (unsigned int t = 0; t < CycleTiles; ++t)
+	{
+		Requantized.LoadTile(t, Decoded);
+
+		for (unsigned int i = 0; i < TileSamples; ++i)
+			CycleMeasured = max(CycleMeasured, fabs(Decoded[i] - Truth[t * TileSamples + i]));
+
+		CycleBound = max(CycleBound, Requantized.GetTileError(t));
+	}
+
+	LOG("After " << Cycles << " edit + requantize cycles of " << CycleTiles << " tiles: reported bound " << CycleBound << ", measured max " << CycleMeasured
+		<< (CycleMeasured <= CycleBound ? "" : " - BOUND VIOLATED"));
+
+	// ---------------------- Gathers: resident floats vs quantized map with float working set ----------------------
+	Heightmap Quantized(Size, Storage, WorkingSet);
+	float *TBOData = new float[TBOSize * TBOSize];
+
+	for (int lvl = 0, Scale = 1; lvl < ClipmapsAmount; ++lvl, Scale *= 2)
+	{
+		const int First = Size / 2 - (TBOSize / 2) * Scale;
+
+		Start = GetTime();
+		for (int y = 0; y < TBOSize; ++y)
+			Resident.GatherRow(First, First + y * Scale, Scale, TBOSize, TBOData + y * TBOSize);
+		double ResidentTime = GetTime() - Start;
+
+		Start = GetTime();
+		for (int y = 0; y < TBOSize; ++y)
+			Quantized.GatherRow(First, First + y * Scale, Scale, TBOSize, TBOData + y * TBOSize);
+		double QuantizedTime = GetTime() - Start;
+
+		LOG("Level " << lvl << " gather: float " << ResidentTime * 1000.0 << " ms, quantized " << QuantizedTime * 1000.0 << " ms");
+	}
+
+	HeightmapPagingStats Stats = Quantized.GetPagingStats();
+	LOG("Working set " << (WorkingSet >> 20) << " MB: " << Stats.Misses << " tiles decoded, " << Stats.Evictions << " evicted, " << Stats.WriteBacks << " requantized");
+
+	delete [] TBOData;
+	delete [] Decoded;
+}
+
+// --------------------------------------------------------------------
+void Benchmark::TileCompression()
+{
+	const int Size = 4096;
+	const int Repeats = 3;
+
+	LOG("==== Tile codec " << Size << " x " << Size << " ====");
+
+	Heightmap Heights(Size);
+
+	for (int y = 0; y < Size; ++y)
+		for (int x = 0; x < Size; ++x)
+			Heights.Set(x, y, TestHeight(x, y) + 400.0f * sin(float(x + 2 * y) / 1500.0f) + 0.37f * sin(float(x * y) / 97.0f));
+
+	Heights.UpdateAllAprons();
+
+	const int TilesAmount = Heights.GetTilesPerRow() * Heights.GetTilesPerRow();
+	const unsigned int Stride = Heights.GetTileStride();
+	const unsigned int MaxBytes = TileCodec::GetMaxCompressedSize(Stride, Stride);
+	const double RawBytes = double(TilesAmount) * Stride * Stride * sizeof(float);
+
+	std::vector<const float*> Tiles(TilesAmount);
+	std::vector<unsigned char> Compressed((size_t)TilesAmount * MaxBytes);
+	std::vector<unsigned int> Sizes(TilesAmount);
+	std::vector<float> Decoded((size_t)TilesAmount * Stride * Stride);
+
+	for (int i = 0; i < TilesAmount; ++i)
+		Tiles[i] = Heights.ReadTile(i % Heights.GetTilesPerRow(), i / Heights.GetTilesPerRow()) - Heightmap::Apron * (Stride + 1);
+
+	const int ThreadCounts[] = {1, omp_get_max_threads()};
+
+	for (int t = 0; t < (ThreadCounts[1] > 1 ? 2 : 1); ++t)
+	{
+		const int Threads = ThreadCounts[t];
+
+		double Start = GetTime();
+		for (int r = 0; r < Repeats; ++r)
+		{
+			#pragma omp parallel for schedule(dynamic) num_threads(Threads)
+			for (int i = 0; i < TilesAmount; ++i)
+				Sizes[i] = TileCodec::Compress(Tiles[i], Stride, Stride, &Compressed[(size_t)i * MaxBytes]);
+		}
+		double CompressTime = (GetTime() - Start) / Repeats;
+
+		int Failures = 0;
+
+		Start = GetTime();
+		for (int r = 0; r < Repeats; ++r)
+		{
+			#pragma omp parallel for schedule(dynamic) num_threads(Threads) reduction(+:Failures)
+			for (int i = 0; i < TilesAmount; ++i)
+				if (!TileCodec::Decompress(&Compressed[(size_t)i * MaxBytes], Sizes[i], Stride, Stride, &Decoded[(size_t)i * Stride * Stride]))
+					Failures++;
+		}
+		double DecompressTime = (GetTime() - Start) / Repeats;
+
+		double CompressedBytes = 0.0;
+		bool bLossless = (Failures == 0);
+
+		for (int i = 0; i < TilesAmount; ++i)
+		{
+			CompressedBytes += Sizes[i];
+			bLossless = bLossless && memcmp(Tiles[i], &Decoded[(size_t)i * Stride * Stride], Stride * Stride * sizeof(float)) == 0;
+		}
+
+		LOG(Threads << " thread(s): compress " << RawBytes / (1 << 20) / CompressTime << " MB/s, decompress " << RawBytes / (1 << 20) / DecompressTime
+			<< " MB/s, ratio " << RawBytes / CompressedBytes << ":1" << (bLossless ? "" : " - ROUND TRIP FAILED"));
+	}
+}
+
+// --------------------------------------------------------------------
+void Benchmark::HeightmapMipPyramid()
+{
+	const int Size = 4096;
+	const int TBOSize = 4 * 63 + 5;
+	const int ClipmapsAmount = 8;
+	const unsigned long long WorkingSet = 16ull << 20;
+	const unsigned long long PyramidBudget = 64ull << 20;
+
+	LOG("==== Mip pyramid " << Size << " x " << Size << " ====");
+
+	Heightmap Resident(Size);
+	const unsigned int TilesPerRow = Resident.GetTilesPerRow();
+
+	for (int y = 0; y < Size; ++y)
+		for (int x = 0; x < Size; ++x)
+			Resident.Set(x, y, TestHeight(x, y) + 400.0f * sin(float(x + 2 * y) / 1500.0f));
+
+	Resident.UpdateAllAprons();
+
+	QuantizedHeightmapStorage *Storage = new QuantizedHeightmapStorage(TilesPerRow * TilesPerRow, Resident.GetTileStride());
+
+	for (unsigned int TileY = 0; TileY < TilesPerRow; ++TileY)
+		for (unsigned int TileX = 0; TileX < TilesPerRow; ++TileX)
+			Storage->StoreTile(TileY * TilesPerRow + TileX, Resident.ReadTile(TileX, TileY) - Heightmap::Apron * (Resident.GetTileStride() + 1));
+
+	Heightmap Quantized(Size, Storage, WorkingSet);
+	float *TBOData = new float[TBOSize * TBOSize];
+
+	// Clipmaps centred on the map middle, pyramids aligned to their first samples
+	const int Center = Size / 2;
+	const int Origin = Center - (TBOSize / 2) * (1 << (ClipmapsAmount - 1));
+
+	Heightmap *Maps[] = {&Resident, &Quantized};
+	const char *Names[] = {"resident", "quantized"};
+
+	for (int m = 0; m < 2; ++m)
+	{
+		HeightmapPyramid Pyramid(Maps[m], Origin, Origin, ClipmapsAmount - 1, PyramidBudget);
+
+		LOG("-- " << Names[m] << " (" << Pyramid.GetLevelsAmount() - 1 << " mip levels) --");
+
+		for (int lvl = 0, Scale = 1; lvl < ClipmapsAmount; ++lvl, Scale *= 2)
+		{
+			const int First = Center - (TBOSize / 2) * Scale;
+
+			double Start = GetTime();
+			for (int y = 0; y < TBOSize; ++y)
+				Maps[m]->GatherRow(First, First + y * Scale, Scale, TBOSize, TBOData + y * TBOSize);
+			double PointTime = GetTime() - Start;
+
+			// First gather filters the touched mip tiles, the second one is what clipmap updates see afterwards
+			Start = GetTime();
+			for (int y = 0; y < TBOSize; ++y)
+				Pyramid.GatherRow(lvl, First, First + y * Scale, TBOSize, TBOData + y * TBOSize);
+			double BuildTime = GetTime() - Start;
+
+			Start = GetTime();
+			for (int y = 0; y < TBOSize; ++y)
+				Pyramid.GatherRow(lvl, First, First + y * Scale, TBOSize, TBOData + y * TBOSize);
+			double MipTime = GetTime() - Start;
+
+			LOG("Level " << lvl << " gather: point sampled " << PointTime * 1000.0 << " ms, mip " << MipTime * 1000.0 << " ms (first "
+				<< BuildTime * 1000.0 << " ms with filtering)");
+		}
+	}
+
+	delete [] TBOData;
+}
+
+// --------------------------------------------------------------------
+void Benchmark::EditPropagation()
+{
+	const int Size = 16384;
+	const int TBOSize = 4 * 63 + 5;
+	const int ClipmapsAmount = 8;
+	const int Radius = 200;
+	const int Spacing = 8;
+	const int StampsPerFrame = 4;
+	const int Frames = 32;
+	const unsigned long long WorkingSet = 64ull << 20;
+
+	LOG("==== Edit propagation " << Size << " x " << Size << ", brush radius " << Radius << " ====");
+
+	// Quantized in-memory tiles written directly, aprons included
+	const unsigned int TileSize = Heightmap::DefaultTileSize;
+	const unsigned int Stride = TileSize + 2 * Heightmap::Apron;
+	const unsigned int TilesPerRow = Size / TileSize;
+
+	QuantizedHeightmapStorage *Storage = new QuantizedHeightmapStorage(TilesPerRow * TilesPerRow, Stride);
+	std::vector<float> Tile(Stride * Stride);
+
+	double Start = GetTime();
+	for (unsigned int TileY = 0; TileY < TilesPerRow; ++TileY)
+	{
+		for (unsigned int TileX = 0; TileX < TilesPerRow; ++TileX)
+		{
+			for (unsigned int y = 0; y < Stride; ++y)
+				for (unsigned int x = 0; x < Stride; ++x)
+					Tile[y * Stride + x] = TestHeight((TileX * TileSize + x - Heightmap::Apron) & (Size - 1), (TileY * TileSize + y - Heightmap::Apron) & (Size - 1));
+
+			Storage->StoreTile(TileY * TilesPerRow + TileX, &Tile[0]);
+		}
+	}
+	LOG("Fill: " << GetTime() - Start << " s");
+
+	Heightmap Paged(Size, Storage, WorkingSet);
+	float *TBOData = new float[TBOSize * TBOSize];
+
+	// Stroke along X through the map centre, clipmaps laid out like InitTBO does - level L spans Origin + (1 - (TBOSize - 1) / 2 .. 1 + (TBOSize - 1) / 2) * 2^L
+	const int StrokeY = Size / 2;
+	const int StrokeStart = Size / 2 - Spacing * StampsPerFrame * Frames / 2;
+	const int Origin = Size / 2;
+
+	for (int Pass = 0; Pass < 2; ++Pass)
+	{
+		const bool bIncremental = (Pass == 0);
+
+		HeightmapPyramid Pyramid(&Paged, Origin, Origin, ClipmapsAmount - 1, WorkingSet);
+		HeightmapTileStats Stats(&Paged);
+		HeightmapChangeTracker Changes;
+
+		Changes.AddConsumer(&Pyramid);
+		Changes.AddConsumer(&Stats);
+
+		// Clipmap gathers of every level and stats of the brushed tiles, as a frame would need them
+		for (int lvl = 0, Scale = 1; lvl < ClipmapsAmount; ++lvl, Scale *= 2)
+			for (int y = 0; y < TBOSize; ++y)
+				Pyramid.GatherRow(lvl, Origin - ((TBOSize - 3) / 2) * Scale, Origin + (y - (TBOSize - 3) / 2) * Scale, TBOSize, TBOData + y * TBOSize);
+
+		double BrushTime = 0.0, PropagateTime = 0.0, GatherTime = 0.0, WorstFrame = 0.0;
+		float Range[2];
+
+		for (int Frame = 0; Frame < Frames; ++Frame)
+		{
+			double FrameStart = GetTime();
+
+			for (int s = 0; s < StampsPerFrame; ++s)
+			{
+				const int CenterX = StrokeStart + (Frame * StampsPerFrame + s) * Spacing;
+				HeightmapRect Changed(CenterX - Radius, StrokeY - Radius, CenterX + Radius + 1, StrokeY + Radius + 1);
+
+				for (int y = Changed.MinY; y < Changed.MaxY; ++y)
+				{
+					for (int x = Changed.MinX; x < Changed.MaxX; ++x)
+					{
+						float Distance = sqrt(float((x - CenterX) * (x - CenterX) + (y - StrokeY) * (y - StrokeY)));
+
+						if (Distance <= Radius)
+							Paged.Set(x, y, Paged.Get(x, y) + BrushFalloff(1.0f - Distance / Radius));
+					}
+				}
+
+				Paged.UpdateAprons(Changed);
+				Changes.MarkDirty(Changed);
+			}
+
+			double Time = GetTime();
+			BrushTime += Time - FrameStart;
+
+			if (bIncremental)
+			{
+				Changes.Propagate();
+			}
+			else
+			{
+				// Dropping the mips under the footprint instead - they are filtered whole again by the gathers below
+				for (unsigned int r = 0; r < Changes.GetDirtyRects().size(); ++r)
+					Pyramid.Invalidate(Changes.GetDirtyRects()[r]);
+
+				Changes.Clear();
+			}
+
+			PropagateTime += GetTime() - Time;
+			Time = GetTime();
+
+			for (int lvl = 0, Scale = 1; lvl < ClipmapsAmount; ++lvl, Scale *= 2)
+				for (int y = 0; y < TBOSize; ++y)
+					Pyramid.GatherRow(lvl, Origin - ((TBOSize - 3) / 2) * Scale, Origin + (y - (TBOSize - 3) / 2) * Scale, TBOSize, TBOData + y * TBOSize);
+
+			Stats.GetTileRange((StrokeStart + Frame * StampsPerFrame * Spacing) / TileSize, StrokeY / TileSize, Range[0], Range[1]);
+
+			GatherTime += GetTime() - Time;
+			WorstFrame = max(WorstFrame, GetTime() - FrameStart);
+		}
+
+		HeightmapChangeStats ChangeStats = Changes.GetStats();
+
+		LOG((bIncremental ? "Incremental update" : "Invalidate and refilter") << ": brush " << BrushTime / Frames * 1000.0 << " ms, derived data "
+			<< PropagateTime / Frames * 1000.0 << " ms, clipmap gathers " << GatherTime / Frames * 1000.0 << " ms per frame, worst frame "
+			<< WorstFrame * 1000.0 << " ms");
+
+		if (bIncremental)
+			LOG("    " << ChangeStats.MarkedRects << " stamps merged into " << ChangeStats.PropagatedRects << " rects, "
+				<< ChangeStats.PropagatedSamples / double(Frames) / 1000.0 << " ksamples propagated per frame");
+	}
+
+	delete [] TBOData;
+}
+
+// --------------------------------------------------------------------
+void Benchmark::TerrainPicking()
+{
+	const int Size = 4096;
+	const int Rays = 2000;
+	const float CameraHeight = 600.0f;
+	const float MaxDistance = 6000.0f;
+	const unsigned long long WorkingSet = 16ull << 20;
+
+	LOG("==== Terrain picking " << Size << " x " << Size << ", " << Rays << " rays ====");
+
+	Heightmap Resident(Size);
+	const unsigned int TilesPerRow = Resident.GetTilesPerRow();
+
+	for (int y = 0; y < Size; ++y)
+		for (int x = 0; x < Size; ++x)
+			Resident.Set(x, y, TestHeight(x, y) + 400.0f * sin(float(x + 2 * y) / 1500.0f));
+
+	Resident.UpdateAllAprons();
+
+	QuantizedHeightmapStorage *Storage = new QuantizedHeightmapStorage(TilesPerRow * TilesPerRow, Resident.GetTileStride());
+
+	for (unsigned int TileY = 0; TileY < TilesPerRow; ++TileY)
+		for (unsigned int TileX = 0; TileX < TilesPerRow; ++TileX)
+			Storage->StoreTile(TileY * TilesPerRow + TileX, Resident.ReadTile(TileX, TileY) - Heightmap::Apron * (Resident.GetTileStride() + 1));
+
+	Heightmap Quantized(Size, Storage, WorkingSet);
+
+	// Cursor rays from above the terrain, from steep to grazing ones, some leaving the map through its wrapping edges
+	std::vector<vec3> Origins(Rays), Directions(Rays);
+	unsigned int Seed = 12345;
+
+	for (int r = 0; r < Rays; ++r)
+	{
+		float Random[4];
+
+		for (int i = 0; i < 4; ++i)
+		{
+			Seed = Seed * 1664525u + 1013904223u;
+			Random[i] = (Seed >> 8) / float(1 << 24);
+		}
+
+		float Angle = Random[2] * 6.2832f;
+		Origins[r] = vec3(Random[0] * Size, CameraHeight, Random[1] * Size);
+		Directions[r] = normalize(vec3(cos(Angle), -(0.02f + Random[3]), sin(Angle)));
+	}
+
+	Heightmap *Maps[] = {&Resident, &Quantized};
+	const char *Names[] = {"resident", "quantized"};
+
+	for (int m = 0; m < 2; ++m)
+	{
+		double Start = GetTime();
+		HeightmapTileStats Stats(Maps[m]);
+
+		// Like the landscape does it - ranges of resident maps up front, paged ones as rays reach their tiles
+		if (!Maps[m]->IsPaged())
+			Stats.ComputeAll();
+
+		HeightmapQuadtree Quadtree(Maps[m], &Stats);
+		double BuildTime = GetTime() - Start;
+
+		std::vector<float> HitT(Rays, -1.0f);
+		double PassTime[2];
+		int Hits = 0;
+
+		for (int Pass = 0; Pass < 2; ++Pass)
+		{
+			Start = GetTime();
+			for (int r = 0; r < Rays; ++r)
+				if (!Quadtree.Raycast(Origins[r], Directions[r], MaxDistance, HitT[r]))
+					HitT[r] = -1.0f;
+			PassTime[Pass] = GetTime() - Start;
+		}
+
+		// Reference on a subset, marching every cell is slow
+		int Mismatches = 0, Checked = 0;
+
+		Start = GetTime();
+		for (int r = 0; r < Rays; r += 10, ++Checked)
+		{
+			float ReferenceT;
+
+			if (!Quadtree.RaycastBruteForce(Origins[r], Directions[r], MaxDistance, ReferenceT))
+				ReferenceT = -1.0f;
+
+			if (fabs(ReferenceT - HitT[r]) > 1e-3f * max(1.0f, ReferenceT))
+				++Mismatches;
+		}
+		double BruteTime = GetTime() - Start;
+
+		for (int r = 0; r < Rays; ++r)
+			Hits += (HitT[r] >= 0.0f) ? (1) : (0);
+
+		LOG("-- " << Names[m] << " (" << Quadtree.GetLevelsAmount() << " quadtree levels, built in " << BuildTime * 1000.0 << " ms) --");
+		LOG("Quadtree: " << PassTime[0] / Rays * 1e6 << " us per pick cold, " << PassTime[1] / Rays * 1e6 << " us warm, " << Hits << " hits");
+		LOG("Brute force: " << BruteTime / Checked * 1e6 << " us per pick, " << Mismatches << " mismatches of " << Checked);
+	}
+
+	// Picks right after painting see the stamp once it is propagated
+	HeightmapTileStats Stats(&Resident);
+	HeightmapQuadtree Quadtree(&Resident, &Stats);
+	HeightmapChangeTracker Changes;
+
+	Stats.ComputeAll();
+	Quadtree.Rebuild();
+	Changes.AddConsumer(&Stats);
+	Changes.AddConsumer(&Quadtree);
+
+	const int Radius = 64;
+	const int Center = Size / 2;
+	HeightmapRect Changed(Center - Radius, Center - Radius, Center + Radius + 1, Center + Radius + 1);
+
+	for (int y = Changed.MinY; y < Changed.MaxY; ++y)
+		for (int x = Changed.MinX; x < Changed.MaxX; ++x)
+			Resident.Set(x, y, Resident.Get(x, y) + 300.0f);
+
+	Resident.UpdateAprons(Changed);
+	Changes.MarkDirty(Changed);
+
+	double Start = GetTime();
+	Changes.Propagate();
+	double UpdateTime = GetTime() - Start;
+
+	float HitT, ReferenceT;
+	vec3 Origin(float(Center - 1000), CameraHeight, float(Center));
+	vec3 Direction = normalize(vec3(float(Center), Resident.Get(Center, Center), float(Center)) - Origin);
+	bool bHit = Quadtree.Raycast(Origin, Direction, MaxDistance, HitT);
+	bool bReference = Quadtree.RaycastBruteForce(Origin, Direction, MaxDistance, ReferenceT);
+
+	LOG("After a stamp: stats and quadtree updated in " << UpdateTime * 1000.0 << " ms, pick " << (bHit ? HitT : -1.0f) << ", reference "
+		<< (bReference ? ReferenceT : -1.0f));
+}
+
+// --------------------------------------------------------------------
+static unsigned long long HashHeights(const Heightmap &Map)
+{
+	// FNV-1a over the bits of every sample
+	unsigned long long Hash = 14695981039346656037ull;
+
+	for (unsigned int TileY = 0; TileY < Map.GetTilesPerRow(); ++TileY)
+	{
+		for (unsigned int TileX = 0; TileX < Map.GetTilesPerRow(); ++TileX)
+		{
+			const float *Tile = Map.ReadTile(TileX, TileY);
+
+			for (unsigned int y = 0; y < Map.GetTileExtent(TileY); ++y)
+			{
+				const unsigned char *Bytes = (const unsigned char*)(Tile + y * Map.GetTileStride());
+
+				for (unsigned int i = 0; i < Map.GetTileExtent(TileX) * sizeof(float); ++i)
+					Hash = (Hash ^ Bytes[i]) * 1099511628211ull;
+			}
+		}
+	}
+
+	return Hash;
+}
+
+// --------------------------------------------------------------------
+void Benchmark::TerrainGeneration()
+{
+	const int Size = 4096;
+	const int LargeSize = 16384;
+	const int RectSize = 512;
+
+	LOG("==== Terrain generation ====");
+
+	TerrainNoiseSettings Settings[3];
+	const char *Names[] = {"fBm", "ridged", "warped fBm"};
+
+	Settings[1].Type = NOISE_RIDGED;
+	Settings[2].WarpStrength = 200.0f;
+
+	// Single thread, one rect - SSE2 vs scalar path
+	std::vector<float> Rect(RectSize * RectSize), ScalarRect(RectSize * RectSize);
+
+	for (int s = 0; s < 3; ++s)
+	{
+		double Start = GetTime();
+		TerrainGenerator::GenerateRect(Settings[s], Size, 100, 200, RectSize, RectSize, &ScalarRect[0], RectSize, false);
+		double ScalarTime = GetTime() - Start;
+
+		Start = GetTime();
+		TerrainGenerator::GenerateRect(Settings[s], Size, 100, 200, RectSize, RectSize, &Rect[0], RectSize, true);
+		double SIMDTime = GetTime() - Start;
+
+		float MaxDifference = 0.0f;
+
+		for (int i = 0; i < RectSize * RectSize; ++i)
+			MaxDifference = max(MaxDifference, fabs(Rect[i] - ScalarRect[i]));
+
+		LOG(Names[s] << ", " << Settings[s].Octaves << " octaves, 1 thread: scalar " << RectSize * RectSize / ScalarTime / 1e6 << " Msamples/s, "
+			<< (TerrainGenerator::HasSIMD() ? "SSE2 " : "no SIMD path ") << RectSize * RectSize / SIMDTime / 1e6 << " Msamples/s, largest difference "
+			<< MaxDifference);
+	}
+
+	// Whole map on growing amount of threads - output has to stay bit identical
+	Heightmap Map(Size);
+	unsigned long long ReferenceHash = 0;
+	const int MaxThreads = omp_get_max_threads();
+
+	for (int Threads = 1; ; Threads = min(Threads * 2, MaxThreads))
+	{
+		omp_set_num_threads(Threads);
+
+		double Start = GetTime();
+		TerrainGenerator::Generate(&Map, Settings[0]);
+		double Time = GetTime() - Start;
+
+		unsigned long long Hash = HashHeights(Map);
+
+		if (Threads == 1)
+			ReferenceHash = Hash;
+
+		LOG(Size << " x " << Size << " fBm, " << Threads << " thread(s): " << Time << " s, " << double(Size) * Size / Time / 1e6 << " Msamples/s"
+			<< ((Hash == ReferenceHash) ? "" : " - OUTPUT DIFFERS FROM 1 THREAD"));
+
+		if (Threads == MaxThreads)
+			break;
+	}
+
+	omp_set_num_threads(MaxThreads);
+
+	Heightmap Large(LargeSize);
+
+	double Start = GetTime();
+	TerrainGenerator::Generate(&Large, Settings[0]);
+	double Time = GetTime() - Start;
+
+	LOG(LargeSize << " x " << LargeSize << " fBm, " << MaxThreads << " thread(s): " << Time << " s, hash " << std::hex << HashHeights(Large) << std::dec);
+}
+
+// --------------------------------------------------------------------
+void Benchmark::Erosion()
+{
+	const int Sizes[] = {4096, 16384};
+	const unsigned long long Droplets[] = {1000000, 8000000};
+	const int MaxThreads = omp_get_max_threads();
+
+	LOG("==== Hydraulic erosion ====");
+
+	TerrainNoiseSettings Noise;
+	Noise.Amplitude = 300.0f;
+
+	for (int s = 0; s < 2; ++s)
+	{
+		Heightmap Map(Sizes[s]);
+		ErosionSettings Settings;
+		Settings.Droplets = Droplets[s];
+
+		double Start = GetTime();
+		TerrainGenerator::Generate(&Map, Noise);
+		LOG(Sizes[s] << " x " << Sizes[s] << " generated in " << GetTime() - Start << " s");
+
+		// Smaller map on one thread, on all of them and in small budgeted steps - results have to be the same
+		const int Runs = (s == 0) ? (3) : (1);
+		unsigned long long ReferenceHash = 0;
+
+		for (int r = 0; r < Runs; ++r)
+		{
+			const int Threads = (r == 0 && Runs > 1) ? (1) : (MaxThreads);
+			const bool bBudgeted = (r == 2);
+
+			if (r > 0)
+				TerrainGenerator::Generate(&Map, Noise);
+
+			omp_set_num_threads(Threads);
+
+			HydraulicErosion Erosion(&Map, Settings);
+
+			Start = GetTime();
+			while (!Erosion.IsFinished())
+				Erosion.Step(bBudgeted ? (Settings.Droplets / 50) : (Settings.Droplets));
+			double Time = GetTime() - Start;
+
+			unsigned long long Hash = HashHeights(Map);
+
+			if (r == 0)
+				ReferenceHash = Hash;
+
+			LOG(Erosion.GetDropletsDone() << " droplets, " << Erosion.GetRegionsPerRow() << "^2 regions, " << Threads << " thread(s)"
+				<< (bBudgeted ? ", 50 budgeted steps" : "") << ": " << Time << " s, " << Erosion.GetDropletsDone() / Time << " droplets/s"
+				<< ((Hash == ReferenceHash) ? "" : " - RESULT DIFFERS FROM THE FIRST RUN"));
+		}
+
+		omp_set_num_threads(MaxThreads);
+	}
+}
+
+// --------------------------------------------------------------------
+void Benchmark::LandscapeCreation()
+{
+	const unsigned int Sizes[] = {1024, 4096, 16384, 32768};
+	const int MaxThreads = omp_get_max_threads();
+
+	LOG("==== Landscape creation ====");
+	LOG("Paging budget " << (LandscapeEditor::Inst()->GetPagingBudget() >> 20) << " MB");
+
+	for (int s = 0; s < 4; ++s)
+	{
+		// 4k once more on a single thread, for the parallel speedup
+		const int Runs = (Sizes[s] == 4096) ? (2) : (1);
+
+		for (int r = 0; r < Runs; ++r)
+		{
+			const int Threads = (r == 1) ? (1) : (MaxThreads);
+
+			omp_set_num_threads(Threads);
+
+			double Start = GetTime();
+			Landscape *Land = new Landscape(Sizes[s], Landscape::DefaultClipmapRimWidth, 1.0f);
+			double Time = GetTime() - Start;
+
+			const Heightmap *Heights = Land->GetHeightmap();
+			const QuantizedHeightmapStorage *Quantized = dynamic_cast<const QuantizedHeightmapStorage*>(Heights->GetStorage());
+			const char *Kind = (!Heights->IsPaged()) ? ("resident") : ((Quantized != 0) ? ("quantized") : ("scratch file"));
+
+			unsigned long long Memory = (unsigned long long)Heights->GetPagingStats().ResidentTiles * Heights->GetTileStride() * Heights->GetTileStride() * sizeof(float);
+
+			if (Quantized != 0)
+				Memory += Quantized->GetMemoryUsage();
+
+			LOG(Sizes[s] << " x " << Sizes[s] << ", " << Kind << ", " << Threads << " thread(s): " << Time << " s, "
+				<< double(Sizes[s]) * Sizes[s] / Time / 1e6 << " Msamples/s, " << Memory / double(1 << 20) << " MB of heights in memory");
+
+			Start = GetTime();
+			delete Land;
+			LOG("Destroyed in " << GetTime() - Start << " s");
+		}
+
+		omp_set_num_threads(MaxThreads);
+	}
+}
+
+// --------------------------------------------------------------------
+static void ReferenceStamp(Heightmap &Map, const BrushStamp &Stamp)
+{
+	// Former Landscape::UpdateHeightmap - every sample of every touched tile, pow for the falloff
+	const int TileSize = Map.GetTileSize();
+	const int Stride = Map.GetTileStride();
+	float HeightSum = 0.0f, HeightAverage = 0.0f;
+	int Counter = 0;
+
+	for (int Pass = (Stamp.Mode == BRUSH_SMOOTH) ? (0) : (1); Pass < 2; ++Pass)
+	{
+		for (unsigned int TileY = 0; TileY < Map.GetTilesPerRow(); ++TileY)
+		{
+			for (unsigned int TileX = 0; TileX < Map.GetTilesPerRow(); ++TileX)
+			{
+				if (float(TileX * TileSize) > Stamp.CenterX + Stamp.Radius || float((TileX + 1) * TileSize) <= Stamp.CenterX - Stamp.Radius ||
+					float(TileY * TileSize) > Stamp.CenterY + Stamp.Radius || float((TileY + 1) * TileSize) <= Stamp.CenterY - Stamp.Radius)
+					continue;
+
+				float *Tile = Map.WriteTile(TileX, TileY);
+
+				for (unsigned int y = 0; y < Map.GetTileExtent(TileY); ++y)
+				{
+					for (unsigned int x = 0; x < Map.GetTileExtent(TileX); ++x)
+					{
+						float DX = float(TileX * TileSize + x) - Stamp.CenterX;
+						float DY = float(TileY * TileSize + y) - Stamp.CenterY;
+						float Distance = sqrt(DX * DX + DY * DY);
+
+						if (Distance > Stamp.Radius)
+							continue;
+
+						float &Height = Tile[y * Stride + x];
+						float Factor = 1.0f - Distance / Stamp.Radius;
+
+						if (Pass == 0)
+						{
+							HeightSum += Height;
+							Counter++;
+						}
+						else if (Stamp.Mode == BRUSH_SMOOTH)
+						{
+							Height += 0.02f * (HeightAverage - Height);
+						}
+						else
+						{
+							float Falloff = (Factor < 0.5f) ? (pow(Factor, 2)) : ((Stamp.Mode == BRUSH_RING) ? (pow(1.0f - Factor, 2)) : (0.5f - pow(1.0f - Factor, 2)));
+							Height += ((Stamp.Mode == BRUSH_SUBTRACT) ? (-0.15f) : (0.15f)) * Falloff;
+						}
+					}
+				}
+			}
+		}
+
+		if (Pass == 0 && Counter > 0)
+			HeightAverage = HeightSum / Counter;
+	}
+}
+
+// --------------------------------------------------------------------
+void Benchmark::BrushStamps()
+{
+	const unsigned int Size = 2048;
+	const float Radii[] = {1.0f, 4.0f, 16.0f, 64.0f, 256.0f};
+	const char *ModeNames[] = {"add", "subtract", "smooth", "ring"};
+
+	LOG("==== Brush stamps ====");
+	LOG("SSE2 kernels " << (BrushKernel::HasSIMD() ? "available" : "not available"));
+
+	TerrainNoiseSettings Noise;
+	Heightmap Reference(Size), Scalar(Size), Vector(Size);
+
+	std::vector<float> Row(Size);
+
+	TerrainGenerator::Generate(&Reference, Noise);
+
+	for (int ModeIndex = 0; ModeIndex <= BRUSH_RING; ++ModeIndex)
+	{
+		const BrushMode Mode = (BrushMode)ModeIndex;
+
+		for (int r = 0; r < sizeof(Radii) / sizeof(Radii[0]); ++r)
+		{
+			const int Stamps = max(8, int(400000.0f / (Radii[r] * Radii[r] + 64.0f)));
+			double Times[3];
+			Heightmap *Maps[3] = {&Reference, &Scalar, &Vector};
+
+			// Every run starts from the same heights
+			for (unsigned int y = 0; y < Size; ++y)
+			{
+				Reference.GatherRow(0, y, 1, Size, &Row[0]);
+				Scalar.ScatterRow(0, y, Size, &Row[0]);
+				Vector.ScatterRow(0, y, Size, &Row[0]);
+			}
+
+			for (int m = 0; m < 3; ++m)
+			{
+				double Start = GetTime();
+
+				// Same path of off-grid centers on every map
+				for (int s = 0; s < Stamps; ++s)
+				{
+					BrushStamp Stamp(Size * 0.5f + 37.3f * sin(s * 0.05f), Size * 0.5f + 29.7f * cos(s * 0.07f), Radii[r], Mode);
+
+					if (m == 0)
+						ReferenceStamp(*Maps[m], Stamp);
+					else
+						BrushKernel::Apply(Maps[m], Stamp, m == 2);
+				}
+
+				Times[m] = GetTime() - Start;
+			}
+
+			float MaxDifference = 0.0f;
+
+			for (unsigned int y = 0; y < Size; ++y)
+				for (unsigned int x = 0; x < Size; ++x)
+					MaxDifference = max(MaxDifference, fabs(Reference.Get(x, y) - Vector.Get(x, y)));
+
+			LOG(ModeNames[Mode] << ", radius " << Radii[r] << ": full tiles with pow " << Stamps / Times[0] << " stamps/s, footprint scalar "
+				<< Stamps / Times[1] << " stamps/s, SSE2 " << Stamps / Times[2] << " stamps/s (" << Times[0] / Times[2] << "x), max difference "
+				<< MaxDifference << ((HashHeights(Scalar) == HashHeights(Vector)) ? "" : ", SCALAR AND SSE2 RESULTS DIFFER"));
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+void Benchmark::BrushStrokes()
+{
+	const unsigned int Size = 4096;
+	const int Frames = 600;
+	const float Radii[] = {8.0f, 32.0f, 128.0f};
+	const float Speeds[] = {4.0f, 64.0f};
+
+	LOG("==== Brush strokes ====");
+
+	TerrainNoiseSettings Noise;
+	Heightmap Stamped(Size), Batched(Size);
+	std::vector<float> Row(Size);
+
+	TerrainGenerator::Generate(&Stamped, Noise);
+
+	for (int r = 0; r < sizeof(Radii) / sizeof(Radii[0]); ++r)
+	{
+		for (int v = 0; v < sizeof(Speeds) / sizeof(Speeds[0]); ++v)
+		{
+			for (unsigned int y = 0; y < Size; ++y)
+			{
+				Stamped.GatherRow(0, y, 1, Size, &Row[0]);
+				Batched.ScatterRow(0, y, Size, &Row[0]);
+			}
+
+			// Cursor circling the map center at Speeds[v] samples per frame
+			BrushStroke Stroke;
+			std::vector<std::vector<BrushStamp> > FrameBatches(Frames);
+			const float PathRadius = Size / 4.0f;
+
+			for (int f = 0; f < Frames; ++f)
+			{
+				float Angle = f * Speeds[v] / PathRadius;
+
+				Stroke.MoveTo(Size * 0.5f + PathRadius * cos(Angle), Size * 0.5f + PathRadius * sin(Angle), Radii[r], BRUSH_ADD);
+				FrameBatches[f] = Stroke.GetBatch();
+				Stroke.ClearBatch();
+			}
+
+			// One stamp at a time, each with its own apron refresh
+			double Start = GetTime();
+			for (int f = 0; f < Frames; ++f)
+			{
+				for (unsigned int i = 0; i < FrameBatches[f].size(); ++i)
+					Stamped.UpdateAprons(BrushKernel::Apply(&Stamped, FrameBatches[f][i]));
+			}
+			double StampedTime = GetTime() - Start;
+
+			// The frame's stamps in one pass over their union footprint
+			Start = GetTime();
+			for (int f = 0; f < Frames; ++f)
+			{
+				if (!FrameBatches[f].empty())
+					Batched.UpdateAprons(BrushKernel::Apply(&Batched, &FrameBatches[f][0], FrameBatches[f].size()));
+			}
+			double BatchedTime = GetTime() - Start;
+
+			LOG("Radius " << Radii[r] << ", " << Speeds[v] << " samples/frame: " << Stroke.GetStampsAmount() << " stamps in " << Frames << " frames, "
+				<< "one by one " << Frames / StampedTime << " frames/s, batched " << Frames / BatchedTime << " frames/s ("
+				<< Stroke.GetStampsAmount() / BatchedTime << " stamps/s)" << ((HashHeights(Stamped) == HashHeights(Batched)) ? "" : " - RESULTS DIFFER"));
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+void Benchmark::BrushThreadScaling()
+{
+	const unsigned int Size = 8192;
+	const float Radii[] = {64.0f, 256.0f, 1024.0f};
+	const BrushMode Modes[] = {BRUSH_ADD, BRUSH_SMOOTH};
+	const int MaxThreads = omp_get_max_threads();
+
+	LOG("==== Brush thread scaling ====");
+
+	TerrainNoiseSettings Noise;
+	Heightmap Map(Size);
+	std::vector<float> Original(Size * Size);
+
+	TerrainGenerator::Generate(&Map, Noise);
+
+	for (unsigned int y = 0; y < Size; ++y)
+		Map.GatherRow(0, y, 1, Size, &Original[y * Size]);
+
+	for (int m = 0; m < 2; ++m)
+	{
+		for (int r = 0; r < sizeof(Radii) / sizeof(Radii[0]); ++r)
+		{
+			const int Stamps = max(4, int(4.0e7f / (Radii[r] * Radii[r])));
+			double SingleTime = 0.0;
+			unsigned long long ReferenceHash = 0;
+
+			for (int Threads = 1; ; Threads = min(Threads * 2, MaxThreads))
+			{
+				for (unsigned int y = 0; y < Size; ++y)
+					Map.ScatterRow(0, y, Size, &Original[y * Size]);
+
+				omp_set_num_threads(Threads);
+
+				double Start = GetTime();
+				for (int s = 0; s < Stamps; ++s)
+					BrushKernel::Apply(&Map, BrushStamp(fmod(13.7f * s, float(Size)), fmod(7.3f * s, float(Size)), Radii[r], Modes[m]));
+				double Time = GetTime() - Start;
+
+				unsigned long long Hash = HashHeights(Map);
+
+				if (Threads == 1)
+				{
+					SingleTime = Time;
+					ReferenceHash = Hash;
+				}
+
+				LOG((Modes[m] == BRUSH_SMOOTH ? "smooth" : "add") << ", radius " << Radii[r] << ", " << Threads << " thread(s): " << Stamps / Time << " stamps/s, "
+					<< SingleTime / Time << "x" << ((Hash == ReferenceHash) ? "" : " - RESULT DIFFERS FROM ONE THREAD"));
+
+				if (Threads == MaxThreads)
+					break;
+			}
+		}
+	}
+
+	omp_set_num_threads(MaxThreads);
+
+	// Paged map - tiles faulted in on one thread and pinned, then edited in parallel. Lossless page file, so it has to match the resident map
+	const char *PageFilePath = "BenchmarkBrush.tmp";
+	{
+		Heightmap Paged(Size, new HeightmapPageFile(PageFilePath, Map.GetTileStride(), true), 64 << 20);
+
+		for (unsigned int y = 0; y < Size; ++y)
+		{
+			Map.ScatterRow(0, y, Size, &Original[y * Size]);
+			Paged.ScatterRow(0, y, Size, &Original[y * Size]);
+		}
+
+		BrushStamp Stamp(Size * 0.5f, Size * 0.5f, 1024.0f, BRUSH_SMOOTH);
+		unsigned long long Misses = Paged.GetPagingStats().Misses;
+
+		double Start = GetTime();
+		BrushKernel::Apply(&Paged, Stamp);
+		double PagedTime = GetTime() - Start;
+
+		BrushKernel::Apply(&Map, Stamp);
+
+		LOG("Paged map, smooth radius 1024, " << MaxThreads << " thread(s): " << PagedTime * 1000.0 << " ms, " << Paged.GetPagingStats().Misses - Misses
+			<< " tile faults" << ((HashHeights(Paged) == HashHeights(Map)) ? "" : " - RESULT DIFFERS FROM THE RESIDENT MAP"));
+	}
+
+	remove(PageFilePath);
+}
+
+// --------------------------------------------------------------------
+void Benchmark::BrushMasks()
+{
+	const unsigned int Size = 4096;
+	const float Radii[] = {8.0f, 32.0f, 128.0f};
+
+	LOG("==== Brush masks ====");
+
+	BrushMask Mask;
+
+	// The editor's brush image if it's there, otherwise a lopsided blob so rotations differ
+	if (!Mask.Load("Content/Textures/Brush2a.png"))
+	{
+		const unsigned int ImageSize = 256;
+		std::vector<float> Image(ImageSize * ImageSize);
+
+		for (unsigned int y = 0; y < ImageSize; ++y)
+		{
+			for (unsigned int x = 0; x < ImageSize; ++x)
+			{
+				float U = 2.0f * x / ImageSize - 1.0f, V = 2.0f * y / ImageSize - 1.0f;
+				float Distance = sqrt(U * U + V * V) * (1.2f + 0.4f * U);
+
+				Image[y * ImageSize + x] = max(0.0f, 1.0f - Distance) * (0.75f + 0.25f * sin(V * 9.0f));
+			}
+		}
+
+		Mask.SetImage(&Image[0], ImageSize, ImageSize);
+		LOG("Brush2a.png not found, using a generated " << ImageSize << " x " << ImageSize << " mask");
+	}
+
+	TerrainNoiseSettings Noise;
+	Heightmap Circle(Size), Masked(Size), Scalar(Size), Uncached(Size);
+	std::vector<float> Row(Size);
+
+	TerrainGenerator::Generate(&Circle, Noise);
+
+	for (unsigned int y = 0; y < Size; ++y)
+	{
+		Circle.GatherRow(0, y, 1, Size, &Row[0]);
+		Masked.ScatterRow(0, y, Size, &Row[0]);
+		Scalar.ScatterRow(0, y, Size, &Row[0]);
+		Uncached.ScatterRow(0, y, Size, &Row[0]);
+	}
+
+	for (int r = 0; r < sizeof(Radii) / sizeof(Radii[0]); ++r)
+	{
+		const int Stamps = max(64, int(2.0e6f / (Radii[r] * Radii[r])));
+		const int UncachedStamps = max(4, Stamps / 64);
+		std::vector<BrushStamp> Path(Stamps);
+
+		// The brush turning along a circular path, radius wobbling a little - what painting with the wheel and PgUp/PgDn does
+		for (int s = 0; s < Stamps; ++s)
+		{
+			float Angle = s * 0.01f;
+
+			Path[s] = BrushStamp(Size * 0.5f + Size * 0.3f * cos(Angle), Size * 0.5f + Size * 0.3f * sin(Angle), Radii[r] * (1.0f + 0.05f * sin(s * 0.013f)),
+								 (s % 5 == 4) ? (BRUSH_SMOOTH) : (BRUSH_ADD));
+		}
+
+		// Every bucket the path needs resampled once
+		const unsigned long long PreviousMisses = Mask.GetMisses();
+		Mask.ClearCache();
+		double Start = GetTime();
+		for (int s = 0; s < Stamps; ++s)
+			Mask.GetShape(Path[s].Radius, s * 0.002f);
+		double ResampleTime = GetTime() - Start;
+		unsigned long long Hits = Mask.GetHits(), Misses = Mask.GetMisses();
+
+		double Times[4];
+
+		for (int m = 0; m < 4; ++m)
+		{
+			Heightmap *Maps[4] = {&Circle, &Masked, &Scalar, &Uncached};
+			const int Amount = (m == 3) ? (UncachedStamps) : (Stamps);
+
+			Start = GetTime();
+			for (int s = 0; s < Amount; ++s)
+			{
+				BrushStamp Stamp = Path[s];
+
+				if (m == 3)
+					Mask.ClearCache();
+
+				if (m > 0)
+					Stamp.Shape = Mask.GetShape(Stamp.Radius, s * 0.002f);
+
+				BrushKernel::Apply(Maps[m], Stamp, m != 2);
+			}
+			Times[m] = (GetTime() - Start) / Amount;
+		}
+
+		LOG("Radius " << Radii[r] << ": circle " << 1.0 / Times[0] << " stamps/s, cached mask " << 1.0 / Times[1] << " stamps/s (" << Times[0] / Times[1]
+			<< "x of the circle), resampled every stamp " << 1.0 / Times[3] << " stamps/s; " << Misses - PreviousMisses << " buckets resampled in "
+			<< ResampleTime * 1000.0 << " ms, " << Mask.GetHits() - Hits << " cache hits" << ((HashHeights(Masked) == HashHeights(Scalar)) ? "" : " - SCALAR AND SSE2 RESULTS DIFFER"));
+	}
+}
+
+// --------------------------------------------------------------------
+static void ReferenceFilter(const std::vector<float> &Heights, unsigned int Size, const BrushStamp &Stamp, std::vector<float> &Out)
+{
+	// Every window summed sample by sample
+	const int Extent = BrushKernel::GetFilterExtent(Stamp);
+	const float Strength = (Stamp.Mode == BRUSH_FLATTEN) ? (BrushKernel::FlattenStrength) : (BrushKernel::BlurStrength);
+	const HeightmapRect Footprint = BrushKernel::GetFootprint(Stamp, Size);
+
+	Out = Heights;
+
+	for (int y = Footprint.MinY; y < Footprint.MaxY; ++y)
+	{
+		for (int x = Footprint.MinX; x < Footprint.MaxX; ++x)
+		{
+			float DX = float(x) - Stamp.CenterX, DY = float(y) - Stamp.CenterY;
+			float Distance = sqrt(DX * DX + DY * DY);
+
+			if (Distance > Stamp.Radius)
+				continue;
+
+			double Sum = 0.0;
+			int Counter = 0;
+
+			for (int wy = max(y - Extent, 0); wy < min(y + Extent + 1, int(Size)); ++wy)
+			{
+				for (int wx = max(x - Extent, 0); wx < min(x + Extent + 1, int(Size)); ++wx)
+				{
+					Sum += Heights[wy * Size + wx];
+					Counter++;
+				}
+			}
+
+			float Factor = 1.0f - Distance / Stamp.Radius;
+			float Falloff = (Factor < 0.5f) ? (Factor * Factor) : (0.5f - (1.0f - Factor) * (1.0f - Factor));
+
+			Out[y * Size + x] += 2.0f * Strength * Falloff * (float(Sum / Counter) - Heights[y * Size + x]);
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+void Benchmark::FilterBrushes()
+{
+	const unsigned int Size = 4096;
+	const float Radii[] = {16.0f, 64.0f, 256.0f, 1024.0f};
+	const BrushMode Modes[] = {BRUSH_SMOOTH, BRUSH_BLUR, BRUSH_FLATTEN};
+	const char *ModeNames[] = {"smooth (mode 2)", "blur", "flatten"};
+
+	LOG("==== Blur and flatten brushes ====");
+
+	TerrainNoiseSettings Noise;
+	Heightmap Vector(Size), Scalar(Size);
+	std::vector<float> Original(Size * Size);
+
+	TerrainGenerator::Generate(&Vector, Noise);
+
+	for (unsigned int y = 0; y < Size; ++y)
+		Vector.GatherRow(0, y, 1, Size, &Original[y * Size]);
+
+	for (int r = 0; r < sizeof(Radii) / sizeof(Radii[0]); ++r)
+	{
+		for (int m = 0; m < sizeof(Modes) / sizeof(Modes[0]); ++m)
+		{
+			const int Stamps = max(4, int(2.0e7f / (Radii[r] * Radii[r])));
+			double Times[2];
+			Heightmap *Maps[2] = {&Vector, &Scalar};
+
+			for (int p = 0; p < 2; ++p)
+			{
+				for (unsigned int y = 0; y < Size; ++y)
+					Maps[p]->ScatterRow(0, y, Size, &Original[y * Size]);
+
+				double Start = GetTime();
+				for (int s = 0; s < Stamps; ++s)
+					BrushKernel::Apply(Maps[p], BrushStamp(Size * 0.5f + 37.3f * sin(s * 0.05f), Size * 0.5f + 29.7f * cos(s * 0.07f), Radii[r], Modes[m]), p == 0);
+				Times[p] = (GetTime() - Start) / Stamps;
+			}
+
+			const double Samples = 3.14159265 * Radii[r] * Radii[r];
+			const int Window = (Modes[m] == BRUSH_SMOOTH) ? (2 * int(Radii[r]) + 1) : (2 * BrushKernel::GetFilterExtent(BrushStamp(0.0f, 0.0f, Radii[r], Modes[m])) + 1);
+
+			LOG(ModeNames[m] << ", radius " << Radii[r] << ", " << Window << " samples wide window: " << 1.0 / Times[0] << " stamps/s, " << Times[0] / Samples * 1e9
+				<< " ns per sample, scalar " << Times[1] / Samples * 1e9 << " ns per sample" << ((HashHeights(Vector) == HashHeights(Scalar)) ? "" : " - SCALAR AND SSE2 RESULTS DIFFER"));
+		}
+
+		// One stamp of each filter against summing every window sample by sample
+		if (Radii[r] > 64.0f)
+			continue;
+
+		for (int m = 1; m < sizeof(Modes) / sizeof(Modes[0]); ++m)
+		{
+			BrushStamp Stamp(Size * 0.5f + 0.3f, Size * 0.5f - 0.2f, Radii[r], Modes[m]);
+			std::vector<float> Reference;
+
+			for (unsigned int y = 0; y < Size; ++y)
+				Vector.ScatterRow(0, y, Size, &Original[y * Size]);
+
+			double Start = GetTime();
+			ReferenceFilter(Original, Size, Stamp, Reference);
+			double ReferenceTime = GetTime() - Start;
+
+			Start = GetTime();
+			BrushKernel::Apply(&Vector, Stamp);
+			double Time = GetTime() - Start;
+
+			float MaxDifference = 0.0f;
+			const HeightmapRect Footprint = BrushKernel::GetFootprint(Stamp, Size);
+
+			for (int y = Footprint.MinY; y < Footprint.MaxY; ++y)
+				for (int x = Footprint.MinX; x < Footprint.MaxX; ++x)
+					MaxDifference = max(MaxDifference, fabs(Vector.Get(x, y) - Reference[y * Size + x]));
+
+			LOG(ModeNames[m] << ", radius " << Radii[r] << ": summing every window " << ReferenceTime * 1000.0 << " ms, running sums " << Time * 1000.0
+				<< " ms (" << ReferenceTime / Time << "x), max difference " << MaxDifference);
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+void Benchmark::BrushModes()
+{
+	const unsigned int Size = 2048;
+	const float Radii[] = {8.0f, 64.0f};
+	const char *ModeNames[] = {"add", "subtract", "smooth", "ring", "blur", "flatten", "plateau", "noise"};
+
+	LOG("==== Brush modes ====");
+
+	BrushMask Mask;
+	std::vector<float> Image(64 * 64);
+
+	for (unsigned int i = 0; i < Image.size(); ++i)
+		Image[i] = max(0.0f, 1.0f - sqrt(float((i % 64 - 32) * (i % 64 - 32) + (i / 64 - 28) * (i / 64 - 28))) / 30.0f);
+
+	Mask.SetImage(&Image[0], 64, 64);
+
+	TerrainNoiseSettings Noise;
+	Heightmap Batched(Size), Rows(Size);
+	std::vector<float> Original(Size * Size);
+
+	const int Shift = Rows.GetTileShift();
+	const int Stride = Rows.GetTileStride();
+
+	TerrainGenerator::Generate(&Batched, Noise);
+
+	for (unsigned int y = 0; y < Size; ++y)
+		Batched.GatherRow(0, y, 1, Size, &Original[y * Size]);
+
+	for (int ModeIndex = 0; ModeIndex < BRUSH_MODES_AMOUNT; ++ModeIndex)
+	{
+		const BrushMode Mode = (BrushMode)ModeIndex;
+
+		for (int r = 0; r < sizeof(Radii) / sizeof(Radii[0]); ++r)
+		{
+			for (int m = 0; m < 2; ++m)
+			{
+				const int Stamps = max(16, int(((BrushKernel::IsFilter(Mode)) ? (2.0e5f) : (4.0e6f)) / (Radii[r] * Radii[r])));
+				std::vector<BrushStamp> Path(Stamps);
+
+				for (int s = 0; s < Stamps; ++s)
+					Path[s] = BrushStamp(Size * 0.5f + 37.3f * sin(s * 0.05f), Size * 0.5f + 29.7f * cos(s * 0.07f), Radii[r], Mode, (m == 1) ? (Mask.GetShape(Radii[r], s * 0.01f)) : (0));
+
+				for (unsigned int y = 0; y < Size; ++y)
+				{
+					Batched.ScatterRow(0, y, Size, &Original[y * Size]);
+					Rows.ScatterRow(0, y, Size, &Original[y * Size]);
+				}
+
+				// The whole path as one batch, kernels picked once per stamp
+				double Start = GetTime();
+				BrushKernel::Apply(&Batched, &Path[0], Stamps);
+				double Time = GetTime() - Start;
+
+				// Same stamps one at a time, against the kernels picked per row through ApplyRow()
+				for (unsigned int y = 0; y < Size; ++y)
+					Batched.ScatterRow(0, y, Size, &Original[y * Size]);
+
+				for (int s = 0; s < Stamps; ++s)
+					BrushKernel::Apply(&Batched, Path[s]);
+
+				if (!BrushKernel::IsFilter(Mode))
+				{
+					for (int s = 0; s < Stamps; ++s)
+					{
+						const HeightmapRect Footprint = BrushKernel::GetFootprint(Path[s], Size);
+						int CenterX = max(Footprint.MinX, min(int(floor(Path[s].CenterX + 0.5f)), Footprint.MaxX - 1));
+						int CenterY = max(Footprint.MinY, min(int(floor(Path[s].CenterY + 0.5f)), Footprint.MaxY - 1));
+						float Target = (Mode == BRUSH_SMOOTH) ? (BrushKernel::GetAverage(&Rows, Path[s])) : (Rows.Get(CenterX, CenterY));
+
+						for (int y = Footprint.MinY; y < Footprint.MaxY; ++y)
+						{
+							int MinX, MaxX;
+
+							if (!BrushKernel::GetRowSpan(Path[s], Footprint, y, MinX, MaxX))
+								continue;
+
+							// Span split at tile edges, straight into tile memory
+							for (int TileX = MinX >> Shift; TileX <= (MaxX - 1) >> Shift; ++TileX)
+							{
+								const int First = max(MinX, TileX << Shift), Last = min(MaxX, (TileX + 1) << Shift);
+								float *Tile = Rows.WriteTile(TileX, y >> Shift);
+
+								BrushKernel::ApplyRow(Path[s], First, y, Last - First, Target, Tile + (y - ((y >> Shift) << Shift)) * Stride + (First - (TileX << Shift)));
+							}
+						}
+					}
+				}
+
+				const double Samples = 3.14159265 * Radii[r] * Radii[r] * Stamps;
+
+				LOG(ModeNames[Mode] << ((m == 1) ? (" masked") : ("")) << ", radius " << Radii[r] << ": " << Stamps / Time << " stamps/s, " << Time / Samples * 1e9
+					<< " ns per sample" << ((BrushKernel::IsFilter(Mode) || HashHeights(Batched) == HashHeights(Rows)) ? "" : " - ROW KERNELS DIFFER"));
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+void Benchmark::EditWorkerFrames()
+{
+	const unsigned int Size = 4096;
+	const int Frames = 300;
+	const float Radii[] = {32.0f, 128.0f};
+	const float Speed = 16.0f;
+	const DWORD RenderMilliseconds = 4;
+
+	LOG("==== Edit worker ====");
+
+	TerrainNoiseSettings Noise;
+	Heightmap Source(Size), InPlace(Size), Front(Size);
+	std::vector<float> Row(Size);
+
+	TerrainGenerator::Generate(&Source, Noise);
+
+	for (int r = 0; r < sizeof(Radii) / sizeof(Radii[0]); ++r)
+	{
+		for (unsigned int y = 0; y < Size; ++y)
+		{
+			Source.GatherRow(0, y, 1, Size, &Row[0]);
+			InPlace.ScatterRow(0, y, Size, &Row[0]);
+			Front.ScatterRow(0, y, Size, &Row[0]);
+		}
+
+		// Cursor circling the map center, alternating noise and flatten strokes - the heavy ones
+		BrushStroke Stroke;
+		std::vector<std::vector<BrushStamp> > FrameBatches(Frames);
+		const float PathRadius = Size / 4.0f;
+
+		for (int f = 0; f < Frames; ++f)
+		{
+			float Angle = f * Speed / PathRadius;
+
+			if (f % 50 == 0)
+				Stroke.End();
+
+			Stroke.MoveTo(Size * 0.5f + PathRadius * cos(Angle), Size * 0.5f + PathRadius * sin(Angle), Radii[r], ((f / 50) % 2) ? (BRUSH_FLATTEN) : (BRUSH_NOISE));
+			FrameBatches[f] = Stroke.GetBatch();
+			Stroke.ClearBatch();
+		}
+
+		// The UI thread applies every frame's batch itself, like it does when the worker can't start
+		HeightmapChangeTracker Changes;
+		double InPlaceTotal = 0.0, InPlaceMax = 0.0;
+
+		for (int f = 0; f < Frames; ++f)
+		{
+			double Start = GetTime();
+
+			if (!FrameBatches[f].empty())
+			{
+				BrushKernel::Apply(&InPlace, &FrameBatches[f][0], FrameBatches[f].size());
+
+				for (unsigned int i = 0; i < FrameBatches[f].size(); ++i)
+					Changes.MarkDirty(BrushKernel::GetFootprint(FrameBatches[f][i], Size));
+
+				for (unsigned int i = 0; i < Changes.GetDirtyRects().size(); ++i)
+					InPlace.UpdateAprons(Changes.GetDirtyRects()[i]);
+
+				Changes.Clear();
+			}
+
+			double Time = GetTime() - Start;
+			InPlaceTotal += Time;
+			InPlaceMax = max(InPlaceMax, Time);
+		}
+
+		// The UI thread only queues batches and copies in the finished ones
+		EditWorker Worker(&Front, 64ull << 20);
+		double WorkerTotal = 0.0, WorkerMax = 0.0;
+
+		if (!Worker.Start())
+		{
+			ERR("Can't start the edit worker");
+			return;
+		}
+
+		for (int f = 0; f < Frames; ++f)
+		{
+			double Start = GetTime();
+
+			if (!FrameBatches[f].empty())
+				Worker.Queue(&FrameBatches[f][0], FrameBatches[f].size());
+
+			Worker.Publish(Changes);
+			Changes.Clear();
+
+			double Time = GetTime() - Start;
+			WorkerTotal += Time;
+			WorkerMax = max(WorkerMax, Time);
+
+			// Rest of the frame goes to rendering, the worker catches up meanwhile
+			Sleep(RenderMilliseconds);
+		}
+
+		double Start = GetTime();
+		Worker.Finish();
+		Worker.Publish(Changes);
+		double DrainTime = GetTime() - Start;
+
+		Worker.Stop();
+
+		EditWorkerStats Stats = Worker.GetStats();
+
+		LOG("Radius " << Radii[r] << ", " << Stroke.GetStampsAmount() << " stamps in " << Frames << " frames - UI thread per frame: in place "
+			<< InPlaceTotal / Frames * 1000.0 << " ms avg, " << InPlaceMax * 1000.0 << " ms max, with the worker " << WorkerTotal / Frames * 1000.0 << " ms avg, "
+			<< WorkerMax * 1000.0 << " ms max");
+		LOG("    queue drained " << DrainTime * 1000.0 << " ms after the last frame, " << Stats.MaxQueuedBatches << " batches queued at most, "
+			<< Stats.SamplesPublished * sizeof(float) / double(1 << 20) << " MB published, " << Stats.TilesCopied << " tiles copied, "
+			<< Stats.MaxBackTiles << " held at most, " << Stats.Releases << " releases" << ((HashHeights(InPlace) == HashHeights(Front)) ? "" : " - RESULTS DIFFER"));
+	}
+}
+
+// --------------------------------------------------------------------
+static void ScrollStrided(const HeightmapPyramid &Pyramid, std::vector<float> &Texels, std::vector<float> &LastX, std::vector<float> &LastY, int TBOSize,
+						  int StartIndexX, int StartIndexY, float OffsetX, float OffsetY)
+{
+	// How the TBOs were scrolled before ClipmapCache - new columns gathered a texel at a time, a TBO row apart
+	int ClipmapScale = 1;
+
+	for (unsigned int lvl = 0; lvl < LastX.size(); ++lvl)
+	{
+		float fDiffX = OffsetX - LastX[lvl];
+		float fDiffY = OffsetY - LastY[lvl];
+		int SignX = (fDiffX > 0.0f) - (fDiffX < 0.0f);
+		int SignY = (fDiffY > 0.0f) - (fDiffY < 0.0f);
+		int DiffX = int(floor((fabs(fDiffX) + ClipmapScale) / (2.0f * ClipmapScale))) * SignX * 2;
+		int DiffY = int(floor((fabs(fDiffY) + ClipmapScale) / (2.0f * ClipmapScale))) * SignY * 2;
+
+		if (DiffX == 0 && DiffY == 0)
+			break;
+
+		float *Data = &Texels[lvl * TBOSize * TBOSize];
+		int Last[2] = {int(LastX[lvl]), int(LastY[lvl])};
+		int FirstRow = max(0, DiffY);
+		int RowsAmount = TBOSize - abs(DiffY);
+
+		for (int j = 0; j < abs(DiffX) && RowsAmount > 0; j++)
+		{
+			int xTBO = FlatWrap(Last[0] / ClipmapScale - ((SignX > 0) ? (2) : (1)) + SignX * (j + 1), TBOSize);
+			int yTBO = FlatWrap(Last[1] / ClipmapScale + FirstRow - 1, TBOSize);
+			int x = StartIndexX + ((TBOSize + 3) / 2) * (ClipmapScale - 1) + Last[0] - ClipmapScale + SignX * (j * ClipmapScale + 1) - ((SignX < 0) ? ((TBOSize + 1) * ClipmapScale - 2) : (0));
+			int y = StartIndexY - ((TBOSize - 3) / 2) * (ClipmapScale - 1) - (TBOSize - 1) + Last[1] - ClipmapScale + FirstRow * ClipmapScale;
+			int FirstPart = min(RowsAmount, TBOSize - yTBO);
+
+			Pyramid.GatherColumn(lvl, x, y, FirstPart, Data + yTBO * TBOSize + xTBO, TBOSize);
+			Pyramid.GatherColumn(lvl, x, y + FirstPart * ClipmapScale, RowsAmount - FirstPart, Data + xTBO, TBOSize);
+		}
+
+		for (int j = 0; j < abs(DiffY); j++)
+		{
+			int xTBO = FlatWrap(Last[0] / ClipmapScale - 1 + DiffX, TBOSize);
+			int yTBO = FlatWrap(Last[1] / ClipmapScale - ((SignY > 0) ? (2) : (1)) + SignY * (j + 1), TBOSize);
+			int x = StartIndexX - ((TBOSize - 3) / 2) * (ClipmapScale - 1) - (TBOSize - 1) + Last[0] - ClipmapScale + DiffX * ClipmapScale;
+			int y = StartIndexY + ((TBOSize + 3) / 2) * (ClipmapScale - 1) + Last[1] - ClipmapScale + SignY * (j * ClipmapScale + 1) - ((SignY < 0) ? (TBOSize * ClipmapScale + (ClipmapScale - 2)) : (0));
+			int FirstPart = TBOSize - xTBO;
+
+			Pyramid.GatherRow(lvl, x, y, FirstPart, Data + yTBO * TBOSize + xTBO);
+			Pyramid.GatherRow(lvl, x + FirstPart * ClipmapScale, y, TBOSize - FirstPart, Data + yTBO * TBOSize);
+		}
+
+		LastX[lvl] += DiffX * ClipmapScale;
+		LastY[lvl] += DiffY * ClipmapScale;
+		ClipmapScale *= 2;
+	}
+}
+
+// --------------------------------------------------------------------
+static unsigned int CountClipmapMismatches(const ClipmapCache &Cache, const HeightmapPyramid &Pyramid)
+{
+	const int TBOSize = Cache.GetSize();
+	std::vector<float> Row(TBOSize);
+	unsigned int Mismatches = 0;
+
+	// Every window row gathered whole and compared with the texels at their toroidal positions
+	for (int lvl = 0; lvl < Cache.GetLevelsAmount(); ++lvl)
+	{
+		const float *Texels = Cache.GetTexels(lvl);
+		int FirstX, FirstY, TBOX, TBOY;
+
+		Cache.GetWindow(lvl, FirstX, FirstY, TBOX, TBOY);
+
+		for (int j = 0; j < TBOSize; ++j)
+		{
+			Pyramid.GatherRow(lvl, FirstX, FirstY + j * (1 << lvl), TBOSize, &Row[0]);
+
+			for (int i = 0; i < TBOSize; ++i)
+				if (Texels[FlatWrap(TBOY + j, TBOSize) * TBOSize + FlatWrap(TBOX + i, TBOSize)] != Row[i])
+					Mismatches++;
+		}
+	}
+
+	return Mismatches;
+}
+
+// --------------------------------------------------------------------
+void Benchmark::ClipmapCacheFlight()
+{
+	const int Size = 4096;
+	const int ClipmapsAmount = 8;
+	const int TBOSizes[] = {4 * Landscape::DefaultClipmapRimWidth + 5, 4 * 63 + 5};
+	const float Speeds[] = {3.0f, 40.0f};
+	const int Frames = 1000;
+	const int EditFrames = 200;
+	const int EditRadius = 24;
+
+	LOG("==== Clipmap cache ====");
+
+	Heightmap Map(Size);
+
+	for (int y = 0; y < Size; ++y)
+		for (int x = 0; x < Size; ++x)
+			Map.Set(x, y, TestHeight(x, y) + 400.0f * sin(float(x + 2 * y) / 1500.0f));
+
+	Map.UpdateAllAprons();
+
+	for (int t = 0; t < sizeof(TBOSizes) / sizeof(TBOSizes[0]); ++t)
+	{
+		// Laid out like Landscape does it - windows around the start index, the pyramid aligned to their samples
+		const int TBOSize = TBOSizes[t];
+		const int StartIndex = Size / 2 + TBOSize / 2;
+		const int Origin = StartIndex - (TBOSize + 1) / 2;
+
+		HeightmapPyramid Pyramid(&Map, Origin, Origin, HeightmapPyramid::DefaultLevels, 256ull << 20);
+		ClipmapCache Cache;
+
+		for (int v = 0; v < sizeof(Speeds) / sizeof(Speeds[0]); ++v)
+		{
+			// Camera circling the start index, turning all the way round during the flight
+			const float PathRadius = Speeds[v] * Frames / 6.2832f;
+			std::vector<float> OffsetsX(Frames), OffsetsY(Frames);
+
+			for (int f = 0; f < Frames; ++f)
+			{
+				OffsetsX[f] = PathRadius * sin(6.2832f * f / Frames) + 0.0001f;
+				OffsetsY[f] = PathRadius * (1.0f - cos(6.2832f * f / Frames)) + 0.0001f;
+			}
+
+			// Mips filtered once before timing, both ways then read the same resident tiles
+			Cache.Reset(&Pyramid, ClipmapsAmount, TBOSize, StartIndex, StartIndex);
+
+			for (int f = 0; f < Frames; ++f)
+				Cache.Scroll(OffsetsX[f], OffsetsY[f]);
+
+			Cache.Reset(&Pyramid, ClipmapsAmount, TBOSize, StartIndex, StartIndex);
+			ClipmapCacheStats Before = Cache.GetStats();
+
+			double Start = GetTime();
+			for (int f = 0; f < Frames; ++f)
+			{
+				Cache.Scroll(OffsetsX[f], OffsetsY[f]);
+				Cache.ClearSpans();
+			}
+			double CacheTime = GetTime() - Start;
+
+			unsigned long long Gathered = Cache.GetStats().GatheredTexels - Before.GatheredTexels;
+			unsigned int Mismatches = CountClipmapMismatches(Cache, Pyramid);
+
+			// Old layout starts from the same texels, its last update offsets one texel ahead of the windows
+			std::vector<float> Strided(ClipmapsAmount * TBOSize * TBOSize);
+			std::vector<float> LastX(ClipmapsAmount), LastY(ClipmapsAmount);
+			ClipmapCache Initial;
+
+			Initial.Reset(&Pyramid, ClipmapsAmount, TBOSize, StartIndex, StartIndex);
+
+			for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+			{
+				memcpy(&Strided[lvl * TBOSize * TBOSize], Initial.GetTexels(lvl), TBOSize * TBOSize * sizeof(float));
+				LastX[lvl] = LastY[lvl] = float(1 << lvl);
+			}
+
+			Start = GetTime();
+			for (int f = 0; f < Frames; ++f)
+				ScrollStrided(Pyramid, Strided, LastX, LastY, TBOSize, StartIndex, StartIndex, OffsetsX[f], OffsetsY[f]);
+			double StridedTime = GetTime() - Start;
+
+			bool bSame = true;
+
+			for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+				bSame = bSame && memcmp(&Strided[lvl * TBOSize * TBOSize], Cache.GetTexels(lvl), TBOSize * TBOSize * sizeof(float)) == 0;
+
+			LOG("TBO " << TBOSize << ", " << Speeds[v] << " samples per frame: " << Gathered / double(Frames) << " texels per frame, row segments "
+				<< Gathered / CacheTime / 1e6 << " Mtexels/s (" << CacheTime / Frames * 1e6 << " us per frame), strided columns "
+				<< Gathered / StridedTime / 1e6 << " Mtexels/s (" << StridedTime / Frames * 1e6 << " us per frame), speedup " << StridedTime / CacheTime);
+			LOG("    " << Mismatches << " texels differ from a reference gather, strided TBOs " << (bSame ? "identical" : "DIFFER"));
+		}
+
+		// Flight with a brush dab under the camera every frame, the edited texels gathered again and spans left for the upload
+		HeightmapChangeTracker Changes;
+		Changes.AddConsumer(&Pyramid);
+
+		Cache.Reset(&Pyramid, ClipmapsAmount, TBOSize, StartIndex, StartIndex);
+		Cache.ClearSpans();
+
+		double RefreshTime = 0.0;
+		unsigned long long Spans = 0, SpanTexels = 0;
+		ClipmapCacheStats Before = Cache.GetStats();
+
+		for (int f = 0; f < EditFrames; ++f)
+		{
+			const float OffsetX = 5.0f * f + 0.0001f;
+			const float OffsetY = 2.0f * f + 0.0001f;
+			const int CenterX = StartIndex + int(OffsetX), CenterY = StartIndex + int(OffsetY);
+			HeightmapRect Dab(CenterX - EditRadius, CenterY - EditRadius, CenterX + EditRadius + 1, CenterY + EditRadius + 1);
+
+			for (int y = Dab.MinY; y < Dab.MaxY; ++y)
+				for (int x = Dab.MinX; x < Dab.MaxX; ++x)
+					Map.Set(x, y, Map.Get(x, y) + 0.5f);
+
+			Map.UpdateAprons(Dab);
+			Changes.MarkDirty(Dab);
+
+			std::vector<HeightmapRect> Changed;
+			Changes.Propagate(&Changed);
+
+			double Time = GetTime();
+			Cache.Scroll(OffsetX, OffsetY);
+			Cache.Refresh(Changed);
+
+			for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+			{
+				const std::vector<ClipmapSpan> &LevelSpans = Cache.GetSpans(lvl);
+
+				for (unsigned int i = 0; i < LevelSpans.size(); ++i)
+					SpanTexels += LevelSpans[i].Count;
+
+				Spans += LevelSpans.size();
+			}
+
+			Cache.ClearSpans();
+			RefreshTime += GetTime() - Time;
+		}
+
+		ClipmapCacheStats After = Cache.GetStats();
+
+		LOG("TBO " << TBOSize << " with edits: " << (After.RefreshedTexels - Before.RefreshedTexels) / double(EditFrames) << " texels refreshed and "
+			<< (After.GatheredTexels - Before.GatheredTexels) / double(EditFrames) << " gathered per frame in " << RefreshTime / EditFrames * 1e6 << " us, "
+			<< Spans / double(EditFrames) << " uploads of " << SpanTexels * sizeof(float) / double(EditFrames) << " bytes per frame, "
+			<< CountClipmapMismatches(Cache, Pyramid) << " texels differ from a reference gather");
+	}
+}
+
+// --------------------------------------------------------------------
+void Benchmark::ClipmapPrefetchFlight()
+{
+	const int Size = 4096;
+	const int ClipmapsAmount = 8;
+	const int TBOSizes[] = {4 * Landscape::DefaultClipmapRimWidth + 5, 4 * 63 + 5};
+	const float Speeds[] = {3.0f, 40.0f};
+	const int Frames = 300;
+	const int RenderMilliseconds = 4;
+
+	LOG("==== Clipmap prefetch ====");
+
+	Heightmap Map(Size);
+
+	for (int y = 0; y < Size; ++y)
+		for (int x = 0; x < Size; ++x)
+			Map.Set(x, y, TestHeight(x, y) + 400.0f * sin(float(x + 2 * y) / 1500.0f));
+
+	Map.UpdateAllAprons();
+
+	for (int t = 0; t < sizeof(TBOSizes) / sizeof(TBOSizes[0]); ++t)
+	{
+		const int TBOSize = TBOSizes[t];
+		const int StartIndex = Size / 2 + TBOSize / 2;
+		const int Origin = StartIndex - (TBOSize + 1) / 2;
+
+		wxMutex PyramidLock;
+
+		for (int v = 0; v < sizeof(Speeds) / sizeof(Speeds[0]); ++v)
+		{
+			// Straight flight which turns a quarter round halfway, the prediction overshoots there
+			std::vector<float> OffsetsX(Frames), OffsetsY(Frames);
+
+			for (int f = 0; f < Frames; ++f)
+			{
+				int Straight = min(f, Frames / 2);
+				OffsetsX[f] = Speeds[v] * Straight + 0.0001f;
+				OffsetsY[f] = Speeds[v] * 0.4f * Straight + Speeds[v] * (f - Straight) + 0.0001f;
+			}
+
+			// Render thread per frame: scrolling alone, then with the prefetcher gathering ahead
+			double FrameTotal[2] = {0.0, 0.0}, ScrollTotal[2] = {0.0, 0.0}, ScrollMax[2] = {0.0, 0.0}, ScrollP99[2] = {0.0, 0.0};
+			ClipmapCacheStats CacheStats[2];
+			ClipmapPrefetchStats PrefetchStats;
+			unsigned int Mismatches = 0;
+
+			for (int p = 0; p < 2; ++p)
+			{
+				// Mips filtered as the flight reaches them, by whichever thread gathers first
+				HeightmapPyramid Pyramid(&Map, Origin, Origin, HeightmapPyramid::DefaultLevels, 256ull << 20);
+				ClipmapCache Cache;
+				ClipmapPrefetcher *Prefetcher = 0;
+				std::vector<double> Times(Frames);
+
+				Cache.Reset(&Pyramid, ClipmapsAmount, TBOSize, StartIndex, StartIndex);
+				Cache.ClearSpans();
+
+				if (p == 1)
+				{
+					Prefetcher = new ClipmapPrefetcher(&Pyramid, PyramidLock);
+
+					if (!Prefetcher->Start())
+					{
+						ERR("Can't start the clipmap prefetcher");
+						delete Prefetcher;
+						return;
+					}
+				}
+
+				ClipmapCacheStats Before = Cache.GetStats();
+
+				for (int f = 0; f < Frames; ++f)
+				{
+					double Start = GetTime();
+
+					if (Prefetcher != 0)
+					{
+						std::vector<ClipmapBlock*> Gathered;
+						Prefetcher->Collect(Gathered);
+						Cache.Stage(Gathered);
+					}
+
+					double ScrollStart = GetTime();
+
+					{
+						wxMutexLocker Locker(PyramidLock);
+						Cache.Scroll(OffsetsX[f], OffsetsY[f]);
+					}
+
+					Times[f] = GetTime() - ScrollStart;
+
+					if (Prefetcher != 0)
+					{
+						float PredictedX[ClipmapPrefetcher::FramesAhead], PredictedY[ClipmapPrefetcher::FramesAhead];
+						float LastX = OffsetsX[max(f - 1, 0)], LastY = OffsetsY[max(f - 1, 0)];
+
+						for (int i = 0; i < ClipmapPrefetcher::FramesAhead; ++i)
+						{
+							PredictedX[i] = OffsetsX[f] + (OffsetsX[f] - LastX) * (i + 1);
+							PredictedY[i] = OffsetsY[f] + (OffsetsY[f] - LastY) * (i + 1);
+						}
+
+						std::vector<ClipmapBlock> Predicted;
+						Cache.PredictBlocks(PredictedX, PredictedY, ClipmapPrefetcher::FramesAhead, Predicted);
+						Prefetcher->Request(Predicted);
+					}
+
+					Cache.ClearSpans();
+					FrameTotal[p] += GetTime() - Start;
+
+					// Rest of the frame goes to rendering, the prefetcher gathers meanwhile
+					Sleep(RenderMilliseconds);
+				}
+
+				if (Prefetcher != 0)
+				{
+					Prefetcher->Stop();
+					PrefetchStats = Prefetcher->GetStats();
+					delete Prefetcher;
+
+					Mismatches = CountClipmapMismatches(Cache, Pyramid);
+				}
+
+				ClipmapCacheStats After = Cache.GetStats();
+				CacheStats[p].GatheredTexels = After.GatheredTexels - Before.GatheredTexels;
+				CacheStats[p].PrefetchedTexels = After.PrefetchedTexels - Before.PrefetchedTexels;
+				CacheStats[p].DroppedBlocks = After.DroppedBlocks - Before.DroppedBlocks;
+
+				for (int f = 0; f < Frames; ++f)
+				{
+					ScrollTotal[p] += Times[f];
+					ScrollMax[p] = max(ScrollMax[p], Times[f]);
+				}
+
+				std::sort(Times.begin(), Times.end());
+				ScrollP99[p] = Times[Frames * 99 / 100];
+			}
+
+			unsigned long long Scrolled = CacheStats[1].GatheredTexels + CacheStats[1].PrefetchedTexels;
+
+			LOG("TBO " << TBOSize << ", " << Speeds[v] << " samples per frame - scrolling per frame: gathering " << ScrollTotal[0] / Frames * 1e6 << " us avg, "
+				<< ScrollP99[0] * 1e6 << " us p99, " << ScrollMax[0] * 1e6 << " us max, prefetched " << ScrollTotal[1] / Frames * 1e6 << " us avg, "
+				<< ScrollP99[1] * 1e6 << " us p99, " << ScrollMax[1] * 1e6 << " us max");
+			LOG("    render thread per frame with the prefetch bookkeeping " << FrameTotal[1] / Frames * 1e6 << " us, without prefetch " << FrameTotal[0] / Frames * 1e6 << " us");
+			LOG("    " << CacheStats[1].PrefetchedTexels * 100.0 / max(Scrolled, 1ull) << "% of " << Scrolled << " texels scrolled in were prefetched, "
+				<< PrefetchStats.BlocksGathered << " blocks gathered ahead, " << CacheStats[1].DroppedBlocks << " dropped unused, " << PrefetchStats.BlocksDiscarded
+				<< " discarded, " << Mismatches << " texels differ from a reference gather");
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+void Benchmark::ClipmapSchedule()
+{
+	const int Size = 4096;
+	const int ClipmapsAmount = 8;
+	const int TBOSizes[] = {4 * Landscape::DefaultClipmapRimWidth + 5, 4 * 63 + 5};
+	const double Budgets[] = {0.0, 100e-6, 300e-6};
+	const int Frames = 300;
+	const int JumpFrame = 100;
+	const float Speed = 20.0f;
+	const float Jump = 1500.0f;
+
+	LOG("==== Clipmap schedule ====");
+
+	Heightmap Map(Size);
+
+	for (int y = 0; y < Size; ++y)
+		for (int x = 0; x < Size; ++x)
+			Map.Set(x, y, TestHeight(x, y) + 400.0f * sin(float(x + 2 * y) / 1500.0f));
+
+	Map.UpdateAllAprons();
+
+	// Flight, a jump across the map - a teleport - and the camera standing still there, then flying on
+	std::vector<float> OffsetsX(Frames), OffsetsY(Frames);
+
+	for (int f = 0; f < Frames; ++f)
+	{
+		int Flown = (f < JumpFrame) ? (f) : ((f < 2 * JumpFrame) ? (JumpFrame) : (f - JumpFrame));
+		OffsetsX[f] = Speed * Flown + ((f >= JumpFrame) ? (Jump) : (0.0f)) + 0.0001f;
+		OffsetsY[f] = Speed * 0.5f * Flown + ((f >= JumpFrame) ? (Jump * 0.7f) : (0.0f)) + 0.0001f;
+	}
+
+	for (int t = 0; t < sizeof(TBOSizes) / sizeof(TBOSizes[0]); ++t)
+	{
+		const int TBOSize = TBOSizes[t];
+		const int StartIndex = Size / 2 + TBOSize / 2;
+		const int Origin = StartIndex - (TBOSize + 1) / 2;
+
+		HeightmapPyramid Pyramid(&Map, Origin, Origin, HeightmapPyramid::DefaultLevels, 256ull << 20);
+		ClipmapCache Cache;
+
+		// Mips of the whole flight filtered once, every budget then reads the same resident tiles
+		Cache.Reset(&Pyramid, ClipmapsAmount, TBOSize, StartIndex, StartIndex);
+
+		for (int f = 0; f < Frames; ++f)
+			Cache.Scroll(OffsetsX[f], OffsetsY[f]);
+
+		for (int b = 0; b < sizeof(Budgets) / sizeof(Budgets[0]); ++b)
+		{
+			ClipmapScheduler Scheduler;
+			std::vector<double> Times(Frames);
+			int CatchUpFrames = 0, MinDrawnLevels = ClipmapsAmount;
+
+			Cache.Reset(&Pyramid, ClipmapsAmount, TBOSize, StartIndex, StartIndex);
+			Scheduler.Reset(ClipmapsAmount, TBOSize, Budgets[b]);
+
+			for (int f = 0; f < Frames; ++f)
+			{
+				double Start = GetTime();
+				Scheduler.Update(Cache, OffsetsX[f], OffsetsY[f]);
+				Cache.ClearSpans();
+				Times[f] = GetTime() - Start;
+
+				MinDrawnLevels = min(MinDrawnLevels, Scheduler.GetDrawnLevels());
+
+				if (f >= JumpFrame && f < 2 * JumpFrame && Scheduler.GetStats().BacklogLevels > 0)
+					CatchUpFrames = f - JumpFrame + 1;
+			}
+
+			const ClipmapSchedulerStats &Stats = Scheduler.GetStats();
+			double FlightTime = 0.0;
+
+			for (int f = 0; f < JumpFrame; ++f)
+				FlightTime += Times[f];
+
+			std::sort(Times.begin(), Times.end());
+
+			LOG("TBO " << TBOSize << ", budget " << Budgets[b] * 1e6 << " us: per frame " << Stats.TotalTime / Frames * 1e6 << " us avg, " << FlightTime / JumpFrame * 1e6
+				<< " us avg in flight, " << Times[Frames * 99 / 100] * 1e6 << " us p99, " << Times.back() * 1e6 << " us max - levels lagged behind the jump for "
+				<< CatchUpFrames << " frames");
+			LOG("    " << Stats.DeferredLevels << " level updates deferred, " << Stats.ForcedLevels << " forced, lagging " << Stats.MaxLagFrames << " frames and "
+				<< Stats.MaxBacklogTexels << " texels at most, " << Stats.HiddenLevels << " levels hidden over all frames, " << MinDrawnLevels << " drawn at least, "
+				<< CountClipmapMismatches(Cache, Pyramid) << " texels differ from a reference gather");
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+bool Benchmark::ReplayStrokes(const std::string &FilePath)
+{
+	StrokeRecordingHeader Header;
+	std::vector<StrokeEvent> Events;
+
+	if (!StrokeRecorder::Load(FilePath.c_str(), Header, Events))
+	{
+		ERR("Can't read stroke recording " << FilePath);
+		return false;
+	}
+
+	LOG("==== Stroke replay ====");
+
+	// The same generated map the strokes were painted on, in the same storage - the recorded budget chooses it again
+	LandscapeEditor::Inst()->SetTerrainSeed(Header.Seed);
+
+	if (Header.PagingBudgetMB != 0)
+		LandscapeEditor::Inst()->SetPagingBudgetMB(Header.PagingBudgetMB);
+
+	Landscape Land(Header.MapSize, Landscape::DefaultClipmapRimWidth, 1.0f, (Header.Flags & STROKE_RECORDING_QUANTIZED) != 0);
+
+	if (Land.HasQuantizedHeights() != ((Header.Flags & STROKE_RECORDING_QUANTIZED) != 0) || Land.IsPagedFromScratch() != ((Header.Flags & STROKE_RECORDING_PAGED) != 0))
+		WARN("Heights aren't stored the way they were in the session - the hash won't match it");
+
+	BrushStroke Stroke;
+	BrushMask Mask;
+	std::vector<double> Latencies;
+	unsigned int Strokes = 0;
+
+	for (unsigned int i = 0; i < Events.size(); ++i)
+	{
+		if ((Events[i].Flags & STROKE_EVENT_IMAGE_MASK) && !Mask.IsLoaded())
+		{
+			if (!Mask.Load("Content/Textures/Brush2a.png"))
+				WARN("Brush2a.png not found, masked stamps are replayed as circles - the hash won't match the session");
+
+			break;
+		}
+	}
+
+	Latencies.reserve(Events.size());
+	double Start = GetTime();
+	double FrameStart = Start;
+
+	// Every frame waits for its batch to reach the heights and derived data, the latency of a frame painted alone
+	for (unsigned int i = 0; i <= Events.size(); ++i)
+	{
+		// Events after the last batch end were cut short by the recording's end, they make the last batch
+		bool bEndBatch = (i == Events.size()) ? (!Stroke.GetBatch().empty()) : ((Events[i].Flags & STROKE_EVENT_BATCH_END) != 0);
+
+		if (i < Events.size() && !bEndBatch)
+		{
+			const StrokeEvent &Event = Events[i];
+			const BrushMaskShape *Shape = (Event.Flags & STROKE_EVENT_IMAGE_MASK) ? (Mask.GetShape(Event.Radius, Event.Rotation)) : (0);
+
+			if (Event.Flags & STROKE_EVENT_BEGIN)
+			{
+				Stroke.End();
+				Strokes++;
+			}
+
+			Stroke.MoveTo(Event.X, Event.Y, Event.Radius, (BrushMode)Event.Mode, Shape);
+		}
+
+		if (!bEndBatch)
+			continue;
+
+		Land.ApplyStamps(Stroke.GetBatch());
+		Land.FinishEdits();
+		Land.PropagateChanges();
+		Stroke.ClearBatch();
+		Mask.Trim();
+
+		Latencies.push_back(GetTime() - FrameStart);
+		FrameStart = GetTime();
+	}
+
+	double Time = GetTime() - Start;
+
+	LOG("Replayed " << Strokes << " strokes, " << Latencies.size() << " frames, " << Stroke.GetStampsAmount() << " stamps on a " << Header.MapSize << " x " << Header.MapSize
+		<< " map (seed " << Header.Seed << ") in " << Time << " s - " << Latencies.size() / Time << " frames/s, " << Stroke.GetStampsAmount() / Time << " stamps/s. "
+		<< "Recorded session took " << ((Events.empty()) ? (0.0f) : (Events.back().Time)) << " s");
+
+	if (!Latencies.empty())
+	{
+		std::sort(Latencies.begin(), Latencies.end());
+
+		LOG("Frame latency: p50 " << Latencies[Latencies.size() / 2] * 1000.0 << " ms, p90 " << Latencies[Latencies.size() * 9 / 10] * 1000.0 << " ms, p99 "
+			<< Latencies[Latencies.size() * 99 / 100] * 1000.0 << " ms, max " << Latencies.back() * 1000.0 << " ms");
+	}
+
+	LOG("Heightmap hash " << std::hex << HashHeights(*Land.GetHeightmap()) << std::dec);
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+void Benchmark::ClipmapUploads()
+{
+	const int Size = 4096;
+	const int ClipmapsAmount = 8;
+	const int TBOSizes[] = {4 * Landscape::DefaultClipmapRimWidth + 5, 4 * 63 + 5};
+	const float Speeds[] = {3.0f, 40.0f};
+	const int Frames = 600;
+
+	LOG("==== Clipmap uploads ====");
+
+	BenchmarkGLContext GLContext;
+
+	if (!GLContext.IsValid())
+	{
+		ERR("No GL context, skipped");
+		return;
+	}
+
+	LOG(glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION));
+
+	Heightmap Map(Size);
+
+	for (int y = 0; y < Size; ++y)
+		for (int x = 0; x < Size; ++x)
+			Map.Set(x, y, TestHeight(x, y) + 400.0f * sin(float(x + 2 * y) / 1500.0f));
+
+	Map.UpdateAllAprons();
+
+	for (int t = 0; t < sizeof(TBOSizes) / sizeof(TBOSizes[0]); ++t)
+	{
+		const int TBOSize = TBOSizes[t];
+		const int StartIndex = Size / 2 + TBOSize / 2;
+		const int Origin = StartIndex - (TBOSize + 1) / 2;
+
+		HeightmapPyramid Pyramid(&Map, Origin, Origin, HeightmapPyramid::DefaultLevels, 256ull << 20);
+		ClipmapCache Cache;
+		GLuint TBOs[ClipmapsAmount];
+
+		glGenBuffers(ClipmapsAmount, TBOs);
+
+		for (int v = 0; v < sizeof(Speeds) / sizeof(Speeds[0]); ++v)
+		{
+			const float PathRadius = Speeds[v] * Frames / 6.2832f;
+
+			// Straight glBufferSubData first, as without ARB_buffer_storage, then staged in a ring sized the way LandGLContext sizes it
+			for (int r = 0; r < 2; ++r)
+			{
+				UploadRing Ring;
+				unsigned int RefillBytes = ClipmapsAmount * TBOSize * TBOSize * sizeof(float);
+				unsigned int DefaultRegionSize = UploadRing::DefaultRegionSize;
+				unsigned int RegionSize = max(RefillBytes, DefaultRegionSize);
+
+				if (r == 1 && !Ring.Init(RegionSize))
+				{
+					WARN("ARB_buffer_storage not available, no ring to compare with");
+					break;
+				}
+
+				Cache.Reset(&Pyramid, ClipmapsAmount, TBOSize, StartIndex, StartIndex);
+
+				for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+				{
+					glBindBuffer(GL_TEXTURE_BUFFER, TBOs[lvl]);
+					glBufferData(GL_TEXTURE_BUFFER, TBOSize * TBOSize * sizeof(float), Cache.GetTexels(lvl), GL_STATIC_DRAW);
+				}
+
+				Cache.ClearSpans();
+				glFinish();
+
+				double UploadTime = 0.0;
+				double Start = GetTime();
+
+				for (int f = 0; f < Frames; ++f)
+				{
+					Cache.Scroll(PathRadius * sin(6.2832f * f / Frames) + 0.0001f, PathRadius * (1.0f - cos(6.2832f * f / Frames)) + 0.0001f);
+
+					double Time = GetTime();
+					Ring.BeginFrame();
+
+					for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+					{
+						const std::vector<ClipmapSpan> &Spans = Cache.GetSpans(lvl);
+
+						for (unsigned int i = 0; i < Spans.size(); ++i)
+							Ring.Upload(TBOs[lvl], Spans[i].Offset * sizeof(float), Cache.GetTexels(lvl) + Spans[i].Offset, Spans[i].Count * sizeof(float));
+					}
+
+					Ring.EndFrame();
+					UploadTime += GetTime() - Time;
+
+					Cache.ClearSpans();
+					glFlush();
+				}
+
+				glFinish();
+				double FlightTime = GetTime() - Start;
+
+				// Read back, the TBOs have to hold exactly what the cache does
+				std::vector<float> Texels(TBOSize * TBOSize);
+				int Differing = 0;
+
+				for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+				{
+					glBindBuffer(GL_TEXTURE_BUFFER, TBOs[lvl]);
+					glGetBufferSubData(GL_TEXTURE_BUFFER, 0, TBOSize * TBOSize * sizeof(float), &Texels[0]);
+
+					if (memcmp(&Texels[0], Cache.GetTexels(lvl), TBOSize * TBOSize * sizeof(float)) != 0)
+						Differing++;
+				}
+
+				const UploadRingStats &Stats = Ring.GetStats();
+
+				LOG("TBO " << TBOSize << ", " << Speeds[v] << " samples per frame, " << (Ring.IsPersistent() ? "ring" : "glBufferSubData") << ": "
+					<< Stats.TotalBytes / 1024.0 / Frames << " KB per frame, "
+					<< UploadTime / Frames * 1e6 << " us per frame issuing uploads, " << FlightTime / Frames * 1e6 << " us per frame with scrolling and until the GPU finished");
+				LOG("    " << Stats.DirectBytes << " bytes direct, " << Stats.FenceWaits << " fence waits (" << Stats.TotalFenceWaitTime * 1e3 << " ms, at most "
+					<< Stats.MaxFenceWaitTime * 1e3 << " ms), " << Differing << " levels differ from the cache, GL error " << glGetError());
+
+				Ring.Release();
+			}
+		}
+
+		glDeleteBuffers(ClipmapsAmount, TBOs);
+	}
+}
+
+// --------------------------------------------------------------------
+void Benchmark::ClipmapTextureArray()
+{
+	const int Size = 2048;
+	const int ClipmapsAmount = 8;
+	const int RimWidths[] = {Landscape::DefaultClipmapRimWidth, 63};
+	const int Frames = 120;
+	const int CheckInterval = 10;
+	const int BindRepeats = 20000;
+	const int Width = 512, Height = 384;
+
+	LOG("==== Clipmap texture array ====");
+
+	BenchmarkGLContext GLContext;
+
+	if (!GLContext.IsValid())
+	{
+		ERR("No GL context, skipped");
+		return;
+	}
+
+	LOG(glGetString(GL_RENDERER) << ", " << glGetString(GL_VERSION));
+
+	// Drawn offscreen, a hidden window's pixels may not be owned
+	GLuint Framebuffer, Renderbuffers[2];
+
+	glGenFramebuffers(1, &Framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, Framebuffer);
+	glGenRenderbuffers(2, Renderbuffers);
+	glBindRenderbuffer(GL_RENDERBUFFER, Renderbuffers[0]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, Width, Height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, Renderbuffers[0]);
+	glBindRenderbuffer(GL_RENDERBUFFER, Renderbuffers[1]);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, Width, Height);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, Renderbuffers[1]);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_PRIMITIVE_RESTART);
+
+	// Camera high above the start index looking down, the same matrices for both paths
+	mat4 MVP = perspective(90.0f, float(Width) / float(Height), 0.1f, 100000.0f) * lookAt(vec3(0.0f, 1500.0f, 0.0f), vec3(0.0f, 0.0f, 0.0f), vec3(1.0f, 0.0f, 0.0f));
+
+	for (int t = 0; t < sizeof(RimWidths) / sizeof(RimWidths[0]); ++t)
+	{
+		Landscape Land(Size, RimWidths[t], 1.0f);
+		const int TBOSize = Land.GetTBOSize();
+		ClipmapCache Cache;
+
+		Cache.Reset(Land.GetHeightPyramid(), ClipmapsAmount, TBOSize, Land.GetStartIndexX(), Land.GetStartIndexY());
+		glPrimitiveRestartIndex(Land.RestartIndex);
+
+		// Grid the way LandGLContext keeps it
+		GLuint VBO, IBOs[IBO_MODES_AMOUNT];
+		int VBOSize, IBOLengths[IBO_MODES_AMOUNT];
+		float *VBOData = Land.GetClipmapVBOData(VBOSize);
+
+		glGenBuffers(1, &VBO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBufferData(GL_ARRAY_BUFFER, VBOSize * sizeof(float), VBOData, GL_STATIC_DRAW);
+		glGenBuffers(IBO_MODES_AMOUNT, IBOs);
+
+		for (int i = 0; i < IBO_MODES_AMOUNT; ++i)
+		{
+			unsigned int *IBOData = Land.GetClipmapIBOData((ClipmapIBOMode)i, IBOLengths[i]);
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBOs[i]);
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, IBOLengths[i] * sizeof(unsigned int), IBOData, GL_STATIC_DRAW);
+		}
+
+		// A TBO per level and a layer per level, filled with the same texels
+		GLuint TBOs[ClipmapsAmount], TBOTexture, ClipmapArray;
+
+		glGenBuffers(ClipmapsAmount, TBOs);
+
+		for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+		{
+			glBindBuffer(GL_TEXTURE_BUFFER, TBOs[lvl]);
+			glBufferData(GL_TEXTURE_BUFFER, TBOSize * TBOSize * sizeof(float), Cache.GetTexels(lvl), GL_STATIC_DRAW);
+		}
+
+		glActiveTexture(GL_TEXTURE2);
+		glGenTextures(1, &TBOTexture);
+		glBindTexture(GL_TEXTURE_BUFFER, TBOTexture);
+		glGenTextures(1, &ClipmapArray);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, ClipmapArray);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, TBOSize, TBOSize, ClipmapsAmount, 0, GL_RED, GL_FLOAT, 0);
+
+		for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, lvl, TBOSize, TBOSize, 1, GL_RED, GL_FLOAT, Cache.GetTexels(lvl));
+
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+		Cache.ClearSpans();
+
+		// Same fragment shader, only the vertex shaders' fetches differ
+		ClipmapLandscapeShader Shaders[2];
+		Shaders[1].UseTextureArray();
+
+		if (!Shaders[0].Initialize("ClipmapLandscape") || !Shaders[1].Initialize("ClipmapLandscapeArray", "ClipmapLandscape"))
+		{
+			ERR("Clipmap shaders failed, run from the directory with Src/Shaders");
+			break;
+		}
+
+		for (int p = 0; p < 2; ++p)
+		{
+			Shaders[p].Use();
+			if (p == 0)
+				Shaders[p].SetTBOSampler(2);
+			else
+				Shaders[p].SetClipmapSampler(2);
+			Shaders[p].SetClipmapWidth(TBOSize);
+			Shaders[p].SetLandscapeVertexOffset(Land.GetOffset());
+			Shaders[p].SetgWorld(MVP);
+		}
+
+		if (!Shaders[0].Validate() || !Shaders[1].Validate())
+			break;
+
+		UploadRing Rings[2];
+		unsigned int RefillBytes = ClipmapsAmount * TBOSize * TBOSize * sizeof(float);
+		unsigned int DefaultRegionSize = UploadRing::DefaultRegionSize;
+
+		Rings[0].Init(max(RefillBytes, DefaultRegionSize));
+		Rings[1].Init(max(RefillBytes, DefaultRegionSize));
+
+		double SubmitTime[2] = {0.0, 0.0}, FrameTime[2] = {0.0, 0.0};
+		unsigned long long Uploads[2] = {0, 0};
+		int Checks = 0, TimedFrames = 0;
+		unsigned long long Differing = 0, Covered = 0;
+		std::vector<unsigned char> Colors[2];
+		std::vector<float> Depths[2];
+
+		for (int p = 0; p < 2; ++p)
+		{
+			Colors[p].resize(Width * Height * 4);
+			Depths[p].resize(Width * Height);
+		}
+
+		glEnableVertexAttribArray(0);
+
+		for (int f = 0; f < Frames; ++f)
+		{
+			const float OffsetX = 37.0f * f + 0.0001f, OffsetY = 13.0f * f + 0.0001f;
+
+			Cache.Scroll(OffsetX, OffsetY);
+			Rings[0].BeginFrame();
+			Rings[1].BeginFrame();
+
+			for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+			{
+				const std::vector<ClipmapSpan> &Spans = Cache.GetSpans(lvl);
+				const float *Texels = Cache.GetTexels(lvl);
+
+				for (unsigned int i = 0; i < Spans.size(); ++i)
+				{
+					Rings[0].Upload(TBOs[lvl], Spans[i].Offset * sizeof(float), Texels + Spans[i].Offset, Spans[i].Count * sizeof(float));
+					Uploads[1] += Rings[1].UploadTextureSpan(ClipmapArray, lvl, TBOSize, Spans[i].Offset, Spans[i].Count, Texels);
+				}
+
+				Uploads[0] += Spans.size();
+			}
+
+			Rings[0].EndFrame();
+			Rings[1].EndFrame();
+			Cache.ClearSpans();
+
+			// Timed frames cover a few pixels and are bound by the vertex shaders, every CheckInterval-th is drawn whole and compared
+			bool bCheck = (f % CheckInterval == 0);
+			int TexelX = int(floor(OffsetX)), TexelY = int(floor(OffsetY));
+
+			for (int p = 0; p < 2; ++p)
+			{
+				glViewport(0, 0, bCheck ? Width : 16, bCheck ? Height : 12);
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+				double Start = GetTime();
+
+				Shaders[p].Use();
+				Shaders[p].SetCameraOffsetX(OffsetX);
+				Shaders[p].SetCameraOffsetY(OffsetY);
+				glActiveTexture(GL_TEXTURE2);
+
+				if (p == 1)
+					glBindTexture(GL_TEXTURE_2D_ARRAY, ClipmapArray);
+
+				for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+				{
+					Shaders[p].SetClipmapScale(1 << lvl);
+					Shaders[p].SetClipmapWindowX(Cache.GetScrolledX(lvl));
+					Shaders[p].SetClipmapWindowY(Cache.GetScrolledY(lvl));
+
+					if (p == 1)
+						Shaders[p].SetClipmapLevel(lvl);
+					else
+					{
+						glBindBuffer(GL_TEXTURE_BUFFER, TBOs[lvl]);
+						glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, TBOs[lvl]);
+					}
+
+					// Strips by the camera's texel parity, as LandGLContext picks them
+					int Strip = (((TexelX >> lvl) & 1) ? 2 : 0) + (((TexelY >> lvl) & 1) ? 1 : 0);
+					int Mode = (lvl == 0 ? IBO_CENTER_1 : IBO_CLIPMAP_1) + Strip;
+
+					glBindBuffer(GL_ARRAY_BUFFER, VBO);
+					glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (const GLvoid*)0);
+					glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBOs[Mode]);
+					glDrawElements(GL_TRIANGLE_STRIP, IBOLengths[Mode], GL_UNSIGNED_INT, 0);
+				}
+
+				double Submitted = GetTime();
+				glFinish();
+
+				if (bCheck)
+				{
+					glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, &Colors[p][0]);
+					glReadPixels(0, 0, Width, Height, GL_DEPTH_COMPONENT, GL_FLOAT, &Depths[p][0]);
+				}
+				else
+				{
+					SubmitTime[p] += Submitted - Start;
+					FrameTime[p] += GetTime() - Start;
+				}
+			}
+
+			if (bCheck)
+			{
+				for (int i = 0; i < Width * Height; ++i)
+				{
+					if (Depths[0][i] != Depths[1][i] || memcmp(&Colors[0][i * 4], &Colors[1][i * 4], 4) != 0)
+						Differing++;
+
+					if (Depths[0][i] < 1.0f)
+						Covered++;
+				}
+
+				Checks++;
+			}
+			else
+				TimedFrames++;
+		}
+
+		glDisableVertexAttribArray(0);
+
+		// Per frame state changes alone - a TBO attached for every level vs the array bound once and a level uniform
+		double Start = GetTime();
+
+		Shaders[0].Use();
+
+		for (int i = 0; i < BindRepeats; ++i)
+			for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+			{
+				glBindBuffer(GL_TEXTURE_BUFFER, TBOs[lvl]);
+				glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, TBOs[lvl]);
+			}
+
+		glFinish();
+		double TBOBindTime = GetTime() - Start;
+
+		Start = GetTime();
+		Shaders[1].Use();
+
+		for (int i = 0; i < BindRepeats; ++i)
+		{
+			glBindTexture(GL_TEXTURE_2D_ARRAY, ClipmapArray);
+
+			for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+				Shaders[1].SetClipmapLevel(lvl);
+		}
+
+		glFinish();
+		double ArrayBindTime = GetTime() - Start;
+
+		LOG("TBO " << TBOSize << ", " << ClipmapsAmount << " levels: TBOs " << SubmitTime[0] / TimedFrames * 1e6 << " us submitting, " << FrameTime[0] / TimedFrames * 1e3
+			<< " ms per frame, texture array " << SubmitTime[1] / TimedFrames * 1e6 << " us submitting, " << FrameTime[1] / TimedFrames * 1e3 << " ms per frame");
+		LOG("    Binds per frame: TBOs " << TBOBindTime / BindRepeats * 1e6 << " us, array and level uniforms " << ArrayBindTime / BindRepeats * 1e6 << " us. Uploads per frame: "
+			<< Uploads[0] / double(Frames) << " to TBOs, " << Uploads[1] / double(Frames) << " to layers");
+		LOG("    " << Differing << " of " << Covered << " drawn pixels differ over " << Checks << " compared frames, GL error " << glGetError());
+
+		Rings[0].Release();
+		Rings[1].Release();
+		glDeleteTextures(1, &ClipmapArray);
+		glDeleteTextures(1, &TBOTexture);
+		glDeleteBuffers(ClipmapsAmount, TBOs);
+		glDeleteBuffers(IBO_MODES_AMOUNT, IBOs);
+		glDeleteBuffers(1, &VBO);
+	}
+
+	glDeleteRenderbuffers(2, Renderbuffers);
+	glDeleteFramebuffers(1, &Framebuffer);
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <string>
+
+/** Performance benchmarks of the terrain code, started from command line with --bench=<name> */
+class Benchmark
+{
+public:
+	/// Run benchmark with given name, "all" runs every one of them. Returns false for unknown name
+	static bool Run(const std::string &Name);
+
+	/// Replay a stroke recording (--replay=<file>) on the map it was painted on, frame by frame as fast as the brushes go.
+	/// Logs stamps/s, latency percentiles of the frames and the hash of the final heights. Returns false if the file can't be read
+	static bool ReplayStrokes(const std::string &FilePath);
+
+protected:
+	/// Tiled heightmap vs flat row-major array - clipmap gathers and brush passes
+	static void HeightmapLayout();
+
+	/// Clipmap flight over a paged heightmap much larger than its memory budget
+	static void HeightmapPaging();
+
+	/// 16-bit quantized tiles - footprint, error bound, encode/decode throughput and gathers through a float working set
+	static void HeightmapQuantization();
+
+	/// Lossless tile codec - ratio and compress/decompress throughput on one and all cores
+	static void TileCompression();
+
+	/// Clipmap level gathers - point sampling the base heightmap vs reading the level's prefiltered mip, resident and quantized
+	static void HeightmapMipPyramid();
+
+	/// Continuous painting on a paged map - brush, incremental mip/stats propagation and clipmap gathers per frame
+	static void EditPropagation();
+
+	/// Cursor picking against the heightmap - min/max quadtree raycasts, cold and warm, vs marching every cell
+	static void TerrainPicking();
+
+	/// Procedural terrain - SSE2 vs scalar noise, thread scaling with output hash, and a 16k map
+	static void TerrainGeneration();
+
+	/// Droplet erosion on 4k and 16k maps - droplets per second and identical results on any amount of threads and step budgets
+	static void Erosion();
+
+	/// New generated landscapes from 1k to 32k - creation time and memory taken by heights, big maps page from quantized tiles or a scratch file
+	static void LandscapeCreation();
+
+	/// Brush stamps by radius and mode - footprint bounded kernels, scalar and SSE2, vs scanning whole tiles with pow
+	static void BrushStamps();
+
+	/// Strokes at slow and fast cursor speeds - stamps of a frame applied one by one vs in one batched pass, with identical results
+	static void BrushStrokes();
+
+	/// Large brushes on an 8k map by amount of threads - stamps/s, speedup and identical results, and a paged map with pinned tiles
+	static void BrushThreadScaling();
+
+	/// Image mask stamps with cached, pre-resampled shapes vs circle stamps, and vs resampling the image for every stamp
+	static void BrushMasks();
+
+	/// Blur and flatten stamps from running sums vs smooth (mode 2) by radius - cost per sample, and against summing every window directly
+	static void FilterBrushes();
+
+	/// Every brush mode, circle and masked - stamps/s and ns per sample of a batch, and one by one stamps against ApplyRow() row by row
+	static void BrushModes();
+
+	/// Strokes applied by the UI thread in place vs queued to the edit worker - time the UI thread spends per frame, and identical results
+	static void EditWorkerFrames();
+
+	/// Clipmap flights with ClipmapCache - texels/s of row segment scrolling vs the old strided column gathers, and levels checked against a reference gather, edits included
+	static void ClipmapCacheFlight();
+
+	/// Clipmap flights with and without ClipmapPrefetcher gathering ahead - time the render thread spends scrolling per frame, and how much of it was prefetched
+	static void ClipmapPrefetchFlight();
+
+	/// Flight with a jump across the map under ClipmapScheduler budgets - time per frame, frames the levels take to catch up and what lagged meanwhile
+	static void ClipmapSchedule();
+
+	/// Clipmap flights uploading the scrolled spans to TBOs through UploadRing vs straight glBufferSubData - KB and time per frame, fence waits,
+	/// and the TBOs read back against the cache. Needs a GL context, runs in a hidden window
+	static void ClipmapUploads();
+
+	/// Clipmap levels drawn from TBOs vs layers of a GL_REPEAT texture array - vertex bound frame times, binds per frame, uploads per frame,
+	/// and the two images compared. Needs a GL context and the shaders in Src/Shaders, runs in a hidden window
+	static void ClipmapTextureArray();
+};
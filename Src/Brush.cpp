@@ -8,7 +8,7 @@
 
 // --------------------------------------------------------------------
 Brush::Brush(vec2 InitialBrushPosition):
-Position(InitialBrushPosition), Radius(0.5f), Mode(0)
+Position(InitialBrushPosition), Radius(0.5f), Mode(BRUSH_ADD), bImageMask(false), Rotation(0.0f)
 {
 }
 
@@ -10,6 +10,16 @@
 
 using namespace glm;
 
+enum BrushMode	{BRUSH_ADD,
+				BRUSH_SUBTRACT,
+				BRUSH_SMOOTH,
+				BRUSH_RING,
+				BRUSH_BLUR,
+				BRUSH_FLATTEN,
+				BRUSH_PLATEAU,
+				BRUSH_NOISE,
+				BRUSH_MODES_AMOUNT};
+
 /** the rendering context used by all GL canvases */
 class Brush
 {
@@ -23,23 +33,31 @@ protected:
     /// Brush radius
     float Radius;
     
-    /// brush mode. 0 - additive, 1 - subtracting, 2 - smooth
-    int Mode;
+    /// brush mode - additive, subtracting, smooth, ring, blur, flatten, plateau or noise
+    BrushMode Mode;
+
+    /// Paint with the image mask instead of the circle, turned by Rotation radians
+    bool bImageMask;
+    float Rotation;
 
 public:
     /// Standard constructors
-    Brush():Radius(10.0f), Mode(0) {};
+    Brush():Radius(10.0f), Mode(BRUSH_ADD), bImageMask(false), Rotation(0.0f) {};
     Brush(vec2 InitialBrushPosition);
 
     /// Setters
-    void SetMode(int NewMode) {Mode = NewMode;};
+    void SetMode(BrushMode NewMode) {Mode = NewMode;};
     void SetPosition(vec3 NewBrushPosition);
     void ModifyRadius(float Modifier);
+    void SetImageMask(bool bNewImageMask) {bImageMask = bNewImageMask;};
+    void ModifyRotation(float Angle) {Rotation += Angle;};
 
     /// Getters
-    int GetMode() {return Mode;};
+    BrushMode GetMode() {return Mode;};
     vec2 GetPosition() {return Position;};
     vec2 GetRenderPosition() {return Position + vec2(-Radius, -Radius);};
     float GetRadius() {return Radius;};
     float GetHeight() {return Height;};
+    bool HasImageMask() {return bImageMask;};
+    float GetRotation() {return Rotation;};
 };
\ No newline at end of file
@@ -0,0 +1,969 @@
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "BrushKernel.h"
+#include "Log.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define BRUSH_KERNEL_SSE2
+#include <emmintrin.h>
+#endif
+
+const float BrushKernel::Strength = 0.15f;
+const float BrushKernel::SmoothStrength = 0.02f;
+const float BrushKernel::BlurStrength = 0.5f;
+const float BrushKernel::FlattenStrength = 0.25f;
+const float BrushKernel::BlurExtent = 0.25f;
+const float BrushKernel::FlattenExtent = 1.0f;
+const float BrushKernel::PlateauStrength = 0.25f;
+const float BrushKernel::NoiseStrength = 0.15f;
+const float BrushKernel::NoiseCellSize = 0.25f;
+
+/// Samples a batch has to cover to be worth starting threads for
+static const long long ParallelWork = 16384;
+
+/** Bell shaped falloff - quadratic ease in up to half of the radius, quadratic ease out to the center */
+struct BellFalloff
+{
+	static float Get(float Factor)
+	{
+		float Inverse = 1.0f - Factor;
+		return (Factor < 0.5f) ? (Factor * Factor) : (0.5f - Inverse * Inverse);
+	};
+
+#ifdef BRUSH_KERNEL_SSE2
+	static __m128 Get(__m128 Factor)
+	{
+		__m128 Inverse = _mm_sub_ps(_mm_set1_ps(1.0f), Factor);
+		__m128 Outer = _mm_mul_ps(Factor, Factor);
+		__m128 Inner = _mm_sub_ps(_mm_set1_ps(0.5f), _mm_mul_ps(Inverse, Inverse));
+		__m128 bOuter = _mm_cmplt_ps(Factor, _mm_set1_ps(0.5f));
+
+		return _mm_or_ps(_mm_and_ps(bOuter, Outer), _mm_andnot_ps(bOuter, Inner));
+	};
+#endif
+};
+
+/** Ring falloff - zero at the center and at the edge, highest half way */
+struct RingFalloff
+{
+	static float Get(float Factor)
+	{
+		float Inverse = 1.0f - Factor;
+		return (Factor < 0.5f) ? (Factor * Factor) : (Inverse * Inverse);
+	};
+
+#ifdef BRUSH_KERNEL_SSE2
+	static __m128 Get(__m128 Factor)
+	{
+		__m128 Inverse = _mm_sub_ps(_mm_set1_ps(1.0f), Factor);
+		__m128 bOuter = _mm_cmplt_ps(Factor, _mm_set1_ps(0.5f));
+
+		return _mm_or_ps(_mm_and_ps(bOuter, _mm_mul_ps(Factor, Factor)), _mm_andnot_ps(bOuter, _mm_mul_ps(Inverse, Inverse)));
+	};
+#endif
+};
+
+// --------------------------------------------------------------------
+static void GetShapeCenter(const BrushStamp &Stamp, int &outX, int &outY)
+{
+	outX = int(floor(Stamp.CenterX + 0.5f));
+	outY = int(floor(Stamp.CenterY + 0.5f));
+}
+
+// --------------------------------------------------------------------
+static const float *GetShapeWeights(const BrushStamp &Stamp, int X, int Y)
+{
+	int CenterX, CenterY;
+	GetShapeCenter(Stamp, CenterX, CenterY);
+
+	return Stamp.Shape->GetRow(Y - CenterY + Stamp.Shape->Extent) + (X - CenterX + Stamp.Shape->Extent);
+}
+
+/** Bell falloff doubled - the center goes the whole Scale of the way toward the target */
+struct PeakBellFalloff
+{
+	static float Get(float Factor) {return 2.0f * BellFalloff::Get(Factor);};
+
+#ifdef BRUSH_KERNEL_SSE2
+	static __m128 Get(__m128 Factor) {__m128 Bell = BellFalloff::Get(Factor); return _mm_add_ps(Bell, Bell);};
+#endif
+};
+
+/** Flat falloff - the whole circle at full weight */
+struct FlatFalloff
+{
+	static float Get(float Factor) {return 1.0f;};
+
+#ifdef BRUSH_KERNEL_SSE2
+	static __m128 Get(__m128 Factor) {return _mm_set1_ps(1.0f);};
+#endif
+};
+
+/** Circle of the stamp's radius weighted by a falloff, set up for one row. Samples outside weigh 0 */
+template <class Falloff>
+struct CircleShape
+{
+	float CenterX, DY2, Radius, InvRadius;
+	int X;
+
+	CircleShape(const BrushStamp &Stamp, int argX, int Y):
+	CenterX(Stamp.CenterX), DY2((float(Y) - Stamp.CenterY) * (float(Y) - Stamp.CenterY)), Radius(Stamp.Radius), InvRadius(1.0f / Stamp.Radius), X(argX) {};
+
+	float Get(int i) const
+	{
+		float DX = float(X + i) - CenterX;
+		float Distance = sqrt(DX * DX + DY2);
+
+		return (Distance <= Radius) ? (Falloff::Get(1.0f - Distance * InvRadius)) : (0.0f);
+	};
+
+#ifdef BRUSH_KERNEL_SSE2
+	__m128 GetLanes(int i) const
+	{
+		__m128 DX = _mm_sub_ps(_mm_cvtepi32_ps(_mm_add_epi32(_mm_set1_epi32(X + i), _mm_set_epi32(3, 2, 1, 0))), _mm_set1_ps(CenterX));
+		__m128 Distance = _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(DX, DX), _mm_set1_ps(DY2)));
+		__m128 Factor = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_mul_ps(Distance, _mm_set1_ps(InvRadius)));
+
+		return _mm_and_ps(_mm_cmple_ps(Distance, _mm_set1_ps(Radius)), Falloff::Get(Factor));
+	};
+#endif
+};
+
+/** Image mask weights of one row */
+struct MaskShape
+{
+	const float *Weights;
+
+	MaskShape(const BrushStamp &Stamp, int X, int Y): Weights(GetShapeWeights(Stamp, X, Y)) {};
+
+	float Get(int i) const {return Weights[i];};
+
+#ifdef BRUSH_KERNEL_SSE2
+	__m128 GetLanes(int i) const {return _mm_loadu_ps(Weights + i);};
+#endif
+};
+
+/** Where row kernels get their target heights from - the stamp's setup for smooth and plateau, the row's own for blur, flatten and noise */
+enum StampTarget	{TARGET_NONE,
+					TARGET_AVERAGE,
+					TARGET_CENTER,
+					TARGET_NEIGHBOURHOOD,
+					TARGET_GENERATED};
+
+struct StampSetup;
+
+/// Row kernel - Count samples of row Y from column X, Targets only for kernels with targets per sample
+typedef void (*RowKernel)(const BrushStamp &Stamp, const StampSetup &Setup, int X, int Y, int Count, const float *Targets, float *Row, bool bSIMD);
+
+/** Everything the rows of a stamp need, set up once per stamp */
+struct StampSetup
+{
+	RowKernel Kernel;
+	float Scale;
+	float Target;
+	StampTarget TargetKind;
+
+	/// Filter window half width and noise lattice spacing, as fractions of the radius
+	float Extent;
+};
+
+/** Target shared by the whole stamp */
+struct ConstantTarget
+{
+	float Value;
+
+	ConstantTarget(const StampSetup &Setup, const float *Targets): Value(Setup.Target) {};
+
+	float Get(int i) const {return Value;};
+
+#ifdef BRUSH_KERNEL_SSE2
+	__m128 GetLanes(int i) const {return _mm_set1_ps(Value);};
+#endif
+};
+
+/** Target of every sample */
+struct RowTarget
+{
+	const float *Values;
+
+	RowTarget(const StampSetup &Setup, const float *Targets): Values(Targets) {};
+
+	float Get(int i) const {return Values[i];};
+
+#ifdef BRUSH_KERNEL_SSE2
+	__m128 GetLanes(int i) const {return _mm_loadu_ps(Values + i);};
+#endif
+};
+
+/** Raise by the weight */
+struct RaiseOp
+{
+	static float Apply(float Height, float Weight, float Scale, float Target) {return Height + Scale * Weight;};
+
+#ifdef BRUSH_KERNEL_SSE2
+	static __m128 Apply(__m128 Height, __m128 Weight, __m128 Scale, __m128 Target) {return _mm_add_ps(Height, _mm_mul_ps(Scale, Weight));};
+#endif
+};
+
+/** Pull toward the target by the weight */
+struct PullOp
+{
+	static float Apply(float Height, float Weight, float Scale, float Target) {return Height + (Scale * Weight) * (Target - Height);};
+
+#ifdef BRUSH_KERNEL_SSE2
+	static __m128 Apply(__m128 Height, __m128 Weight, __m128 Scale, __m128 Target)
+	{
+		return _mm_add_ps(Height, _mm_mul_ps(_mm_mul_ps(Scale, Weight), _mm_sub_ps(Target, Height)));
+	};
+#endif
+};
+
+/** Raise by the weight times the target, noise in -1 - 1 */
+struct DisplaceOp
+{
+	static float Apply(float Height, float Weight, float Scale, float Target) {return Height + (Scale * Weight) * Target;};
+
+#ifdef BRUSH_KERNEL_SSE2
+	static __m128 Apply(__m128 Height, __m128 Weight, __m128 Scale, __m128 Target) {return _mm_add_ps(Height, _mm_mul_ps(_mm_mul_ps(Scale, Weight), Target));};
+#endif
+};
+
+// --------------------------------------------------------------------
+template <class Op, class Shape, class Target>
+static void StampRow(const BrushStamp &Stamp, const StampSetup &Setup, int X, int Y, int Count, const float *Targets, float *Row, bool bSIMD)
+{
+	// One instance per operation, shape and target - no branches on the mode left in here, and both loops give the same results
+	const Shape Weights(Stamp, X, Y);
+	const Target Goals(Setup, Targets);
+	int i = 0;
+
+#ifdef BRUSH_KERNEL_SSE2
+	if (bSIMD)
+	{
+		const __m128 Scale = _mm_set1_ps(Setup.Scale);
+
+		for (; i + 4 <= Count; i += 4)
+			_mm_storeu_ps(Row + i, Op::Apply(_mm_loadu_ps(Row + i), Weights.GetLanes(i), Scale, Goals.GetLanes(i)));
+	}
+#endif
+
+	for (; i < Count; ++i)
+		Row[i] = Op::Apply(Row[i], Weights.Get(i), Setup.Scale, Goals.Get(i));
+}
+
+// --------------------------------------------------------------------
+static float GetLatticeValue(int X, int Y)
+{
+	unsigned int Hash = (unsigned int)X * 374761393u + (unsigned int)Y * 668265263u + 2246822519u;
+
+	Hash = (Hash ^ (Hash >> 13)) * 1274126177u;
+	Hash ^= Hash >> 16;
+
+	return float(Hash & 0xFFFF) / 32767.5f - 1.0f;
+}
+
+// --------------------------------------------------------------------
+template <class Shape>
+static void NoiseRow(const BrushStamp &Stamp, const StampSetup &Setup, int X, int Y, int Count, const float *Targets, float *Row, bool bSIMD)
+{
+	// Value noise tied to map coordinates so overlapping stamps of a stroke agree - generated a chunk at a time, then displaced by like any row target
+	const int Chunk = 256;
+	const float Frequency = 1.0f / max(2.0f, Stamp.Radius * Setup.Extent);
+	const int CellY = int(floor(Y * Frequency));
+	const float FY = Y * Frequency - CellY;
+	const float SY = FY * FY * (3.0f - 2.0f * FY);
+	float Noise[Chunk];
+
+	// Lattice values of the current cell's edges, blended across the row once per cell
+	int CellX = int(floor(X * Frequency)) - 1;
+	float Left = 0.0f, Right = 0.0f;
+
+	for (int First = 0; First < Count; First += Chunk)
+	{
+		const int Amount = min(Chunk, Count - First);
+
+		for (int i = 0; i < Amount; ++i)
+		{
+			const float PX = float(X + First + i) * Frequency;
+			const int Cell = int(floor(PX));
+
+			if (Cell != CellX)
+			{
+				CellX = Cell;
+				Left = GetLatticeValue(CellX, CellY) + (GetLatticeValue(CellX, CellY + 1) - GetLatticeValue(CellX, CellY)) * SY;
+				Right = GetLatticeValue(CellX + 1, CellY) + (GetLatticeValue(CellX + 1, CellY + 1) - GetLatticeValue(CellX + 1, CellY)) * SY;
+			}
+
+			const float FX = PX - Cell;
+			Noise[i] = Left + (Right - Left) * (FX * FX * (3.0f - 2.0f * FX));
+		}
+
+		StampRow<DisplaceOp, Shape, RowTarget>(Stamp, Setup, X + First, Y, Amount, Noise, Row + First, bSIMD);
+	}
+}
+
+// --------------------------------------------------------------------
+static void SkipRow(const BrushStamp &Stamp, const StampSetup &Setup, int X, int Y, int Count, const float *Targets, float *Row, bool bSIMD)
+{
+}
+
+// --------------------------------------------------------------------
+template <class Op, class Falloff, class Target>
+static RowKernel SelectKernel(const BrushStamp &Stamp)
+{
+	return (Stamp.Shape) ? (&StampRow<Op, MaskShape, Target>) : (&StampRow<Op, CircleShape<Falloff>, Target>);
+}
+
+// --------------------------------------------------------------------
+static StampSetup SetupStamp(const BrushStamp &Stamp)
+{
+	// Operation, falloff, strength and target of every mode - a new mode is a new case here, the loops stay as they are
+	StampSetup Setup;
+
+	Setup.Kernel = &SkipRow;
+	Setup.Scale = 0.0f;
+	Setup.Target = 0.0f;
+	Setup.TargetKind = TARGET_NONE;
+	Setup.Extent = 0.0f;
+
+	switch (Stamp.Mode)
+	{
+	case BRUSH_ADD:
+		Setup.Kernel = SelectKernel<RaiseOp, BellFalloff, ConstantTarget>(Stamp);
+		Setup.Scale = BrushKernel::Strength;
+		break;
+	case BRUSH_SUBTRACT:
+		Setup.Kernel = SelectKernel<RaiseOp, BellFalloff, ConstantTarget>(Stamp);
+		Setup.Scale = -BrushKernel::Strength;
+		break;
+	case BRUSH_SMOOTH:
+		Setup.Kernel = SelectKernel<PullOp, FlatFalloff, ConstantTarget>(Stamp);
+		Setup.Scale = BrushKernel::SmoothStrength;
+		Setup.TargetKind = TARGET_AVERAGE;
+		break;
+	case BRUSH_RING:
+		Setup.Kernel = SelectKernel<RaiseOp, RingFalloff, ConstantTarget>(Stamp);
+		Setup.Scale = BrushKernel::Strength;
+		break;
+	case BRUSH_BLUR:
+		Setup.Kernel = SelectKernel<PullOp, PeakBellFalloff, RowTarget>(Stamp);
+		Setup.Scale = BrushKernel::BlurStrength;
+		Setup.TargetKind = TARGET_NEIGHBOURHOOD;
+		Setup.Extent = BrushKernel::BlurExtent;
+		break;
+	case BRUSH_FLATTEN:
+		Setup.Kernel = SelectKernel<PullOp, PeakBellFalloff, RowTarget>(Stamp);
+		Setup.Scale = BrushKernel::FlattenStrength;
+		Setup.TargetKind = TARGET_NEIGHBOURHOOD;
+		Setup.Extent = BrushKernel::FlattenExtent;
+		break;
+	case BRUSH_PLATEAU:
+		Setup.Kernel = SelectKernel<PullOp, PeakBellFalloff, ConstantTarget>(Stamp);
+		Setup.Scale = BrushKernel::PlateauStrength;
+		Setup.TargetKind = TARGET_CENTER;
+		break;
+	case BRUSH_NOISE:
+		Setup.Kernel = (Stamp.Shape) ? (&NoiseRow<MaskShape>) : (&NoiseRow<CircleShape<BellFalloff> >);
+		Setup.Scale = BrushKernel::NoiseStrength;
+		Setup.TargetKind = TARGET_GENERATED;
+		Setup.Extent = BrushKernel::NoiseCellSize;
+		break;
+	}
+
+	return Setup;
+}
+
+// --------------------------------------------------------------------
+static float MaskSumRow(const float *Weights, int Count, const float *Row, int &outCounter, bool bSIMD)
+{
+	// Samples under nonzero weights count, summed the same way as SumRow() does
+	float Lanes[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	int i = 0;
+
+#ifdef BRUSH_KERNEL_SSE2
+	if (bSIMD)
+	{
+		__m128 Sums = _mm_setzero_ps();
+		__m128i Counters = _mm_setzero_si128();
+
+		for (; i + 4 <= Count; i += 4)
+		{
+			__m128 bInside = _mm_cmpgt_ps(_mm_loadu_ps(Weights + i), _mm_setzero_ps());
+
+			Sums = _mm_add_ps(Sums, _mm_and_ps(bInside, _mm_loadu_ps(Row + i)));
+			Counters = _mm_sub_epi32(Counters, _mm_castps_si128(bInside));
+		}
+
+		int CounterLanes[4];
+
+		_mm_storeu_ps(Lanes, Sums);
+		_mm_storeu_si128((__m128i*)CounterLanes, Counters);
+
+		outCounter += CounterLanes[0] + CounterLanes[1] + CounterLanes[2] + CounterLanes[3];
+	}
+#endif
+
+	for (; i + 4 <= Count; i += 4)
+	{
+		for (int Lane = 0; Lane < 4; ++Lane)
+		{
+			bool bInside = Weights[i + Lane] > 0.0f;
+
+			Lanes[Lane] += (bInside) ? (Row[i + Lane]) : (0.0f);
+			outCounter += (bInside) ? (1) : (0);
+		}
+	}
+
+	float Sum = (Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3]);
+
+	for (; i < Count; ++i)
+	{
+		if (Weights[i] > 0.0f)
+		{
+			Sum += Row[i];
+			outCounter++;
+		}
+	}
+
+	return Sum;
+}
+
+// --------------------------------------------------------------------
+static float SumRow(const BrushStamp &Stamp, int X, int Y, int Count, const float *Row, int &outCounter, bool bSIMD)
+{
+	if (Stamp.Shape)
+		return MaskSumRow(GetShapeWeights(Stamp, X, Y), Count, Row, outCounter, bSIMD);
+
+	// Four partial sums on both paths, added up the same way, so scalar and SSE2 averages match to the bit
+	const float DY2 = (float(Y) - Stamp.CenterY) * (float(Y) - Stamp.CenterY);
+	float Lanes[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	int i = 0;
+
+#ifdef BRUSH_KERNEL_SSE2
+	if (bSIMD)
+	{
+		const __m128 CenterX = _mm_set1_ps(Stamp.CenterX);
+		const __m128 Radius = _mm_set1_ps(Stamp.Radius);
+		const __m128 VDY2 = _mm_set1_ps(DY2);
+		__m128i Column = _mm_add_epi32(_mm_set1_epi32(X), _mm_set_epi32(3, 2, 1, 0));
+		__m128 Sums = _mm_setzero_ps();
+		__m128i Counters = _mm_setzero_si128();
+
+		for (; i + 4 <= Count; i += 4, Column = _mm_add_epi32(Column, _mm_set1_epi32(4)))
+		{
+			__m128 DX = _mm_sub_ps(_mm_cvtepi32_ps(Column), CenterX);
+			__m128 bInside = _mm_cmple_ps(_mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(DX, DX), VDY2)), Radius);
+
+			Sums = _mm_add_ps(Sums, _mm_and_ps(bInside, _mm_loadu_ps(Row + i)));
+			Counters = _mm_sub_epi32(Counters, _mm_castps_si128(bInside));
+		}
+
+		int CounterLanes[4];
+
+		_mm_storeu_ps(Lanes, Sums);
+		_mm_storeu_si128((__m128i*)CounterLanes, Counters);
+
+		outCounter += CounterLanes[0] + CounterLanes[1] + CounterLanes[2] + CounterLanes[3];
+	}
+#endif
+
+	for (; i + 4 <= Count; i += 4)
+	{
+		for (int Lane = 0; Lane < 4; ++Lane)
+		{
+			float DX = float(X + i + Lane) - Stamp.CenterX;
+			bool bInside = sqrt(DX * DX + DY2) <= Stamp.Radius;
+
+			Lanes[Lane] += (bInside) ? (Row[i + Lane]) : (0.0f);
+			outCounter += (bInside) ? (1) : (0);
+		}
+	}
+
+	float Sum = (Lanes[0] + Lanes[1]) + (Lanes[2] + Lanes[3]);
+
+	for (; i < Count; ++i)
+	{
+		float DX = float(X + i) - Stamp.CenterX;
+
+		if (sqrt(DX * DX + DY2) <= Stamp.Radius)
+		{
+			Sum += Row[i];
+			outCounter++;
+		}
+	}
+
+	return Sum;
+}
+
+// --------------------------------------------------------------------
+bool BrushKernel::HasSIMD()
+{
+#ifdef BRUSH_KERNEL_SSE2
+	return true;
+#else
+	return false;
+#endif
+}
+
+// --------------------------------------------------------------------
+HeightmapRect BrushKernel::GetFootprint(const BrushStamp &Stamp, unsigned int Size)
+{
+	HeightmapRect Footprint(int(floor(Stamp.CenterX - Stamp.Radius)), int(floor(Stamp.CenterY - Stamp.Radius)),
+							int(floor(Stamp.CenterX + Stamp.Radius)) + 1, int(floor(Stamp.CenterY + Stamp.Radius)) + 1);
+
+	if (Stamp.Shape)
+	{
+		int CenterX, CenterY;
+		GetShapeCenter(Stamp, CenterX, CenterY);
+
+		Footprint = HeightmapRect(CenterX - Stamp.Shape->Extent, CenterY - Stamp.Shape->Extent, CenterX + Stamp.Shape->Extent + 1, CenterY + Stamp.Shape->Extent + 1);
+	}
+
+	Footprint.MinX = max(Footprint.MinX, 0);
+	Footprint.MinY = max(Footprint.MinY, 0);
+	Footprint.MaxX = min(Footprint.MaxX, int(Size));
+	Footprint.MaxY = min(Footprint.MaxY, int(Size));
+
+	return Footprint;
+}
+
+// --------------------------------------------------------------------
+bool BrushKernel::GetRowSpan(const BrushStamp &Stamp, const HeightmapRect &Footprint, int Y, int &outMinX, int &outMaxX)
+{
+	if (Stamp.Shape)
+	{
+		int CenterX, CenterY;
+		GetShapeCenter(Stamp, CenterX, CenterY);
+
+		const int Row = Y - CenterY + Stamp.Shape->Extent;
+
+		if (Row < 0 || Row >= Stamp.Shape->Size || Stamp.Shape->RowFirst[Row] == Stamp.Shape->RowLast[Row])
+			return false;
+
+		outMinX = max(Footprint.MinX, CenterX - Stamp.Shape->Extent + Stamp.Shape->RowFirst[Row]);
+		outMaxX = min(Footprint.MaxX, CenterX - Stamp.Shape->Extent + Stamp.Shape->RowLast[Row]);
+
+		return outMinX < outMaxX;
+	}
+
+	float DY = float(Y) - Stamp.CenterY;
+	float HalfWidth2 = Stamp.Radius * Stamp.Radius - DY * DY;
+
+	if (HalfWidth2 < 0.0f)
+		return false;
+
+	// One sample of slack on both sides, the kernels test the exact distance anyway
+	float HalfWidth = sqrt(HalfWidth2);
+
+	outMinX = max(Footprint.MinX, int(floor(Stamp.CenterX - HalfWidth)));
+	outMaxX = min(Footprint.MaxX, int(floor(Stamp.CenterX + HalfWidth)) + 2);
+
+	return outMinX < outMaxX;
+}
+
+// --------------------------------------------------------------------
+static bool StampReachesRect(const BrushStamp &Stamp, const HeightmapRect &Rect)
+{
+	// Masks are tested by their square only
+	if (Stamp.Shape)
+	{
+		int CenterX, CenterY;
+		GetShapeCenter(Stamp, CenterX, CenterY);
+
+		return (Rect.MinX <= CenterX + Stamp.Shape->Extent) && (Rect.MaxX > CenterX - Stamp.Shape->Extent) &&
+			   (Rect.MinY <= CenterY + Stamp.Shape->Extent) && (Rect.MaxY > CenterY - Stamp.Shape->Extent);
+	}
+
+	// Nearest sample of the rect to the center
+	float DX = max(float(Rect.MinX), min(Stamp.CenterX, float(Rect.MaxX - 1))) - Stamp.CenterX;
+	float DY = max(float(Rect.MinY), min(Stamp.CenterY, float(Rect.MaxY - 1))) - Stamp.CenterY;
+
+	return DX * DX + DY * DY <= Stamp.Radius * Stamp.Radius;
+}
+
+// --------------------------------------------------------------------
+static double SumTile(const BrushStamp &Stamp, const HeightmapRect &Footprint, const HeightmapRect &TileRect, const float *Tile, int Stride,
+					  int &outCounter, bool bSIMD)
+{
+	const HeightmapRect Rect(max(Footprint.MinX, TileRect.MinX), max(Footprint.MinY, TileRect.MinY), min(Footprint.MaxX, TileRect.MaxX), min(Footprint.MaxY, TileRect.MaxY));
+	double Sum = 0.0;
+
+	for (int y = Rect.MinY; y < Rect.MaxY; ++y)
+	{
+		int MinX, MaxX;
+
+		if (!BrushKernel::GetRowSpan(Stamp, Rect, y, MinX, MaxX))
+			continue;
+
+		Sum += SumRow(Stamp, MinX, y, MaxX - MinX, Tile + (y - TileRect.MinY) * Stride + (MinX - TileRect.MinX), outCounter, bSIMD);
+	}
+
+	return Sum;
+}
+
+// --------------------------------------------------------------------
+static HeightmapRect GetTileRect(const Heightmap *Heights, int TileX, int TileY)
+{
+	const int TileSize = Heights->GetTileSize();
+	const int Size = Heights->GetSize();
+
+	return HeightmapRect(TileX * TileSize, TileY * TileSize, min((TileX + 1) * TileSize, Size), min((TileY + 1) * TileSize, Size));
+}
+
+// --------------------------------------------------------------------
+float BrushKernel::GetAverage(const Heightmap *Heights, const BrushStamp &Stamp, bool bSIMD)
+{
+	const HeightmapRect Footprint = GetFootprint(Stamp, Heights->GetSize());
+	const int Shift = Heights->GetTileShift();
+
+	double Sum = 0.0;
+	int Counter = 0;
+
+	if (Footprint.IsEmpty())
+		return 0.0f;
+
+	// Per tile sums added up in tile order, the same as Apply() does for smooth stamps
+	for (int TileY = Footprint.MinY >> Shift; TileY <= (Footprint.MaxY - 1) >> Shift; ++TileY)
+	{
+		for (int TileX = Footprint.MinX >> Shift; TileX <= (Footprint.MaxX - 1) >> Shift; ++TileX)
+		{
+			const HeightmapRect TileRect = GetTileRect(Heights, TileX, TileY);
+
+			// Tiles in the corners of the box the circle misses are never faulted in
+			if (StampReachesRect(Stamp, TileRect))
+				Sum += SumTile(Stamp, Footprint, TileRect, Heights->ReadTile(TileX, TileY), Heights->GetTileStride(), Counter, bSIMD);
+		}
+	}
+
+	return (Counter > 0) ? (float(Sum / Counter)) : (0.0f);
+}
+
+// --------------------------------------------------------------------
+HeightmapRect BrushKernel::Apply(Heightmap *Heights, const BrushStamp &Stamp, bool bSIMD)
+{
+	return Apply(Heights, &Stamp, 1, bSIMD);
+}
+
+// --------------------------------------------------------------------
+static HeightmapRect UniteRects(const HeightmapRect &A, const HeightmapRect &B)
+{
+	if (A.IsEmpty())
+		return B;
+
+	if (B.IsEmpty())
+		return A;
+
+	return HeightmapRect(min(A.MinX, B.MinX), min(A.MinY, B.MinY), max(A.MaxX, B.MaxX), max(A.MaxY, B.MaxY));
+}
+
+// --------------------------------------------------------------------
+HeightmapRect BrushKernel::Apply(Heightmap *Heights, const BrushStamp *Stamps, unsigned int Amount, bool bSIMD)
+{
+	HeightmapRect Union;
+	unsigned int First = 0;
+
+	// Runs of row local stamps go tile by tile, blur and flatten stamps in between go on their own
+	for (unsigned int i = 0; i <= Amount; ++i)
+	{
+		if (i < Amount && !IsFilter(Stamps[i].Mode))
+			continue;
+
+		if (i > First)
+			Union = UniteRects(Union, ApplyTiles(Heights, Stamps + First, i - First, bSIMD));
+
+		if (i < Amount)
+			Union = UniteRects(Union, ApplyFilter(Heights, Stamps[i], bSIMD));
+
+		First = i + 1;
+	}
+
+	return Union;
+}
+
+// --------------------------------------------------------------------
+bool BrushKernel::IsFilter(BrushMode Mode)
+{
+	BrushStamp Stamp;
+	Stamp.Mode = Mode;
+
+	return SetupStamp(Stamp).TargetKind == TARGET_NEIGHBOURHOOD;
+}
+
+// --------------------------------------------------------------------
+int BrushKernel::GetFilterExtent(const BrushStamp &Stamp)
+{
+	return max(1, int(Stamp.Radius * SetupStamp(Stamp).Extent + 0.5f));
+}
+
+// --------------------------------------------------------------------
+HeightmapRect BrushKernel::ApplyFilter(Heightmap *Heights, const BrushStamp &Stamp, bool bSIMD)
+{
+	const int Size = Heights->GetSize();
+	const HeightmapRect Footprint = GetFootprint(Stamp, Size);
+
+	if (Footprint.IsEmpty())
+		return Footprint;
+
+	// Windows are clipped to the map, edge samples average over fewer neighbours
+	const int Extent = GetFilterExtent(Stamp);
+	const HeightmapRect Region(max(Footprint.MinX - Extent, 0), max(Footprint.MinY - Extent, 0), min(Footprint.MaxX + Extent, Size), min(Footprint.MaxY + Extent, Size));
+	const int RegionWidth = Region.GetWidth();
+	const int RegionHeight = Region.GetHeight();
+	const int Width = Footprint.GetWidth();
+	const int Height = Footprint.GetHeight();
+	const int ColumnBlock = 256;
+	const StampSetup Setup = SetupStamp(Stamp);
+
+	// Paged maps are only read and written on this thread, the passes in between work on local copies
+	const bool bParallel = (long long)RegionWidth * RegionHeight >= ParallelWork;
+
+	std::vector<float> Source(RegionWidth * RegionHeight);
+	std::vector<float> RowAverages(RegionHeight * Width);
+	std::vector<float> Averages(Width * Height);
+
+	for (int y = 0; y < RegionHeight; ++y)
+		Heights->GatherRow(Region.MinX, Region.MinY + y, 1, RegionWidth, &Source[y * RegionWidth]);
+
+	// Box averages are separable - running sums along the rows for the footprint's columns, then down those columns.
+	// Adding the sample entering the window and taking the one leaving it costs the same for any window
+	#pragma omp parallel for if (bParallel)
+	for (int y = 0; y < RegionHeight; ++y)
+	{
+		const float *In = &Source[y * RegionWidth];
+		float *Out = &RowAverages[y * Width];
+		int First = 0, Last = 0;
+		double Sum = 0.0;
+
+		for (int x = 0; x < Width; ++x)
+		{
+			const int WindowFirst = max(Footprint.MinX + x - Extent, Region.MinX) - Region.MinX;
+			const int WindowLast = min(Footprint.MinX + x + Extent + 1, Region.MaxX) - Region.MinX;
+
+			for (; Last < WindowLast; ++Last)
+				Sum += In[Last];
+
+			for (; First < WindowFirst; ++First)
+				Sum -= In[First];
+
+			Out[x] = float(Sum / (WindowLast - WindowFirst));
+		}
+	}
+
+	#pragma omp parallel for if (bParallel)
+	for (int Block = 0; Block < (Width + ColumnBlock - 1) / ColumnBlock; ++Block)
+	{
+		const int BlockFirst = Block * ColumnBlock;
+		const int BlockWidth = min(Width, BlockFirst + ColumnBlock) - BlockFirst;
+		std::vector<double> Sums(BlockWidth, 0.0);
+		int First = 0, Last = 0;
+
+		for (int y = 0; y < Height; ++y)
+		{
+			const int WindowFirst = max(Footprint.MinY + y - Extent, Region.MinY) - Region.MinY;
+			const int WindowLast = min(Footprint.MinY + y + Extent + 1, Region.MaxY) - Region.MinY;
+
+			for (; Last < WindowLast; ++Last)
+			{
+				const float *Row = &RowAverages[Last * Width + BlockFirst];
+
+				for (int x = 0; x < BlockWidth; ++x)
+					Sums[x] += Row[x];
+			}
+
+			for (; First < WindowFirst; ++First)
+			{
+				const float *Row = &RowAverages[First * Width + BlockFirst];
+
+				for (int x = 0; x < BlockWidth; ++x)
+					Sums[x] -= Row[x];
+			}
+
+			const double InvWindow = 1.0 / (WindowLast - WindowFirst);
+			float *Out = &Averages[y * Width + BlockFirst];
+
+			for (int x = 0; x < BlockWidth; ++x)
+				Out[x] = float(Sums[x] * InvWindow);
+		}
+	}
+
+	// Every sample pulled toward its own average, all averages taken from the heights before the stamp
+	#pragma omp parallel for if (bParallel)
+	for (int y = 0; y < Height; ++y)
+	{
+		const int Y = Footprint.MinY + y;
+		int MinX, MaxX;
+
+		if (!GetRowSpan(Stamp, Footprint, Y, MinX, MaxX))
+			continue;
+
+		Setup.Kernel(Stamp, Setup, MinX, Y, MaxX - MinX, &Averages[y * Width + (MinX - Footprint.MinX)], &Source[(Y - Region.MinY) * RegionWidth + (MinX - Region.MinX)], bSIMD);
+	}
+
+	for (int y = 0; y < Height; ++y)
+		Heights->ScatterRow(Footprint.MinX, Footprint.MinY + y, Width, &Source[(Footprint.MinY - Region.MinY + y) * RegionWidth + (Footprint.MinX - Region.MinX)]);
+
+	return Footprint;
+}
+
+// --------------------------------------------------------------------
+HeightmapRect BrushKernel::ApplyTiles(Heightmap *Heights, const BrushStamp *Stamps, unsigned int Amount, bool bSIMD)
+{
+	const int Shift = Heights->GetTileShift();
+	const int Stride = Heights->GetTileStride();
+	const int TilesPerRow = Heights->GetTilesPerRow();
+	const bool bPaged = Heights->IsPaged();
+
+	std::vector<HeightmapRect> Footprints(Amount);
+	std::vector<StampSetup> Setups(Amount);
+	std::vector<std::pair<int, unsigned int> > TileStamps;
+	HeightmapRect Union;
+	bool bSmooth = false;
+	long long Work = 0;
+
+	for (unsigned int i = 0; i < Amount; ++i)
+	{
+		const HeightmapRect &Footprint = Footprints[i] = GetFootprint(Stamps[i], Heights->GetSize());
+
+		// Kernels are picked once per stamp, the rows only call them
+		Setups[i] = SetupStamp(Stamps[i]);
+
+		if (Footprint.IsEmpty())
+			continue;
+
+		// Only tiles the circles reach get faulted in and dirtied
+		for (int TileY = Footprint.MinY >> Shift; TileY <= (Footprint.MaxY - 1) >> Shift; ++TileY)
+			for (int TileX = Footprint.MinX >> Shift; TileX <= (Footprint.MaxX - 1) >> Shift; ++TileX)
+				if (StampReachesRect(Stamps[i], GetTileRect(Heights, TileX, TileY)))
+					TileStamps.push_back(std::make_pair(TileY * TilesPerRow + TileX, i));
+
+		bSmooth |= (Setups[i].TargetKind == TARGET_AVERAGE);
+
+		// Plateaus level toward the height under their center from before the batch
+		if (Setups[i].TargetKind == TARGET_CENTER)
+			Setups[i].Target = Heights->Get(max(Footprint.MinX, min(int(floor(Stamps[i].CenterX + 0.5f)), Footprint.MaxX - 1)),
+											max(Footprint.MinY, min(int(floor(Stamps[i].CenterY + 0.5f)), Footprint.MaxY - 1)));
+
+		Work += (long long)Footprint.GetWidth() * Footprint.GetHeight();
+		Union = UniteRects(Union, Footprint);
+	}
+
+	// Every touched tile once, with the stamps reaching it in batch order. Tiles are independent of each other and go in parallel
+	std::sort(TileStamps.begin(), TileStamps.end());
+	std::vector<unsigned int> TileFirst;
+
+	for (unsigned int t = 0; t < TileStamps.size(); ++t)
+		if (t == 0 || TileStamps[t].first != TileStamps[t - 1].first)
+			TileFirst.push_back(t);
+
+	TileFirst.push_back(TileStamps.size());
+
+	const int TilesAmount = int(TileFirst.size()) - 1;
+	std::vector<double> PartialSums(bSmooth ? TileStamps.size() : 0, 0.0);
+	std::vector<int> PartialCounters(bSmooth ? TileStamps.size() : 0, 0);
+	std::vector<const float*> ReadPointers(bSmooth ? TilesAmount : 0, (const float*)0);
+	std::vector<float*> TilePointers(TilesAmount, (float*)0);
+
+	// Paged maps share one tile cache - tiles are faulted in and pinned on this thread, a budget friendly batch at a time
+	const unsigned int PagedBatchTiles = Heightmap::BatchSize;
+	const int BatchTiles = (bPaged) ? (max(1, int(min(PagedBatchTiles, Heights->GetPagingStats().MaxResidentTiles / 2)))) : (max(1, TilesAmount));
+
+	// Smooth stamps pull toward their average from before the batch - partial sums per tile first, added up in tile order
+	for (int Phase = (bSmooth) ? (0) : (1); Phase < 2; ++Phase)
+	{
+		for (int BatchFirst = 0; BatchFirst < TilesAmount; BatchFirst += BatchTiles)
+		{
+			const int BatchLast = min(TilesAmount, BatchFirst + BatchTiles);
+
+			for (int t = BatchFirst; t < BatchLast; ++t)
+			{
+				const int TileIndex = TileStamps[TileFirst[t]].first;
+
+				// Summing only reads, tiles aren't marked dirty until the kernels write them
+				if (Phase == 0)
+					ReadPointers[t] = Heights->ReadTile(TileIndex % TilesPerRow, TileIndex / TilesPerRow);
+				else
+					TilePointers[t] = Heights->WriteTile(TileIndex % TilesPerRow, TileIndex / TilesPerRow);
+
+				if (bPaged)
+					Heights->PinTile(TileIndex % TilesPerRow, TileIndex / TilesPerRow);
+			}
+
+			#pragma omp parallel for schedule(dynamic) if (Work >= ParallelWork)
+			for (int t = BatchFirst; t < BatchLast; ++t)
+			{
+				const int TileIndex = TileStamps[TileFirst[t]].first;
+				const HeightmapRect TileRect = GetTileRect(Heights, TileIndex % TilesPerRow, TileIndex / TilesPerRow);
+				if (Phase == 0)
+				{
+					for (unsigned int p = TileFirst[t]; p < TileFirst[t + 1]; ++p)
+					{
+						const unsigned int i = TileStamps[p].second;
+
+						if (Setups[i].TargetKind == TARGET_AVERAGE)
+							PartialSums[p] = SumTile(Stamps[i], Footprints[i], TileRect, ReadPointers[t], Stride, PartialCounters[p], bSIMD);
+					}
+
+					continue;
+				}
+
+				float *Tile = TilePointers[t];
+
+				for (int y = TileRect.MinY; y < TileRect.MaxY; ++y)
+				{
+					for (unsigned int p = TileFirst[t]; p < TileFirst[t + 1]; ++p)
+					{
+						const unsigned int i = TileStamps[p].second;
+						const HeightmapRect &Footprint = Footprints[i];
+						int MinX, MaxX;
+
+						if (y < Footprint.MinY || y >= Footprint.MaxY)
+							continue;
+
+						if (!GetRowSpan(Stamps[i], HeightmapRect(max(Footprint.MinX, TileRect.MinX), y, min(Footprint.MaxX, TileRect.MaxX), y + 1), y, MinX, MaxX))
+							continue;
+
+						Setups[i].Kernel(Stamps[i], Setups[i], MinX, y, MaxX - MinX, 0, Tile + (y - TileRect.MinY) * Stride + (MinX - TileRect.MinX), bSIMD);
+					}
+				}
+			}
+
+			if (bPaged)
+			{
+				for (int t = BatchFirst; t < BatchLast; ++t)
+					Heights->UnpinTile(TileStamps[TileFirst[t]].first % TilesPerRow, TileStamps[TileFirst[t]].first / TilesPerRow);
+			}
+		}
+
+		if (Phase == 0)
+		{
+			std::vector<double> Sums(Amount, 0.0);
+			std::vector<int> Counters(Amount, 0);
+
+			for (unsigned int p = 0; p < TileStamps.size(); ++p)
+			{
+				Sums[TileStamps[p].second] += PartialSums[p];
+				Counters[TileStamps[p].second] += PartialCounters[p];
+			}
+
+			for (unsigned int i = 0; i < Amount; ++i)
+				if (Setups[i].TargetKind == TARGET_AVERAGE)
+					Setups[i].Target = (Counters[i] > 0) ? (float(Sums[i] / Counters[i])) : (0.0f);
+		}
+	}
+
+	return Union;
+}
+
+// --------------------------------------------------------------------
+void BrushKernel::ApplyRow(const BrushStamp &Stamp, int X, int Y, int Count, float Target, float *Row, bool bSIMD)
+{
+	StampSetup Setup = SetupStamp(Stamp);
+
+	if (Setup.TargetKind == TARGET_NEIGHBOURHOOD)
+		return;
+
+	Setup.Target = Target;
+	Setup.Kernel(Stamp, Setup, X, Y, Count, 0, Row, bSIMD);
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Brush.h"
+#include "BrushMask.h"
+#include "Heightmap.h"
+
+/** Single brush application - center and radius in heightmap samples, and one of BrushMode. Stamps with a Shape take their
+	falloff from the image mask instead of the circle, centered on the nearest sample; the shape must outlive the stamp */
+struct BrushStamp
+{
+	float CenterX;
+	float CenterY;
+	float Radius;
+	BrushMode Mode;
+	const BrushMaskShape *Shape;
+
+	BrushStamp(): CenterX(0.0f), CenterY(0.0f), Radius(1.0f), Mode(BRUSH_ADD), Shape(0) {};
+	BrushStamp(float argCenterX, float argCenterY, float argRadius, BrushMode argMode, const BrushMaskShape *argShape = 0):
+		CenterX(argCenterX), CenterY(argCenterY), Radius(argRadius), Mode(argMode), Shape(argShape) {};
+};
+
+/** Brush edit kernels. Only tiles within the stamp's bounding box are touched, and every row only between the edges of the circle,
+	four samples at a time with SSE2. The falloff is a piecewise quadratic of the distance, the scalar path gives the same results.
+	Masked stamps read the shape's weights row by row instead - ring ones raise the same as add ones.
+	Row kernels are instantiated per operation, weights and target and picked once per stamp; a new mode only adds its setup.
+	Plateau stamps level toward the height under their center, noise stamps displace by value noise tied to map coordinates.
+	Blur and flatten stamps pull every sample toward the box average of its neighbourhood, small for blur and as wide as the brush for flatten.
+	The averages come from running sums over the footprint grown by the window, so the cost per sample doesn't depend on the window size */
+class BrushKernel
+{
+public:
+	/// Height added (or taken) at the brush center by one stamp, and the fraction of the way to the average one smooth stamp goes
+	static const float Strength;
+	static const float SmoothStrength;
+
+	/// Fraction of the way to the local average blur and flatten stamps go at the brush center
+	static const float BlurStrength;
+	static const float FlattenStrength;
+
+	/// Window half widths of blur and flatten stamps, as a fraction of the radius
+	static const float BlurExtent;
+	static const float FlattenExtent;
+
+	/// Fraction of the way to the center height a plateau stamp goes at its center, and the most a noise stamp displaces by
+	static const float PlateauStrength;
+	static const float NoiseStrength;
+
+	/// Noise lattice spacing as a fraction of the radius
+	static const float NoiseCellSize;
+
+	/// True if this build has the SSE2 path
+	static bool HasSIMD();
+
+	/// Samples within the stamp's bounding box (the mask's square for masked stamps), clipped to the map - brushes don't wrap around its edges
+	static HeightmapRect GetFootprint(const BrushStamp &Stamp, unsigned int Size);
+
+	/// Mean height of the samples within the stamp's radius (or under the mask's nonzero weights), 0 if there are none
+	static float GetAverage(const Heightmap *Heights, const BrushStamp &Stamp, bool bSIMD = true);
+
+	/// Apply the stamp in place and return the rect of changed samples. Aprons are not refreshed, call UpdateAprons() afterwards
+	static HeightmapRect Apply(Heightmap *Heights, const BrushStamp &Stamp, bool bSIMD = true);
+
+	/// Apply a batch of stamps in one pass - every touched tile is visited once and its rows get the stamps in batch order,
+	/// the same as stamping one by one except that smooth stamps use averages from before the batch. Returns the union footprint.
+	/// Tiles go in parallel, smooth averages are summed per tile first - results don't depend on the amount of threads.
+	/// Blur and flatten stamps read around their footprints, they split the batch and go one at a time
+	static HeightmapRect Apply(Heightmap *Heights, const BrushStamp *Stamps, unsigned int Amount, bool bSIMD = true);
+
+	/// Apply a blur or flatten stamp and return the rect of changed samples
+	static HeightmapRect ApplyFilter(Heightmap *Heights, const BrushStamp &Stamp, bool bSIMD = true);
+
+	/// Apply the stamp to Count samples of row Y starting at column X, Row pointing at sample X. Target is the smooth stamp's average
+	/// or the plateau's height. Picks the kernel on every call, batches do it once per stamp. Blur and flatten stamps are left out, they aren't row local
+	static void ApplyRow(const BrushStamp &Stamp, int X, int Y, int Count, float Target, float *Row, bool bSIMD = true);
+
+	/// True for the modes that average over a neighbourhood of every sample
+	static bool IsFilter(BrushMode Mode);
+
+	/// Window half width of a blur or flatten stamp, in samples
+	static int GetFilterExtent(const BrushStamp &Stamp);
+
+	/// Span [outMinX, outMaxX) of row Y within the stamp's radius (or the mask row's nonzero weights), clipped to the footprint.
+	/// Returns false if the row misses the stamp
+	static bool GetRowSpan(const BrushStamp &Stamp, const HeightmapRect &Footprint, int Y, int &outMinX, int &outMaxX);
+
+private:
+	/// Apply a batch of row local stamps, tile by tile
+	static HeightmapRect ApplyTiles(Heightmap *Heights, const BrushStamp *Stamps, unsigned int Amount, bool bSIMD);
+
+	BrushKernel();
+};
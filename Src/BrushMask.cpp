@@ -0,0 +1,172 @@
+#include <math.h>
+
+#include "BrushMask.h"
+#include "TextureManager.h"
+#include "LandscapeEditor.h"
+
+static const float TwoPi = 6.28318531f;
+
+// --------------------------------------------------------------------
+BrushMask::BrushMask():
+ImageWidth(0), ImageHeight(0), CachedBytes(0), Hits(0), Misses(0)
+{
+}
+
+// --------------------------------------------------------------------
+BrushMask::~BrushMask()
+{
+	ClearCache();
+}
+
+// --------------------------------------------------------------------
+bool BrushMask::Load(const char *FileName)
+{
+	std::vector<float> Values;
+	unsigned int Width, Height;
+
+	if (!TextureManager::Inst()->LoadImageData(FileName, Values, Width, Height))
+		return false;
+
+	SetImage(&Values[0], Width, Height);
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+void BrushMask::SetImage(const float *Values, unsigned int Width, unsigned int Height)
+{
+	ClearCache();
+
+	Image.assign(Values, Values + Width * Height);
+	ImageWidth = Width;
+	ImageHeight = Height;
+}
+
+// --------------------------------------------------------------------
+int BrushMask::GetRadiusBucket(float Radius)
+{
+	return int(floor(log(max(Radius, 0.5f)) / log(2.0f) * RadiusStepsPerOctave + 0.5f));
+}
+
+// --------------------------------------------------------------------
+float BrushMask::GetBucketRadius(int RadiusBucket)
+{
+	return pow(2.0f, float(RadiusBucket) / RadiusStepsPerOctave);
+}
+
+// --------------------------------------------------------------------
+const BrushMaskShape *BrushMask::GetShape(float Radius, float Rotation)
+{
+	if (Image.empty())
+		return 0;
+
+	int RotationBucket = int(floor(Rotation / TwoPi * RotationSteps + 0.5f)) % RotationSteps;
+	RotationBucket += (RotationBucket < 0) ? (RotationSteps) : (0);
+
+	const std::pair<int, int> Key(GetRadiusBucket(Radius), RotationBucket);
+	std::map<std::pair<int, int>, BrushMaskShape*>::iterator Found = Shapes.find(Key);
+
+	if (Found != Shapes.end())
+	{
+		Hits++;
+		return Found->second;
+	}
+
+	BrushMaskShape *Shape = Resample(Key.first, Key.second);
+
+	Misses++;
+	CachedBytes += Shape->Weights.size() * sizeof(float) + (Shape->RowFirst.size() + Shape->RowLast.size()) * sizeof(int);
+	Shapes[Key] = Shape;
+
+	return Shape;
+}
+
+// --------------------------------------------------------------------
+BrushMaskShape *BrushMask::Resample(int RadiusBucket, int RotationBucket) const
+{
+	const float Radius = GetBucketRadius(RadiusBucket);
+	const float Angle = TwoPi * RotationBucket / RotationSteps;
+	const float Cos = cos(Angle) / Radius;
+	const float Sin = sin(Angle) / Radius;
+
+	// Shrinking a large image averages a few pixels per sample, or thin features would alias away
+	const int MostSupersampling = MaxSupersampling;
+	const int Supersampling = max(1, min(MostSupersampling, int(ceil(max(ImageWidth, ImageHeight) / (2.0f * Radius)))));
+
+	BrushMaskShape *Shape = new BrushMaskShape;
+
+	Shape->Extent = int(ceil(Radius));
+	Shape->Size = 2 * Shape->Extent + 1;
+	Shape->Weights.assign(Shape->Size * Shape->Size, 0.0f);
+	Shape->RowFirst.assign(Shape->Size, 0);
+	Shape->RowLast.assign(Shape->Size, 0);
+
+	for (int y = 0; y < Shape->Size; ++y)
+	{
+		for (int x = 0; x < Shape->Size; ++x)
+		{
+			float Sum = 0.0f;
+
+			for (int sy = 0; sy < Supersampling; ++sy)
+			{
+				for (int sx = 0; sx < Supersampling; ++sx)
+				{
+					float PX = float(x - Shape->Extent) + (sx + 0.5f) / Supersampling - 0.5f;
+					float PY = float(y - Shape->Extent) + (sy + 0.5f) / Supersampling - 0.5f;
+
+					// Rotated into the image's -1 - 1 square, nothing outside of it
+					float U = Cos * PX + Sin * PY;
+					float V = Cos * PY - Sin * PX;
+
+					if (U < -1.0f || U > 1.0f || V < -1.0f || V > 1.0f)
+						continue;
+
+					float FX = max(0.0f, (U * 0.5f + 0.5f) * ImageWidth - 0.5f);
+					float FY = max(0.0f, (V * 0.5f + 0.5f) * ImageHeight - 0.5f);
+					unsigned int X0 = min((unsigned int)FX, ImageWidth - 1), X1 = min(X0 + 1, ImageWidth - 1);
+					unsigned int Y0 = min((unsigned int)FY, ImageHeight - 1), Y1 = min(Y0 + 1, ImageHeight - 1);
+					float TX = FX - floor(FX), TY = FY - floor(FY);
+
+					float Top = Image[Y0 * ImageWidth + X0] + (Image[Y0 * ImageWidth + X1] - Image[Y0 * ImageWidth + X0]) * TX;
+					float Bottom = Image[Y1 * ImageWidth + X0] + (Image[Y1 * ImageWidth + X1] - Image[Y1 * ImageWidth + X0]) * TX;
+
+					Sum += Top + (Bottom - Top) * TY;
+				}
+			}
+
+			Shape->Weights[y * Shape->Size + x] = Sum / (Supersampling * Supersampling);
+		}
+
+		// Nonzero span of the row, empty rows keep 0 - 0
+		const float *Row = Shape->GetRow(y);
+		int First = 0, Last = Shape->Size;
+
+		while (First < Last && Row[First] <= 0.0f)
+			First++;
+
+		while (Last > First && Row[Last - 1] <= 0.0f)
+			Last--;
+
+		Shape->RowFirst[y] = (First < Last) ? (First) : (0);
+		Shape->RowLast[y] = (First < Last) ? (Last) : (0);
+	}
+
+	return Shape;
+}
+
+// --------------------------------------------------------------------
+void BrushMask::Trim()
+{
+	if (CachedBytes > MaxCachedBytes)
+		ClearCache();
+}
+
+// --------------------------------------------------------------------
+void BrushMask::ClearCache()
+{
+	for (std::map<std::pair<int, int>, BrushMaskShape*>::iterator i = Shapes.begin(); i != Shapes.end(); ++i)
+		delete i->second;
+
+	Shapes.clear();
+	CachedBytes = 0;
+}
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <map>
+#include <vector>
+
+/** Brush mask resampled for one radius and rotation - weights of the (2 * Extent + 1)^2 samples around the stamp center,
+	with the span of nonzero weights of every row so the kernels skip the empty corners */
+struct BrushMaskShape
+{
+	int Extent;
+	int Size;
+	std::vector<float> Weights;
+	std::vector<int> RowFirst;
+	std::vector<int> RowLast;
+
+	const float *GetRow(int Row) const {return &Weights[Row * Size];};
+};
+
+/** Stamp shape from an image, scaled and rotated per stamp. Resampling is paid once per (radius, rotation) bucket -
+	radii go in RadiusStepsPerOctave geometric steps, rotations in RotationSteps - and stamping reads the cached weights only */
+class BrushMask
+{
+public:
+	/// Bucket resolution
+	static const int RadiusStepsPerOctave = 16;
+	static const int RotationSteps = 64;
+
+	/// Cache size Trim() brings the cache back under
+	static const unsigned int MaxCachedBytes = 64 << 20;
+
+	/// Most source pixels averaged per sample and axis when the image is shrunk
+	static const int MaxSupersampling = 4;
+
+protected:
+	/// Source image, values 0 - 1, row 0 at the top
+	std::vector<float> Image;
+	unsigned int ImageWidth, ImageHeight;
+
+	/// Resampled shapes by (radius bucket, rotation bucket)
+	std::map<std::pair<int, int>, BrushMaskShape*> Shapes;
+	unsigned long long CachedBytes;
+
+	/// Cache statistics
+	unsigned long long Hits, Misses;
+
+	/// Resample the image for the bucket
+	BrushMaskShape *Resample(int RadiusBucket, int RotationBucket) const;
+
+public:
+	BrushMask();
+	~BrushMask();
+
+	/// Load the image through TextureManager - luminance times alpha. False if it can't be read
+	bool Load(const char *FileName);
+
+	/// Use Width x Height values in 0 - 1 as the image, row 0 at the top. Drops the cached shapes
+	void SetImage(const float *Values, unsigned int Width, unsigned int Height);
+
+	/// Shape for the radius (in samples) and rotation (in radians), resampled on the first use of its bucket.
+	/// Shapes stay valid until Trim() or ClearCache(), stamps pointing at them must be applied before either
+	const BrushMaskShape *GetShape(float Radius, float Rotation);
+
+	/// Drop the cached shapes if they take more than MaxCachedBytes
+	void Trim();
+
+	/// Drop all cached shapes
+	void ClearCache();
+
+	/// Bucket of the radius, and the radius the bucket's shape is resampled for
+	static int GetRadiusBucket(float Radius);
+	static float GetBucketRadius(int RadiusBucket);
+
+	/// Getters
+	bool IsLoaded() const {return !Image.empty();};
+	unsigned int GetImageWidth() const {return ImageWidth;};
+	unsigned int GetImageHeight() const {return ImageHeight;};
+	unsigned int GetShapesAmount() const {return Shapes.size();};
+	unsigned long long GetCachedBytes() const {return CachedBytes;};
+	unsigned long long GetHits() const {return Hits;};
+	unsigned long long GetMisses() const {return Misses;};
+
+private:
+	BrushMask(const BrushMask&);
+	BrushMask& operator=(const BrushMask&);
+};
@@ -0,0 +1,53 @@
+#include <math.h>
+
+#include "BrushStroke.h"
+#include "LandscapeEditor.h"
+
+/// Stamps are never closer than this many samples, however small the brush
+static const float MinStampDistance = 0.1f;
+
+// --------------------------------------------------------------------
+BrushStroke::BrushStroke(float argSpacing):
+Spacing(argSpacing), bActive(false), LastX(0.0f), LastY(0.0f), Travelled(0.0f), StampsAmount(0)
+{
+}
+
+// --------------------------------------------------------------------
+void BrushStroke::MoveTo(float X, float Y, float Radius, BrushMode Mode, const BrushMaskShape *Shape)
+{
+	if (!bActive)
+	{
+		bActive = true;
+		LastX = X;
+		LastY = Y;
+		Travelled = 0.0f;
+
+		Batch.push_back(BrushStamp(X, Y, Radius, Mode, Shape));
+		StampsAmount++;
+		return;
+	}
+
+	float DX = X - LastX;
+	float DY = Y - LastY;
+	float Length = sqrt(DX * DX + DY * DY);
+	float Step = max(Spacing * Radius, MinStampDistance);
+
+	if (Length <= 0.0f)
+		return;
+
+	if (Length / Step > MaxStampsPerSegment)
+		Step = Length / MaxStampsPerSegment;
+
+	// Distance along this segment to the next stamp, the remainder of the previous segment counts
+	float Next = max(Step - Travelled, 0.0f);
+
+	for (; Next <= Length; Next += Step)
+	{
+		Batch.push_back(BrushStamp(LastX + DX * (Next / Length), LastY + DY * (Next / Length), Radius, Mode, Shape));
+		StampsAmount++;
+	}
+
+	Travelled = Length - (Next - Step);
+	LastX = X;
+	LastY = Y;
+}
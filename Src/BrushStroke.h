@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include "BrushKernel.h"
+
+/** Brush stroke along the cursor path. Stamps are laid at even spacing along the segments between cursor positions,
+	however far apart these are, and gathered into a batch the owner applies once per frame */
+class BrushStroke
+{
+public:
+	/// Most stamps laid along a single segment, the spacing grows for longer ones
+	static const unsigned int MaxStampsPerSegment = 4096;
+
+protected:
+	/// Distance between stamps as a fraction of the brush radius
+	float Spacing;
+
+	/// Stroke in progress, its last cursor position and the distance walked from the last stamp
+	bool bActive;
+	float LastX, LastY;
+	float Travelled;
+
+	/// Stamps laid since the last ClearBatch()
+	std::vector<BrushStamp> Batch;
+
+	/// Stamps laid by the stroke, all of them
+	unsigned long long StampsAmount;
+
+public:
+	BrushStroke(float argSpacing = 0.25f);
+
+	/// Continue the stroke to (X, Y) in heightmap samples - or start it there with one stamp. Stamps get the mask shape if one is given
+	void MoveTo(float X, float Y, float Radius, BrushMode Mode, const BrushMaskShape *Shape = 0);
+
+	/// Finish the stroke, the next MoveTo() starts a new one. Stamps already laid stay in the batch
+	void End() {bActive = false;};
+
+	/// Forget the batch after it got applied
+	void ClearBatch() {Batch.clear();};
+
+	/// Setters
+	void SetSpacing(float NewSpacing) {Spacing = NewSpacing;};
+
+	/// Getters
+	bool IsActive() const {return bActive;};
+	float GetSpacing() const {return Spacing;};
+	const std::vector<BrushStamp> & GetBatch() const {return Batch;};
+	unsigned long long GetStampsAmount() const {return StampsAmount;};
+};
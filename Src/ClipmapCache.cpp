@@ -0,0 +1,448 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "ClipmapCache.h"
+#include "Log.h"
+
+// --------------------------------------------------------------------
+static int WrapIndex(int Index, int Size)
+{
+	Index %= Size;
+	return (Index < 0) ? (Index + Size) : (Index);
+}
+
+// --------------------------------------------------------------------
+static bool IsInWrappedRange(int X, int Min, int Max, int Size)
+{
+	return Max - Min >= Size || WrapIndex(X - Min, Size) < Max - Min;
+}
+
+/** Rows and columns of a window coming in with a scroll, in window texels */
+struct WindowBlock
+{
+	int Row, Column;
+	int Width, Height;
+};
+
+// --------------------------------------------------------------------
+static int GetScrollDiff(float Offset, int Scrolled, int ClipmapScale)
+{
+	// Window texel 0 of the level is a texel behind the offset it was last scrolled to
+	float fDiff = Offset - float((Scrolled + 1) * ClipmapScale);
+	int Sign = (fDiff > 0.0f) - (fDiff < 0.0f);
+
+	// Levels move two texels at a time, keeping in step with the coarser level's grid
+	return int(floor((fabs(fDiff) + ClipmapScale) / (2.0f * ClipmapScale))) * Sign * 2;
+}
+
+// --------------------------------------------------------------------
+static int GetIncomingBlocks(int Size, int DiffX, int DiffY, WindowBlock *outBlocks)
+{
+	int NewRows = abs(DiffY);
+	int NewColumns = abs(DiffX);
+	int Amount = 0;
+
+	// Nothing stays in view, all of it
+	if (NewRows >= Size || NewColumns >= Size)
+	{
+		WindowBlock Whole = {0, 0, Size, Size};
+		outBlocks[Amount++] = Whole;
+		return Amount;
+	}
+
+	// Coming rows whole, the other rows just their coming columns
+	if (NewRows > 0)
+	{
+		WindowBlock Rows = {(DiffY > 0) ? (Size - NewRows) : (0), 0, Size, NewRows};
+		outBlocks[Amount++] = Rows;
+	}
+
+	if (NewColumns > 0)
+	{
+		WindowBlock Columns = {(DiffY > 0) ? (0) : (NewRows), (DiffX > 0) ? (Size - NewColumns) : (0), NewColumns, Size - NewRows};
+		outBlocks[Amount++] = Columns;
+	}
+
+	return Amount;
+}
+
+// --------------------------------------------------------------------
+ClipmapCache::ClipmapCache():
+Pyramid(0), Size(0), LevelsAmount(0), StartIndexX(0), StartIndexY(0), StagedTexels(0)
+{
+}
+
+// --------------------------------------------------------------------
+ClipmapCache::~ClipmapCache()
+{
+	DropStaged();
+}
+
+// --------------------------------------------------------------------
+void ClipmapCache::Reset(const HeightmapPyramid *argPyramid, int argLevelsAmount, int argSize, int argStartIndexX, int argStartIndexY)
+{
+	Pyramid = argPyramid;
+	LevelsAmount = argLevelsAmount;
+	Size = argSize;
+	StartIndexX = argStartIndexX;
+	StartIndexY = argStartIndexY;
+
+	Texels.assign(LevelsAmount * Size * Size, 0.0f);
+	ScrolledX.assign(LevelsAmount, 0);
+	ScrolledY.assign(LevelsAmount, 0);
+	Spans.assign(LevelsAmount, std::vector<ClipmapSpan>());
+	DropStaged();
+
+	Refill();
+}
+
+// --------------------------------------------------------------------
+void ClipmapCache::Refill()
+{
+	for (int lvl = 0; lvl < LevelsAmount; ++lvl)
+		FillLevel(lvl);
+}
+
+// --------------------------------------------------------------------
+void ClipmapCache::FillLevel(int Level)
+{
+	GatherBlock(Level, 0, 0, Size, Size);
+
+	// Whole level goes up at once, the block spans are dropped
+	Spans[Level].assign(1, ClipmapSpan(0, Size * Size));
+	Stats.RefilledLevels++;
+}
+
+// --------------------------------------------------------------------
+void ClipmapCache::GetWindow(int Level, int &outFirstX, int &outFirstY, int &outTBOX, int &outTBOY) const
+{
+	outFirstX = GetFirstSample(Level, ScrolledX[Level], StartIndexX);
+	outFirstY = GetFirstSample(Level, ScrolledY[Level], StartIndexY);
+	outTBOX = WrapIndex(ScrolledX[Level], Size);
+	outTBOY = WrapIndex(ScrolledY[Level], Size);
+}
+
+// --------------------------------------------------------------------
+int ClipmapCache::GetFirstSample(int Level, int Scrolled, int StartIndex) const
+{
+	int ClipmapScale = 1 << Level;
+
+	// Reset() centers the windows on the start index, scrolling moves them by a texel a time
+	return StartIndex + ClipmapScale + ((Size + 1) / 2) * (ClipmapScale - 1) - Size * ClipmapScale + Scrolled * ClipmapScale;
+}
+
+// --------------------------------------------------------------------
+void ClipmapCache::GatherBlock(int Level, int Row, int Column, int Width, int Height)
+{
+	int ClipmapScale = 1 << Level;
+	int FirstX, FirstY, TBOX, TBOY;
+
+	GetWindow(Level, FirstX, FirstY, TBOX, TBOY);
+
+	float *Data = &Texels[Level * Size * Size];
+	ClipmapBlock *Block = 0;
+
+	if (!Staged.empty())
+		Block = TakeStaged(ClipmapBlock(Level, FirstX + Column * ClipmapScale, FirstY + Row * ClipmapScale, Width, Height));
+
+	for (int j = Row; j < Row + Height;)
+	{
+		int Y = WrapIndex(TBOY + j, Size);
+		int Rows = min(Row + Height - j, Size - Y);
+
+		for (int i = Column; i < Column + Width;)
+		{
+			int X = WrapIndex(TBOX + i, Size);
+			int Columns = min(Column + Width - i, Size - X);
+
+			if (Block != 0)
+			{
+				for (int r = 0; r < Rows; ++r)
+					memcpy(Data + (Y + r) * Size + X, &Block->Texels[(j - Row + r) * Width + i - Column], Columns * sizeof(float));
+
+				Stats.PrefetchedTexels += Columns * Rows;
+			}
+			else
+			{
+				Pyramid->GatherBlock(Level, FirstX + i * ClipmapScale, FirstY + j * ClipmapScale, Columns, Rows, Data + Y * Size + X, Size);
+				Stats.GatheredTexels += Columns * Rows;
+			}
+
+			Spans[Level].push_back(ClipmapSpan(Y * Size + X, (Rows - 1) * Size + Columns));
+			i += Columns;
+		}
+
+		j += Rows;
+	}
+
+	delete Block;
+}
+
+// --------------------------------------------------------------------
+int ClipmapCache::Scroll(float OffsetX, float OffsetY)
+{
+	int ClipmapScale = 1;
+	int lvl = 0;
+
+	for (; lvl < LevelsAmount; ++lvl)
+	{
+		int DiffX = GetScrollDiff(OffsetX, ScrolledX[lvl], ClipmapScale);
+		int DiffY = GetScrollDiff(OffsetY, ScrolledY[lvl], ClipmapScale);
+
+		// Coarser levels move even less
+		if (DiffX == 0 && DiffY == 0)
+			break;
+
+		ScrollLevel(lvl, DiffX, DiffY);
+		ClipmapScale *= 2;
+	}
+
+	return lvl;
+}
+
+// --------------------------------------------------------------------
+void ClipmapCache::GetLag(int Level, float OffsetX, float OffsetY, int &outDiffX, int &outDiffY) const
+{
+	outDiffX = GetScrollDiff(OffsetX, ScrolledX[Level], 1 << Level);
+	outDiffY = GetScrollDiff(OffsetY, ScrolledY[Level], 1 << Level);
+}
+
+// --------------------------------------------------------------------
+void ClipmapCache::ScrollLevel(int Level, int DiffX, int DiffY)
+{
+	ScrolledX[Level] += DiffX;
+	ScrolledY[Level] += DiffY;
+	Stats.ScrolledLevels++;
+
+	// Nothing stays in view, gather all of it
+	if (abs(DiffX) >= Size || abs(DiffY) >= Size)
+	{
+		FillLevel(Level);
+		return;
+	}
+
+	// The window moved, texels staying in view keep their array positions - only the rows and columns coming in are written,
+	// over the ones that went out
+	WindowBlock Blocks[2];
+	int BlocksAmount = GetIncomingBlocks(Size, DiffX, DiffY, Blocks);
+
+	for (int b = 0; b < BlocksAmount; ++b)
+		GatherBlock(Level, Blocks[b].Row, Blocks[b].Column, Blocks[b].Width, Blocks[b].Height);
+}
+
+// --------------------------------------------------------------------
+void ClipmapCache::Refresh(const std::vector<HeightmapRect> &Rects)
+{
+	if (Rects.empty())
+		return;
+
+	int MapSize = Pyramid->GetLevel(0)->GetSize();
+	std::vector<int> Columns;
+
+	DirtyTexels.resize(Size * Size, 0);
+	DirtyRows.resize(Size, 0);
+
+	for (int lvl = 0; lvl < LevelsAmount; ++lvl)
+	{
+		int ClipmapScale = 1 << lvl;
+		int FirstX, FirstY, TBOX, TBOY;
+
+		GetWindow(lvl, FirstX, FirstY, TBOX, TBOY);
+
+		for (unsigned int r = 0; r < Rects.size(); ++r)
+		{
+			// A texel of the level filters base samples up to ClipmapScale - 1 away from its own, rects grow by as much
+			const HeightmapRect &Rect = Rects[r];
+			int MinX = Rect.MinX - (ClipmapScale - 1), MaxX = Rect.MaxX + (ClipmapScale - 1);
+			int MinY = Rect.MinY - (ClipmapScale - 1), MaxY = Rect.MaxY + (ClipmapScale - 1);
+
+			Columns.clear();
+
+			for (int i = 0; i < Size; ++i)
+				if (IsInWrappedRange(FirstX + i * ClipmapScale, MinX, MaxX, MapSize))
+					Columns.push_back(i);
+
+			// The level's window may miss the edit while coarser ones still cover it
+			if (Columns.empty())
+				continue;
+
+			for (int j = 0; j < Size; ++j)
+			{
+				if (!IsInWrappedRange(FirstY + j * ClipmapScale, MinY, MaxY, MapSize))
+					continue;
+
+				unsigned char *Row = &DirtyTexels[j * Size];
+
+				for (unsigned int c = 0; c < Columns.size(); ++c)
+					Row[Columns[c]] = 1;
+
+				DirtyRows[j] = 1;
+			}
+		}
+
+		// Flagged runs of every window row, gathered straight into place. Flags are cleared on the way for the next level
+		for (int j = 0; j < Size; ++j)
+		{
+			if (!DirtyRows[j])
+				continue;
+
+			unsigned char *Row = &DirtyTexels[j * Size];
+			int i = 0;
+
+			while (i < Size)
+			{
+				if (!Row[i])
+				{
+					i++;
+					continue;
+				}
+
+				int RunStart = i++;
+
+				while (i < Size && Row[i])
+					i++;
+
+				GatherBlock(lvl, j, RunStart, i - RunStart, 1);
+				Stats.RefreshedTexels += i - RunStart;
+			}
+
+			memset(Row, 0, Size);
+			DirtyRows[j] = 0;
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+const std::vector<ClipmapSpan> & ClipmapCache::GetSpans(int Level)
+{
+	std::vector<ClipmapSpan> &LevelSpans = Spans[Level];
+
+	if (LevelSpans.size() < 2)
+		return LevelSpans;
+
+	std::sort(LevelSpans.begin(), LevelSpans.end());
+
+	// Overlapping and nearly touching spans become one
+	unsigned int Last = 0;
+
+	for (unsigned int i = 1; i < LevelSpans.size(); ++i)
+	{
+		ClipmapSpan &Merged = LevelSpans[Last];
+		int MergedEnd = Merged.Offset + Merged.Count;
+
+		if (LevelSpans[i].Offset <= MergedEnd + SpanMergeGap)
+			Merged.Count = max(MergedEnd, LevelSpans[i].Offset + LevelSpans[i].Count) - Merged.Offset;
+		else
+			LevelSpans[++Last] = LevelSpans[i];
+	}
+
+	LevelSpans.resize(Last + 1);
+
+	// Too many small ones, e.g. texels scattered by edits all over a big level
+	if (LevelSpans.size() > MaxSpansPerLevel)
+	{
+		int End = LevelSpans.back().Offset + LevelSpans.back().Count;
+
+		LevelSpans.resize(1);
+		LevelSpans[0].Count = End - LevelSpans[0].Offset;
+	}
+
+	return LevelSpans;
+}
+
+// --------------------------------------------------------------------
+void ClipmapCache::ClearSpans()
+{
+	for (unsigned int i = 0; i < Spans.size(); ++i)
+		Spans[i].clear();
+}
+
+// --------------------------------------------------------------------
+void ClipmapCache::PredictBlocks(const float *OffsetsX, const float *OffsetsY, int Amount, std::vector<ClipmapBlock> &outBlocks) const
+{
+	std::vector<int> PredictedX(ScrolledX), PredictedY(ScrolledY);
+	WindowBlock Blocks[2];
+
+	for (int f = 0; f < Amount; ++f)
+	{
+		// Same steps as Scroll(), on copies of the window positions
+		for (int lvl = 0, ClipmapScale = 1; lvl < LevelsAmount; ++lvl, ClipmapScale *= 2)
+		{
+			int DiffX = GetScrollDiff(OffsetsX[f], PredictedX[lvl], ClipmapScale);
+			int DiffY = GetScrollDiff(OffsetsY[f], PredictedY[lvl], ClipmapScale);
+
+			if (DiffX == 0 && DiffY == 0)
+				break;
+
+			PredictedX[lvl] += DiffX;
+			PredictedY[lvl] += DiffY;
+
+			int FirstX = GetFirstSample(lvl, PredictedX[lvl], StartIndexX);
+			int FirstY = GetFirstSample(lvl, PredictedY[lvl], StartIndexY);
+			int BlocksAmount = GetIncomingBlocks(Size, DiffX, DiffY, Blocks);
+
+			for (int b = 0; b < BlocksAmount; ++b)
+			{
+				ClipmapBlock Block(lvl, FirstX + Blocks[b].Column * ClipmapScale, FirstY + Blocks[b].Row * ClipmapScale, Blocks[b].Width, Blocks[b].Height);
+				bool bStaged = false;
+
+				for (unsigned int i = 0; i < Staged.size() && !bStaged; ++i)
+					bStaged = Staged[i]->IsSameArea(Block);
+
+				if (!bStaged)
+					outBlocks.push_back(Block);
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+void ClipmapCache::Stage(std::vector<ClipmapBlock*> &Blocks)
+{
+	for (unsigned int i = 0; i < Blocks.size(); ++i)
+		StagedTexels += Blocks[i]->Texels.size();
+
+	Staged.insert(Staged.end(), Blocks.begin(), Blocks.end());
+	Blocks.clear();
+
+	// Predictions the camera didn't follow
+	unsigned int Dropped = 0;
+
+	while (StagedTexels > MaxStagedTexels)
+	{
+		StagedTexels -= Staged[Dropped]->Texels.size();
+		delete Staged[Dropped++];
+	}
+
+	Staged.erase(Staged.begin(), Staged.begin() + Dropped);
+	Stats.DroppedBlocks += Dropped;
+}
+
+// --------------------------------------------------------------------
+ClipmapBlock * ClipmapCache::TakeStaged(const ClipmapBlock &Area)
+{
+	for (unsigned int i = 0; i < Staged.size(); ++i)
+	{
+		if (Staged[i]->IsSameArea(Area))
+		{
+			ClipmapBlock *Block = Staged[i];
+			Staged.erase(Staged.begin() + i);
+			StagedTexels -= Block->Texels.size();
+			return Block;
+		}
+	}
+
+	return 0;
+}
+
+// --------------------------------------------------------------------
+void ClipmapCache::DropStaged()
+{
+	for (unsigned int i = 0; i < Staged.size(); ++i)
+		delete Staged[i];
+
+	Stats.DroppedBlocks += Staged.size();
+	Staged.clear();
+	StagedTexels = 0;
+}
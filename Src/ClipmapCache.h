@@ -0,0 +1,160 @@
+#pragma once
+
+#include <vector>
+
+#include "HeightmapPyramid.h"
+
+/** Texels of a level written since the last upload - Count of them from Offset, in the level's toroidal array */
+struct ClipmapSpan
+{
+	int Offset;
+	int Count;
+
+	ClipmapSpan(): Offset(0), Count(0) {};
+	ClipmapSpan(int argOffset, int argCount): Offset(argOffset), Count(argCount) {};
+
+	bool operator< (const ClipmapSpan &other) const {return Offset < other.Offset;};
+};
+
+/** Texels of a level's window block gathered ahead of time - Width x Height of them from base sample (X, Y) on, row after row */
+struct ClipmapBlock
+{
+	int Level;
+	int X, Y;
+	int Width, Height;
+	std::vector<float> Texels;
+
+	ClipmapBlock(): Level(0), X(0), Y(0), Width(0), Height(0) {};
+	ClipmapBlock(int argLevel, int argX, int argY, int argWidth, int argHeight): Level(argLevel), X(argX), Y(argY), Width(argWidth), Height(argHeight) {};
+
+	bool IsSameArea(const ClipmapBlock &other) const {return Level == other.Level && X == other.X && Y == other.Y && Width == other.Width && Height == other.Height;};
+};
+
+/** Clipmap cache counters */
+struct ClipmapCacheStats
+{
+	unsigned long long GatheredTexels;
+	unsigned long long ScrolledLevels;
+	unsigned long long RefilledLevels;
+	unsigned long long RefreshedTexels;
+
+	/// Texels copied from staged blocks instead of gathered, and staged blocks dropped unused
+	unsigned long long PrefetchedTexels;
+	unsigned long long DroppedBlocks;
+
+	ClipmapCacheStats(): GatheredTexels(0), ScrolledLevels(0), RefilledLevels(0), RefreshedTexels(0), PrefetchedTexels(0), DroppedBlocks(0) {};
+};
+
+/** Clipmap levels around the camera, without any GL - every level is a Size x Size toroidal array of texels gathered from the height pyramid.
+	Windows follow the camera offset two texels at a time and keep their position as integer texel counts, so only the texels scrolling in are
+	gathered, a block of contiguous row segments at a time, and nothing else moves. Texels depending on edited samples are gathered again by Refresh().
+	Whatever got written is listed as spans of the arrays, which the renderer uploads as they are and clears.
+	Blocks scrolling in may be gathered ahead of time, see PredictBlocks() - staged ones are copied instead of gathered again */
+class ClipmapCache
+{
+public:
+	/// Spans at most this many texels apart are merged, resending the texels between them is cheaper than another upload
+	static const int SpanMergeGap = 64;
+
+	/// Levels left with more spans than this after merging go up as one span covering all of them
+	static const unsigned int MaxSpansPerLevel = 32;
+
+	/// Texels of staged blocks kept at most, the oldest blocks are dropped beyond that
+	static const unsigned int MaxStagedTexels = 1 << 20;
+
+protected:
+	const HeightmapPyramid *Pyramid;
+
+	/// Level edge length in texels, amount of levels and the base sample the clipmaps are centered on after Reset()
+	int Size;
+	int LevelsAmount;
+	int StartIndexX, StartIndexY;
+
+	/// Size * Size texels of every level, level after level
+	std::vector<float> Texels;
+
+	/// Texels every window has scrolled by since Reset(). Window texel (0, 0) sits at (ScrolledX, ScrolledY) modulo Size in the array
+	std::vector<int> ScrolledX;
+	std::vector<int> ScrolledY;
+
+	/// Texels written since the last ClearSpans(), per level
+	std::vector<std::vector<ClipmapSpan> > Spans;
+
+	/// Window texels and rows of the level Refresh() is at flagged for gathering, all cleared again once gathered
+	std::vector<unsigned char> DirtyTexels;
+	std::vector<unsigned char> DirtyRows;
+
+	/// Blocks gathered ahead of time, oldest first (owned), and their texels
+	std::vector<ClipmapBlock*> Staged;
+	unsigned int StagedTexels;
+
+	ClipmapCacheStats Stats;
+
+public:
+	ClipmapCache();
+	~ClipmapCache();
+
+	/// Levels of given size over the pyramid, windows centered on the start index. Every level is gathered whole
+	void Reset(const HeightmapPyramid *argPyramid, int argLevelsAmount, int argSize, int argStartIndexX, int argStartIndexY);
+
+	/// Gather every level again where it is, e.g. after most of the map changed
+	void Refill();
+
+	/// Follow the camera offset (in base samples from the start index) from the finest level up to the first one staying where it is.
+	/// Levels jumping by a whole window are gathered again. Returns the amount of levels scrolled
+	int Scroll(float OffsetX, float OffsetY);
+
+	/// Texels the level's window would move by to follow the camera offset, what Scroll() does to it. ClipmapScheduler scrolls level by level with them
+	void GetLag(int Level, float OffsetX, float OffsetY, int &outDiffX, int &outDiffY) const;
+
+	/// Move the level's window by whole texels and gather what comes into it
+	void ScrollLevel(int Level, int DiffX, int DiffY);
+
+	/// Gather again texels of every level depending on samples inside the rects
+	void Refresh(const std::vector<HeightmapRect> &Rects);
+
+	/// Base sample read by the first texel of the level's window, and where that texel sits in the level's array.
+	/// Window texel (i, j) is sample (outFirstX + i * 2^Level, outFirstY + j * 2^Level) at ((outTBOX + i) % Size, (outTBOY + j) % Size)
+	void GetWindow(int Level, int &outFirstX, int &outFirstY, int &outTBOX, int &outTBOY) const;
+
+	/// Spans of the level written since the last ClearSpans(), sorted and merged
+	const std::vector<ClipmapSpan> & GetSpans(int Level);
+
+	/// Forget the spans once uploaded
+	void ClearSpans();
+
+	/// Blocks the windows would gather scrolling through the offsets one after another, from where they are now. Staged ones are left out
+	void PredictBlocks(const float *OffsetsX, const float *OffsetsY, int Amount, std::vector<ClipmapBlock> &outBlocks) const;
+
+	/// Keep gathered blocks until a scroll needs them, taking them over
+	void Stage(std::vector<ClipmapBlock*> &Blocks);
+
+	/// Drop the staged blocks, e.g. once the heights they were gathered from changed
+	void DropStaged();
+
+	/// Getters
+	const float * GetTexels(int Level) const {return &Texels[Level * Size * Size];};
+	int GetSize() const {return Size;};
+	int GetLevelsAmount() const {return LevelsAmount;};
+	int GetScrolledX(int Level) const {return ScrolledX[Level];};
+	int GetScrolledY(int Level) const {return ScrolledY[Level];};
+	ClipmapCacheStats GetStats() const {return Stats;};
+
+protected:
+	/// Gather Width x Height texels of the window from (Column, Row) on - at most four blocks of the array, split where it wraps around.
+	/// Every block is listed as one span, from its first texel to its last one. Copied from a staged block of the same area if there is one
+	void GatherBlock(int Level, int Row, int Column, int Width, int Height);
+
+	/// Base sample read by the first window texel of the level along one axis, the window scrolled by Scrolled texels
+	int GetFirstSample(int Level, int Scrolled, int StartIndex) const;
+
+	/// Staged block of given area taken out of the list, or 0
+	ClipmapBlock * TakeStaged(const ClipmapBlock &Area);
+
+	/// Gather the whole level where its window is
+	void FillLevel(int Level);
+
+private:
+	ClipmapCache(const ClipmapCache &other);
+	ClipmapCache & operator= (const ClipmapCache &other);
+};
@@ -27,6 +27,10 @@ public:
 	void SetCameraOffsetX(float Value) {SetUniform("CameraOffsetX", Value);};
 	void SetCameraOffsetY(float Value) {SetUniform("CameraOffsetY", Value);};
 	void SetClipmapScale(int Value) {SetUniform("ClipmapScale", Value);};
+	void SetClipmapWindowX(int Value) {SetUniform("ClipmapWindowX", Value);};
+	void SetClipmapWindowY(int Value) {SetUniform("ClipmapWindowY", Value);};
+	void SetClipmapSampler(int Value) {SetUniform("ClipmapSampler", Value);};
+	void SetClipmapLevel(int Value) {SetUniform("ClipmapLevel", Value);};
 	void SetTextureSampler(int Value) {SetUniform("TextureSampler", Value);};
 
     /// Standard constructor
@@ -42,6 +46,17 @@ public:
 		Uniforms.insert(std::make_pair<std::string, GLuint>("CameraOffsetX", 0));
 		Uniforms.insert(std::make_pair<std::string, GLuint>("CameraOffsetY", 0));
 		Uniforms.insert(std::make_pair<std::string, GLuint>("ClipmapScale", 0));
+		Uniforms.insert(std::make_pair<std::string, GLuint>("ClipmapWindowX", 0));
+		Uniforms.insert(std::make_pair<std::string, GLuint>("ClipmapWindowY", 0));
 		Uniforms.insert(std::make_pair<std::string, GLuint>("TextureSampler", 0));
 	}
+
+	/// Switch to the uniforms of the texture array version, every level a layer of one GL_TEXTURE_2D_ARRAY instead of a TBO of its own.
+	/// Call before Initialize()
+	void UseTextureArray()
+	{
+		Uniforms.erase("TBOSampler");
+		Uniforms.insert(std::make_pair<std::string, GLuint>("ClipmapSampler", 0));
+		Uniforms.insert(std::make_pair<std::string, GLuint>("ClipmapLevel", 0));
+	}
 };
\ No newline at end of file
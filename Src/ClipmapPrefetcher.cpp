@@ -0,0 +1,138 @@
+#include "ClipmapPrefetcher.h"
+#include "LandscapeEditor.h"
+
+// --------------------------------------------------------------------
+ClipmapPrefetcher::ClipmapPrefetcher(const HeightmapPyramid *argPyramid, wxMutex &argPyramidLock):
+wxThread(wxTHREAD_JOINABLE), Pyramid(argPyramid), PyramidLock(argPyramidLock), WorkQueued(Lock), bBusy(false), Epoch(0), bStop(false)
+{
+}
+
+// --------------------------------------------------------------------
+ClipmapPrefetcher::~ClipmapPrefetcher()
+{
+	for (unsigned int i = 0; i < Ready.size(); ++i)
+		delete Ready[i];
+}
+
+// --------------------------------------------------------------------
+bool ClipmapPrefetcher::Start()
+{
+	return Create() == wxTHREAD_NO_ERROR && Run() == wxTHREAD_NO_ERROR;
+}
+
+// --------------------------------------------------------------------
+void ClipmapPrefetcher::Stop()
+{
+	{
+		wxMutexLocker Locker(Lock);
+
+		bStop = true;
+		WorkQueued.Signal();
+	}
+
+	Wait();
+}
+
+// --------------------------------------------------------------------
+void ClipmapPrefetcher::Request(const std::vector<ClipmapBlock> &Blocks)
+{
+	wxMutexLocker Locker(Lock);
+
+	// Older predictions the camera may have turned away from are dropped
+	Requests.clear();
+
+	for (unsigned int i = 0; i < Blocks.size(); ++i)
+	{
+		bool bGathered = bBusy && Current.IsSameArea(Blocks[i]);
+
+		for (unsigned int r = 0; r < Ready.size() && !bGathered; ++r)
+			bGathered = Ready[r]->IsSameArea(Blocks[i]);
+
+		if (!bGathered)
+			Requests.push_back(Blocks[i]);
+	}
+
+	Stats.BlocksRequested += Requests.size();
+
+	if (!Requests.empty())
+		WorkQueued.Signal();
+}
+
+// --------------------------------------------------------------------
+wxThread::ExitCode ClipmapPrefetcher::Entry()
+{
+	for (;;)
+	{
+		ClipmapBlock *Block = 0;
+		unsigned int BlockEpoch;
+
+		{
+			wxMutexLocker Locker(Lock);
+
+			while (Requests.empty() && !bStop)
+				WorkQueued.Wait();
+
+			if (bStop)
+				return 0;
+
+			Current = Requests.front();
+			Requests.pop_front();
+			bBusy = true;
+
+			Block = new ClipmapBlock(Current);
+			BlockEpoch = Epoch;
+		}
+
+		Block->Texels.resize(Block->Width * Block->Height);
+
+		// One block at a time, the render thread waits for the lock at most that long
+		{
+			wxMutexLocker Locker(PyramidLock);
+			Pyramid->GatherBlock(Block->Level, Block->X, Block->Y, Block->Width, Block->Height, &Block->Texels[0], Block->Width);
+		}
+
+		wxMutexLocker Locker(Lock);
+		bBusy = false;
+
+		if (BlockEpoch != Epoch)
+		{
+			Stats.BlocksDiscarded++;
+			delete Block;
+			continue;
+		}
+
+		Ready.push_back(Block);
+		Stats.BlocksGathered++;
+		Stats.TexelsGathered += Block->Texels.size();
+	}
+}
+
+// --------------------------------------------------------------------
+void ClipmapPrefetcher::Collect(std::vector<ClipmapBlock*> &outBlocks)
+{
+	wxMutexLocker Locker(Lock);
+
+	outBlocks.insert(outBlocks.end(), Ready.begin(), Ready.end());
+	Ready.clear();
+}
+
+// --------------------------------------------------------------------
+void ClipmapPrefetcher::Invalidate()
+{
+	wxMutexLocker Locker(Lock);
+
+	for (unsigned int i = 0; i < Ready.size(); ++i)
+		delete Ready[i];
+
+	Stats.BlocksDiscarded += Ready.size();
+	Ready.clear();
+	Requests.clear();
+	Epoch++;
+}
+
+// --------------------------------------------------------------------
+ClipmapPrefetchStats ClipmapPrefetcher::GetStats()
+{
+	wxMutexLocker Locker(Lock);
+	return Stats;
+}
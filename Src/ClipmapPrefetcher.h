@@ -0,0 +1,87 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "wx/thread.h"
+
+#include "ClipmapCache.h"
+#include "HeightmapPyramid.h"
+
+/** Prefetcher counters */
+struct ClipmapPrefetchStats
+{
+	unsigned long long BlocksRequested;
+	unsigned long long BlocksGathered;
+	unsigned long long TexelsGathered;
+
+	/// Blocks gathered from heights changed meanwhile, thrown away
+	unsigned long long BlocksDiscarded;
+
+	ClipmapPrefetchStats(): BlocksRequested(0), BlocksGathered(0), TexelsGathered(0), BlocksDiscarded(0) {};
+};
+
+/** Gathers clipmap blocks the camera is about to scroll in on its own thread, so fast flights don't pile whole rows and columns of every
+	level onto the frames the levels shift on. The render thread requests blocks predicted from the camera velocity (ClipmapCache::PredictBlocks())
+	every frame and stages the gathered ones in its cache before scrolling, which then copies instead of gathering.
+	The pyramid filters its mips lazily and isn't safe to read from two threads - the worker holds PyramidLock for every block it gathers,
+	the render thread has to hold it around everything else touching the pyramid. Base heights may change under the worker's feet though,
+	Invalidate() drops whatever was gathered before a change */
+class ClipmapPrefetcher : public wxThread
+{
+public:
+	/// Frames of camera movement predicted ahead
+	static const int FramesAhead = 4;
+
+protected:
+	const HeightmapPyramid *Pyramid;
+	wxMutex &PyramidLock;
+
+	/// Guards everything below
+	wxMutex Lock;
+
+	/// Signalled when blocks are requested or the worker should stop
+	wxCondition WorkQueued;
+
+	/// Blocks waiting for the worker in the order predicted, the one it gathers now and gathered ones not collected yet
+	std::deque<ClipmapBlock> Requests;
+	ClipmapBlock Current;
+	bool bBusy;
+	std::vector<ClipmapBlock*> Ready;
+
+	/// Bumped by Invalidate(), blocks started before are thrown away
+	unsigned int Epoch;
+	bool bStop;
+
+	ClipmapPrefetchStats Stats;
+
+	/// Worker thread loop
+	virtual ExitCode Entry();
+
+public:
+	/// Prefetcher reading the pyramid under argPyramidLock. Start() runs the thread
+	ClipmapPrefetcher(const HeightmapPyramid *argPyramid, wxMutex &argPyramidLock);
+	~ClipmapPrefetcher();
+
+	/// Run the thread, false if it can't be created
+	bool Start();
+
+	/// Stop the thread, dropping requests. Call before deleting the prefetcher or the pyramid
+	void Stop();
+
+	/// Replace pending requests with these blocks, in order. Ones gathered or being gathered already aren't requested again
+	void Request(const std::vector<ClipmapBlock> &Blocks);
+
+	/// Take the gathered blocks over
+	void Collect(std::vector<ClipmapBlock*> &outBlocks);
+
+	/// Drop requests and gathered blocks, the heights changed
+	void Invalidate();
+
+	/// Getters
+	ClipmapPrefetchStats GetStats();
+
+private:
+	ClipmapPrefetcher(const ClipmapPrefetcher &other);
+	ClipmapPrefetcher & operator= (const ClipmapPrefetcher &other);
+};
@@ -0,0 +1,106 @@
+#include <stdlib.h>
+
+#include "ClipmapScheduler.h"
+#include "Log.h"
+#include "Timer.h"
+
+/// Seconds per texel assumed before the first level is timed
+static const double InitialTexelTime = 5e-9;
+
+// --------------------------------------------------------------------
+static unsigned int GetIncomingTexels(int Size, int DiffX, int DiffY)
+{
+	int NewRows = abs(DiffY);
+	int NewColumns = abs(DiffX);
+
+	// Same blocks ClipmapCache::ScrollLevel() gathers
+	if (NewRows >= Size || NewColumns >= Size)
+		return Size * Size;
+
+	return NewRows * Size + NewColumns * (Size - NewRows);
+}
+
+// --------------------------------------------------------------------
+ClipmapScheduler::ClipmapScheduler():
+LevelsAmount(0), Size(0), Budget(0.0), MaxLagTexels(2), DrawnLevels(0), TexelTime(InitialTexelTime)
+{
+}
+
+// --------------------------------------------------------------------
+void ClipmapScheduler::Reset(int argLevelsAmount, int argSize, double argBudget)
+{
+	LevelsAmount = argLevelsAmount;
+	Size = argSize;
+	Budget = argBudget;
+	DrawnLevels = LevelsAmount;
+
+	// Half the rim - the inner half of a lagging level's ring, next to the finer level, always reads texels it has
+	MaxLagTexels = max((Size - 5) / 8, 2);
+
+	LagFrames.assign(LevelsAmount, 0);
+	Stats = ClipmapSchedulerStats();
+}
+
+// --------------------------------------------------------------------
+void ClipmapScheduler::Update(ClipmapCache &Cache, float OffsetX, float OffsetY)
+{
+	double Start = GetTime();
+
+	Stats.FrameLevels = 0;
+	Stats.BacklogLevels = 0;
+	Stats.BacklogTexels = 0;
+	DrawnLevels = LevelsAmount;
+
+	for (int lvl = 0; lvl < LevelsAmount; ++lvl)
+	{
+		int DiffX, DiffY;
+		Cache.GetLag(lvl, OffsetX, OffsetY, DiffX, DiffY);
+
+		// Coarser levels may still lag, unlike Scroll() this doesn't stop here
+		if (DiffX == 0 && DiffY == 0)
+		{
+			LagFrames[lvl] = 0;
+			continue;
+		}
+
+		unsigned int Texels = GetIncomingTexels(Size, DiffX, DiffY);
+		double Elapsed = GetTime() - Start;
+
+		bool bFits = Budget <= 0.0 || Stats.FrameLevels == 0 || Elapsed + Texels * TexelTime <= Budget;
+
+		// Reads clamped to the window would stretch too much of the ring, the level goes over budget rather than lag further
+		bool bTooFar = max(abs(DiffX), abs(DiffY)) > MaxLagTexels;
+		bool bForced = !bFits && (LagFrames[lvl] >= MaxLagFrames || (bTooFar && Elapsed + Texels * TexelTime <= Budget * MaxOverBudget));
+
+		if (bFits || bForced)
+		{
+			double LevelStart = GetTime();
+			Cache.ScrollLevel(lvl, DiffX, DiffY);
+
+			TexelTime = TexelTime * 0.75 + (GetTime() - LevelStart) / Texels * 0.25;
+			LagFrames[lvl] = 0;
+			Stats.FrameLevels++;
+
+			if (bForced)
+				Stats.ForcedLevels++;
+
+			continue;
+		}
+
+		LagFrames[lvl]++;
+		Stats.MaxLagFrames = max(Stats.MaxLagFrames, LagFrames[lvl]);
+		Stats.DeferredLevels++;
+		Stats.BacklogLevels++;
+		Stats.BacklogTexels += Texels;
+
+		// Last resort, the frame is far over budget already - coarser levels would be drawn around a hole, they go too
+		if (bTooFar)
+			DrawnLevels = min(DrawnLevels, lvl);
+	}
+
+	Stats.FrameTime = GetTime() - Start;
+	Stats.MaxFrameTime = max(Stats.MaxFrameTime, Stats.FrameTime);
+	Stats.TotalTime += Stats.FrameTime;
+	Stats.MaxBacklogTexels = max(Stats.MaxBacklogTexels, Stats.BacklogTexels);
+	Stats.HiddenLevels += LevelsAmount - DrawnLevels;
+}
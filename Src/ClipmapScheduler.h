@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+
+#include "ClipmapCache.h"
+
+/** Scheduler counters - this frame's, and since Reset() */
+struct ClipmapSchedulerStats
+{
+	/// Seconds spent scrolling levels this frame, the longest frame and all of them
+	double FrameTime;
+	double MaxFrameTime;
+	double TotalTime;
+
+	/// Levels scrolled this frame
+	unsigned int FrameLevels;
+
+	/// Levels left behind the camera after this frame, and the texels they'd gather to catch up
+	unsigned int BacklogLevels;
+	unsigned long long BacklogTexels;
+	unsigned long long MaxBacklogTexels;
+
+	/// Level updates put off to a later frame, and ones done over budget since the level lagged MaxLagFrames or GetMaxLagTexels() already
+	unsigned long long DeferredLevels;
+	unsigned long long ForcedLevels;
+
+	/// Levels not drawn, summed over frames - the last resort when forced updates didn't fit MaxOverBudget budgets
+	unsigned long long HiddenLevels;
+
+	/// Most frames in a row a level lagged behind
+	unsigned int MaxLagFrames;
+
+	ClipmapSchedulerStats(): FrameTime(0.0), MaxFrameTime(0.0), TotalTime(0.0), FrameLevels(0), BacklogLevels(0), BacklogTexels(0), MaxBacklogTexels(0),
+		DeferredLevels(0), ForcedLevels(0), HiddenLevels(0), MaxLagFrames(0) {};
+};
+
+/** Scrolls clipmap levels within a time budget per frame, finest first. A level whose estimated gather doesn't fit into what's left of the
+	frame waits for a later one, so jumps refilling whole levels spread over several frames. The finest level needing it and the first one of
+	every frame go regardless, and so does a level lagging MaxLagFrames - the lag is bounded in frames.
+	The shaders clamp texel reads to each level's window (its ScrolledX/Y), so a lagging level is still drawn, stretching its outermost texels
+	over the part it hasn't gathered yet. A level about to lag more than GetMaxLagTexels() texels is updated over budget too, as long as the
+	frame stays within MaxOverBudget budgets. Only past that it isn't drawn, and neither are coarser ones - the terrain then ends earlier until
+	it catches up */
+class ClipmapScheduler
+{
+public:
+	/// Frames a level may be put off for in a row
+	static const unsigned int MaxLagFrames = 8;
+
+	/// Budgets a frame may take updating levels lagging too many texels, before they are hidden instead
+	static const unsigned int MaxOverBudget = 4;
+
+protected:
+	int LevelsAmount;
+	int Size;
+
+	/// Seconds per frame, 0 for no limit
+	double Budget;
+
+	/// Texels a level may lag behind before it's updated over budget
+	int MaxLagTexels;
+
+	/// Frames every level has been put off for in a row
+	std::vector<unsigned int> LagFrames;
+
+	/// Levels drawn after the last update, all of them unless one lagging too far couldn't be updated
+	int DrawnLevels;
+
+	/// Running estimate of seconds per texel gathered
+	double TexelTime;
+
+	ClipmapSchedulerStats Stats;
+
+public:
+	ClipmapScheduler();
+
+	/// Schedule levels of a cache just reset to given levels and size, with Budget seconds per frame (0 for no limit)
+	void Reset(int argLevelsAmount, int argSize, double argBudget);
+
+	/// Scroll the cache's levels towards the camera offset, as many as fit into the budget
+	void Update(ClipmapCache &Cache, float OffsetX, float OffsetY);
+
+	/// Getters
+	int GetDrawnLevels() const {return DrawnLevels;};
+	int GetMaxLagTexels() const {return MaxLagTexels;};
+	double GetBudget() const {return Budget;};
+	const ClipmapSchedulerStats & GetStats() const {return Stats;};
+
+private:
+	ClipmapScheduler(const ClipmapScheduler &other);
+	ClipmapScheduler & operator= (const ClipmapScheduler &other);
+};
@@ -0,0 +1,379 @@
+#include <map>
+#include <string.h>
+
+#include "EditWorker.h"
+#include "LandscapeEditor.h"
+
+/** Queued stamps with their own copies of the mask shapes they point at, and the tiles they need the worker doesn't hold yet */
+struct EditBatch
+{
+	std::vector<BrushStamp> Stamps;
+	std::vector<BrushMaskShape*> Shapes;
+
+	/// Tiles copied from the front map, whole with aprons. The worker takes them over, 0 once it did
+	std::vector<unsigned int> TileIndices;
+	std::vector<float*> Tiles;
+
+	~EditBatch()
+	{
+		for (unsigned int i = 0; i < Shapes.size(); ++i)
+			delete Shapes[i];
+
+		for (unsigned int i = 0; i < Tiles.size(); ++i)
+			delete [] Tiles[i];
+	};
+};
+
+/** Storage of the worker's map - tiles copied from the front map wait here until the map faults them in. Only tiles handed over are
+	ever touched and the map never evicts, so nothing needs storing back */
+class EditTileStorage : public HeightmapStorage
+{
+protected:
+	unsigned int TileFloats;
+	std::map<unsigned int, float*> Tiles;
+
+public:
+	EditTileStorage(unsigned int TileStride): TileFloats(TileStride * TileStride) {};
+	~EditTileStorage() {Clear();};
+
+	/// Take over a copied tile
+	void Add(unsigned int TileIndex, float *Data)
+	{
+		float *&Slot = Tiles[TileIndex];
+
+		delete [] Slot;
+		Slot = Data;
+	};
+
+	/// Drop the tiles never faulted in
+	void Clear()
+	{
+		for (std::map<unsigned int, float*>::iterator it = Tiles.begin(); it != Tiles.end(); ++it)
+			delete [] it->second;
+
+		Tiles.clear();
+	};
+
+	bool LoadTile(unsigned int TileIndex, float *Data)
+	{
+		std::map<unsigned int, float*>::iterator Found = Tiles.find(TileIndex);
+
+		if (Found == Tiles.end())
+			return false;
+
+		memcpy(Data, Found->second, TileFloats * sizeof(float));
+		delete [] Found->second;
+		Tiles.erase(Found);
+
+		return true;
+	};
+
+	bool StoreTile(unsigned int TileIndex, const float *Data) {return true;};
+};
+
+// --------------------------------------------------------------------
+EditWorker::EditWorker(Heightmap *argFront, unsigned long long MemoryBudget):
+wxThread(wxTHREAD_JOINABLE), Front(argFront), WorkHeights(0), Seeds(0), HeldTilesAmount(0), MaxHeldTiles(0), bQueuedSincePublish(false),
+WorkQueued(Lock), WorkDone(Lock), bBusy(false), bStop(false)
+{
+	const unsigned int TilesPerRow = Front->GetTilesPerRow();
+	const unsigned int TileBytes = Front->GetTileStride() * Front->GetTileStride() * sizeof(float);
+
+	// Same tiling as the rendered map, so the kernels walk both the same way. Budget of every tile - the worker's map never evicts,
+	// the amount of tiles is bounded by the releases
+	Seeds = new EditTileStorage(Front->GetTileStride());
+	WorkHeights = new Heightmap(Front->GetSize(), Seeds, (unsigned long long)TilesPerRow * TilesPerRow * TileBytes, Front->GetTileSize());
+
+	HeldTiles.assign(TilesPerRow * TilesPerRow, false);
+	MaxHeldTiles = (unsigned int)min(MemoryBudget / TileBytes, (unsigned long long)TilesPerRow * TilesPerRow);
+}
+
+// --------------------------------------------------------------------
+EditWorker::~EditWorker()
+{
+	for (unsigned int i = 0; i < Batches.size(); ++i)
+		delete Batches[i];
+
+	for (unsigned int i = 0; i < Patches.size(); ++i)
+		delete Patches[i];
+
+	delete WorkHeights;
+}
+
+// --------------------------------------------------------------------
+bool EditWorker::Start()
+{
+	return Create() == wxTHREAD_NO_ERROR && Run() == wxTHREAD_NO_ERROR;
+}
+
+// --------------------------------------------------------------------
+void EditWorker::Stop()
+{
+	{
+		wxMutexLocker Locker(Lock);
+
+		bStop = true;
+		WorkQueued.Signal();
+	}
+
+	Wait();
+}
+
+// --------------------------------------------------------------------
+void EditWorker::Queue(const BrushStamp *Stamps, unsigned int Amount)
+{
+	if (Amount == 0)
+		return;
+
+	// Copied before taking the lock, the worker may be busy with the previous batch meanwhile
+	EditBatch *Batch = new EditBatch;
+	std::map<const BrushMaskShape*, BrushMaskShape*> Copies;
+
+	Batch->Stamps.assign(Stamps, Stamps + Amount);
+
+	for (unsigned int i = 0; i < Amount; ++i)
+	{
+		if (Stamps[i].Shape == 0)
+			continue;
+
+		std::map<const BrushMaskShape*, BrushMaskShape*>::iterator Found = Copies.find(Stamps[i].Shape);
+
+		if (Found == Copies.end())
+		{
+			Found = Copies.insert(std::make_pair(Stamps[i].Shape, new BrushMaskShape(*Stamps[i].Shape))).first;
+			Batch->Shapes.push_back(Found->second);
+		}
+
+		Batch->Stamps[i].Shape = Found->second;
+	}
+
+	CopyBackTiles(*Batch);
+	bQueuedSincePublish = true;
+
+	wxMutexLocker Locker(Lock);
+
+	Batches.push_back(Batch);
+	Stats.BatchesQueued++;
+	Stats.MaxQueuedBatches = max(Stats.MaxQueuedBatches, (unsigned int)Batches.size());
+	Stats.TilesCopied += Batch->TileIndices.size();
+	Stats.MaxBackTiles = max(Stats.MaxBackTiles, HeldTilesAmount);
+
+	WorkQueued.Signal();
+}
+
+// --------------------------------------------------------------------
+wxThread::ExitCode EditWorker::Entry()
+{
+	for (;;)
+	{
+		EditBatch *Batch = 0;
+
+		{
+			wxMutexLocker Locker(Lock);
+
+			while (Batches.empty() && !bStop)
+				WorkQueued.Wait();
+
+			if (bStop)
+				return 0;
+
+			Batch = Batches.front();
+			Batches.pop_front();
+			bBusy = true;
+		}
+
+		// Tiles handed over go to the storage the worker's map faults them in from
+		for (unsigned int i = 0; i < Batch->TileIndices.size(); ++i)
+		{
+			Seeds->Add(Batch->TileIndices[i], Batch->Tiles[i]);
+			Batch->Tiles[i] = 0;
+		}
+
+		// Kernels run unlocked - queueing and publishing only wait for the list operations
+		std::vector<EditPatch*> Applied;
+		ApplyBatch(*Batch, Applied);
+
+		wxMutexLocker Locker(Lock);
+
+		for (unsigned int i = 0; i < Applied.size(); ++i)
+			Stats.SamplesPublished += Applied[i]->Samples.size();
+
+		Patches.insert(Patches.end(), Applied.begin(), Applied.end());
+		Stats.BatchesApplied++;
+		Stats.StampsApplied += Batch->Stamps.size();
+		Stats.PatchesPublished += Applied.size();
+		bBusy = false;
+
+		delete Batch;
+		WorkDone.Broadcast();
+	}
+}
+
+// --------------------------------------------------------------------
+void EditWorker::ApplyBatch(const EditBatch &Batch, std::vector<EditPatch*> &outPatches)
+{
+	const unsigned int Size = WorkHeights->GetSize();
+
+	BrushKernel::Apply(WorkHeights, &Batch.Stamps[0], Batch.Stamps.size());
+
+	// Footprints of a stroke overlap, merged ones are copied out once
+	HeightmapChangeTracker Footprints;
+
+	for (unsigned int i = 0; i < Batch.Stamps.size(); ++i)
+		Footprints.MarkDirty(BrushKernel::GetFootprint(Batch.Stamps[i], Size));
+
+	const std::vector<HeightmapRect> &Rects = Footprints.GetDirtyRects();
+
+	for (unsigned int i = 0; i < Rects.size(); ++i)
+	{
+		EditPatch *Patch = new EditPatch;
+		const int Width = Rects[i].GetWidth();
+
+		// Kernels never read aprons, the worker's map leaves them be - the front map gets its own refreshed
+		Patch->Rect = Rects[i];
+		Patch->Samples.resize(Width * Rects[i].GetHeight());
+
+		for (int y = 0; y < Rects[i].GetHeight(); ++y)
+			WorkHeights->GatherRow(Rects[i].MinX, Rects[i].MinY + y, 1, Width, &Patch->Samples[y * Width]);
+
+		outPatches.push_back(Patch);
+	}
+}
+
+// --------------------------------------------------------------------
+void EditWorker::CopyBackTiles(EditBatch &Batch)
+{
+	const int Size = Front->GetSize();
+	const int Shift = Front->GetTileShift();
+	const unsigned int TilesPerRow = Front->GetTilesPerRow();
+	const unsigned int TileStride = Front->GetTileStride();
+
+	for (unsigned int i = 0; i < Batch.Stamps.size(); ++i)
+	{
+		// Samples the stamp reads - its footprint, grown by the window for blur and flatten stamps
+		const BrushStamp &Stamp = Batch.Stamps[i];
+		HeightmapRect Read = BrushKernel::GetFootprint(Stamp, Size);
+
+		if (Read.IsEmpty())
+			continue;
+
+		if (BrushKernel::IsFilter(Stamp.Mode))
+		{
+			const int Extent = BrushKernel::GetFilterExtent(Stamp);
+			Read = HeightmapRect(max(Read.MinX - Extent, 0), max(Read.MinY - Extent, 0), min(Read.MaxX + Extent, Size), min(Read.MaxY + Extent, Size));
+		}
+
+		for (int TileY = Read.MinY >> Shift; TileY <= (Read.MaxY - 1) >> Shift; ++TileY)
+		{
+			for (int TileX = Read.MinX >> Shift; TileX <= (Read.MaxX - 1) >> Shift; ++TileX)
+			{
+				const unsigned int TileIndex = TileY * TilesPerRow + TileX;
+
+				if (HeldTiles[TileIndex])
+					continue;
+
+				// Whole tile with its aprons, the way the worker's map stores it
+				float *Tile = new float[TileStride * TileStride];
+				memcpy(Tile, Front->ReadTile(TileX, TileY) - Heightmap::Apron * (TileStride + 1), TileStride * TileStride * sizeof(float));
+
+				Batch.TileIndices.push_back(TileIndex);
+				Batch.Tiles.push_back(Tile);
+
+				HeldTiles[TileIndex] = true;
+				HeldTilesAmount++;
+			}
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+void EditWorker::ReleaseBackTiles()
+{
+	if (HeldTilesAmount == 0)
+		return;
+
+	// Nothing runs on the worker thread meanwhile - the queue is empty and only this thread fills it
+	WorkHeights->Discard(HeightmapRect(0, 0, Front->GetSize(), Front->GetSize()));
+	Seeds->Clear();
+
+	HeldTiles.assign(HeldTiles.size(), false);
+	HeldTilesAmount = 0;
+
+	wxMutexLocker Locker(Lock);
+	Stats.Releases++;
+}
+
+// --------------------------------------------------------------------
+bool EditWorker::Publish(HeightmapChangeTracker &Changes)
+{
+	// Over the budget the worker is waited for, so its tiles can be released below
+	if (HeldTilesAmount > MaxHeldTiles)
+		Finish();
+
+	std::vector<EditPatch*> Published;
+	bool bIdle;
+
+	{
+		wxMutexLocker Locker(Lock);
+		Published.swap(Patches);
+		bIdle = Batches.empty() && !bBusy;
+	}
+
+	for (unsigned int i = 0; i < Published.size(); ++i)
+	{
+		const EditPatch &Patch = *Published[i];
+		const int Width = Patch.Rect.GetWidth();
+
+		for (int y = 0; y < Patch.Rect.GetHeight(); ++y)
+			Front->ScatterRow(Patch.Rect.MinX, Patch.Rect.MinY + y, Width, &Patch.Samples[y * Width]);
+
+		Front->UpdateAprons(Patch.Rect);
+		Changes.MarkDirty(Patch.Rect);
+
+		delete Published[i];
+	}
+
+	// Idle with everything published, the back tiles hold what the front map does. Kept while the stroke goes on, so its next
+	// batches don't copy them again
+	if (bIdle && (!bQueuedSincePublish || HeldTilesAmount > MaxHeldTiles))
+		ReleaseBackTiles();
+
+	bQueuedSincePublish = false;
+
+	return !Published.empty();
+}
+
+// --------------------------------------------------------------------
+void EditWorker::Finish()
+{
+	wxMutexLocker Locker(Lock);
+
+	while (!Batches.empty() || bBusy)
+		WorkDone.Wait();
+}
+
+// --------------------------------------------------------------------
+void EditWorker::Sync()
+{
+	Finish();
+
+	// Patches not published by now predate the change, the front map has the heights to keep
+	{
+		wxMutexLocker Locker(Lock);
+
+		for (unsigned int i = 0; i < Patches.size(); ++i)
+			delete Patches[i];
+
+		Patches.clear();
+	}
+
+	// The worker is idle and the queue empty, tiles copied from now on see the change
+	ReleaseBackTiles();
+}
+
+// --------------------------------------------------------------------
+EditWorkerStats EditWorker::GetStats()
+{
+	wxMutexLocker Locker(Lock);
+	return Stats;
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+#include "wx/thread.h"
+
+#include "BrushKernel.h"
+#include "Heightmap.h"
+#include "HeightmapChanges.h"
+
+/** Samples of one rect changed by a batch, as the worker's map has them once the batch is applied */
+struct EditPatch
+{
+	HeightmapRect Rect;
+	std::vector<float> Samples;
+};
+
+/** Worker counters */
+struct EditWorkerStats
+{
+	unsigned long long BatchesQueued;
+	unsigned long long BatchesApplied;
+	unsigned long long StampsApplied;
+	unsigned long long PatchesPublished;
+	unsigned long long SamplesPublished;
+	unsigned int MaxQueuedBatches;
+
+	/// Tiles copied from the front map to the worker, how many it held at most and how many times they were released
+	unsigned long long TilesCopied;
+	unsigned int MaxBackTiles;
+	unsigned long long Releases;
+
+	EditWorkerStats(): BatchesQueued(0), BatchesApplied(0), StampsApplied(0), PatchesPublished(0), SamplesPublished(0), MaxQueuedBatches(0),
+		TilesCopied(0), MaxBackTiles(0), Releases(0) {};
+};
+
+struct EditBatch;
+class EditTileStorage;
+
+/** Applies stamp batches on its own thread, so heavy brushes don't hold up the frames. The rendered map (the front buffer) is only
+	written by Publish() on the UI thread, which copies in the samples every finished batch changed. The worker edits its own copies
+	of just the tiles the batches read (the back buffer) - Queue() copies tiles the worker doesn't hold yet from the front map and hands
+	them over with the batch, so front maps may be resident or paged alike. Once the worker is idle and everything is published the back
+	tiles hold nothing the front map doesn't, they are released when a stroke pauses or they outgrow the budget.
+	Queue() and Publish() touch the front map - call them under the lock guarding its other readers. Edits made around the worker
+	call Finish() first and Sync() afterwards */
+class EditWorker : public wxThread
+{
+protected:
+	/// The rendered map, touched on the UI thread only
+	Heightmap *Front;
+
+	/// The worker's map - paged over Seeds, so only tiles handed over are ever in memory. Touched by the worker thread only while it runs
+	Heightmap *WorkHeights;
+	EditTileStorage *Seeds;
+
+	/// Tiles handed to the worker since the last release, their amount and the most kept before publishing waits for a release.
+	/// UI thread only
+	std::vector<bool> HeldTiles;
+	unsigned int HeldTilesAmount;
+	unsigned int MaxHeldTiles;
+
+	/// A batch was queued since the last Publish(), the stroke goes on. UI thread only
+	bool bQueuedSincePublish;
+
+	/// Guards everything below
+	wxMutex Lock;
+
+	/// Signalled when a batch is queued or the worker should stop, and when a batch is done
+	wxCondition WorkQueued;
+	wxCondition WorkDone;
+
+	/// Batches waiting for the worker, oldest first
+	std::deque<EditBatch*> Batches;
+
+	/// Patches of applied batches not published yet, in order
+	std::vector<EditPatch*> Patches;
+
+	/// True while the worker applies a batch taken off the queue
+	bool bBusy;
+	bool bStop;
+
+	EditWorkerStats Stats;
+
+	/// Worker thread loop
+	virtual ExitCode Entry();
+
+	/// Apply the batch to WorkHeights and return patches of the rects it changed
+	void ApplyBatch(const EditBatch &Batch, std::vector<EditPatch*> &outPatches);
+
+	/// Copy tiles the stamps read, and the worker doesn't hold yet, from the front map into the batch
+	void CopyBackTiles(EditBatch &Batch);
+
+	/// Drop all back tiles, the worker has to be idle with every patch published
+	void ReleaseBackTiles();
+
+public:
+	/// Worker editing Front, keeping at most about MemoryBudget bytes of back tiles. Start() runs the thread
+	EditWorker(Heightmap *argFront, unsigned long long MemoryBudget);
+	~EditWorker();
+
+	/// Run the thread, false if it can't be created
+	bool Start();
+
+	/// Stop the thread, dropping batches not applied yet. Call before deleting the worker
+	void Stop();
+
+	/// Queue a batch. Mask shapes the stamps point at are copied, the cache may drop them right away. Reads the front map
+	void Queue(const BrushStamp *Stamps, unsigned int Amount);
+
+	/// Copy published patches into the front map, refresh its aprons and mark the rects dirty. UI thread only, returns false if there were none.
+	/// Waits for the worker when it holds more back tiles than the budget
+	bool Publish(HeightmapChangeTracker &Changes);
+
+	/// Wait until every queued batch is applied. Publish() afterwards brings the rendered map up to date
+	void Finish();
+
+	/// Forget the back tiles after the front map was changed around the worker, e.g. eroded. Waits for the queue first, patches not
+	/// published by then are dropped
+	void Sync();
+
+	/// Getters
+	EditWorkerStats GetStats();
+
+private:
+	EditWorker(const EditWorker &other);
+	EditWorker & operator= (const EditWorker &other);
+};
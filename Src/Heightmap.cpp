@@ -0,0 +1,642 @@
+#include <string.h>
+#include <vector>
+
+#include "Heightmap.h"
+#include "Log.h"
+
+// --------------------------------------------------------------------
+Heightmap::Heightmap(unsigned int argSize, unsigned int argTileSize):
+Tiles(0), Storage(0), LRUPrev(0), LRUNext(0), LRUHead(-1), LRUTail(-1), TileDirty(0), TilePins(0)
+{
+	Initialize(argSize, argTileSize);
+
+	const int TilesAmount = TilesPerRow * TilesPerRow;
+
+	// Committing the pages of a large map takes a while, tiles are allocated and zeroed in parallel
+	#pragma omp parallel for schedule(static)
+	for (int i = 0; i < TilesAmount; ++i)
+	{
+		Tiles[i] = new float[TileStride * TileStride];
+		memset(Tiles[i], 0, TileStride * TileStride * sizeof(float));
+	}
+
+	Stats.ResidentTiles = Stats.MaxResidentTiles = TilesPerRow * TilesPerRow;
+}
+
+// --------------------------------------------------------------------
+Heightmap::Heightmap(unsigned int argSize, HeightmapStorage *argStorage, unsigned long long MemoryBudget, unsigned int argTileSize):
+Tiles(0), Storage(argStorage), LRUPrev(0), LRUNext(0), LRUHead(-1), LRUTail(-1), TileDirty(0), TilePins(0)
+{
+	Initialize(argSize, argTileSize);
+
+	unsigned long long BudgetTiles = MemoryBudget / (TileStride * TileStride * sizeof(float));
+
+	if (BudgetTiles < MinResidentTiles)
+		BudgetTiles = MinResidentTiles;
+
+	InitializePaging((BudgetTiles < TilesPerRow * TilesPerRow) ? (unsigned int)BudgetTiles : TilesPerRow * TilesPerRow);
+}
+
+// --------------------------------------------------------------------
+void Heightmap::Initialize(unsigned int argSize, unsigned int argTileSize)
+{
+	Size = argSize;
+	SizeMask = ((Size & (Size - 1)) == 0) ? (Size - 1) : (0);
+	TileShift = 0;
+
+	while ((1u << TileShift) < argTileSize)
+		TileShift++;
+
+	// Tile size has to be a power of two, round it up if it isn't
+	TileSize = 1 << TileShift;
+	TileStride = TileSize + 2 * Apron;
+	TilesPerRow = (Size + TileSize - 1) / TileSize;
+
+	Tiles = new float*[TilesPerRow * TilesPerRow];
+	memset(Tiles, 0, TilesPerRow * TilesPerRow * sizeof(float*));
+}
+
+// --------------------------------------------------------------------
+void Heightmap::InitializePaging(unsigned int MaxResidentTiles)
+{
+	const unsigned int TilesAmount = TilesPerRow * TilesPerRow;
+
+	Stats.MaxResidentTiles = MaxResidentTiles;
+
+	LRUPrev = new int[TilesAmount];
+	LRUNext = new int[TilesAmount];
+	TileDirty = new bool[TilesAmount];
+	TilePins = new unsigned short[TilesAmount];
+
+	for (unsigned int i = 0; i < TilesAmount; ++i)
+	{
+		LRUPrev[i] = LRUNext[i] = -1;
+		TileDirty[i] = false;
+		TilePins[i] = 0;
+
+		if (Tiles[i] != 0)
+			LinkFront(i);
+	}
+}
+
+// --------------------------------------------------------------------
+Heightmap::~Heightmap()
+{
+	if (Storage != 0)
+	{
+		if (!Flush())
+			ERR("Failed to write back " << Stats.WriteFailures << " heightmap tiles");
+
+		delete Storage;
+	}
+
+	for (unsigned int i = 0; i < TilesPerRow * TilesPerRow; ++i)
+		delete [] Tiles[i];
+
+	delete [] Tiles;
+	delete [] LRUPrev;
+	delete [] LRUNext;
+	delete [] TileDirty;
+	delete [] TilePins;
+}
+
+// --------------------------------------------------------------------
+void Heightmap::LinkFront(int TileIndex) const
+{
+	LRUPrev[TileIndex] = -1;
+	LRUNext[TileIndex] = LRUHead;
+
+	if (LRUHead != -1)
+		LRUPrev[LRUHead] = TileIndex;
+	else
+		LRUTail = TileIndex;
+
+	LRUHead = TileIndex;
+}
+
+// --------------------------------------------------------------------
+void Heightmap::Unlink(int TileIndex) const
+{
+	if (LRUPrev[TileIndex] != -1)
+		LRUNext[LRUPrev[TileIndex]] = LRUNext[TileIndex];
+	else
+		LRUHead = LRUNext[TileIndex];
+
+	if (LRUNext[TileIndex] != -1)
+		LRUPrev[LRUNext[TileIndex]] = LRUPrev[TileIndex];
+	else
+		LRUTail = LRUPrev[TileIndex];
+
+	LRUPrev[TileIndex] = LRUNext[TileIndex] = -1;
+}
+
+// --------------------------------------------------------------------
+float * Heightmap::PageIn(unsigned int TileIndex) const
+{
+	if (Tiles[TileIndex] != 0)
+	{
+		Stats.Hits++;
+
+		if (LRUHead != int(TileIndex))
+		{
+			Unlink(TileIndex);
+			LinkFront(TileIndex);
+		}
+
+		return Tiles[TileIndex];
+	}
+
+	Stats.Misses++;
+
+	float *Tile = 0;
+
+	if (Stats.ResidentTiles >= Stats.MaxResidentTiles)
+		Tile = EvictTile();
+
+	// Nothing could be evicted (all pinned or write back failed) - go over the budget rather than lose data
+	if (Tile == 0)
+	{
+		Tile = new float[TileStride * TileStride];
+		Stats.ResidentTiles++;
+	}
+
+	if (!Storage->LoadTile(TileIndex, Tile))
+		memset(Tile, 0, TileStride * TileStride * sizeof(float));
+
+	Tiles[TileIndex] = Tile;
+	TileDirty[TileIndex] = false;
+	LinkFront(TileIndex);
+
+	return Tile;
+}
+
+// --------------------------------------------------------------------
+float * Heightmap::EvictTile() const
+{
+	for (int i = LRUTail; i != -1; i = LRUPrev[i])
+	{
+		if (TilePins[i] != 0)
+			continue;
+
+		if (TileDirty[i])
+		{
+			if (!Storage->StoreTile(i, Tiles[i]))
+			{
+				Stats.WriteFailures++;
+				continue;
+			}
+
+			Stats.WriteBacks++;
+			TileDirty[i] = false;
+		}
+
+		float *Tile = Tiles[i];
+
+		Unlink(i);
+		Tiles[i] = 0;
+		Stats.Evictions++;
+
+		return Tile;
+	}
+
+	return 0;
+}
+
+// --------------------------------------------------------------------
+void Heightmap::PinTile(unsigned int TileX, unsigned int TileY) const
+{
+	if (Storage == 0)
+		return;
+
+	unsigned int TileIndex = TileY * TilesPerRow + TileX;
+
+	PageIn(TileIndex);
+	TilePins[TileIndex]++;
+}
+
+// --------------------------------------------------------------------
+void Heightmap::UnpinTile(unsigned int TileX, unsigned int TileY) const
+{
+	if (Storage == 0)
+		return;
+
+	unsigned int TileIndex = TileY * TilesPerRow + TileX;
+
+	if (TilePins[TileIndex] > 0)
+		TilePins[TileIndex]--;
+}
+
+// --------------------------------------------------------------------
+bool Heightmap::Flush()
+{
+	if (Storage == 0)
+		return true;
+
+	bool bResult = true;
+	std::vector<unsigned int> Batch;
+	std::vector<const float*> BatchData;
+
+	for (int i = LRUHead; ; i = LRUNext[i])
+	{
+		if (i != -1 && TileDirty[i])
+		{
+			Batch.push_back(i);
+			BatchData.push_back(Tiles[i]);
+		}
+
+		// Dirty tiles go to the storage in batches, so it can encode them in parallel
+		if (Batch.size() == BatchSize || (i == -1 && !Batch.empty()))
+		{
+			if (Storage->StoreTiles(Batch.size(), &Batch[0], &BatchData[0]))
+			{
+				for (unsigned int b = 0; b < Batch.size(); ++b)
+					TileDirty[Batch[b]] = false;
+
+				Stats.WriteBacks += Batch.size();
+			}
+			else
+			{
+				Stats.WriteFailures += Batch.size();
+				bResult = false;
+			}
+
+			Batch.clear();
+			BatchData.clear();
+		}
+
+		if (i == -1)
+			break;
+	}
+
+	return Storage->Sync() && bResult;
+}
+
+// --------------------------------------------------------------------
+bool Heightmap::SaveAs(HeightmapStorage *Target)
+{
+	const unsigned int TilesAmount = TilesPerRow * TilesPerRow;
+
+	float *Buffers = new float[BatchSize * TileStride * TileStride];
+	unsigned int Batch[BatchSize], Missing[BatchSize];
+	const float *BatchData[BatchSize];
+	float *MissingData[BatchSize];
+	bool bLoaded[BatchSize];
+	bool bResult = true;
+
+	for (unsigned int First = 0; First < TilesAmount && bResult; First += BatchSize)
+	{
+		unsigned int Amount = (TilesAmount - First < BatchSize) ? (TilesAmount - First) : (BatchSize);
+		unsigned int MissingAmount = 0;
+
+		for (unsigned int b = 0; b < Amount; ++b)
+		{
+			Batch[b] = First + b;
+			BatchData[b] = Tiles[First + b];
+
+			// Tiles not resident are copied straight from the old storage, without disturbing the LRU
+			if (BatchData[b] == 0)
+			{
+				Missing[MissingAmount] = First + b;
+				MissingData[MissingAmount] = Buffers + MissingAmount * TileStride * TileStride;
+				BatchData[b] = MissingData[MissingAmount++];
+			}
+		}
+
+		if (MissingAmount > 0)
+		{
+			Storage->LoadTiles(MissingAmount, Missing, MissingData, bLoaded);
+
+			for (unsigned int m = 0; m < MissingAmount; ++m)
+				if (!bLoaded[m])
+					memset(MissingData[m], 0, TileStride * TileStride * sizeof(float));
+		}
+
+		bResult = Target->StoreTiles(Amount, Batch, BatchData);
+	}
+
+	delete [] Buffers;
+
+	return bResult && Target->Sync();
+}
+
+// --------------------------------------------------------------------
+void Heightmap::Prefetch(const HeightmapRect &Rect)
+{
+	if (Storage == 0 || Rect.IsEmpty())
+		return;
+
+	std::vector<bool> ColumnsTouched, RowsTouched;
+	std::vector<unsigned int> Batch;
+
+	GetTouchedTiles(Rect, 0, ColumnsTouched, RowsTouched);
+
+	// Never prefetch more than fits, tiles of the same batch must not evict each other
+	for (unsigned int TileY = 0; TileY < TilesPerRow; ++TileY)
+		for (unsigned int TileX = 0; TileX < TilesPerRow && Batch.size() < Stats.MaxResidentTiles; ++TileX)
+			if (RowsTouched[TileY] && ColumnsTouched[TileX] && Tiles[TileY * TilesPerRow + TileX] == 0)
+				Batch.push_back(TileY * TilesPerRow + TileX);
+
+	for (unsigned int First = 0; First < Batch.size(); First += BatchSize)
+	{
+		unsigned int Amount = (Batch.size() - First < BatchSize) ? (Batch.size() - First) : (BatchSize);
+		float *BatchData[BatchSize];
+		bool bLoaded[BatchSize];
+
+		for (unsigned int b = 0; b < Amount; ++b)
+		{
+			BatchData[b] = (Stats.ResidentTiles >= Stats.MaxResidentTiles) ? (EvictTile()) : (0);
+
+			if (BatchData[b] == 0)
+			{
+				BatchData[b] = new float[TileStride * TileStride];
+				Stats.ResidentTiles++;
+			}
+		}
+
+		Storage->LoadTiles(Amount, &Batch[First], BatchData, bLoaded);
+
+		for (unsigned int b = 0; b < Amount; ++b)
+		{
+			if (!bLoaded[b])
+				memset(BatchData[b], 0, TileStride * TileStride * sizeof(float));
+
+			Tiles[Batch[First + b]] = BatchData[b];
+			TileDirty[Batch[First + b]] = false;
+			LinkFront(Batch[First + b]);
+			Stats.Misses++;
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+void Heightmap::Discard(const HeightmapRect &Rect)
+{
+	if (Storage == 0 || Rect.IsEmpty())
+		return;
+
+	std::vector<bool> ColumnsTouched, RowsTouched;
+
+	GetTouchedTiles(Rect, Apron, ColumnsTouched, RowsTouched);
+
+	for (unsigned int TileY = 0; TileY < TilesPerRow; ++TileY)
+	{
+		if (!RowsTouched[TileY])
+			continue;
+
+		for (unsigned int TileX = 0; TileX < TilesPerRow; ++TileX)
+		{
+			unsigned int TileIndex = TileY * TilesPerRow + TileX;
+
+			if (!ColumnsTouched[TileX] || Tiles[TileIndex] == 0 || TilePins[TileIndex] != 0)
+				continue;
+
+			Unlink(TileIndex);
+			delete [] Tiles[TileIndex];
+
+			Tiles[TileIndex] = 0;
+			TileDirty[TileIndex] = false;
+			Stats.ResidentTiles--;
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+void Heightmap::GetTouchedTiles(const HeightmapRect &Rect, int Margin, std::vector<bool> &outColumns, std::vector<bool> &outRows) const
+{
+	outColumns.assign(TilesPerRow, false);
+	outRows.assign(TilesPerRow, false);
+
+	for (int x = Rect.MinX - Margin, Covered = 0; x < Rect.MaxX + Margin && Covered < int(Size);)
+	{
+		int Wrapped = Wrap(x);
+		unsigned int TileX = Wrapped >> TileShift;
+		int Advance = GetTileExtent(TileX) - (Wrapped - TileX * TileSize);
+
+		outColumns[TileX] = true;
+		x += Advance;
+		Covered += Advance;
+	}
+
+	for (int y = Rect.MinY - Margin, Covered = 0; y < Rect.MaxY + Margin && Covered < int(Size);)
+	{
+		int Wrapped = Wrap(y);
+		unsigned int TileY = Wrapped >> TileShift;
+		int Advance = GetTileExtent(TileY) - (Wrapped - TileY * TileSize);
+
+		outRows[TileY] = true;
+		y += Advance;
+		Covered += Advance;
+	}
+}
+
+// --------------------------------------------------------------------
+void Heightmap::GatherRow(int X, int Y, int Step, int Count, float *Out) const
+{
+	Y = Wrap(Y);
+	X = Wrap(X);
+
+	const unsigned int TileY = Y >> TileShift;
+	const unsigned int RowOffset = ((Y & (TileSize - 1)) + Apron) * TileStride + Apron;
+
+	while (Count > 0)
+	{
+		unsigned int TileX = X >> TileShift;
+		int LocalX = X & (TileSize - 1);
+		const float *Src = AcquireTile(TileY * TilesPerRow + TileX) + RowOffset + LocalX;
+
+		// Samples which can be taken from this tile before crossing its edge
+		int Amount = (int(GetTileExtent(TileX)) - LocalX + Step - 1) / Step;
+		if (Amount > Count)
+			Amount = Count;
+
+		if (Step == 1)
+		{
+			memcpy(Out, Src, Amount * sizeof(float));
+		}
+		else
+		{
+			for (int i = 0; i < Amount; ++i)
+				Out[i] = Src[i * Step];
+		}
+
+		Out += Amount;
+		Count -= Amount;
+		X = Wrap(X + Amount * Step);
+	}
+}
+
+// --------------------------------------------------------------------
+void Heightmap::ScatterRow(int X, int Y, int Count, const float *In)
+{
+	Y = Wrap(Y);
+	X = Wrap(X);
+
+	const unsigned int TileY = Y >> TileShift;
+	const unsigned int RowOffset = ((Y & (TileSize - 1)) + Apron) * TileStride + Apron;
+
+	while (Count > 0)
+	{
+		unsigned int TileX = X >> TileShift;
+		int LocalX = X & (TileSize - 1);
+		int Amount = min(int(GetTileExtent(TileX)) - LocalX, Count);
+
+		memcpy(AcquireTileForWrite(TileY * TilesPerRow + TileX) + RowOffset + LocalX, In, Amount * sizeof(float));
+
+		In += Amount;
+		Count -= Amount;
+		X = Wrap(X + Amount);
+	}
+}
+
+// --------------------------------------------------------------------
+void Heightmap::GatherColumn(int X, int Y, int Step, int Count, float *Out, int OutStride) const
+{
+	X = Wrap(X);
+	Y = Wrap(Y);
+
+	const unsigned int TileX = X >> TileShift;
+	const unsigned int ColumnOffset = (X & (TileSize - 1)) + Apron;
+	const int SrcStep = Step * TileStride;
+
+	while (Count > 0)
+	{
+		unsigned int TileY = Y >> TileShift;
+		int LocalY = Y & (TileSize - 1);
+		const float *Src = AcquireTile(TileY * TilesPerRow + TileX) + (LocalY + Apron) * TileStride + ColumnOffset;
+
+		int Amount = (int(GetTileExtent(TileY)) - LocalY + Step - 1) / Step;
+		if (Amount > Count)
+			Amount = Count;
+
+		for (int i = 0; i < Amount; ++i)
+		{
+			*Out = *Src;
+			Out += OutStride;
+			Src += SrcStep;
+		}
+
+		Count -= Amount;
+		Y = Wrap(Y + Amount * Step);
+	}
+}
+
+// --------------------------------------------------------------------
+void Heightmap::GatherBlock(int X, int Y, int Step, int Width, int Height, float *Out, int OutStride) const
+{
+	X = Wrap(X);
+	Y = Wrap(Y);
+
+	// Tile by tile - every tile is acquired once for all the block's rows it holds
+	while (Height > 0)
+	{
+		unsigned int TileY = Y >> TileShift;
+		int LocalY = Y & (TileSize - 1);
+
+		int Rows = (int(GetTileExtent(TileY)) - LocalY + Step - 1) / Step;
+		if (Rows > Height)
+			Rows = Height;
+
+		int ColumnX = X;
+		int Count = Width;
+		float *Column = Out;
+
+		while (Count > 0)
+		{
+			unsigned int TileX = ColumnX >> TileShift;
+			int LocalX = ColumnX & (TileSize - 1);
+			const float *Src = AcquireTile(TileY * TilesPerRow + TileX) + (LocalY + Apron) * TileStride + LocalX + Apron;
+
+			int Amount = (int(GetTileExtent(TileX)) - LocalX + Step - 1) / Step;
+			if (Amount > Count)
+				Amount = Count;
+
+			for (int j = 0; j < Rows; ++j)
+			{
+				const float *SrcRow = Src + j * Step * TileStride;
+				float *OutRow = Column + j * OutStride;
+
+				// Narrow blocks, like the columns a clipmap scrolls in, are cheaper copied by hand than through memcpy calls
+				if (Step == 1 && Amount >= 8)
+				{
+					memcpy(OutRow, SrcRow, Amount * sizeof(float));
+				}
+				else
+				{
+					for (int i = 0; i < Amount; ++i)
+						OutRow[i] = SrcRow[i * Step];
+				}
+			}
+
+			Column += Amount;
+			Count -= Amount;
+			ColumnX = Wrap(ColumnX + Amount * Step);
+		}
+
+		Out += Rows * OutStride;
+		Height -= Rows;
+		Y = Wrap(Y + Rows * Step);
+	}
+}
+
+// --------------------------------------------------------------------
+void Heightmap::UpdateTileApron(unsigned int TileX, unsigned int TileY)
+{
+	// Neighbour reads below may page other tiles in - keep this one resident meanwhile
+	PinTile(TileX, TileY);
+
+	float *Tile = AcquireTileForWrite(TileY * TilesPerRow + TileX);
+	int ExtentX = GetTileExtent(TileX);
+	int ExtentY = GetTileExtent(TileY);
+	int StartX = TileX * TileSize;
+	int StartY = TileY * TileSize;
+
+	for (int i = -1; i <= ExtentX; ++i)
+	{
+		Tile[i + Apron] = Get(StartX + i, StartY - 1);
+		Tile[(ExtentY + Apron) * TileStride + i + Apron] = Get(StartX + i, StartY + ExtentY);
+	}
+
+	for (int j = 0; j < ExtentY; ++j)
+	{
+		Tile[(j + Apron) * TileStride] = Get(StartX - 1, StartY + j);
+		Tile[(j + Apron) * TileStride + ExtentX + Apron] = Get(StartX + ExtentX, StartY + j);
+	}
+
+	UnpinTile(TileX, TileY);
+}
+
+// --------------------------------------------------------------------
+void Heightmap::UpdateAprons(const HeightmapRect &Rect)
+{
+	if (Rect.IsEmpty())
+		return;
+
+	if (Rect.GetWidth() + 2 * int(Apron) >= int(Size) && Rect.GetHeight() + 2 * int(Apron) >= int(Size))
+	{
+		UpdateAllAprons();
+		return;
+	}
+
+	// Changed samples lying on a tile border are also present in the neighbours' aprons
+	std::vector<bool> ColumnsTouched, RowsTouched;
+
+	GetTouchedTiles(Rect, Apron, ColumnsTouched, RowsTouched);
+
+	for (unsigned int TileY = 0; TileY < TilesPerRow; ++TileY)
+	{
+		if (!RowsTouched[TileY])
+			continue;
+
+		for (unsigned int TileX = 0; TileX < TilesPerRow; ++TileX)
+			if (ColumnsTouched[TileX])
+				UpdateTileApron(TileX, TileY);
+	}
+}
+
+// --------------------------------------------------------------------
+void Heightmap::UpdateAllAprons()
+{
+	for (unsigned int TileY = 0; TileY < TilesPerRow; ++TileY)
+		for (unsigned int TileX = 0; TileX < TilesPerRow; ++TileX)
+			UpdateTileApron(TileX, TileY);
+}
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <vector>
+
+#include "HeightmapStorage.h"
+
+/** Rectangle of heightmap samples, max coordinates exclusive. May exceed the map - wraps around */
+struct HeightmapRect
+{
+	int MinX, MinY;
+	int MaxX, MaxY;
+
+	HeightmapRect(): MinX(0), MinY(0), MaxX(0), MaxY(0) {};
+	HeightmapRect(int argMinX, int argMinY, int argMaxX, int argMaxY): MinX(argMinX), MinY(argMinY), MaxX(argMaxX), MaxY(argMaxY) {};
+
+	bool IsEmpty() const {return MaxX <= MinX || MaxY <= MinY;};
+	int GetWidth() const {return MaxX - MinX;};
+	int GetHeight() const {return MaxY - MinY;};
+};
+
+/** Tile paging counters */
+struct HeightmapPagingStats
+{
+	unsigned long long Hits;
+	unsigned long long Misses;
+	unsigned long long Evictions;
+	unsigned long long WriteBacks;
+	unsigned long long WriteFailures;
+	unsigned int ResidentTiles;
+	unsigned int MaxResidentTiles;
+
+	HeightmapPagingStats(): Hits(0), Misses(0), Evictions(0), WriteBacks(0), WriteFailures(0), ResidentTiles(0), MaxResidentTiles(0) {};
+};
+
+/** Square, toroidally wrapped heightmap stored in fixed size tiles with apron borders.
+	Either fully resident, or paged - tiles are faulted in from HeightmapStorage on first touch
+	and the least recently used ones are written back and evicted when over the memory budget */
+class Heightmap
+{
+public:
+	/// Default tile edge length in samples, without aprons
+	static const unsigned int DefaultTileSize = 64;
+
+	/// Amount of samples copied from neighbouring tiles around every tile
+	static const unsigned int Apron = 1;
+
+	/// Tiles which always fit in the budget, so pinned tile and its neighbours can be resident at once
+	static const unsigned int MinResidentTiles = 16;
+
+	/// Tiles handed to the storage at once when saving or prefetching
+	static const unsigned int BatchSize = 256;
+
+protected:
+	/// Heightmap edge length in samples
+	unsigned int Size;
+
+	/// Size - 1 when Size is a power of two, 0 otherwise
+	unsigned int SizeMask;
+
+	/// Tile edge length in samples (power of two) and its log2
+	unsigned int TileSize;
+	unsigned int TileShift;
+
+	/// Tile row length in memory, TileSize + 2 * Apron
+	unsigned int TileStride;
+
+	/// Amount of tiles in one row of the map, last one may be partially used
+	unsigned int TilesPerRow;
+
+	/// Tiles data, row-major, every tile is TileStride * TileStride floats. 0 for tiles not resident
+	mutable float **Tiles;
+
+	/// Backing store of paged heightmaps, 0 when the whole map is kept in memory
+	HeightmapStorage *Storage;
+
+	/// LRU list of resident tiles (head = most recently used), -1 terminated
+	mutable int *LRUPrev;
+	mutable int *LRUNext;
+	mutable int LRUHead, LRUTail;
+
+	/// Per tile dirty flags and pin counters
+	mutable bool *TileDirty;
+	mutable unsigned short *TilePins;
+
+	mutable HeightmapPagingStats Stats;
+
+public:
+	/// Fully resident heightmap, zeroed
+	Heightmap(unsigned int argSize, unsigned int argTileSize = DefaultTileSize);
+
+	/// Paged heightmap keeping at most MemoryBudget bytes of tiles in memory. Takes ownership of the storage
+	Heightmap(unsigned int argSize, HeightmapStorage *argStorage, unsigned long long MemoryBudget, unsigned int argTileSize = DefaultTileSize);
+
+	/// Writes back dirty tiles of paged heightmaps
+	~Heightmap();
+
+	/// Wrap any coordinate into <0, Size)
+	int Wrap(int Coord) const
+	{
+		if (SizeMask)
+			return Coord & SizeMask;
+
+		Coord %= (int)Size;
+		return (Coord < 0) ? (Coord + Size) : (Coord);
+	};
+
+	/// Single sample access, coordinates are wrapped
+	float Get(int X, int Y) const
+	{
+		X = Wrap(X);
+		Y = Wrap(Y);
+		return AcquireTile((Y >> TileShift) * TilesPerRow + (X >> TileShift))[((Y & (TileSize - 1)) + Apron) * TileStride + (X & (TileSize - 1)) + Apron];
+	};
+
+	/// Single sample write, coordinates are wrapped. Aprons are not refreshed, call UpdateAprons() afterwards
+	void Set(int X, int Y, float Value)
+	{
+		X = Wrap(X);
+		Y = Wrap(Y);
+		AcquireTileForWrite((Y >> TileShift) * TilesPerRow + (X >> TileShift))[((Y & (TileSize - 1)) + Apron) * TileStride + (X & (TileSize - 1)) + Apron] = Value;
+	};
+
+	/// Read Count samples of row Y starting at X, every Step samples, into Out
+	void GatherRow(int X, int Y, int Step, int Count, float *Out) const;
+
+	/// Read Count samples of column X starting at Y, every Step samples, into Out (OutStride floats apart)
+	void GatherColumn(int X, int Y, int Step, int Count, float *Out, int OutStride = 1) const;
+
+	/// Read Width x Height samples starting at (X, Y), every Step samples both ways, into Out (rows OutStride floats apart)
+	void GatherBlock(int X, int Y, int Step, int Width, int Height, float *Out, int OutStride) const;
+
+	/// Write Count consecutive samples of row Y starting at X. Aprons are not refreshed, call UpdateAprons() afterwards
+	void ScatterRow(int X, int Y, int Count, const float *In);
+
+	/// Refresh apron copies of all tiles touching given rect
+	void UpdateAprons(const HeightmapRect &Rect);
+	void UpdateAllAprons();
+
+	/// Pointer to the first (non-apron) sample of given tile. Valid until another tile of a paged map is touched
+	const float * ReadTile(unsigned int TileX, unsigned int TileY) const {return AcquireTile(TileY * TilesPerRow + TileX) + Apron * TileStride + Apron;};
+	float * WriteTile(unsigned int TileX, unsigned int TileY) {return AcquireTileForWrite(TileY * TilesPerRow + TileX) + Apron * TileStride + Apron;};
+
+	/// Pinned tiles of paged maps are never evicted
+	void PinTile(unsigned int TileX, unsigned int TileY) const;
+	void UnpinTile(unsigned int TileX, unsigned int TileY) const;
+
+	/// Write back all dirty tiles and sync the storage, return false if any of them failed
+	bool Flush();
+
+	/// Write every tile, dirty ones included, to Target and sync it. The map keeps its own storage (if any), Target stays the caller's
+	bool SaveAs(HeightmapStorage *Target);
+
+	/// Fault in all tiles touching Rect (as many as the budget allows) with one batched, possibly parallel, storage read
+	void Prefetch(const HeightmapRect &Rect);
+
+	/// Drop resident tiles holding samples of Rect (aprons included) without writing them back, so they get loaded
+	/// from the storage again. For paged maps over derived storages only, pinned tiles are kept
+	void Discard(const HeightmapRect &Rect);
+
+	/// Tile columns and rows holding samples of Rect or Margin samples around it
+	void GetTouchedTiles(const HeightmapRect &Rect, int Margin, std::vector<bool> &outColumns, std::vector<bool> &outRows) const;
+
+	/// True if given tile is in memory - always for maps not paged
+	bool IsTileResident(unsigned int TileX, unsigned int TileY) const {return Tiles[TileY * TilesPerRow + TileX] != 0;};
+
+	/// Amount of valid samples in given tile column/row (less than TileSize for the last, partial tiles)
+	unsigned int GetTileExtent(unsigned int TileIndex) const {return (TileIndex + 1 < TilesPerRow) ? (TileSize) : (Size - TileIndex * TileSize);};
+
+	/// Getters
+	unsigned int GetSize() const {return Size;};
+	unsigned int GetTileSize() const {return TileSize;};
+	unsigned int GetTileShift() const {return TileShift;};
+	unsigned int GetTileStride() const {return TileStride;};
+	unsigned int GetTilesPerRow() const {return TilesPerRow;};
+	bool IsPaged() const {return Storage != 0;};
+	HeightmapStorage * GetStorage() const {return Storage;};
+	HeightmapPagingStats GetPagingStats() const {return Stats;};
+
+	/// Largest height error of the stored (e.g. quantized) version of given tile
+	float GetTileError(unsigned int TileX, unsigned int TileY) const {return (Storage != 0) ? (Storage->GetTileError(TileY * TilesPerRow + TileX)) : (0.0f);};
+
+protected:
+	/// Returns whole tile (with aprons), faulting it in if needed
+	const float * AcquireTile(unsigned int TileIndex) const
+	{
+		if (Storage == 0)
+			return Tiles[TileIndex];
+
+		return PageIn(TileIndex);
+	};
+
+	float * AcquireTileForWrite(unsigned int TileIndex)
+	{
+		if (Storage == 0)
+			return Tiles[TileIndex];
+
+		float *Tile = PageIn(TileIndex);
+		TileDirty[TileIndex] = true;
+		return Tile;
+	};
+
+	/// Paging internals
+	float * PageIn(unsigned int TileIndex) const;
+	float * EvictTile() const;
+	void LinkFront(int TileIndex) const;
+	void Unlink(int TileIndex) const;
+
+private:
+	/// Not copyable
+	Heightmap(const Heightmap &other);
+	Heightmap & operator= (const Heightmap &other);
+
+	void Initialize(unsigned int argSize, unsigned int argTileSize);
+	void InitializePaging(unsigned int MaxResidentTiles);
+	void UpdateTileApron(unsigned int TileX, unsigned int TileY);
+};
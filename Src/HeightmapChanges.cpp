@@ -0,0 +1,73 @@
+#include "HeightmapChanges.h"
+#include "Log.h"
+
+const float HeightmapChangeTracker::MergeSlack = 0.25f;
+
+// --------------------------------------------------------------------
+static double RectArea(const HeightmapRect &Rect)
+{
+	return double(Rect.GetWidth()) * double(Rect.GetHeight());
+}
+
+// --------------------------------------------------------------------
+void HeightmapChangeTracker::AddConsumer(DerivedHeightData *Consumer)
+{
+	Consumers.push_back(Consumer);
+}
+
+// --------------------------------------------------------------------
+void HeightmapChangeTracker::MarkDirty(const HeightmapRect &Rect)
+{
+	if (Rect.IsEmpty())
+		return;
+
+	HeightmapRect Merged = Rect;
+	bool bMerged = true;
+
+	Stats.MarkedRects++;
+
+	// Joining two rects may make the result worth joining with another one, repeat until nothing changes
+	while (bMerged)
+	{
+		bMerged = false;
+
+		for (unsigned int i = 0; i < DirtyRects.size(); ++i)
+		{
+			const HeightmapRect &Other = DirtyRects[i];
+			HeightmapRect Union(min(Merged.MinX, Other.MinX), min(Merged.MinY, Other.MinY), max(Merged.MaxX, Other.MaxX), max(Merged.MaxY, Other.MaxY));
+
+			if (RectArea(Union) <= (RectArea(Merged) + RectArea(Other)) * (1.0 + MergeSlack))
+			{
+				Merged = Union;
+				DirtyRects.erase(DirtyRects.begin() + i);
+				bMerged = true;
+				break;
+			}
+		}
+	}
+
+	DirtyRects.push_back(Merged);
+}
+
+// --------------------------------------------------------------------
+void HeightmapChangeTracker::Propagate(std::vector<HeightmapRect> *outRects)
+{
+	if (DirtyRects.empty())
+		return;
+
+	for (unsigned int r = 0; r < DirtyRects.size(); ++r)
+	{
+		for (unsigned int c = 0; c < Consumers.size(); ++c)
+			Consumers[c]->Update(DirtyRects[r]);
+
+		Stats.PropagatedSamples += (unsigned long long)RectArea(DirtyRects[r]);
+	}
+
+	if (outRects != 0)
+		outRects->insert(outRects->end(), DirtyRects.begin(), DirtyRects.end());
+
+	Stats.PropagatedRects += DirtyRects.size();
+	Stats.Propagations++;
+
+	DirtyRects.clear();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <vector>
+
+#include "Heightmap.h"
+
+/** Data computed from heightmap samples (mips, bounds...), kept up to date by recomputing only what edits changed */
+class DerivedHeightData
+{
+public:
+	virtual ~DerivedHeightData() {};
+
+	/// Recompute everything depending on heightmap samples inside Rect (map coordinates, may wrap)
+	virtual void Update(const HeightmapRect &Rect) = 0;
+};
+
+/** Propagation counters */
+struct HeightmapChangeStats
+{
+	unsigned long long MarkedRects;
+	unsigned long long PropagatedRects;
+	unsigned long long PropagatedSamples;
+	unsigned long long Propagations;
+
+	HeightmapChangeStats(): MarkedRects(0), PropagatedRects(0), PropagatedSamples(0), Propagations(0) {};
+};
+
+/** Collects rects changed by edits, merging overlapping ones, and hands them over to the derived data once per frame
+	so a stroke of many stamps costs one incremental update of its union footprint */
+class HeightmapChangeTracker
+{
+protected:
+	/// Pending changed rects, disjoint enough that merging any two would waste more than MergeSlack of their area
+	std::vector<HeightmapRect> DirtyRects;
+
+	/// Updated in order of registration - finer data first, if anything depends on other derived data. Not owned
+	std::vector<DerivedHeightData*> Consumers;
+
+	HeightmapChangeStats Stats;
+
+public:
+	/// Fraction of additional area two rects may cover once merged
+	static const float MergeSlack;
+
+	HeightmapChangeTracker() {};
+
+	/// Derived data updated by Propagate()
+	void AddConsumer(DerivedHeightData *Consumer);
+
+	/// Record changed samples
+	void MarkDirty(const HeightmapRect &Rect);
+
+	/// Update all consumers inside the pending rects and clear them. Propagated rects are appended to outRects if given
+	void Propagate(std::vector<HeightmapRect> *outRects = 0);
+
+	/// Forget pending rects without updating anything, e.g. when the derived data gets rebuilt anyway
+	void Clear() {DirtyRects.clear();};
+
+	/// Getters
+	bool IsDirty() const {return !DirtyRects.empty();};
+	const std::vector<HeightmapRect> & GetDirtyRects() const {return DirtyRects;};
+	HeightmapChangeStats GetStats() const {return Stats;};
+
+private:
+	HeightmapChangeTracker(const HeightmapChangeTracker &other);
+	HeightmapChangeTracker & operator= (const HeightmapChangeTracker &other);
+};
@@ -0,0 +1,240 @@
+#include "HeightmapPyramid.h"
+#include "Log.h"
+
+// --------------------------------------------------------------------
+static int FloorHalf(int Value)
+{
+	return (Value >= 0) ? (Value / 2) : (-((1 - Value) / 2));
+}
+
+// --------------------------------------------------------------------
+MipLevelStorage::MipLevelStorage(const Heightmap *argFiner, unsigned int LevelSize, unsigned int argTileSize, int argOriginX, int argOriginY):
+Finer(argFiner), TileSize(argTileSize), TileStride(argTileSize + 2 * Heightmap::Apron), TilesPerRow((LevelSize + argTileSize - 1) / argTileSize),
+OriginX(argOriginX), OriginY(argOriginY)
+{
+}
+
+// --------------------------------------------------------------------
+bool MipLevelStorage::LoadTile(unsigned int TileIndex, float *Data)
+{
+	const int TileX = TileIndex % TilesPerRow;
+	const int TileY = TileIndex / TilesPerRow;
+
+	Filter(TileX * int(TileSize) - int(Heightmap::Apron), TileY * int(TileSize) - int(Heightmap::Apron), TileStride, TileStride, Data, TileStride);
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+void MipLevelStorage::Filter(int X, int Y, int Width, int Height, float *Out, int OutStride)
+{
+	// Texel c covers finer samples 2c - 1 .. 2c + 1, so Width texels need 2 * Width + 1 of them
+	const int RowLength = 2 * Width + 1;
+	const int RowsAmount = 2 * Height + 1;
+	const int FirstX = OriginX + 2 * X - 1;
+	const int FirstY = OriginY + 2 * Y - 1;
+
+	Rows.resize(RowLength);
+	Filtered.resize(RowsAmount * Width);
+
+	// Separable 1-2-1 binomial - horizontal pass on every gathered row, wrapping is left to the finer level
+	for (int y = 0; y < RowsAmount; ++y)
+	{
+		const float *Row = &Rows[0];
+		float *Horizontal = &Filtered[y * Width];
+
+		Finer->GatherRow(FirstX, FirstY + y, 1, RowLength, &Rows[0]);
+
+		for (int x = 0; x < Width; ++x)
+			Horizontal[x] = 0.25f * (Row[2 * x] + 2.0f * Row[2 * x + 1] + Row[2 * x + 2]);
+	}
+
+	for (int y = 0; y < Height; ++y)
+	{
+		const float *Above = &Filtered[(2 * y) * Width];
+		const float *Center = Above + Width;
+		const float *Below = Center + Width;
+		float *Texels = Out + y * OutStride;
+
+		for (int x = 0; x < Width; ++x)
+			Texels[x] = 0.25f * (Above[x] + 2.0f * Center[x] + Below[x]);
+	}
+}
+
+// --------------------------------------------------------------------
+HeightmapPyramid::HeightmapPyramid(Heightmap *Base, int argOriginX, int argOriginY, unsigned int MaxLevels, unsigned long long MemoryBudget):
+OriginX(argOriginX), OriginY(argOriginY)
+{
+	const unsigned int Size = Base->GetSize();
+
+	Levels.push_back(Base);
+	Storages.push_back(0);
+
+	// Every level has to wrap around exactly like the base, so it stops at the first one not dividing the size
+	for (unsigned int Level = 1; Level <= MaxLevels && (Size >> Level) > 0 && ((Size >> Level) << Level) == Size; ++Level)
+	{
+		unsigned int LevelTileSize = Base->GetTileSize() >> Level;
+
+		if (LevelTileSize < MinTileSize)
+			LevelTileSize = MinTileSize;
+
+		// Only level 1 is shifted to the origin, coarser ones start at texel 0 of the finer level
+		MipLevelStorage *Storage = new MipLevelStorage(Levels.back(), Size >> Level, LevelTileSize, (Level == 1) ? (OriginX) : (0), (Level == 1) ? (OriginY) : (0));
+
+		Levels.push_back(new Heightmap(Size >> Level, Storage, MemoryBudget >> Level, LevelTileSize));
+		Storages.push_back(Storage);
+	}
+}
+
+// --------------------------------------------------------------------
+HeightmapPyramid::~HeightmapPyramid()
+{
+	// Coarse levels first, their storages refer to the finer ones
+	for (unsigned int Level = Levels.size() - 1; Level > 0; --Level)
+		delete Levels[Level];
+}
+
+// --------------------------------------------------------------------
+unsigned int HeightmapPyramid::ResolveLevel(unsigned int Level, int &X, int &Y) const
+{
+	unsigned int Source = min(Level, (unsigned int)Levels.size() - 1);
+
+	// Samples off the level's grid are point sampled from the finest level they lie on
+	while (Source > 0 && (((X - OriginX) | (Y - OriginY)) & ((1 << Source) - 1)) != 0)
+		Source--;
+
+	if (Source > 0)
+	{
+		X = (X - OriginX) / (1 << Source);
+		Y = (Y - OriginY) / (1 << Source);
+	}
+
+	return Source;
+}
+
+// --------------------------------------------------------------------
+void HeightmapPyramid::GatherRow(unsigned int Level, int X, int Y, int Count, float *Out) const
+{
+	unsigned int Source = ResolveLevel(Level, X, Y);
+
+	Levels[Source]->GatherRow(X, Y, 1 << (Level - Source), Count, Out);
+}
+
+// --------------------------------------------------------------------
+void HeightmapPyramid::GatherColumn(unsigned int Level, int X, int Y, int Count, float *Out, int OutStride) const
+{
+	unsigned int Source = ResolveLevel(Level, X, Y);
+
+	Levels[Source]->GatherColumn(X, Y, 1 << (Level - Source), Count, Out, OutStride);
+}
+
+// --------------------------------------------------------------------
+void HeightmapPyramid::GatherBlock(unsigned int Level, int X, int Y, int Width, int Height, float *Out, int OutStride) const
+{
+	unsigned int Source = ResolveLevel(Level, X, Y);
+
+	Levels[Source]->GatherBlock(X, Y, 1 << (Level - Source), Width, Height, Out, OutStride);
+}
+
+// --------------------------------------------------------------------
+HeightmapRect HeightmapPyramid::GetCoarserFootprint(const HeightmapRect &Rect)
+{
+	// Texel c depends on finer samples 2c - 1 .. 2c + 1 - the footprint halves and grows by a texel
+	return HeightmapRect(FloorHalf(Rect.MinX), FloorHalf(Rect.MinY), FloorHalf(Rect.MaxX) + 1, FloorHalf(Rect.MaxY) + 1);
+}
+
+// --------------------------------------------------------------------
+void HeightmapPyramid::Update(const HeightmapRect &Rect)
+{
+	HeightmapRect Affected(Rect.MinX - OriginX, Rect.MinY - OriginY, Rect.MaxX - OriginX, Rect.MaxY - OriginY);
+
+	// Finest level first, every level is filtered from the already updated one below
+	for (unsigned int Level = 1; Level < Levels.size() && !Affected.IsEmpty(); ++Level)
+	{
+		Affected = GetCoarserFootprint(Affected);
+
+		UpdateLevel(Level, Affected);
+	}
+}
+
+// --------------------------------------------------------------------
+static int GetTileRuns(int TileStart, int Extent, const HeightmapRect &Rect, bool bColumns, int Size, int *outFirst, int *outLength)
+{
+	const int Min = bColumns ? Rect.MinX : Rect.MinY;
+	const int Length = bColumns ? Rect.GetWidth() : Rect.GetHeight();
+	int Amount = 0;
+
+	// Contiguous runs of tile samples (aprons included, -Apron is the first one) lying inside the rect modulo map size
+	for (int i = -int(Heightmap::Apron); i < Extent + int(Heightmap::Apron); ++i)
+	{
+		int Offset = (TileStart + i - Min) % Size;
+
+		if (Offset < 0)
+			Offset += Size;
+
+		if (Length < Size && Offset >= Length)
+			continue;
+
+		if (Amount > 0 && outFirst[Amount - 1] + outLength[Amount - 1] == i)
+		{
+			outLength[Amount - 1]++;
+		}
+		else
+		{
+			outFirst[Amount] = i;
+			outLength[Amount++] = 1;
+		}
+	}
+
+	return Amount;
+}
+
+// --------------------------------------------------------------------
+void HeightmapPyramid::UpdateLevel(unsigned int Level, const HeightmapRect &Rect)
+{
+	Heightmap *Mip = Levels[Level];
+	const int Size = Mip->GetSize();
+	const int TileSize = Mip->GetTileSize();
+	const int Stride = Mip->GetTileStride();
+
+	std::vector<bool> ColumnsTouched, RowsTouched;
+	std::vector<int> FirstX(Stride), LengthX(Stride), FirstY(Stride), LengthY(Stride);
+
+	Mip->GetTouchedTiles(Rect, Heightmap::Apron, ColumnsTouched, RowsTouched);
+
+	for (unsigned int TileY = 0; TileY < Mip->GetTilesPerRow(); ++TileY)
+	{
+		if (!RowsTouched[TileY])
+			continue;
+
+		int RunsY = GetTileRuns(TileY * TileSize, Mip->GetTileExtent(TileY), Rect, false, Size, &FirstY[0], &LengthY[0]);
+
+		for (unsigned int TileX = 0; TileX < Mip->GetTilesPerRow(); ++TileX)
+		{
+			// Tiles not in memory are filtered from up to date finer texels whenever they get touched
+			if (!ColumnsTouched[TileX] || !Mip->IsTileResident(TileX, TileY))
+				continue;
+
+			int RunsX = GetTileRuns(TileX * TileSize, Mip->GetTileExtent(TileX), Rect, true, Size, &FirstX[0], &LengthX[0]);
+			float *Tile = Mip->WriteTile(TileX, TileY) - Heightmap::Apron * (Stride + 1);
+
+			for (int ry = 0; ry < RunsY; ++ry)
+				for (int rx = 0; rx < RunsX; ++rx)
+					Storages[Level]->Filter(TileX * TileSize + FirstX[rx], TileY * TileSize + FirstY[ry], LengthX[rx], LengthY[ry],
+											Tile + (FirstY[ry] + Heightmap::Apron) * Stride + FirstX[rx] + Heightmap::Apron, Stride);
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+void HeightmapPyramid::Invalidate(const HeightmapRect &Rect)
+{
+	HeightmapRect Affected(Rect.MinX - OriginX, Rect.MinY - OriginY, Rect.MaxX - OriginX, Rect.MaxY - OriginY);
+
+	for (unsigned int Level = 1; Level < Levels.size() && !Affected.IsEmpty(); ++Level)
+	{
+		Affected = GetCoarserFootprint(Affected);
+
+		Levels[Level]->Discard(Affected);
+	}
+}
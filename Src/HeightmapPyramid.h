@@ -0,0 +1,104 @@
+#pragma once
+
+#include <vector>
+
+#include "Heightmap.h"
+#include "HeightmapChanges.h"
+#include "HeightmapStorage.h"
+
+/** Storage of a mip level - synthesizes its tiles by filtering the next finer level with a 3x3 binomial kernel.
+	Nothing is kept, evicted or invalidated tiles are simply filtered again when touched */
+class MipLevelStorage : public HeightmapStorage
+{
+protected:
+	const Heightmap *Finer;
+
+	/// Geometry of the synthesized level
+	unsigned int TileSize;
+	unsigned int TileStride;
+	unsigned int TilesPerRow;
+
+	/// Finer level sample under texel 0 of this level
+	int OriginX, OriginY;
+
+	/// Finer rows gathered for a single tile and their horizontally filtered version
+	std::vector<float> Rows;
+	std::vector<float> Filtered;
+
+public:
+	MipLevelStorage(const Heightmap *argFiner, unsigned int LevelSize, unsigned int argTileSize, int argOriginX, int argOriginY);
+
+	bool LoadTile(unsigned int TileIndex, float *Data);
+
+	/// Filter Width x Height texels of this level starting at texel (X, Y) into Out, rows OutStride floats apart
+	void Filter(int X, int Y, int Width, int Height, float *Out, int OutStride);
+
+	/// Mip tiles are derived data, there is nothing to persist
+	bool StoreTile(unsigned int TileIndex, const float *Data) {return true;};
+
+private:
+	MipLevelStorage(const MipLevelStorage &other);
+	MipLevelStorage & operator= (const MipLevelStorage &other);
+};
+
+/** Prefiltered mip chain of a heightmap. Texel i of level L is the filtered height around base sample Origin + i * 2^L,
+	so clipmap level L reads its samples contiguously from level L instead of point sampling every 2^L-th base sample.
+	Levels are paged heightmaps filled on demand from the finer level, only levels dividing the map size exist.
+	Edits are propagated up the chain in place, only texels under the grown footprint of the change are filtered again */
+class HeightmapPyramid : public DerivedHeightData
+{
+public:
+	/// Mip levels built above the base, enough for 8 clipmap levels
+	static const unsigned int DefaultLevels = 7;
+
+	/// Smallest tile edge of coarse levels, tiles shrink with the level so a clipmap doesn't pull in far more than it shows
+	static const unsigned int MinTileSize = 16;
+
+protected:
+	/// Levels[0] is the base heightmap (not owned)
+	std::vector<Heightmap*> Levels;
+
+	/// Storages filling Levels[i], owned by the levels. Storages[0] is 0
+	std::vector<MipLevelStorage*> Storages;
+
+	/// Base sample of texel 0 of every level
+	int OriginX, OriginY;
+
+public:
+	/// Pyramid over Base aligned to the samples clipmaps read around (OriginX, OriginY). Level L keeps at most MemoryBudget / 2^L bytes resident
+	HeightmapPyramid(Heightmap *Base, int argOriginX, int argOriginY, unsigned int MaxLevels, unsigned long long MemoryBudget);
+	~HeightmapPyramid();
+
+	/// Read Count texels of given level along row Y starting at X, 2^Level base samples apart. Coordinates are base samples.
+	/// Falls back to point sampling a finer level when the level doesn't exist or the coordinates aren't aligned to it
+	void GatherRow(unsigned int Level, int X, int Y, int Count, float *Out) const;
+	void GatherColumn(unsigned int Level, int X, int Y, int Count, float *Out, int OutStride = 1) const;
+	void GatherBlock(unsigned int Level, int X, int Y, int Width, int Height, float *Out, int OutStride) const;
+
+	/// Filter again resident texels depending on given rect of base samples, level by level from the finest one
+	void Update(const HeightmapRect &Rect);
+
+	/// Drop filtered texels depending on given rect of base samples, they are filtered again when gathered next time.
+	/// Cheaper than Update() after rewriting most of the map, as tiles never gathered again cost nothing
+	void Invalidate(const HeightmapRect &Rect);
+
+	/// Getters
+	unsigned int GetLevelsAmount() const {return Levels.size();};
+	const Heightmap * GetLevel(unsigned int Level) const {return Levels[Level];};
+	int GetOriginX() const {return OriginX;};
+	int GetOriginY() const {return OriginY;};
+
+protected:
+	/// Finest existing level to serve given one from, X and Y converted to its texels
+	unsigned int ResolveLevel(unsigned int Level, int &X, int &Y) const;
+
+	/// Filter again resident texels of given level inside Rect (level texels)
+	void UpdateLevel(unsigned int Level, const HeightmapRect &Rect);
+
+	/// Footprint on the next coarser level of the texels inside Rect
+	static HeightmapRect GetCoarserFootprint(const HeightmapRect &Rect);
+
+private:
+	HeightmapPyramid(const HeightmapPyramid &other);
+	HeightmapPyramid & operator= (const HeightmapPyramid &other);
+};
@@ -0,0 +1,316 @@
+#include <float.h>
+
+#include "HeightmapQuadtree.h"
+#include "Log.h"
+
+// --------------------------------------------------------------------
+static double GetExitT(double Origin, double Direction, double Min, double Max)
+{
+	if (Direction > 0.0)
+		return (Max - Origin) / Direction;
+
+	if (Direction < 0.0)
+		return (Min - Origin) / Direction;
+
+	return DBL_MAX;
+}
+
+// --------------------------------------------------------------------
+static bool IntersectTriangle(const dvec3 &Origin, const dvec3 &Direction, const dvec3 &A, const dvec3 &B, const dvec3 &C, double &outT)
+{
+	// Moller-Trumbore, both sides
+	dvec3 EdgeAB = B - A;
+	dvec3 EdgeAC = C - A;
+	dvec3 P = cross(Direction, EdgeAC);
+	double Determinant = dot(EdgeAB, P);
+
+	if (fabs(Determinant) < 1e-12)
+		return false;
+
+	double InvDeterminant = 1.0 / Determinant;
+	dvec3 ToOrigin = Origin - A;
+	double U = dot(ToOrigin, P) * InvDeterminant;
+
+	if (U < 0.0 || U > 1.0)
+		return false;
+
+	dvec3 Q = cross(ToOrigin, EdgeAB);
+	double V = dot(Direction, Q) * InvDeterminant;
+
+	if (V < 0.0 || U + V > 1.0)
+		return false;
+
+	outT = dot(EdgeAC, Q) * InvDeterminant;
+	return outT >= 0.0;
+}
+
+// --------------------------------------------------------------------
+HeightmapQuadtree::HeightmapQuadtree(const Heightmap *argHeights, HeightmapTileStats *argStats):
+Heights(argHeights), Stats(argStats)
+{
+	unsigned int Nodes = Heights->GetTilesPerRow();
+
+	while (true)
+	{
+		NodesPerRow.push_back(Nodes);
+		NodeMin.push_back(std::vector<float>(Nodes * Nodes, 0.0f));
+		NodeMax.push_back(std::vector<float>(Nodes * Nodes, 0.0f));
+		NodeComplete.push_back(std::vector<unsigned char>(Nodes * Nodes, 0));
+
+		if (Nodes == 1)
+			break;
+
+		Nodes = (Nodes + 1) / 2;
+	}
+
+	Rebuild();
+}
+
+// --------------------------------------------------------------------
+void HeightmapQuadtree::Rebuild()
+{
+	const unsigned int TilesPerRow = NodesPerRow[0];
+
+	for (unsigned int TileY = 0; TileY < TilesPerRow; ++TileY)
+	{
+		for (unsigned int TileX = 0; TileX < TilesPerRow; ++TileX)
+		{
+			unsigned int Index = TileY * TilesPerRow + TileX;
+
+			NodeComplete[0][Index] = Stats->IsTileValid(TileX, TileY) ? 1 : 0;
+
+			if (NodeComplete[0][Index])
+				Stats->GetTileRange(TileX, TileY, NodeMin[0][Index], NodeMax[0][Index]);
+		}
+	}
+
+	for (unsigned int Level = 1; Level < NodesPerRow.size(); ++Level)
+		for (unsigned int NodeY = 0; NodeY < NodesPerRow[Level]; ++NodeY)
+			for (unsigned int NodeX = 0; NodeX < NodesPerRow[Level]; ++NodeX)
+				RefreshNode(Level, NodeX, NodeY);
+}
+
+// --------------------------------------------------------------------
+void HeightmapQuadtree::RefreshNode(unsigned int Level, unsigned int NodeX, unsigned int NodeY)
+{
+	const unsigned int ChildrenPerRow = NodesPerRow[Level - 1];
+	const unsigned int Index = NodeY * NodesPerRow[Level] + NodeX;
+
+	float Min = FLT_MAX;
+	float Max = -FLT_MAX;
+	bool bComplete = true;
+
+	for (unsigned int ChildY = 2 * NodeY; ChildY < 2 * NodeY + 2 && ChildY < ChildrenPerRow; ++ChildY)
+	{
+		for (unsigned int ChildX = 2 * NodeX; ChildX < 2 * NodeX + 2 && ChildX < ChildrenPerRow; ++ChildX)
+		{
+			unsigned int Child = ChildY * ChildrenPerRow + ChildX;
+
+			bComplete = bComplete && NodeComplete[Level - 1][Child];
+			Min = min(Min, NodeMin[Level - 1][Child]);
+			Max = max(Max, NodeMax[Level - 1][Child]);
+		}
+	}
+
+	NodeMin[Level][Index] = Min;
+	NodeMax[Level][Index] = Max;
+	NodeComplete[Level][Index] = bComplete ? 1 : 0;
+}
+
+// --------------------------------------------------------------------
+void HeightmapQuadtree::SetLeaf(unsigned int TileX, unsigned int TileY, bool bCompute)
+{
+	if (!bCompute && !Stats->IsTileValid(TileX, TileY))
+		return;
+
+	unsigned int Index = TileY * NodesPerRow[0] + TileX;
+
+	Stats->GetTileRange(TileX, TileY, NodeMin[0][Index], NodeMax[0][Index]);
+	NodeComplete[0][Index] = 1;
+
+	for (unsigned int Level = 1; Level < NodesPerRow.size(); ++Level)
+		RefreshNode(Level, TileX >> Level, TileY >> Level);
+}
+
+// --------------------------------------------------------------------
+void HeightmapQuadtree::Update(const HeightmapRect &Rect)
+{
+	std::vector<bool> ColumnsTouched, RowsTouched;
+
+	Heights->GetTouchedTiles(Rect, Heightmap::Apron, ColumnsTouched, RowsTouched);
+
+	// Tiles never examined stay incomplete, there is nothing stale about them
+	for (unsigned int TileY = 0; TileY < NodesPerRow[0]; ++TileY)
+	{
+		if (!RowsTouched[TileY])
+			continue;
+
+		for (unsigned int TileX = 0; TileX < NodesPerRow[0]; ++TileX)
+			if (ColumnsTouched[TileX])
+				SetLeaf(TileX, TileY, false);
+	}
+}
+
+// --------------------------------------------------------------------
+bool HeightmapQuadtree::Raycast(const vec3 &Origin, const vec3 &Direction, float MaxT, float &outT)
+{
+	const int Size = Heights->GetSize();
+	const int TileSize = Heights->GetTileSize();
+	const unsigned int TileShift = Heights->GetTileShift();
+	const int Top = NodesPerRow.size() - 1;
+
+	const dvec3 O(Origin);
+	const dvec3 D(Direction);
+	double T = 0.0;
+	double EndT = MaxT;
+
+	// Nothing to hit above or below the whole map
+	if (NodeComplete[Top][0])
+	{
+		if (fabs(D.y) < 1e-12)
+		{
+			if (O.y < NodeMin[Top][0] || O.y > NodeMax[Top][0])
+				return false;
+		}
+		else
+		{
+			double EnterT = (NodeMin[Top][0] - O.y) / D.y;
+			double LeaveT = (NodeMax[Top][0] - O.y) / D.y;
+
+			T = max(T, min(EnterT, LeaveT));
+			EndT = min(EndT, max(EnterT, LeaveT));
+		}
+	}
+
+	const double HorizontalSpeed = sqrt(D.x * D.x + D.z * D.z);
+
+	// Vertical ray only ever crosses the cell below it
+	if (HorizontalSpeed < 1e-9)
+	{
+		if (T > EndT || !MarchCells(Origin, Direction, float(T), float(EndT), outT))
+			return false;
+
+		return outT <= MaxT;
+	}
+
+	// Step past node borders, so the next position falls into the next node
+	const double Epsilon = 1e-4 / HorizontalSpeed;
+
+	while (T <= EndT)
+	{
+		dvec3 Position = O + D * T;
+		int SampleX = int(floor(Position.x));
+		int SampleZ = int(floor(Position.z));
+		int WrappedX = Heights->Wrap(SampleX);
+		int WrappedZ = Heights->Wrap(SampleZ);
+		unsigned int TileX = WrappedX >> TileShift;
+		unsigned int TileZ = WrappedZ >> TileShift;
+
+		if (!NodeComplete[0][TileZ * NodesPerRow[0] + TileX])
+			SetLeaf(TileX, TileZ, true);
+
+		// Coarsest complete node the ray passes above or below is skipped whole, otherwise cells of the tile are marched
+		for (int Level = Top; Level >= 0; --Level)
+		{
+			unsigned int NodeX = TileX >> Level;
+			unsigned int NodeZ = TileZ >> Level;
+			unsigned int Index = NodeZ * NodesPerRow[Level] + NodeX;
+
+			if (!NodeComplete[Level][Index])
+				continue;
+
+			// Node box in the ray's unwrapped coordinates, the last node of a row may be partial
+			int NodeSamples = TileSize << Level;
+			double MinX = SampleX - (WrappedX - int(NodeX) * NodeSamples);
+			double MinZ = SampleZ - (WrappedZ - int(NodeZ) * NodeSamples);
+			double MaxX = MinX + min(NodeSamples, Size - int(NodeX) * NodeSamples);
+			double MaxZ = MinZ + min(NodeSamples, Size - int(NodeZ) * NodeSamples);
+			double ExitT = min(EndT, min(GetExitT(O.x, D.x, MinX, MaxX), GetExitT(O.z, D.z, MinZ, MaxZ)));
+
+			double StartY = O.y + D.y * T;
+			double ExitY = O.y + D.y * ExitT;
+
+			if (Level == 0 && max(StartY, ExitY) >= NodeMin[0][Index] && min(StartY, ExitY) <= NodeMax[0][Index])
+			{
+				if (MarchCells(Origin, Direction, float(T), float(ExitT), outT))
+					return outT <= MaxT;
+			}
+			else if (max(StartY, ExitY) >= NodeMin[Level][Index] && min(StartY, ExitY) <= NodeMax[Level][Index])
+			{
+				continue;
+			}
+
+			T = ExitT + Epsilon;
+			break;
+		}
+	}
+
+	return false;
+}
+
+// --------------------------------------------------------------------
+bool HeightmapQuadtree::RaycastBruteForce(const vec3 &Origin, const vec3 &Direction, float MaxT, float &outT) const
+{
+	return MarchCells(Origin, Direction, 0.0f, MaxT, outT) && outT <= MaxT;
+}
+
+// --------------------------------------------------------------------
+bool HeightmapQuadtree::MarchCells(const vec3 &Origin, const vec3 &Direction, float T, float EndT, float &outT) const
+{
+	const dvec3 O(Origin);
+	const dvec3 D(Direction);
+	const dvec3 Position = O + D * double(T);
+
+	int X = int(floor(Position.x));
+	int Z = int(floor(Position.z));
+	int StepX = (D.x > 0.0) ? (1) : (-1);
+	int StepZ = (D.z > 0.0) ? (1) : (-1);
+
+	// Ray parameters of the next cell borders along both axes
+	double NextX = GetExitT(O.x, D.x, X, X + 1);
+	double NextZ = GetExitT(O.z, D.z, Z, Z + 1);
+	double DeltaX = (D.x != 0.0) ? (1.0 / fabs(D.x)) : (DBL_MAX);
+	double DeltaZ = (D.z != 0.0) ? (1.0 / fabs(D.z)) : (DBL_MAX);
+
+	while (true)
+	{
+		if (IntersectCell(Origin, Direction, X, Z, outT))
+			return true;
+
+		if (min(NextX, NextZ) >= EndT)
+			return false;
+
+		if (NextX < NextZ)
+		{
+			X += StepX;
+			NextX += DeltaX;
+		}
+		else
+		{
+			Z += StepZ;
+			NextZ += DeltaZ;
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+bool HeightmapQuadtree::IntersectCell(const vec3 &Origin, const vec3 &Direction, int X, int Z, float &outT) const
+{
+	const dvec3 O(Origin);
+	const dvec3 D(Direction);
+
+	dvec3 Corner00(X, Heights->Get(X, Z), Z);
+	dvec3 Corner10(X + 1, Heights->Get(X + 1, Z), Z);
+	dvec3 Corner01(X, Heights->Get(X, Z + 1), Z + 1);
+	dvec3 Corner11(X + 1, Heights->Get(X + 1, Z + 1), Z + 1);
+
+	double FirstT = DBL_MAX, SecondT = DBL_MAX;
+	bool bFirst = IntersectTriangle(O, D, Corner00, Corner10, Corner01, FirstT);
+	bool bSecond = IntersectTriangle(O, D, Corner10, Corner11, Corner01, SecondT);
+
+	if (!bFirst && !bSecond)
+		return false;
+
+	outT = float(min(FirstT, SecondT));
+	return true;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "Heightmap.h"
+#include "HeightmapChanges.h"
+#include "HeightmapTileStats.h"
+
+using namespace glm;
+
+/** Min/max height quadtree over heightmap tiles, for marching rays against the terrain on the CPU.
+	Leaves are tiles, taken from HeightmapTileStats - nodes over tiles never examined are incomplete and always descended,
+	so paged maps only fault in tiles some ray actually reached. Kept up to date from the edited rects */
+class HeightmapQuadtree : public DerivedHeightData
+{
+protected:
+	const Heightmap *Heights;
+	HeightmapTileStats *Stats;
+
+	/// Per level node ranges, level 0 are the tiles, last level is the root
+	std::vector< std::vector<float> > NodeMin;
+	std::vector< std::vector<float> > NodeMax;
+
+	/// Nonzero for nodes whose whole subtree range is known
+	std::vector< std::vector<unsigned char> > NodeComplete;
+
+	std::vector<unsigned int> NodesPerRow;
+
+public:
+	/// Quadtree over tiles Stats already knows. Refreshed with Update(), Stats has to be updated before it
+	HeightmapQuadtree(const Heightmap *argHeights, HeightmapTileStats *argStats);
+
+	/// Refresh nodes above tiles holding samples of Rect
+	void Update(const HeightmapRect &Rect);
+
+	/// Rebuild the whole tree from the tile ranges known to Stats
+	void Rebuild();
+
+	/// Nearest intersection of ray Origin + t * Direction, t in <0, MaxT>, with the triangulated heightfield.
+	/// Coordinates are x = column, y = height, z = row, unwrapped. Cells are split along the (x + 1, z) - (x, z + 1) diagonal
+	bool Raycast(const vec3 &Origin, const vec3 &Direction, float MaxT, float &outT);
+
+	/// Reference intersection marching every cell without the tree, for testing
+	bool RaycastBruteForce(const vec3 &Origin, const vec3 &Direction, float MaxT, float &outT) const;
+
+	/// Getters
+	unsigned int GetLevelsAmount() const {return NodesPerRow.size();};
+
+protected:
+	/// Copy range of given tile (computing it if needed) and refresh its ancestors
+	void SetLeaf(unsigned int TileX, unsigned int TileY, bool bCompute);
+
+	/// Combine ranges of the four children of given node
+	void RefreshNode(unsigned int Level, unsigned int NodeX, unsigned int NodeY);
+
+	/// Intersect cells crossed by the ray between T and EndT, return true and set outT at the first hit
+	bool MarchCells(const vec3 &Origin, const vec3 &Direction, float T, float EndT, float &outT) const;
+
+	/// Ray against the two triangles of cell (X, Z)
+	bool IntersectCell(const vec3 &Origin, const vec3 &Direction, int X, int Z, float &outT) const;
+
+private:
+	HeightmapQuadtree(const HeightmapQuadtree &other);
+	HeightmapQuadtree & operator= (const HeightmapQuadtree &other);
+};
@@ -0,0 +1,260 @@
+#include <windows.h>
+
+#include "HeightmapStorage.h"
+
+// --------------------------------------------------------------------
+bool HeightmapStorage::LoadTiles(unsigned int Amount, const unsigned int *TileIndices, float * const *Data, bool *outLoaded)
+{
+	for (unsigned int i = 0; i < Amount; ++i)
+		outLoaded[i] = LoadTile(TileIndices[i], Data[i]);
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+bool HeightmapStorage::StoreTiles(unsigned int Amount, const unsigned int *TileIndices, const float * const *Data)
+{
+	bool bResult = true;
+
+	for (unsigned int i = 0; i < Amount; ++i)
+		bResult = StoreTile(TileIndices[i], Data[i]) && bResult;
+
+	return bResult;
+}
+
+// --------------------------------------------------------------------
+HeightmapPageFile::HeightmapPageFile(const char *FilePath, unsigned int TileStride, bool bCreate):
+File(0), TileBytes(TileStride * TileStride * sizeof(float)), FileLength(0)
+{
+	if (FilePath == NULL)
+		return;
+
+	File = fopen(FilePath, bCreate ? "w+b" : "r+b");
+
+	if (File != NULL)
+	{
+		_fseeki64(File, 0, SEEK_END);
+		FileLength = _ftelli64(File);
+	}
+}
+
+// --------------------------------------------------------------------
+HeightmapPageFile::~HeightmapPageFile()
+{
+	if (File != NULL)
+		fclose(File);
+}
+
+// --------------------------------------------------------------------
+bool HeightmapPageFile::LoadTile(unsigned int TileIndex, float *Data)
+{
+	unsigned long long Offset = (unsigned long long)TileIndex * TileBytes;
+
+	if (File == NULL || Offset + TileBytes > FileLength)
+		return false;
+
+	if (_fseeki64(File, Offset, SEEK_SET) != 0)
+		return false;
+
+	return fread(Data, 1, TileBytes, File) == TileBytes;
+}
+
+// --------------------------------------------------------------------
+bool HeightmapPageFile::StoreTile(unsigned int TileIndex, const float *Data)
+{
+	unsigned long long Offset = (unsigned long long)TileIndex * TileBytes;
+
+	if (File == NULL || _fseeki64(File, Offset, SEEK_SET) != 0)
+		return false;
+
+	if (fwrite(Data, 1, TileBytes, File) != TileBytes)
+		return false;
+
+	if (Offset + TileBytes > FileLength)
+		FileLength = Offset + TileBytes;
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+QuantizedHeightmapStorage::QuantizedHeightmapStorage(unsigned int argTilesAmount, unsigned int TileStride):
+TileSamples(TileStride * TileStride), TilesAmount(argTilesAmount), Tiles(0), Headers(0)
+{
+	Tiles = new unsigned short*[TilesAmount];
+	Headers = new QuantizedTileHeader[TilesAmount];
+
+	for (unsigned int i = 0; i < TilesAmount; ++i)
+		Tiles[i] = 0;
+}
+
+// --------------------------------------------------------------------
+QuantizedHeightmapStorage::~QuantizedHeightmapStorage()
+{
+	for (unsigned int i = 0; i < TilesAmount; ++i)
+		delete [] Tiles[i];
+
+	delete [] Tiles;
+	delete [] Headers;
+}
+
+// --------------------------------------------------------------------
+bool QuantizedHeightmapStorage::LoadTile(unsigned int TileIndex, float *Data)
+{
+	if (Tiles[TileIndex] == 0)
+		return false;
+
+	DequantizeTile(Tiles[TileIndex], TileSamples, Headers[TileIndex], Data);
+	return true;
+}
+
+// --------------------------------------------------------------------
+bool QuantizedHeightmapStorage::StoreTile(unsigned int TileIndex, const float *Data)
+{
+	const QuantizedTileHeader *Previous = (Tiles[TileIndex] != 0) ? (&Headers[TileIndex]) : (0);
+
+	if (Tiles[TileIndex] == 0)
+		Tiles[TileIndex] = new unsigned short[TileSamples];
+
+	QuantizeTile(Data, TileSamples, Previous, Headers[TileIndex], Tiles[TileIndex]);
+	return true;
+}
+
+// --------------------------------------------------------------------
+unsigned long long QuantizedHeightmapStorage::GetMemoryUsage() const
+{
+	unsigned long long Usage = 0;
+
+	for (unsigned int i = 0; i < TilesAmount; ++i)
+		if (Tiles[i] != 0)
+			Usage += TileSamples * sizeof(unsigned short);
+
+	return Usage;
+}
+
+// --------------------------------------------------------------------
+HeightmapOverlayStorage::HeightmapOverlayStorage(HeightmapStorage *argBase, unsigned int TilesAmount, unsigned int argTileStride):
+Base(argBase), Scratch(0), TileStride(argTileStride), Modified(TilesAmount, false)
+{
+}
+
+// --------------------------------------------------------------------
+HeightmapOverlayStorage::~HeightmapOverlayStorage()
+{
+	delete Scratch;
+
+	if (!ScratchPath.empty())
+		DeleteFileA(ScratchPath.c_str());
+
+	delete Base;
+}
+
+// --------------------------------------------------------------------
+bool HeightmapOverlayStorage::LoadTile(unsigned int TileIndex, float *Data)
+{
+	return (Modified[TileIndex]) ? (Scratch->LoadTile(TileIndex, Data)) : (Base->LoadTile(TileIndex, Data));
+}
+
+// --------------------------------------------------------------------
+bool HeightmapOverlayStorage::LoadTiles(unsigned int Amount, const unsigned int *TileIndices, float * const *Data, bool *outLoaded)
+{
+	std::vector<unsigned int> BaseIndices;
+	std::vector<float*> BaseData;
+	std::vector<unsigned int> BaseSlots;
+
+	for (unsigned int i = 0; i < Amount; ++i)
+	{
+		if (Modified[TileIndices[i]])
+		{
+			outLoaded[i] = Scratch->LoadTile(TileIndices[i], Data[i]);
+			continue;
+		}
+
+		BaseIndices.push_back(TileIndices[i]);
+		BaseData.push_back(Data[i]);
+		BaseSlots.push_back(i);
+	}
+
+	if (BaseIndices.empty())
+		return true;
+
+	// Tiles not modified stay one batch for the base, a compressed file decodes them in parallel
+	bool *BaseLoaded = new bool[BaseIndices.size()];
+	bool bResult = Base->LoadTiles(BaseIndices.size(), &BaseIndices[0], &BaseData[0], BaseLoaded);
+
+	for (unsigned int i = 0; i < BaseSlots.size(); ++i)
+		outLoaded[BaseSlots[i]] = BaseLoaded[i];
+
+	delete [] BaseLoaded;
+
+	return bResult;
+}
+
+// --------------------------------------------------------------------
+bool HeightmapOverlayStorage::StoreTile(unsigned int TileIndex, const float *Data)
+{
+	if (Scratch == 0)
+	{
+		char TempDirectory[MAX_PATH], TempPath[MAX_PATH];
+
+		if (GetTempPathA(MAX_PATH, TempDirectory) == 0 || GetTempFileNameA(TempDirectory, "ovl", 0, TempPath) == 0)
+			return false;
+
+		ScratchPath = TempPath;
+		Scratch = new HeightmapPageFile(TempPath, TileStride, true);
+	}
+
+	if (!Scratch->StoreTile(TileIndex, Data))
+		return false;
+
+	Modified[TileIndex] = true;
+	return true;
+}
+
+// --------------------------------------------------------------------
+bool HeightmapOverlayStorage::Commit()
+{
+	std::vector<float> Buffers(BatchSize * TileStride * TileStride);
+	unsigned int Batch[BatchSize];
+	float *BatchData[BatchSize];
+	unsigned int Amount = 0;
+
+	for (unsigned int i = 0; i <= Modified.size(); ++i)
+	{
+		if (i < Modified.size() && Modified[i])
+		{
+			Batch[Amount] = i;
+			BatchData[Amount] = &Buffers[Amount * TileStride * TileStride];
+			Amount++;
+		}
+
+		if (Amount == BatchSize || (i == Modified.size() && Amount > 0))
+		{
+			for (unsigned int b = 0; b < Amount; ++b)
+				if (!Scratch->LoadTile(Batch[b], BatchData[b]))
+					return false;
+
+			if (!Base->StoreTiles(Amount, Batch, BatchData))
+				return false;
+
+			Amount = 0;
+		}
+	}
+
+	if (!Base->Sync())
+		return false;
+
+	ClearModified();
+	return true;
+}
+
+// --------------------------------------------------------------------
+unsigned int HeightmapOverlayStorage::GetModifiedTiles() const
+{
+	unsigned int Amount = 0;
+
+	for (unsigned int i = 0; i < Modified.size(); ++i)
+		if (Modified[i])
+			Amount++;
+
+	return Amount;
+}
@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "TileQuantization.h"
+
+/** Backing store of paged heightmaps. Tiles are stored whole - TileStride * TileStride floats, aprons included */
+class HeightmapStorage
+{
+public:
+	virtual ~HeightmapStorage() {};
+
+	/// Fill Data with given tile, return false if the tile has never been stored (caller zeroes it then)
+	virtual bool LoadTile(unsigned int TileIndex, float *Data) = 0;
+
+	/// Persist given tile, return false on failure
+	virtual bool StoreTile(unsigned int TileIndex, const float *Data) = 0;
+
+	/// Batch versions, storages able to code tiles in parallel override them. outLoaded tells which tiles were found
+	virtual bool LoadTiles(unsigned int Amount, const unsigned int *TileIndices, float * const *Data, bool *outLoaded);
+	virtual bool StoreTiles(unsigned int Amount, const unsigned int *TileIndices, const float * const *Data);
+
+	/// Make stored tiles durable, return false on failure
+	virtual bool Sync() {return true;};
+
+	/// Largest height error of the stored tile, 0 for lossless storages
+	virtual float GetTileError(unsigned int TileIndex) {return 0.0f;};
+};
+
+/** Plain page file - tile N lives at offset N * TileBytes, file grows as tiles get written */
+class HeightmapPageFile : public HeightmapStorage
+{
+protected:
+	FILE *File;
+
+	/// Size of one stored tile in bytes
+	unsigned int TileBytes;
+
+	/// Current file length, tiles behind it were never written
+	unsigned long long FileLength;
+
+public:
+	/// Opens (or creates, when bCreate is set) page file for tiles TileStride samples wide
+	HeightmapPageFile(const char *FilePath, unsigned int TileStride, bool bCreate);
+	~HeightmapPageFile();
+
+	/// True if file was opened successfully
+	bool IsOpen() const {return File != 0;};
+
+	bool LoadTile(unsigned int TileIndex, float *Data);
+	bool StoreTile(unsigned int TileIndex, const float *Data);
+	bool Sync() {return File != 0 && fflush(File) == 0;};
+
+private:
+	HeightmapPageFile(const HeightmapPageFile &other);
+	HeightmapPageFile & operator= (const HeightmapPageFile &other);
+};
+
+/** In-memory storage keeping tiles as 16-bit quantized heights with per-tile min/scale - half the size of float tiles.
+	Paired with a paged Heightmap only the working set is kept as floats, and only tiles written back get requantized */
+class QuantizedHeightmapStorage : public HeightmapStorage
+{
+protected:
+	unsigned int TileSamples;
+	unsigned int TilesAmount;
+
+	/// Quantized tiles, 0 for the ones never stored
+	unsigned short **Tiles;
+	QuantizedTileHeader *Headers;
+
+public:
+	QuantizedHeightmapStorage(unsigned int TilesAmount, unsigned int TileStride);
+	~QuantizedHeightmapStorage();
+
+	bool LoadTile(unsigned int TileIndex, float *Data);
+	bool StoreTile(unsigned int TileIndex, const float *Data);
+	float GetTileError(unsigned int TileIndex) {return (Tiles[TileIndex] != 0) ? (Headers[TileIndex].MaxError) : (0.0f);};
+
+	/// Bytes taken by stored tiles
+	unsigned long long GetMemoryUsage() const;
+
+private:
+	QuantizedHeightmapStorage(const QuantizedHeightmapStorage &other);
+	QuantizedHeightmapStorage & operator= (const QuantizedHeightmapStorage &other);
+};
+
+/** Copy-on-write layer over a storage the map was opened from, e.g. a user's terrain file. The base is only read - tiles written back go
+	to a scratch page file created on the first one, and get into the base on an explicit Commit() only */
+class HeightmapOverlayStorage : public HeightmapStorage
+{
+public:
+	/// Tiles moved from the scratch file to the base at once
+	static const unsigned int BatchSize = 256;
+
+protected:
+	HeightmapStorage *Base;
+	HeightmapPageFile *Scratch;
+	std::string ScratchPath;
+	unsigned int TileStride;
+
+	/// Tiles stored since opening or the last Commit(), they're read from the scratch file
+	std::vector<bool> Modified;
+
+public:
+	/// Takes ownership of the base storage
+	HeightmapOverlayStorage(HeightmapStorage *argBase, unsigned int TilesAmount, unsigned int argTileStride);
+	~HeightmapOverlayStorage();
+
+	bool LoadTile(unsigned int TileIndex, float *Data);
+	bool StoreTile(unsigned int TileIndex, const float *Data);
+	bool LoadTiles(unsigned int Amount, const unsigned int *TileIndices, float * const *Data, bool *outLoaded);
+
+	/// Modified tiles are the map's own until they're committed
+	float GetTileError(unsigned int TileIndex) {return (Modified[TileIndex]) ? (0.0f) : (Base->GetTileError(TileIndex));};
+
+	/// Write the modified tiles to the base and sync it - the base has to accept writes by then. Returns false on failure, the tiles
+	/// stay modified then
+	bool Commit();
+
+	/// Forget the modified tiles, once the base has been replaced by storage holding them already
+	void ClearModified() {Modified.assign(Modified.size(), false);};
+
+	/// Getters
+	HeightmapStorage * GetBase() const {return Base;};
+	unsigned int GetModifiedTiles() const;
+
+private:
+	HeightmapOverlayStorage(const HeightmapOverlayStorage &other);
+	HeightmapOverlayStorage & operator= (const HeightmapOverlayStorage &other);
+};
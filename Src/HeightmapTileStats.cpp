@@ -0,0 +1,84 @@
+#include "HeightmapTileStats.h"
+#include "Log.h"
+
+// --------------------------------------------------------------------
+HeightmapTileStats::HeightmapTileStats(const Heightmap *argHeights):
+Heights(argHeights)
+{
+	const unsigned int TilesAmount = Heights->GetTilesPerRow() * Heights->GetTilesPerRow();
+
+	TileMin.assign(TilesAmount, 0.0f);
+	TileMax.assign(TilesAmount, 0.0f);
+	TileValid.assign(TilesAmount, 0);
+}
+
+// --------------------------------------------------------------------
+void HeightmapTileStats::GetTileRange(unsigned int TileX, unsigned int TileY, float &outMin, float &outMax)
+{
+	unsigned int TileIndex = TileY * Heights->GetTilesPerRow() + TileX;
+
+	if (!TileValid[TileIndex])
+		ComputeTile(TileX, TileY);
+
+	outMin = TileMin[TileIndex];
+	outMax = TileMax[TileIndex];
+}
+
+// --------------------------------------------------------------------
+void HeightmapTileStats::ComputeTile(unsigned int TileX, unsigned int TileY)
+{
+	const unsigned int Stride = Heights->GetTileStride();
+	const unsigned int TileIndex = TileY * Heights->GetTilesPerRow() + TileX;
+	const int ExtentX = Heights->GetTileExtent(TileX) + 2 * Heightmap::Apron;
+	const int ExtentY = Heights->GetTileExtent(TileY) + 2 * Heightmap::Apron;
+	const float *Tile = Heights->ReadTile(TileX, TileY) - Heightmap::Apron * (Stride + 1);
+
+	float Min = Tile[0];
+	float Max = Tile[0];
+
+	for (int y = 0; y < ExtentY; ++y)
+	{
+		const float *Row = Tile + y * Stride;
+
+		for (int x = 0; x < ExtentX; ++x)
+		{
+			Min = min(Min, Row[x]);
+			Max = max(Max, Row[x]);
+		}
+	}
+
+	TileMin[TileIndex] = Min;
+	TileMax[TileIndex] = Max;
+	TileValid[TileIndex] = 1;
+}
+
+// --------------------------------------------------------------------
+void HeightmapTileStats::Update(const HeightmapRect &Rect)
+{
+	std::vector<bool> ColumnsTouched, RowsTouched;
+
+	// Changed border samples are also part of the neighbours' aprons
+	Heights->GetTouchedTiles(Rect, Heightmap::Apron, ColumnsTouched, RowsTouched);
+
+	for (unsigned int TileY = 0; TileY < Heights->GetTilesPerRow(); ++TileY)
+	{
+		if (!RowsTouched[TileY])
+			continue;
+
+		for (unsigned int TileX = 0; TileX < Heights->GetTilesPerRow(); ++TileX)
+			if (ColumnsTouched[TileX] && TileValid[TileY * Heights->GetTilesPerRow() + TileX])
+				ComputeTile(TileX, TileY);
+	}
+}
+
+// --------------------------------------------------------------------
+void HeightmapTileStats::ComputeAll()
+{
+	const int TilesAmount = Heights->GetTilesPerRow() * Heights->GetTilesPerRow();
+
+	// Paged tiles go through the shared cache, which isn't thread safe
+	#pragma omp parallel for schedule(dynamic) if (!Heights->IsPaged())
+	for (int i = 0; i < TilesAmount; ++i)
+		if (!TileValid[i])
+			ComputeTile(i % Heights->GetTilesPerRow(), i / Heights->GetTilesPerRow());
+}
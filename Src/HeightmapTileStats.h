@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+
+#include "Heightmap.h"
+#include "HeightmapChanges.h"
+
+/** Height range of every heightmap tile, aprons included so cells straddling a tile border are bounded too.
+	Ranges are computed on first query and refreshed only for tiles touched by edits */
+class HeightmapTileStats : public DerivedHeightData
+{
+protected:
+	const Heightmap *Heights;
+
+	std::vector<float> TileMin;
+	std::vector<float> TileMax;
+	std::vector<unsigned char> TileValid;
+
+public:
+	HeightmapTileStats(const Heightmap *argHeights);
+
+	/// Height range of given tile, faulting the tile in if it wasn't computed yet
+	void GetTileRange(unsigned int TileX, unsigned int TileY, float &outMin, float &outMax);
+
+	/// Recompute ranges of already computed tiles holding samples of Rect
+	void Update(const HeightmapRect &Rect);
+
+	/// Compute ranges of all tiles at once, in parallel. Meant for fully resident maps - a paged one would be read whole
+	void ComputeAll();
+
+	/// True if range of given tile is known without touching the tile
+	bool IsTileValid(unsigned int TileX, unsigned int TileY) const {return TileValid[TileY * Heights->GetTilesPerRow() + TileX] != 0;};
+
+protected:
+	void ComputeTile(unsigned int TileX, unsigned int TileY);
+
+private:
+	HeightmapTileStats(const HeightmapTileStats &other);
+	HeightmapTileStats & operator= (const HeightmapTileStats &other);
+};
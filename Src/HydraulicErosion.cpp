@@ -0,0 +1,246 @@
+#include <math.h>
+
+#include "HydraulicErosion.h"
+#include "Log.h"
+
+// --------------------------------------------------------------------
+static unsigned long long MixSeed(unsigned long long Value)
+{
+	// splitmix64 finalizer
+	Value += 0x9e3779b97f4a7c15ull;
+	Value = (Value ^ (Value >> 30)) * 0xbf58476d1ce4e5b9ull;
+	Value = (Value ^ (Value >> 27)) * 0x94d049bb133111ebull;
+
+	return Value ^ (Value >> 31);
+}
+
+// --------------------------------------------------------------------
+static float NextRandom(unsigned long long &State)
+{
+	// Uniform in <0, 1), 24 bits of a 64-bit LCG
+	State = State * 6364136223846793005ull + 1442695040888963407ull;
+
+	return float(State >> 40) / float(1 << 24);
+}
+
+// --------------------------------------------------------------------
+HydraulicErosion::HydraulicErosion(Heightmap *argHeights, const ErosionSettings &argSettings):
+Heights(argHeights), Settings(argSettings), RegionsPerRow(1), Margin(0), DropletsPerPass(0), DropletsPerRegion(0), Pass(0), PassesAmount(0),
+DropletsDone(0)
+{
+	const unsigned int Size = Heights->GetSize();
+
+	// Regions of one phase are one region apart, which has to be wider than two droplet reaches
+	const unsigned int Reach = Settings.MaxLifetime + Settings.Radius + 2;
+	const unsigned int MinRegionSize = 2 * Reach + 1;
+	unsigned int PreferredSize = RegionSize;
+
+	if (PreferredSize < MinRegionSize)
+		PreferredSize = MinRegionSize;
+
+	// Even amount per row, so regions of the same phase don't meet where the map wraps
+	RegionsPerRow = (Size / PreferredSize) & ~1u;
+
+	if (RegionsPerRow < 2)
+		RegionsPerRow = (Size >= 2 * MinRegionSize) ? (2) : (1);
+
+	// Single region maps are eroded as one piece without wrapping, droplets stop at the map edges
+	Margin = (RegionsPerRow > 1) ? (int(Reach)) : (0);
+
+	for (unsigned int i = 0; i <= RegionsPerRow; ++i)
+		RegionStart.push_back(int((unsigned long long)i * Size / RegionsPerRow));
+
+	const unsigned long long RegionsAmount = RegionsPerRow * RegionsPerRow;
+	const unsigned int RegionArea = (Size / RegionsPerRow) * (Size / RegionsPerRow);
+
+	DropletsPerRegion = (Settings.Droplets + RegionsAmount - 1) / RegionsAmount;
+	DropletsPerPass = (RegionArea / 16 > 0) ? (RegionArea / 16) : (1);
+
+	if (DropletsPerPass > DropletsPerRegion)
+		DropletsPerPass = (unsigned int)DropletsPerRegion;
+
+	PassesAmount = (DropletsPerPass > 0) ? (unsigned int)((DropletsPerRegion + DropletsPerPass - 1) / DropletsPerPass) : (0);
+
+	// Brush of the erosion, weights falling off linearly from the node and summing to one
+	const int Radius = Settings.Radius;
+	float WeightSum = 0.0f;
+
+	for (int y = -Radius; y <= Radius; ++y)
+	{
+		for (int x = -Radius; x <= Radius; ++x)
+		{
+			float Distance = sqrt(float(x * x + y * y));
+
+			if (Distance >= Radius && Radius > 0)
+				continue;
+
+			BrushOffsetX.push_back(x);
+			BrushOffsetY.push_back(y);
+			BrushWeights.push_back((Radius > 0) ? (1.0f - Distance / Radius) : (1.0f));
+			WeightSum += BrushWeights.back();
+		}
+	}
+
+	for (unsigned int i = 0; i < BrushWeights.size(); ++i)
+		BrushWeights[i] /= WeightSum;
+}
+
+// --------------------------------------------------------------------
+unsigned long long HydraulicErosion::Step(unsigned long long MaxDroplets)
+{
+	const unsigned long long RegionsAmount = RegionsPerRow * RegionsPerRow;
+	unsigned long long Done = 0;
+
+	while (!IsFinished())
+	{
+		const unsigned int Amount = (unsigned int)min((unsigned long long)DropletsPerPass, DropletsPerRegion - (unsigned long long)Pass * DropletsPerPass);
+
+		if (Done > 0 && Done + Amount * RegionsAmount > MaxDroplets)
+			break;
+
+		// 2 x 2 checkerboard phases, regions within a phase never touch the same samples
+		for (unsigned int Phase = 0; Phase < 4; ++Phase)
+		{
+			const unsigned int PhaseX = Phase & 1;
+			const unsigned int PhaseY = Phase >> 1;
+			const int PhaseRegionsPerRow = (RegionsPerRow + 1 - PhaseX) / 2;
+			const int PhaseRegions = PhaseRegionsPerRow * ((RegionsPerRow + 1 - PhaseY) / 2);
+
+			// Paged maps share one tile cache, their regions go one by one
+			#pragma omp parallel for schedule(dynamic) if (!Heights->IsPaged())
+			for (int i = 0; i < PhaseRegions; ++i)
+				RunRegion(PhaseX + 2 * (i % PhaseRegionsPerRow), PhaseY + 2 * (i / PhaseRegionsPerRow), Amount);
+		}
+
+		Done += Amount * RegionsAmount;
+		++Pass;
+	}
+
+	Heights->UpdateAllAprons();
+	DropletsDone += Done;
+
+	return Done;
+}
+
+// --------------------------------------------------------------------
+void HydraulicErosion::RunRegion(unsigned int RegionX, unsigned int RegionY, unsigned int Amount)
+{
+	const int X = RegionStart[RegionX] - Margin;
+	const int Y = RegionStart[RegionY] - Margin;
+	const int RegionWidth = RegionStart[RegionX + 1] - RegionStart[RegionX];
+	const int RegionHeight = RegionStart[RegionY + 1] - RegionStart[RegionY];
+	const int Width = RegionWidth + 2 * Margin;
+	const int Height = RegionHeight + 2 * Margin;
+
+	std::vector<float> Buffer(Width * Height);
+
+	for (int y = 0; y < Height; ++y)
+		Heights->GatherRow(X, Y + y, 1, Width, &Buffer[y * Width]);
+
+	// Own random sequence of every region and pass, whichever thread runs it
+	unsigned long long Random = MixSeed(MixSeed(MixSeed(Settings.Seed) + Pass) + RegionY * RegionsPerRow + RegionX);
+
+	for (unsigned int i = 0; i < Amount; ++i)
+	{
+		float PosX = Margin + NextRandom(Random) * RegionWidth;
+		float PosY = Margin + NextRandom(Random) * RegionHeight;
+
+		RunDroplet(&Buffer[0], Width, Height, PosX, PosY);
+	}
+
+	for (int y = 0; y < Height; ++y)
+		Heights->ScatterRow(X, Y + y, Width, &Buffer[y * Width]);
+}
+
+// --------------------------------------------------------------------
+void HydraulicErosion::RunDroplet(float *Buffer, int Width, int Height, float PosX, float PosY) const
+{
+	const int Border = Settings.Radius + 1;
+	const unsigned int BrushSize = BrushWeights.size();
+
+	float DirX = 0.0f, DirY = 0.0f;
+	float Speed = Settings.InitialSpeed;
+	float Water = Settings.InitialWater;
+	float Sediment = 0.0f;
+	float *Node = 0;
+	float CellX = 0.0f, CellY = 0.0f;
+
+	if (PosX < Border || PosY < Border || PosX >= Width - Border || PosY >= Height - Border)
+		return;
+
+	for (unsigned int Lifetime = 0; Lifetime < Settings.MaxLifetime; ++Lifetime)
+	{
+		int NodeX = int(PosX);
+		int NodeY = int(PosY);
+		CellX = PosX - NodeX;
+		CellY = PosY - NodeY;
+		Node = Buffer + NodeY * Width + NodeX;
+
+		// Bilinear height and gradient inside the cell
+		float GradX = (Node[1] - Node[0]) * (1.0f - CellY) + (Node[Width + 1] - Node[Width]) * CellY;
+		float GradY = (Node[Width] - Node[0]) * (1.0f - CellX) + (Node[Width + 1] - Node[1]) * CellX;
+		float CurrentHeight = (Node[0] * (1.0f - CellX) + Node[1] * CellX) * (1.0f - CellY) + (Node[Width] * (1.0f - CellX) + Node[Width + 1] * CellX) * CellY;
+
+		DirX = DirX * Settings.Inertia - GradX * (1.0f - Settings.Inertia);
+		DirY = DirY * Settings.Inertia - GradY * (1.0f - Settings.Inertia);
+
+		float Length = sqrt(DirX * DirX + DirY * DirY);
+
+		// Stuck in a flat spot
+		if (Length < 1e-6f)
+			break;
+
+		DirX /= Length;
+		DirY /= Length;
+		PosX += DirX;
+		PosY += DirY;
+
+		if (PosX < Border || PosY < Border || PosX >= Width - Border || PosY >= Height - Border)
+			break;
+
+		int NewX = int(PosX);
+		int NewY = int(PosY);
+		float NewCellX = PosX - NewX;
+		float NewCellY = PosY - NewY;
+		const float *NewNode = Buffer + NewY * Width + NewX;
+		float NewHeight = (NewNode[0] * (1.0f - NewCellX) + NewNode[1] * NewCellX) * (1.0f - NewCellY)
+			+ (NewNode[Width] * (1.0f - NewCellX) + NewNode[Width + 1] * NewCellX) * NewCellY;
+
+		float DeltaHeight = NewHeight - CurrentHeight;
+		float Capacity = max(-DeltaHeight * Speed * Water * Settings.SedimentCapacity, Settings.MinCapacity);
+
+		if (Sediment > Capacity || DeltaHeight > 0.0f)
+		{
+			// Uphill fill the pit behind, otherwise drop part of the excess - spread over the cell corners it left
+			float Deposit = (DeltaHeight > 0.0f) ? (min(DeltaHeight, Sediment)) : ((Sediment - Capacity) * Settings.DepositSpeed);
+
+			Sediment -= Deposit;
+			Node[0] += Deposit * (1.0f - CellX) * (1.0f - CellY);
+			Node[1] += Deposit * CellX * (1.0f - CellY);
+			Node[Width] += Deposit * (1.0f - CellX) * CellY;
+			Node[Width + 1] += Deposit * CellX * CellY;
+		}
+		else
+		{
+			// Never dig deeper than the drop, or the droplet would carve a hole behind itself
+			float Erode = min((Capacity - Sediment) * Settings.ErodeSpeed, -DeltaHeight);
+
+			for (unsigned int b = 0; b < BrushSize; ++b)
+				Node[BrushOffsetY[b] * Width + BrushOffsetX[b]] -= Erode * BrushWeights[b];
+
+			Sediment += Erode;
+		}
+
+		Speed = sqrt(max(Speed * Speed - DeltaHeight * Settings.Gravity, 0.0f));
+		Water *= 1.0f - Settings.EvaporateSpeed;
+	}
+
+	// Whatever the droplet still carries settles in the last cell, so the terrain keeps its volume and nothing drains out at the edges
+	if (Node)
+	{
+		Node[0] += Sediment * (1.0f - CellX) * (1.0f - CellY);
+		Node[1] += Sediment * CellX * (1.0f - CellY);
+		Node[Width] += Sediment * (1.0f - CellX) * CellY;
+		Node[Width + 1] += Sediment * CellX * CellY;
+	}
+}
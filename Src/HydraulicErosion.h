@@ -0,0 +1,99 @@
+#pragma once
+
+#include <vector>
+
+#include "Heightmap.h"
+
+/** Droplet erosion parameters */
+struct ErosionSettings
+{
+	unsigned int Seed;
+
+	/// Droplets to simulate over the whole map (rounded up to the same amount in every region)
+	unsigned long long Droplets;
+
+	/// Steps of one droplet, it moves about one sample per step
+	unsigned int MaxLifetime;
+
+	/// Radius (in samples) of the area a droplet erodes at once
+	unsigned int Radius;
+
+	/// How much a droplet keeps its direction instead of following the slope, <0, 1>
+	float Inertia;
+
+	/// Sediment a droplet can carry per unit of height drop, speed and water, and the least it can carry on flat ground
+	float SedimentCapacity;
+	float MinCapacity;
+
+	/// Fractions of the free capacity eroded, of the excess sediment deposited and of the water evaporated per step
+	float ErodeSpeed;
+	float DepositSpeed;
+	float EvaporateSpeed;
+
+	float Gravity;
+	float InitialWater;
+	float InitialSpeed;
+
+	ErosionSettings(): Seed(1), Droplets(100000), MaxLifetime(30), Radius(3), Inertia(0.05f), SedimentCapacity(4.0f), MinCapacity(0.01f),
+		ErodeSpeed(0.3f), DepositSpeed(0.3f), EvaporateSpeed(0.01f), Gravity(4.0f), InitialWater(1.0f), InitialSpeed(1.0f) {};
+};
+
+/** Particle based hydraulic erosion working in place on a heightmap.
+	The map is split into an even amount of regions per row, processed in four phases of a 2 x 2 checkerboard - regions of one phase
+	are further apart than a droplet can travel, so they run in parallel. Each region copies its area with a margin, runs its droplets
+	in order from its own random sequence and writes the area back, which makes the result independent of the amount of threads.
+	Droplets run in passes of a fixed amount per region, Step() runs whole passes within the given budget */
+class HydraulicErosion
+{
+public:
+	/// Preferred region edge length, regions are larger on maps not dividing into it
+	static const unsigned int RegionSize = 256;
+
+protected:
+	Heightmap *Heights;
+	ErosionSettings Settings;
+
+	/// Region boundaries along both axes, RegionsPerRow + 1 entries
+	std::vector<int> RegionStart;
+	unsigned int RegionsPerRow;
+
+	/// Samples copied around every region, farther than a droplet with its erosion radius gets
+	int Margin;
+
+	/// Droplets every region runs in a full pass, and in all passes
+	unsigned int DropletsPerPass;
+	unsigned long long DropletsPerRegion;
+
+	unsigned int Pass;
+	unsigned int PassesAmount;
+	unsigned long long DropletsDone;
+
+	/// Erosion brush - offsets (in buffer samples, relative to the node) and normalized weights
+	std::vector<int> BrushOffsetX;
+	std::vector<int> BrushOffsetY;
+	std::vector<float> BrushWeights;
+
+public:
+	HydraulicErosion(Heightmap *argHeights, const ErosionSettings &argSettings);
+
+	/// Run whole passes, as many as fit into MaxDroplets (at least one), and refresh the aprons. Returns droplets simulated
+	unsigned long long Step(unsigned long long MaxDroplets);
+
+	/// Getters
+	bool IsFinished() const {return Pass >= PassesAmount;};
+	float GetProgress() const {return (PassesAmount > 0) ? (float(Pass) / PassesAmount) : (1.0f);};
+	unsigned long long GetDropletsDone() const {return DropletsDone;};
+	unsigned long long GetDropletsTotal() const {return DropletsPerRegion * RegionsPerRow * RegionsPerRow;};
+	unsigned int GetRegionsPerRow() const {return RegionsPerRow;};
+
+protected:
+	/// Simulate Amount droplets of one region in the current pass
+	void RunRegion(unsigned int RegionX, unsigned int RegionY, unsigned int Amount);
+
+	/// Simulate one droplet starting at (PosX, PosY) on a Width x Height buffer, stopping before its brush would reach the buffer edge
+	void RunDroplet(float *Buffer, int Width, int Height, float PosX, float PosY) const;
+
+private:
+	HydraulicErosion(const HydraulicErosion &other);
+	HydraulicErosion & operator= (const HydraulicErosion &other);
+};
@@ -4,6 +4,7 @@
 // --------------------------------------------------------------------
 
 #include "LandGLCanvas.h"
+#include "Timer.h"
 
 enum
 {
@@ -26,18 +27,7 @@ LandGLCanvas::LandGLCanvas(wxWindow *parent):
 wxGLCanvas(parent, wxID_ANY, NULL, wxDefaultPosition, wxDefaultSize, wxFULL_REPAINT_ON_RESIZE), m_spinTimer(this, SpinTimer), bOpenGLContextInitialized(false), framesCounter(0)
 {
     m_spinTimer.Start(-1);
-    usingHighFrequencyCounter = (QueryPerformanceFrequency(&frequency) != 0);   // Setting the flag, putting a frequnecy to the variable.
-
-    if (usingHighFrequencyCounter) // Setting the programStartMoment value.
-    {
-        LARGE_INTEGER Ticks;
-        QueryPerformanceCounter(&Ticks);
-        programStartMoment =  (float)(Ticks.QuadPart / (double)frequency.QuadPart);
-    }
-    else
-    {
-        programStartMoment = GetTickCount() / 1000.0f;
-    }
+    programStartMoment = GetTime();
 }
 
 // --------------------------------------------------------------------
@@ -113,18 +103,5 @@ void LandGLCanvas::UpdateFPS()
 // --------------------------------------------------------------------
 float LandGLCanvas::GetSecond()
 {
-  float tmpCounter;   // Current time.
-
-  if (usingHighFrequencyCounter) 
-  {
-    LARGE_INTEGER Ticks;
-    QueryPerformanceCounter(&Ticks);
-    tmpCounter = (float)(Ticks.QuadPart / (double)frequency.QuadPart);
-  }
-  else
-  {
-    tmpCounter = GetTickCount() / 1000.0f;
-  }
-
-  return tmpCounter - programStartMoment; // Returns: current time - program start moment = time since program start.
+  return (float)(GetTime() - programStartMoment); // Returns: current time - program start moment = time since program start.
 }
\ No newline at end of file
@@ -24,14 +24,8 @@ protected:
     /// True if OpenGL context already initialized
     bool bOpenGLContextInitialized;
 
-    // Flag: Is high frequency counter available?
-    bool usingHighFrequencyCounter;      
-
     // Stores the information about time when the program was started
-    float programStartMoment;        
-
-    // Frequency of high frequency counter.
-    LARGE_INTEGER frequency; 
+    double programStartMoment;        
 
     // How many frames we have in curret second?
     int framesCounter;  
@@ -5,6 +5,8 @@
 
 #include "LandGLContext.h"
 #include "LandscapeEditor.h"
+#include "TerrainFile.h"
+#include "Timer.h"
 
 #include <sstream>
 
@@ -33,19 +35,31 @@ static void CheckGLError()
     }
 }
 
+// --------------------------------------------------------------------
+static Heightmap * CreatePagedHeightmap(TerrainFile *File)
+{
+	unsigned int TilesPerRow = (File->GetSize() + File->GetTileSize() - 1) / File->GetTileSize();
+	unsigned int TileStride = File->GetTileSize() + 2 * File->GetHeader().Apron;
+
+	// Tiles paged out edited go to the overlay's scratch file, the terrain file only changes when it's saved
+	HeightmapOverlayStorage *Overlay = new HeightmapOverlayStorage(File, TilesPerRow * TilesPerRow, TileStride);
+
+	return new Heightmap(File->GetSize(), Overlay, LandscapeEditor::Inst()->GetPagingBudget(), File->GetTileSize());
+}
+
 // --------------------------------------------------------------------
 float LandGLContext::getSecond()
 {
-	return timeGetTime() / 1000.0f - programStartMoment; // Returns: current time - program start moment = time since program start.
+	return (float)(GetTime() - programStartMoment); // Returns: current time - program start moment = time since program start.
 }
 
 // --------------------------------------------------------------------
 LandGLContext::LandGLContext(wxGLCanvas *canvas):
 wxGLContext(canvas), MouseIntensity(350.0f), CurrentLandscape(0), LandscapeTexture(0), BrushTexture(1), SoilTexture(3), CameraSpeed(0.2f),
-OffsetX(0.0001f), OffsetY(0.0001f), ClipmapsAmount(8), VBO(0), IBOs(0), TBOs(0), IBOLengths(0), MovementModifier(10.0f), bNewLandscape(false),
-VisibleClipmapStrips(0), CurrentDisplayMode(LANDSCAPE), CurrentMovementMode(ATTACHED_TO_TERRAIN)
+OffsetX(0.0001f), OffsetY(0.0001f), Prefetcher(0), LastOffsetX(0.0001f), LastOffsetY(0.0001f), BacklogFrames(0), ClipmapsAmount(8), VBO(0), IBOs(0), TBOs(0), bClipmapArray(false), ClipmapArray(0), IBOLengths(0), MovementModifier(10.0f),
+ViewportWidth(1), ViewportHeight(1), VisibleClipmapStrips(0), CurrentDisplayMode(LANDSCAPE), CurrentMovementMode(ATTACHED_TO_TERRAIN)
 {
-	programStartMoment = timeGetTime() / 1000.0f;
+	programStartMoment = GetTime();
 
 	VisibleClipmapStrips = new ClipmapStripPair[ClipmapsAmount];
 
@@ -72,7 +86,55 @@ VisibleClipmapStrips(0), CurrentDisplayMode(LANDSCAPE), CurrentMovementMode(ATTA
 	else 
 		ERR("Failed to initialize GLEW!");
 
-    CurrentLandscape = new Landscape(9, 1.0f);
+    const wxString &PageFilePath = LandscapeEditor::Inst()->GetPageFilePath();
+    bool bQuantized = LandscapeEditor::Inst()->IsQuantized();
+
+    if (!PageFilePath.IsEmpty())
+    {
+        TerrainFile *File = new TerrainFile(PageFilePath.mb_str());
+
+        if (!File->IsOpen())
+        {
+            delete File;
+            File = new TerrainFile(PageFilePath.mb_str(), LandscapeEditor::Inst()->GetPagedMapSize(), 1.0f, Heightmap::DefaultTileSize, Heightmap::Apron,
+                                   bQuantized ? TERRAIN_ENCODING_UINT16 : TERRAIN_ENCODING_FLOAT32);
+        }
+
+        if (File->IsOpen())
+        {
+            CurrentLandscape = new Landscape(CreatePagedHeightmap(File), Landscape::DefaultClipmapRimWidth, File->GetOffset());
+        }
+        else
+        {
+            ERR("Failed to open page file " << PageFilePath.mb_str());
+            delete File;
+        }
+    }
+
+    if (CurrentLandscape == 0)
+    {
+        CurrentLandscape = new Landscape(Landscape::DefaultTerrainSize, Landscape::DefaultClipmapRimWidth, 1.0f, bQuantized);
+
+        // Replays generate the same map again from its size and seed
+        const wxString &RecordPath = LandscapeEditor::Inst()->GetStrokeRecordPath();
+
+        if (!RecordPath.IsEmpty())
+        {
+            // The storage the budget chose for the heights, not just --quantized - quantized or paged maps replay differently
+            unsigned int Flags = ((CurrentLandscape->HasQuantizedHeights()) ? (STROKE_RECORDING_QUANTIZED) : (0))
+                | ((CurrentLandscape->IsPagedFromScratch()) ? (STROKE_RECORDING_PAGED) : (0));
+
+            if (Recorder.Open(RecordPath.mb_str(), Landscape::DefaultTerrainSize, LandscapeEditor::Inst()->GetTerrainSeed(), Flags, LandscapeEditor::Inst()->GetPagingBudgetMB()))
+                LOG("Recording strokes to " << RecordPath.mb_str());
+            else
+                ERR("Can't create stroke recording " << RecordPath.mb_str());
+        }
+    }
+    else if (!LandscapeEditor::Inst()->GetStrokeRecordPath().IsEmpty())
+    {
+        WARN("Strokes are recorded on generated terrain only");
+    }
+
     LOG("Initial Landscape created");
 
     glClearColor(0.6f, 0.85f, 0.9f, 1.0f);
@@ -103,13 +165,28 @@ VisibleClipmapStrips(0), CurrentDisplayMode(LANDSCAPE), CurrentMovementMode(ATTA
         FatalError("Height Shader init failed");
     if (WireframeShad.Initialize("Wireframe") == false)
         FatalError("Wireframe Shader init failed");
-	if (ClipmapWireframeShad.Initialize("ClipmapWireframe") == false)
+
+	// Texture array versions of the clipmap vertex shaders sample a layer per level instead of a TBO, fragment shaders are the same
+	bClipmapArray = LandscapeEditor::Inst()->UsesClipmapTextureArray();
+
+	if (bClipmapArray)
+	{
+		ClipmapWireframeShad.UseTextureArray();
+		ClipmapLandscapeShad.UseTextureArray();
+	}
+
+	if (ClipmapWireframeShad.Initialize(bClipmapArray ? "ClipmapWireframeArray" : "ClipmapWireframe", "ClipmapWireframe") == false)
         FatalError("Clipmap Wireframe Shader init failed");
-	if (ClipmapLandscapeShad.Initialize("ClipmapLandscape") == false)
+	if (ClipmapLandscapeShad.Initialize(bClipmapArray ? "ClipmapLandscapeArray" : "ClipmapLandscape", "ClipmapLandscape") == false)
         FatalError("Clipmap Landscape Shader init failed");
     
 	SetShadersInitialUniforms();
 
+	// Validated only now, with every sampler on its own unit
+	if (LandscapeShad.Validate() == false || LightningOnlyShad.Validate() == false || HeightShad.Validate() == false || WireframeShad.Validate() == false
+		|| ClipmapWireframeShad.Validate() == false || ClipmapLandscapeShad.Validate() == false)
+		FatalError("Shader validation failed");
+
 	switch (CurrentDisplayMode)
 	{
 	case LANDSCAPE:
@@ -155,6 +232,9 @@ VisibleClipmapStrips(0), CurrentDisplayMode(LANDSCAPE), CurrentMovementMode(ATTA
 		WARN("Can't load Brush2a.png texture!");
 	}
 
+	if (!StampMask.Load("Content/Textures/Brush2a.png"))
+		WARN("Can't load Brush2a.png stamp mask!");
+
 
     // ----------------------------- Soil Texture --------------------------------
     glActiveTexture(GL_TEXTURE3);
@@ -177,16 +257,19 @@ VisibleClipmapStrips(0), CurrentDisplayMode(LANDSCAPE), CurrentMovementMode(ATTA
 
 	// ----------------------------- Texture Buffer Objects (TBOs) --------------------------------
 
-	TBOs = new GLuint[ClipmapsAmount];
-	glGenBuffers(ClipmapsAmount, TBOs);
-
-	int ClipmapScale = 1;
-
-	for (int i = 0; i < ClipmapsAmount; ++i)
+	if (bClipmapArray)
 	{
-		InitTBO(TBOs[i], ClipmapScale);
-		ClipmapScale *= 2;
+		glGenTextures(1, &ClipmapArray);
+		LOG("Clipmap levels kept in a texture array");
 	}
+	else
+	{
+		TBOs = new GLuint[ClipmapsAmount];
+		glGenBuffers(ClipmapsAmount, TBOs);
+	}
+
+	InitAllTBOs();
+	StartPrefetch();
 
     CheckGLError();
 
@@ -199,9 +282,15 @@ VisibleClipmapStrips(0), CurrentDisplayMode(LANDSCAPE), CurrentMovementMode(ATTA
 // --------------------------------------------------------------------
 LandGLContext::~LandGLContext(void)
 {
+	StopPrefetch();
+
 	glDeleteBuffers(1, &VBO);
 	glDeleteBuffers(IBO_MODES_AMOUNT, IBOs);
-	glDeleteBuffers(ClipmapsAmount, TBOs);
+	if (TBOs != 0)
+		glDeleteBuffers(ClipmapsAmount, TBOs);
+
+	glDeleteTextures(1, &ClipmapArray);
+	ClipmapUploads.Release();
 
 	glDeleteTextures(1, &LandscapeTexture);
     glDeleteTextures(1, &SoilTexture);
@@ -209,6 +298,7 @@ LandGLContext::~LandGLContext(void)
 
 	delete[] IBOs;
 	delete[] IBOLengths;
+	delete[] VisibleClipmapStrips;
 }
 
 // --------------------------------------------------------------------
@@ -230,7 +320,10 @@ void LandGLContext::SetShadersInitialUniforms()
 
 	ClipmapWireframeShad.Use();
 	ClipmapWireframeShad.SetBrushTextureSampler(1);
-	ClipmapWireframeShad.SetTBOSampler(2);
+	if (bClipmapArray)
+		ClipmapWireframeShad.SetClipmapSampler(2);
+	else
+		ClipmapWireframeShad.SetTBOSampler(2);
     ClipmapWireframeShad.SetBrushPosition(CurrentBrush.GetRenderPosition());
     ClipmapWireframeShad.SetBrushScale(CurrentBrush.GetRadius() * 2.0f);
     ClipmapWireframeShad.SetLandscapeVertexOffset(CurrentLandscape->GetOffset());
@@ -257,9 +350,20 @@ void LandGLContext::SetShadersInitialUniforms()
 	LandscapeShad.SetClipmapPartOffset(vec2(0.0f, 0.0f));
 	LandscapeShad.SetTextureSampler(0);
 
+	LightningOnlyShad.Use();
+	LightningOnlyShad.SetBrushTextureSampler(1);
+	LightningOnlyShad.SetTBOSampler(2);
+
+	HeightShad.Use();
+	HeightShad.SetBrushTextureSampler(1);
+	HeightShad.SetTBOSampler(2);
+
 	ClipmapLandscapeShad.Use();
     ClipmapLandscapeShad.SetBrushTextureSampler(1);
-    ClipmapLandscapeShad.SetTBOSampler(2);
+	if (bClipmapArray)
+		ClipmapLandscapeShad.SetClipmapSampler(2);
+	else
+		ClipmapLandscapeShad.SetTBOSampler(2);
     ClipmapLandscapeShad.SetBrushPosition(CurrentBrush.GetRenderPosition());
     ClipmapLandscapeShad.SetBrushScale(CurrentBrush.GetRadius() * 2.0f);
     ClipmapLandscapeShad.SetLandscapeVertexOffset(CurrentLandscape->GetOffset());
@@ -272,33 +376,90 @@ void LandGLContext::SetShadersInitialUniforms()
 }
 
 // --------------------------------------------------------------------
-void LandGLContext::InitTBO(GLuint TBOID, int ClipmapScale)
+void LandGLContext::InitTBO(GLuint TBOID, int ClipmapLevel)
+{
+	int TBOSize = Clipmaps.GetSize();
+
+	glActiveTexture(GL_TEXTURE2);
+	glBindBuffer(GL_TEXTURE_BUFFER, TBOID);
+	glBufferData(GL_TEXTURE_BUFFER, TBOSize * TBOSize * sizeof(float), Clipmaps.GetTexels(ClipmapLevel), GL_STATIC_DRAW);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, TBOID);
+}
+
+// --------------------------------------------------------------------
+void LandGLContext::InitTextureArray()
 {
-	int TBOSize = CurrentLandscape->GetTBOSize();
+	int TBOSize = Clipmaps.GetSize();
 
 	glActiveTexture(GL_TEXTURE2);
-	float *Data = new float[TBOSize * TBOSize];
-	float *Heightmap = CurrentLandscape->GetHeightmap();
-	int StartIndexX = CurrentLandscape->GetStartIndexX();
-	int StartIndexY = CurrentLandscape->GetStartIndexY();
-	unsigned int DataSize = CurrentLandscape->GetHeightDataSize();
+	glBindTexture(GL_TEXTURE_2D_ARRAY, ClipmapArray);
 
-	for (int x = 0; x < TBOSize; ++x)
+	// The cache keeps its levels one after another, as the layers go
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_R32F, TBOSize, TBOSize, ClipmapsAmount, 0, GL_RED, GL_FLOAT, Clipmaps.GetTexels(0));
+
+	// Texel centers read as they are, coordinates past the layer wrap around it like the windows do
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+}
+
+// --------------------------------------------------------------------
+void LandGLContext::InitAllTBOs()
+{
+	if (bClipmapArray)
+		InitTextureArray();
+	else
+		for (int i = 0; i < ClipmapsAmount; ++i)
+			InitTBO(TBOs[i], i);
+
+	// The TBOs hold all of it now
+	Clipmaps.ClearSpans();
+
+	// Regions fit all levels refilled at once, so only a frame both scrolling every level and editing may spill over
+	unsigned int RefillBytes = ClipmapsAmount * Clipmaps.GetSize() * Clipmaps.GetSize() * sizeof(float);
+	unsigned int DefaultRegionSize = UploadRing::DefaultRegionSize;
+
+	if (ClipmapUploads.Init(max(RefillBytes, DefaultRegionSize)))
+		LOG("Clipmap uploads staged in a persistently mapped ring, " << UploadRing::RegionsAmount << " x " << max(RefillBytes, DefaultRegionSize) << " bytes");
+	else
+		WARN("ARB_buffer_storage not available, clipmap uploads go through glBufferSubData");
+}
+
+// --------------------------------------------------------------------
+void LandGLContext::UploadClipmaps()
+{
+	UploadStats.FrameBytes = 0;
+	UploadStats.FrameUploads = 0;
+
+	ClipmapUploads.BeginFrame();
+
+	for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
 	{
-		for (int y = 0; y < TBOSize; ++y)
+		const std::vector<ClipmapSpan> &Spans = Clipmaps.GetSpans(lvl);
+		const float *Texels = Clipmaps.GetTexels(lvl);
+
+		// Staged and copied on the GPU's timeline, the TBOs drawn from in flight frames are never mapped
+		for (unsigned int i = 0; i < Spans.size() && !bClipmapArray; ++i)
 		{
-			int IndexX = int(mod(float(StartIndexX + ClipmapScale + ((TBOSize + 1) / 2) * (ClipmapScale - 1) + (x - TBOSize) * ClipmapScale), float(DataSize)));
-			int IndexY = int(mod(float(StartIndexY + ClipmapScale + ((TBOSize + 1) / 2) * (ClipmapScale - 1) + (y - TBOSize) * ClipmapScale), float(DataSize)));
+			ClipmapUploads.Upload(TBOs[lvl], Spans[i].Offset * sizeof(float), Texels + Spans[i].Offset, Spans[i].Count * sizeof(float));
 
-			Data[y * TBOSize + x] = Heightmap[IndexY * DataSize + IndexX];
+			UploadStats.FrameBytes += Spans[i].Count * sizeof(float);
+			UploadStats.FrameUploads++;
+		}
+
+		// A layer takes rectangles, a span wrapping around the rows is split into up to three
+		for (unsigned int i = 0; i < Spans.size() && bClipmapArray; ++i)
+		{
+			UploadStats.FrameUploads += ClipmapUploads.UploadTextureSpan(ClipmapArray, lvl, Clipmaps.GetSize(), Spans[i].Offset, Spans[i].Count, Texels);
+			UploadStats.FrameBytes += Spans[i].Count * sizeof(float);
 		}
 	}
-			
-	glBindBuffer(GL_TEXTURE_BUFFER, TBOID);
-	glBufferData(GL_TEXTURE_BUFFER, TBOSize * TBOSize * sizeof(float), Data, GL_STATIC_DRAW);
-	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, TBOID);
 
-	delete[] Data;
+	ClipmapUploads.EndFrame();
+	Clipmaps.ClearSpans();
+	UploadStats.TotalBytes += UploadStats.FrameBytes;
 }
 
 // --------------------------------------------------------------------
@@ -313,20 +474,35 @@ void LandGLContext::DrawScene()
     glActiveTexture(GL_TEXTURE2);
     glEnableVertexAttribArray(0);
 
+	// Every level is a layer of it, bound once for all of them
+	if (bClipmapArray)
+		glBindTexture(GL_TEXTURE_2D_ARRAY, ClipmapArray);
+
 	switch (CurrentDisplayMode)
 	{
 	case LANDSCAPE:	ClipmapLandscapeShad.SetgWorld(MVP);	break;
 	case WIREFRAME:	ClipmapWireframeShad.SetgWorld(MVP);	break;
 	}
 
+	// Levels lagging too far behind the camera are left out, the finer ones still drawn end the terrain earlier until they catch up
 	float Scale = 1.0f;
-	for (int lvl = 0; lvl < ClipmapsAmount; lvl++, Scale *= 2.0f)
+	for (int lvl = 0; lvl < Scheduler.GetDrawnLevels(); lvl++, Scale *= 2.0f)
 	{
 		switch (CurrentDisplayMode)
 		{
-		case LANDSCAPE: ClipmapLandscapeShad.SetClipmapScale(Scale); break;
+		case LANDSCAPE:
+			ClipmapLandscapeShad.SetClipmapScale(Scale);
+			ClipmapLandscapeShad.SetClipmapWindowX(Clipmaps.GetScrolledX(lvl));
+			ClipmapLandscapeShad.SetClipmapWindowY(Clipmaps.GetScrolledY(lvl));
+			if (bClipmapArray)
+				ClipmapLandscapeShad.SetClipmapLevel(lvl);
+			break;
 		case WIREFRAME: 
 			ClipmapWireframeShad.SetClipmapScale(Scale); 
+			ClipmapWireframeShad.SetClipmapWindowX(Clipmaps.GetScrolledX(lvl));
+			ClipmapWireframeShad.SetClipmapWindowY(Clipmaps.GetScrolledY(lvl));
+			if (bClipmapArray)
+				ClipmapWireframeShad.SetClipmapLevel(lvl);
 			if (lvl % 2 == 0)
 				ClipmapWireframeShad.SetWireframeColor(vec3(0.0f, 0.0f, 0.0f));
 			else
@@ -334,19 +510,21 @@ void LandGLContext::DrawScene()
 			break;
 		}
 
+		GLuint TBO = (bClipmapArray) ? (0) : (TBOs[lvl]);
+
 		switch (VisibleClipmapStrips[lvl])
 		{
 		case CLIPMAP_STRIP_1:
-			RenderLandscapeModule(lvl == 0 ? IBO_CENTER_1 : IBO_CLIPMAP_1, TBOs[lvl]);
+			RenderLandscapeModule(lvl == 0 ? IBO_CENTER_1 : IBO_CLIPMAP_1, TBO);
 			break;
 		case CLIPMAP_STRIP_2:
-			RenderLandscapeModule(lvl == 0 ? IBO_CENTER_2 : IBO_CLIPMAP_2, TBOs[lvl]);
+			RenderLandscapeModule(lvl == 0 ? IBO_CENTER_2 : IBO_CLIPMAP_2, TBO);
 			break;
 		case CLIPMAP_STRIP_3:
-			RenderLandscapeModule(lvl == 0 ? IBO_CENTER_3 : IBO_CLIPMAP_3, TBOs[lvl]);
+			RenderLandscapeModule(lvl == 0 ? IBO_CENTER_3 : IBO_CLIPMAP_3, TBO);
 			break;
 		case CLIPMAP_STRIP_4:
-			RenderLandscapeModule(lvl == 0 ? IBO_CENTER_4 : IBO_CLIPMAP_4, TBOs[lvl]);
+			RenderLandscapeModule(lvl == 0 ? IBO_CENTER_4 : IBO_CLIPMAP_4, TBO);
 			break;
 		}
 	}
@@ -360,8 +538,12 @@ void LandGLContext::DrawScene()
 // --------------------------------------------------------------------
 void LandGLContext::RenderLandscapeModule(const ClipmapIBOMode IBOMode, GLuint TBOID)
 {
-	glBindBuffer(GL_TEXTURE_BUFFER, TBOID);
-	glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, TBOID);
+	// A level's TBO is attached for every draw, the texture array stays bound (TBOID 0)
+	if (TBOID != 0)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, TBOID);
+		glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, TBOID);
+	}
 
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
 	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, (const GLvoid*)0);
@@ -492,12 +674,25 @@ void LandGLContext::OnKey(bool bKeyIsDown, wxKeyEvent& event)
         case WXK_SPACE:
             Keys[8] = bKeyIsDown;
             break;
+
+        case WXK_PAGEUP:
+            if (bKeyIsDown)
+                CurrentBrush.ModifyRotation(3.14159265f / 16.0f);
+            break;
+
+        case WXK_PAGEDOWN:
+            if (bKeyIsDown)
+                CurrentBrush.ModifyRotation(-3.14159265f / 16.0f);
+            break;
     }
 }
 
 // --------------------------------------------------------------------
 void LandGLContext::OnResize(wxSize NewSize)
 {
+    ViewportWidth = max(NewSize.x, 1);
+    ViewportHeight = max(NewSize.y, 1);
+
     glViewport(0, 0, NewSize.x, NewSize.y);
 	Projection = perspective(90.0f, ( (float)NewSize.x / (float)NewSize.y), 0.1f, 100000.0f);
 }
@@ -505,16 +700,32 @@ void LandGLContext::OnResize(wxSize NewSize)
 // --------------------------------------------------------------------
 void LandGLContext::UpdateBrushPosition()
 {
-    GLfloat winZ;
-    GLint viewport[4];
-    glGetIntegerv(GL_VIEWPORT, viewport);
+    // Ray through the cursor between the near and far planes, traced against the heightmap instead of reading back depth
+    vec4 Viewport(0.0f, 0.0f, ViewportWidth, ViewportHeight);
+    vec3 NearPos = unProject(vec3(MouseX, ViewportHeight - MouseY, 0.0f), View, Projection, Viewport);
+    vec3 FarPos = unProject(vec3(MouseX, ViewportHeight - MouseY, 1.0f), View, Projection, Viewport);
+    vec3 worldPos;
 
-    glReadPixels(MouseX, viewport[3] - MouseY, 1, 1, GL_DEPTH_COMPONENT, GL_FLOAT, &winZ);
-    vec3 screenPos = vec3(MouseX, viewport[3] - MouseY, winZ);
-    vec3 worldPos = unProject(screenPos, View, Projection, vec4(0.0f, 0.0f, viewport[2], viewport[3]));
+    if (!CurrentLandscape || !CurrentLandscape->PickTerrain(NearPos, FarPos - NearPos, OffsetX, OffsetY, length(FarPos - NearPos), worldPos))
+    {
+        // Painting off the terrain breaks the stroke, it doesn't bridge the gap
+        CurrentStroke.End();
+        return;
+    }
 
     CurrentBrush.SetPosition(worldPos);
 
+    // Every cursor position while painting extends the stroke, stamps fill the path in between
+    if (Keys[9])
+    {
+        vec2 Samples = CurrentLandscape->WorldToSamples(CurrentBrush.GetPosition(), OffsetX, OffsetY);
+        float Radius = CurrentBrush.GetRadius() / CurrentLandscape->GetOffset();
+        const BrushMaskShape *Shape = (CurrentBrush.HasImageMask()) ? (StampMask.GetShape(Radius, CurrentBrush.GetRotation())) : (0);
+
+        Recorder.Record(Samples.x, Samples.y, Radius, CurrentBrush.GetRotation(), CurrentBrush.GetMode(), Shape != 0, !CurrentStroke.IsActive());
+        CurrentStroke.MoveTo(Samples.x, Samples.y, Radius, CurrentBrush.GetMode(), Shape);
+    }
+
 	switch (CurrentDisplayMode)
 	{
 	case LANDSCAPE: ClipmapLandscapeShad.SetBrushPosition(CurrentBrush.GetRenderPosition()); break;
@@ -529,6 +740,7 @@ void LandGLContext::OnMouse(wxMouseEvent& event)
 
 	MouseX = event.GetX();
 	MouseY = event.GetY();
+    Keys[9] = event.LeftIsDown();
 
     if (event.RightIsDown())
     {
@@ -583,9 +795,6 @@ void LandGLContext::OnMouse(wxMouseEvent& event)
 
     if (event.RightUp())
         LandscapeEditor::Inst()->Frame->SetCursor(wxNullCursor);
-
-    if (event.LeftIsDown()) Keys[9] = true;
-    else  Keys[9] = false;
 }
 
 // --------------------------------------------------------------------
@@ -644,18 +853,91 @@ void LandGLContext::ManageInput()
 
 		View = lookAt(CameraPosition, CameraPosition + Direction, Up);
     }
+	else if (Scheduler.GetStats().BacklogLevels > 0)
+	{
+		// Levels put off by the budget catch up while the camera stands still
+		UpdateTBO();
+	}
+
+	if (!Keys[9])
+		CurrentStroke.End();
+
+	// All stamps laid this frame go to the edit worker in one batch, the map gets whatever batches it finished meanwhile. Both copy
+	// tiles of level 0 the prefetcher reads, and may page them in
+	{
+		wxMutexLocker Locker(PyramidLock);
+		CurrentLandscape->ApplyStamps(CurrentStroke.GetBatch());
+		Recorder.EndBatch();
+		CurrentLandscape->PublishEdits();
+	}
+
+	CurrentStroke.ClearBatch();
+
+	// No stamp points at the cached mask shapes anymore, queued batches have their own copies
+	StampMask.Trim();
+
+	// Everything edited this frame reaches the mips and stats in one incremental pass
+	std::vector<HeightmapRect> Changed;
+
+	{
+		wxMutexLocker Locker(PyramidLock);
+		CurrentLandscape->PropagateChanges(&Changed);
+
+		// Only texels depending on the changed samples are gathered again, and go to the TBOs along with the ones scrolled in
+		Clipmaps.Refresh(Changed);
+	}
+
+	// Blocks gathered ahead may hold the old heights
+	if (!Changed.empty() && Prefetcher != 0)
+	{
+		Prefetcher->Invalidate();
+		Clipmaps.DropStaged();
+	}
+
+	UploadClipmaps();
+
+	if (!Changed.empty())
+	{
+		UploadStats.StrokeBytes += UploadStats.FrameBytes;
+		UploadStats.StrokePeakFrameBytes = max(UploadStats.StrokePeakFrameBytes, UploadStats.FrameBytes);
+		UploadStats.StrokeFrames++;
+	}
+
+	// The worker may still be finishing the stroke's last batches, it's over once they stop coming
+	if (!CurrentStroke.IsActive() && UploadStats.StrokeFrames > 0 && Changed.empty())
+	{
+		const UploadRingStats &RingStats = ClipmapUploads.GetStats();
+
+		LOG("Stroke uploaded " << UploadStats.StrokeBytes << " bytes to the TBOs in " << UploadStats.StrokeFrames << " frames, at most " << UploadStats.StrokePeakFrameBytes
+			<< " per frame - refilling all levels takes " << ClipmapsAmount * CurrentLandscape->GetTBOSize() * CurrentLandscape->GetTBOSize() * sizeof(float));
+		LOG("    Upload ring: " << RingStats.TotalBytes - RingStats.DirectBytes << " bytes staged, " << RingStats.DirectBytes << " direct, waited for fences "
+			<< RingStats.FenceWaits << " times, " << RingStats.TotalFenceWaitTime * 1000.0 << " ms in total and " << RingStats.MaxFenceWaitTime * 1000.0 << " ms at most");
+
+		UploadStats.StrokeBytes = 0;
+		UploadStats.StrokePeakFrameBytes = 0;
+		UploadStats.StrokeFrames = 0;
+	}
 }
 
 // --------------------------------------------------------------------
-void LandGLContext::CreateNewLandscape(int Size)
+void LandGLContext::CreateNewLandscape(unsigned int TerrainSize, int ClipmapRimWidth)
 {
+    StopStrokeRecording("new landscape");
+
+    StopPrefetch();
+
     if (CurrentLandscape != 0)
         delete CurrentLandscape;
 
-    CurrentLandscape = new Landscape(Size, 1.0f);
+    CurrentLandscape = new Landscape(TerrainSize, ClipmapRimWidth, 1.0f, LandscapeEditor::Inst()->IsQuantized());
 
     ResetAllVBOIBO();
     ResetCamera();
+    SetShadersInitialUniforms();
+
+    // Rim width sets the TBO size, all of them get refilled
+    InitAllTBOs();
+    StartPrefetch();
 
     //if ((*CurrentShader) == LandscapeShad)
     //{
@@ -683,16 +965,20 @@ void LandGLContext::CreateNewLandscape(int Size)
 }
 
 // --------------------------------------------------------------------
-void LandGLContext::SaveLandscape(const char* FilePath)
+void LandGLContext::SaveLandscape(const char* FilePath, TerrainEncoding Encoding)
 {
-    //if (CurrentLandscape != 0)
-    //    CurrentLandscape->SaveToFile(FilePath);
+	if (CurrentLandscape == 0)
+		return;
 
-	//LOG("Saving...");
+	LOG("Saving...");
 
-	//LandscapeEditor::FileWrite(FilePath, DATA, DataSize * DataSize);
+	// Saving publishes the edits still queued
+	wxMutexLocker Locker(PyramidLock);
 
-	//LOG("Completed!");
+	if (CurrentLandscape->SaveToFile(FilePath, Encoding))
+		LOG("Completed!");
+	else
+		ERR("Failed to save " << FilePath);
 }
 
 // --------------------------------------------------------------------
@@ -700,32 +986,108 @@ void LandGLContext::OpenFromFile(const char* FilePath)
 {
 	LOG("Opening...");
 
-	//delete[] DATA;
+	TerrainFile *File = new TerrainFile(FilePath);
+
+	if (!File->IsOpen())
+	{
+		ERR("Can't open terrain file " << FilePath);
+		delete File;
+		return;
+	}
+
+	// Only the header is read here, tiles are mapped in as the clipmaps touch them
+	Heightmap *Heights = CreatePagedHeightmap(File);
+	float VerticesInterval = File->GetOffset();
+
+	StopStrokeRecording("landscape opened from file");
+	StopPrefetch();
+
+	if (CurrentLandscape != 0)
+		delete CurrentLandscape;
+
+	CurrentLandscape = new Landscape(Heights, Landscape::DefaultClipmapRimWidth, VerticesInterval);
+
+	ResetAllVBOIBO();
+	ResetCamera();
+	SetShadersInitialUniforms();
+	InitAllTBOs();
+	StartPrefetch();
+
+	for (int i = 0; i < ClipmapsAmount; ++i)
+		VisibleClipmapStrips[i] = CLIPMAP_STRIP_1;
+
+	LOG("Completed!");
+
+    CheckGLError();
+}
+
+// --------------------------------------------------------------------
+void LandGLContext::ErodeLandscape(unsigned long long Droplets)
+{
+	if (CurrentLandscape == 0)
+		return;
+
+	ErosionSettings Settings;
+	Settings.Seed = LandscapeEditor::Inst()->GetTerrainSeed();
+	Settings.Droplets = Droplets;
+
+	StopStrokeRecording("landscape eroded");
+
+	{
+		wxMutexLocker Locker(PyramidLock);
+		CurrentLandscape->Erode(Settings);
+		CurrentLandscape->PropagateChanges();
+
+		// Every texel may have changed, the levels are gathered again where they are
+		Clipmaps.Refill();
+	}
+
+	if (Prefetcher != 0)
+		Prefetcher->Invalidate();
+
+	UploadClipmaps();
 
-	//DATA = new float[DataSize * DataSize];
-	//unsigned int DataByteSize;
+	CheckGLError();
+}
 
-	//DATA = (float*)LandscapeEditor::FileRead(FilePath, DataByteSize);
-	//DataSize = sqrt((float)DataByteSize / 4.0);
-	//StartIndexY = StartIndexX = DataSize / 2.0f;
+// --------------------------------------------------------------------
+void LandGLContext::StartPrefetch()
+{
+	if (CurrentLandscape->GetHeightmap()->IsPaged())
+	{
+		LOG("Clipmap prefetch off, the heights are paged in from the file");
+		return;
+	}
 
-	//int ClipmapScale = 1;
-	//for (int i = 0; i < ClipmapsAmount; ++i)
-	//{
-	//	InitTBO(TBOs[i], ClipmapScale);
-	//	ClipmapScale *= 2;
-	//}
+	Prefetcher = new ClipmapPrefetcher(CurrentLandscape->GetHeightPyramid(), PyramidLock);
 
-	//ResetCamera();
-	//SetShadersInitialUniforms();
+	if (!Prefetcher->Start())
+	{
+		ERR("Can't start the clipmap prefetch thread, blocks are gathered as the camera scrolls them in");
+		delete Prefetcher;
+		Prefetcher = 0;
+	}
+}
 
-	//for (int i = 0; i < ClipmapsAmount; ++i)
-	//	VisibleClipmapStrips[i] = CLIPMAP_STRIP_1;
+// --------------------------------------------------------------------
+void LandGLContext::StopPrefetch()
+{
+	if (Prefetcher == 0)
+		return;
 
-	//bNewLandscape = true;
-	//LOG("Completed!");
+	Prefetcher->Stop();
+	delete Prefetcher;
+	Prefetcher = 0;
+}
 
- //   CheckGLError();
+// --------------------------------------------------------------------
+void LandGLContext::StopStrokeRecording(const char *Reason)
+{
+	if (!Recorder.IsOpen())
+		return;
+
+	Recorder.Close();
+	LOG("Stroke recording stopped (" << Reason << "), " << Recorder.GetEventsAmount() << " frames in " << Recorder.GetFilePath());
 }
 
 // --------------------------------------------------------------------
@@ -740,8 +1102,21 @@ void LandGLContext::FatalError(char* text)
 // --------------------------------------------------------------------
 void LandGLContext::ResetCamera()
 {
-	OffsetX = 0.0001f;
-	OffsetY = 0.0001f;
+	OffsetX = LastOffsetX = 0.0001f;
+	OffsetY = LastOffsetY = 0.0001f;
+
+	// Windows start over around the start index, TBOs have to be refilled afterwards
+	{
+		wxMutexLocker Locker(PyramidLock);
+		Clipmaps.Reset(CurrentLandscape->GetHeightPyramid(), ClipmapsAmount, CurrentLandscape->GetTBOSize(), CurrentLandscape->GetStartIndexX(), CurrentLandscape->GetStartIndexY());
+	}
+
+	Scheduler.Reset(ClipmapsAmount, CurrentLandscape->GetTBOSize(), LandscapeEditor::Inst()->GetClipmapBudget());
+	BacklogFrames = 0;
+
+	// Whatever was predicted from where the camera was is of no use now
+	if (Prefetcher != 0)
+		Prefetcher->Invalidate();
 
 	CameraPosition = vec3(0.0f, 100.0f, 0.0f);
 	CameraVerticalAngle = -1.57f;
@@ -797,114 +1172,66 @@ void LandGLContext::ResetAllVBOIBO()
 // --------------------------------------------------------------------
 void LandGLContext::UpdateTBO()
 {
-	static float *ClipmapLastUpdateOffsetX = 0;
-	static float *ClipmapLastUpdateOffsetY = 0;
-
-	if (bNewLandscape)
+	// Blocks the prefetcher gathered since the last frame are copied by the scroll instead of gathered
+	if (Prefetcher != 0)
 	{
-		delete [] ClipmapLastUpdateOffsetX;
-		delete [] ClipmapLastUpdateOffsetY;
-
-		ClipmapLastUpdateOffsetX = 0;
-		ClipmapLastUpdateOffsetY = 0;
-
-		bNewLandscape = false;
+		std::vector<ClipmapBlock*> Gathered;
+		Prefetcher->Collect(Gathered);
+		Clipmaps.Stage(Gathered);
 	}
 
-	if (ClipmapLastUpdateOffsetX == 0 && ClipmapLastUpdateOffsetY == 0)
+	// Windows follow the camera as far as the budget goes, texels coming into view are gathered now and uploaded with the edits at the end of the frame
 	{
-		ClipmapLastUpdateOffsetX = new float[ClipmapsAmount];
-		ClipmapLastUpdateOffsetY = new float[ClipmapsAmount];
+		wxMutexLocker Locker(PyramidLock);
+		Scheduler.Update(Clipmaps, OffsetX, OffsetY);
+	}
 
-		float scale11 = 1.0f;
+	const ClipmapSchedulerStats &SchedulerStats = Scheduler.GetStats();
 
-		for (int i = 0; i < ClipmapsAmount; ++i)
-		{
-			ClipmapLastUpdateOffsetX[i] = scale11;
-			ClipmapLastUpdateOffsetY[i] = scale11;
-			scale11 *= 2.0f;
-		}
+	if (SchedulerStats.BacklogLevels > 0)
+	{
+		if (BacklogFrames++ == 0)
+			BacklogStartStats = SchedulerStats;
 	}
+	else if (BacklogFrames > 0)
+	{
+		LOG("Clipmap levels caught up with the camera after " << BacklogFrames << " frames: " << SchedulerStats.DeferredLevels - BacklogStartStats.DeferredLevels
+			<< " level updates deferred, " << SchedulerStats.ForcedLevels - BacklogStartStats.ForcedLevels << " forced over the " << Scheduler.GetBudget() * 1e6
+			<< " us budget, " << SchedulerStats.HiddenLevels - BacklogStartStats.HiddenLevels << " levels hidden, " << SchedulerStats.MaxBacklogTexels
+			<< " texels pending at most, longest frame " << SchedulerStats.MaxFrameTime * 1e6 << " us");
 
-	float *BufferData32 = NULL;
-	int TBOSize = CurrentLandscape->GetTBOSize();
-	float *Heightmap = CurrentLandscape->GetHeightmap();
-	unsigned int DataSize = CurrentLandscape->GetHeightDataSize();
-	int StartIndexX = CurrentLandscape->GetStartIndexX();
-	int StartIndexY = CurrentLandscape->GetStartIndexY();
-	int ClipmapScale = 1;
+		BacklogFrames = 0;
+	}
 
-	for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+	// The camera keeps moving the way it moved last frame, the prefetcher gathers what that would scroll in
+	if (Prefetcher != 0)
 	{
-		float fDiffX = OffsetX - ClipmapLastUpdateOffsetX[lvl];
-		float fDiffY = OffsetY - ClipmapLastUpdateOffsetY[lvl];
-
-		int SignX = sign(fDiffX);
-		int SignY = sign(fDiffY);
-		
-		int	DiffX = floor((abs(fDiffX) + ClipmapScale) / (2.0f * ClipmapScale)) * SignX * 2.0f;
-		int	DiffY = floor((abs(fDiffY) + ClipmapScale) / (2.0f * ClipmapScale)) * SignY * 2.0f;
+		float PredictedX[ClipmapPrefetcher::FramesAhead];
+		float PredictedY[ClipmapPrefetcher::FramesAhead];
 
-		// Update VisibleClipmapStrip value
-		if (mod(OffsetX, 2.0f * ClipmapScale) < ClipmapScale)
+		for (int i = 0; i < ClipmapPrefetcher::FramesAhead; ++i)
 		{
-			if (mod(OffsetY, 2.0f * ClipmapScale) < ClipmapScale)
-				VisibleClipmapStrips[lvl] = CLIPMAP_STRIP_1;
-			else
-				VisibleClipmapStrips[lvl] = CLIPMAP_STRIP_2;
-		}
-		else
-		{
-			if (mod(OffsetY, 2.0f * ClipmapScale) < ClipmapScale)
-				VisibleClipmapStrips[lvl] = CLIPMAP_STRIP_3;
-			else
-				VisibleClipmapStrips[lvl] = CLIPMAP_STRIP_4;
+			PredictedX[i] = OffsetX + (OffsetX - LastOffsetX) * (i + 1);
+			PredictedY[i] = OffsetY + (OffsetY - LastOffsetY) * (i + 1);
 		}
 
-		if (DiffX != 0 || DiffY != 0)
-		{
-			glActiveTexture(GL_TEXTURE2);	
+		std::vector<ClipmapBlock> Predicted;
+		Clipmaps.PredictBlocks(PredictedX, PredictedY, ClipmapPrefetcher::FramesAhead, Predicted);
+		Prefetcher->Request(Predicted);
+	}
 
-			glBindBuffer(GL_TEXTURE_BUFFER, TBOs[lvl]);
-			glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, TBOs[lvl]);
-			BufferData32 = (float*)glMapBuffer(GL_TEXTURE_BUFFER, GL_WRITE_ONLY);
+	LastOffsetX = OffsetX;
+	LastOffsetY = OffsetY;
 
-			for (int j = 0; j < abs(DiffX); j++)
-			{
-				for (int i = max(0, DiffY); i < TBOSize + min(0, DiffY); i++)
-				{
-					int xTBO = int(mod(ClipmapLastUpdateOffsetX[lvl] / ClipmapScale - ((SignX > 0) ? (2.0f) : (1.0f)) + SignX * (j + 1), float(TBOSize)));
-					int yTBO = int(mod(ClipmapLastUpdateOffsetY[lvl] / ClipmapScale + i - 1.0f, float(TBOSize)));
-					int x = int(mod(StartIndexX + ((TBOSize + 3) / 2) * (ClipmapScale - 1) + ClipmapLastUpdateOffsetX[lvl] - ClipmapScale + SignX * (j * ClipmapScale + 1) - ((SignX < 0) ? ((TBOSize + 1) * ClipmapScale - 2.0f) : (0.0f)), float(DataSize)));
-					int y = int(mod(StartIndexY - ((TBOSize - 3) / 2) * (ClipmapScale - 1) - (TBOSize - 1.0f) + ClipmapLastUpdateOffsetY[lvl] - ClipmapScale + i * ClipmapScale, float(DataSize)));
-
-					BufferData32[yTBO * TBOSize + xTBO] = Heightmap[y * DataSize + x];
-				}
-			}
-		
-			for (int j = 0; j < abs(DiffY); j++)
-			{
-				for (int i = 0; i < TBOSize; i++)
-				{
-					int xTBO = int(mod(ClipmapLastUpdateOffsetX[lvl] / ClipmapScale + i - 1.0f + DiffX, float(TBOSize)));
-					int yTBO = int(mod(ClipmapLastUpdateOffsetY[lvl] / ClipmapScale - ((SignY > 0) ? (2.0f) : (1.0f)) + SignY * (j + 1), float(TBOSize)));
-					int x = int(mod(StartIndexX - ((TBOSize - 3) / 2) * (ClipmapScale - 1) - (TBOSize - 1.0f) + ClipmapLastUpdateOffsetX[lvl] - ClipmapScale + (i + DiffX) * ClipmapScale, float(DataSize)));
-					int y = int(mod(StartIndexY + ((TBOSize + 3) / 2) * (ClipmapScale - 1) + ClipmapLastUpdateOffsetY[lvl] - ClipmapScale + SignY * (j * ClipmapScale + 1) - ((SignY < 0) ? (TBOSize * ClipmapScale + (ClipmapScale - 2.0f)) : (0.0f)), float(DataSize)));
-
-					BufferData32[yTBO * TBOSize + xTBO] = Heightmap[y * DataSize + x];
-				}
-			}
+	// Which strips fill a level's ring depends on the camera's texel parity - mod(Offset, 2 * 2^lvl) < 2^lvl is bit lvl of floor(Offset)
+	int TexelX = int(floor(OffsetX));
+	int TexelY = int(floor(OffsetY));
 
-			glUnmapBuffer(GL_TEXTURE_BUFFER);	
-			
-			ClipmapLastUpdateOffsetX[lvl] += min(abs(DiffX), TBOSize) * SignX * ClipmapScale;
-			ClipmapLastUpdateOffsetY[lvl] += min(abs(DiffY), TBOSize) * SignY * ClipmapScale;
-		}
+	for (int lvl = 0; lvl < ClipmapsAmount; ++lvl)
+	{
+		if (((TexelX >> lvl) & 1) == 0)
+			VisibleClipmapStrips[lvl] = (((TexelY >> lvl) & 1) == 0) ? (CLIPMAP_STRIP_1) : (CLIPMAP_STRIP_2);
 		else
-		{
-			break;
-		}
-
-		ClipmapScale *= 2;
+			VisibleClipmapStrips[lvl] = (((TexelY >> lvl) & 1) == 0) ? (CLIPMAP_STRIP_3) : (CLIPMAP_STRIP_4);
 	}
-}
\ No newline at end of file
+}
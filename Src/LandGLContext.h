@@ -14,6 +14,12 @@
 #include "Landscape.h"
 #include "TextureManager.h"
 #include "Brush.h"
+#include "BrushStroke.h"
+#include "StrokeRecording.h"
+#include "ClipmapCache.h"
+#include "ClipmapScheduler.h"
+#include "UploadRing.h"
+#include "ClipmapPrefetcher.h"
 #include "LandscapeShader.h"
 #include "LightningOnlyShader.h"
 #include "HeightShader.h"
@@ -26,6 +32,19 @@ using namespace glm;
 enum DisplayMode {LANDSCAPE, WIREFRAME};
 enum MovementMode {FREE_CAMERA, ATTACHED_TO_TERRAIN};
 
+/** Bytes sent to the clipmap TBOs - this frame's, scrolling included, and the current stroke's edits so far */
+struct TBOUploadStats
+{
+	unsigned long long FrameBytes;
+	unsigned long long FrameUploads;
+	unsigned long long StrokeBytes;
+	unsigned long long StrokePeakFrameBytes;
+	unsigned long long StrokeFrames;
+	unsigned long long TotalBytes;
+
+	TBOUploadStats(): FrameBytes(0), FrameUploads(0), StrokeBytes(0), StrokePeakFrameBytes(0), StrokeFrames(0), TotalBytes(0) {};
+};
+
 /** the rendering context used by all GL canvases */
 class LandGLContext : public wxGLContext
 {
@@ -48,6 +67,10 @@ protected:
 	GLuint *IBOs;
 	GLuint *TBOs;
 
+	/// All levels as layers of one R32F texture instead of the TBOs (--texturearray), toroidal addressing done by GL_REPEAT
+	bool bClipmapArray;
+	GLuint ClipmapArray;
+
     /// Textures
     GLuint LandscapeTexture, BrushTexture, SoilTexture;
 
@@ -60,6 +83,15 @@ protected:
     /// Brush object
     Brush CurrentBrush;
 
+    /// Stroke painted while LMB is down, its stamps are applied once per frame
+    BrushStroke CurrentStroke;
+
+    /// Image the brush stamps with when its image mask is on - the cursor's own picture
+    BrushMask StampMask;
+
+    /// Records the cursor path of every stroke (--record), while the map is the generated one the editor started with
+    StrokeRecorder Recorder;
+
     /// Camera Position
     vec3 CameraPosition;
 
@@ -87,14 +119,36 @@ protected:
 
 	ClipmapStripPair *VisibleClipmapStrips;
 
-	LARGE_INTEGER frequency;
-	float programStartMoment;
-	bool usingHighFrequencyCounter;   
+	/// Texels of every level's TBO, kept following the camera and the edits. The TBOs mirror it, UploadClipmaps() sends what it changed
+	ClipmapCache Clipmaps;
+
+	/// Scrolls the cache's levels within the clipmap budget, coarse ones may lag a few frames behind
+	ClipmapScheduler Scheduler;
+
+	/// Frames the scheduler has left levels behind in a row, and its counters when that started
+	unsigned int BacklogFrames;
+	ClipmapSchedulerStats BacklogStartStats;
+
+	/// Staging ring the cache's spans reach the TBOs through
+	UploadRing ClipmapUploads;
+
+	/// Gathers the blocks the camera is about to scroll in on its own thread, 0 when the map is paged. The render thread holds
+	/// PyramidLock around everything reading or changing the pyramid while it runs
+	ClipmapPrefetcher *Prefetcher;
+	wxMutex PyramidLock;
+
+	/// Camera offsets of the previous frame, the prefetcher extrapolates the movement since
+	float LastOffsetX, LastOffsetY;
+
+	TBOUploadStats UploadStats;
 
-	bool bNewLandscape;
+	double programStartMoment;
 
 	int MouseX, MouseY;
 
+	/// Viewport size, kept from the last resize so picking doesn't have to query GL
+	int ViewportWidth, ViewportHeight;
+
 public:
     /// Standard constructor/destructor
     LandGLContext(wxGLCanvas *canvas);
@@ -118,20 +172,35 @@ public:
     /// Call this function regulary, calculate the input and moves camera
     void ManageInput();
 
-    /// Create new landscape
-    void CreateNewLandscape(int Size);
+    /// Create new generated landscape TerrainSize samples across, drawn with clipmap rings ClipmapRimWidth quads wide
+    void CreateNewLandscape(unsigned int TerrainSize, int ClipmapRimWidth);
 
-    /// Save landscape
-    void SaveLandscape(const char* FilePath);
+    /// Save landscape with given height encoding
+    void SaveLandscape(const char* FilePath, TerrainEncoding Encoding = TERRAIN_ENCODING_FLOAT32);
 
     /// Open landscape from file
     void OpenFromFile(const char* FilePath);
 
+    /// Run hydraulic erosion with given amount of droplets over the current landscape
+    void ErodeLandscape(unsigned long long Droplets);
+
     /// Manage fatal errors
     void FatalError(char* text = 0);
 
     /// Call when you want to change current brush mode
-    void ChangeBrushMode(int NewMode) {CurrentBrush.SetMode(NewMode);};
+    void ChangeBrushMode(BrushMode NewMode) {CurrentBrush.SetMode(NewMode);};
+
+    /// Call when you want to paint with the image mask, or with the circle again
+    void SetBrushImageMask(bool bImageMask) {CurrentBrush.SetImageMask(bImageMask);};
+
+    /// Bytes sent to the TBOs
+    const TBOUploadStats & GetUploadStats() const {return UploadStats;};
+
+    /// Bytes staged per frame and time spent waiting for the staging fences
+    const UploadRingStats & GetUploadRingStats() const {return ClipmapUploads.GetStats();};
+
+    /// Time spent scrolling the clipmap levels and the updates left for later frames
+    const ClipmapSchedulerStats & GetClipmapSchedulerStats() const {return Scheduler.GetStats();};
 
 protected:
     /// Reset camera to default position
@@ -143,10 +212,30 @@ protected:
     /// Reset TBO
 	void UpdateTBO();
 
+	/// Run the prefetcher over the current landscape, unless its heights are paged in - the pager isn't safe to use from two threads
+	void StartPrefetch();
+
+	/// Stop and delete the prefetcher, before the landscape goes away
+	void StopPrefetch();
+
+	/// Close the stroke recording once the map changes some other way than by strokes, a replay couldn't follow
+	void StopStrokeRecording(const char *Reason);
+
 	/// Set vertical synchronization status
 	void SetVSync(bool sync);
 
-	void InitTBO(GLuint TBOID, int ClipmapScale = 1);
+	/// Fill the whole TBO of the level with its cached texels
+	void InitTBO(GLuint TBOID, int ClipmapLevel = 0);
+
+	/// Fill the texture array with every level's cached texels
+	void InitTextureArray();
+
+	/// Fill every TBO, or the texture array, anew once the cache was reset
+	void InitAllTBOs();
+
+	/// Send every level the texels the cache wrote since the last upload, one staged copy per span - per row block of a span for the texture array
+	void UploadClipmaps();
+
 	void SetShadersInitialUniforms();
 	void RenderLandscapeModule(const ClipmapIBOMode IBOMode, GLuint TBOID);
 	void ResetVBO(GLuint &BufferID, float *NewData, int DataSize);
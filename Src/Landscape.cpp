@@ -5,83 +5,120 @@
 
 #include "Landscape.h"
 #include "LandscapeEditor.h"
+#include "TerrainGenerator.h"
 
 // --------------------------------------------------------------------
-Landscape::Landscape(int ClipmapRimWidth, float VerticesInterval):
-RestartIndex(0xFFFFFFFF), Offset(VerticesInterval), VBOSize(0), IBOSize(0), TBOSize(0), HeightData(0), HeightDataSize(0), StartIndexX(0), StartIndexY(0)
+Landscape::Landscape(unsigned int TerrainSize, int ClipmapRimWidth, float VerticesInterval, bool bQuantized):
+RestartIndex(0xFFFFFFFF), Offset(VerticesInterval), VBOSize(0), IBOSize(0), TBOSize(0), HeightData(0), HeightDataSize(0), StartIndexX(0), StartIndexY(0), HeightPyramid(0), HeightStats(0), HeightBounds(0), bQuantizedHeights(false), Edits(0)
 {
-	ClipmapIBOsData = new unsigned int*[IBO_MODES_AMOUNT];
+	CreateClipmapGeometry(ClipmapRimWidth);
 
-	IBOSize = new unsigned int[IBO_MODES_AMOUNT];
+	HeightDataSize = TerrainSize;
 
-	ClipmapVBOWidth = ClipmapRimWidth * 4 + 4;
-	TBOSize = ClipmapRimWidth * 4 + 5;
+	const unsigned int TileStride = Heightmap::DefaultTileSize + 2 * Heightmap::Apron;
+	unsigned int TilesPerRow = (HeightDataSize + Heightmap::DefaultTileSize - 1) / Heightmap::DefaultTileSize;
+	unsigned long long TilesAmount = (unsigned long long)TilesPerRow * TilesPerRow;
+	const unsigned long long Budget = LandscapeEditor::Inst()->GetPagingBudget();
 
-	CreateVBO();
+	// Quantized tiles share the budget with the float tiles decoded from them, which need at least the minimal cache
+	const unsigned long long MinCacheBytes = (unsigned long long)Heightmap::MinResidentTiles * TileStride * TileStride * sizeof(float);
+	const unsigned long long QuantizedTileBytes = TileStride * TileStride * sizeof(unsigned short);
 
-	for (int i = 0; i < IBO_MODES_AMOUNT; ++i)
-		CreateIBO((ClipmapIBOMode)i);
+	if (!bQuantized && TilesAmount * TileStride * TileStride * sizeof(float) <= Budget)
+	{
+		HeightData = new Heightmap(HeightDataSize);
+	}
+	else if (TilesAmount * QuantizedTileBytes + MinCacheBytes <= Budget)
+	{
+		HeightData = new Heightmap(HeightDataSize, new QuantizedHeightmapStorage((unsigned int)TilesAmount, TileStride), Budget - TilesAmount * QuantizedTileBytes);
+		bQuantizedHeights = true;
+	}
+	else
+	{
+		char TempDirectory[MAX_PATH], TempPath[MAX_PATH];
 
+		if (GetTempPathA(MAX_PATH, TempDirectory) != 0 && GetTempFileNameA(TempDirectory, "ter", 0, TempPath) != 0)
+		{
+			TerrainFile *File = new TerrainFile(TempPath, HeightDataSize, Offset, Heightmap::DefaultTileSize, Heightmap::Apron,
+												bQuantized ? TERRAIN_ENCODING_UINT16 : TERRAIN_ENCODING_FLOAT32);
 
-	HeightDataSize = 424;
-	StartIndexX = StartIndexY = 210;
+			if (File->IsOpen())
+			{
+				ScratchFilePath = TempPath;
+				HeightData = new Heightmap(HeightDataSize, File, Budget);
+				bQuantizedHeights = bQuantized;
+			}
+			else
+			{
+				ERR("Failed to create scratch terrain file " << TempPath);
+				delete File;
+				DeleteFileA(TempPath);
+			}
+		}
+		else
+		{
+			ERR("Failed to get a scratch terrain file path");
+		}
 
-	HeightData = new float[HeightDataSize * HeightDataSize];
+		// Without a scratch file the terrain shrinks to as many quantized tiles as the budget holds, at least one
+		if (HeightData == 0)
+		{
+			TilesPerRow = max((unsigned int)sqrt(double((Budget > MinCacheBytes) ? ((Budget - MinCacheBytes) / QuantizedTileBytes) : (0))), 1u);
+			TilesPerRow = min(TilesPerRow, (HeightDataSize + Heightmap::DefaultTileSize - 1) / Heightmap::DefaultTileSize);
+			TilesAmount = (unsigned long long)TilesPerRow * TilesPerRow;
+			HeightDataSize = min(HeightDataSize, TilesPerRow * Heightmap::DefaultTileSize);
 
-	LOG("Generating terrain data...");
+			WARN("Terrain reduced to " << HeightDataSize << " x " << HeightDataSize << " to stay resident");
 
-	for (unsigned int i = 0; i < HeightDataSize; ++i)
-	{
-		for (unsigned int j = 0; j < HeightDataSize; ++j)
-		{
-			//HeightData[i + HeightDataSize * j] = 10.0f + i / 10.0f;
-			//HeightData[i + HeightDataSize * j] = (i % 32) / 8.0f + 430.0f;
-			//HeightData[i + HeightDataSize * j] = (j % 512 == 113 || i % 512 == 113) ? (20.0f) : (0.0f);
-			//HeightData[i + HeightDataSize * j] = 93.8f;
-			//HeightData[i + HeightDataSize * j] = 50.0f + sin(float(i) / 3.0f) * 1.0f + sin(float(j) / 5.6f) * 1.6f;
-			//HeightData[i + HeightDataSize * j] = 20.0f + j / 11.0f + i / 4.36f;
-			//HeightData[i + HeightDataSize * j] = sin(float(j) / 400.f) * 80.0f + 300.0f;
-			HeightData[i + HeightDataSize * j] = 70.0f + sin(float(i) / 10.0f) * 2.0f + sin(float(j) / 25.6f) * 10.6f;
-
-			//float a = sin(float(i) / (1.0 * 704.0f)) * 30.0f;
-			//float b = sin(float(i) / (1.0 * 352.0f)) * 25.0f;
-			//float c = (sin(float(j) / (1.0 * 469.4f)) - (cos(float(j) / (1.0 * 234.7f)) + 1.0f) / 4.5f) * 30.0f;
-			//float d = sin(float(j) / (2.0 * 58.f)) * 3.0f + sin(float(i) / (2.0 * 122.f)) * 5.0f;
-			//float e = sin(float(i) / (3.0 * 2.0f)) * 0.8f * cos(float(j) / (3.0 * 6.2f)) * 0.6f + sin(float(j) / (3.0 * 2.3f)) * 0.8f * cos(float(i) / (3.0 * 6.4f)) * 0.5f;
-			//HeightData[i + HeightDataSize * j] = (a + b + c + d + e) * 5.0f;
+			HeightData = new Heightmap(HeightDataSize, new QuantizedHeightmapStorage((unsigned int)TilesAmount, TileStride),
+									   (Budget > TilesAmount * QuantizedTileBytes) ? (Budget - TilesAmount * QuantizedTileBytes) : (0));
+			bQuantizedHeights = true;
 		}
-
-		if (HeightDataSize > 10 && i % (HeightDataSize / 10) == 0)
-			LOG("Progress: " << i / (HeightDataSize / 10) * 10 << "%");
 	}
 
-	StartIndexX += TBOSize / 2;
-	StartIndexY += TBOSize / 2;
+	StartIndexX = StartIndexY = HeightDataSize / 2 + TBOSize / 2;
+
+	LOG("Generating " << HeightDataSize << " x " << HeightDataSize << " terrain"
+		<< ((!HeightData->IsPaged()) ? ("") : ((ScratchFilePath.empty()) ? (", 16-bit quantized") : (", paged from scratch file"))) << "...");
+
+	TerrainNoiseSettings Settings;
+	Settings.Seed = LandscapeEditor::Inst()->GetTerrainSeed();
+
+	DWORD StartTime = GetTickCount();
+	TerrainGenerator::Generate(HeightData, Settings);
+	LOG("Generated in " << (GetTickCount() - StartTime) / 1000.0 << " s, seed " << Settings.Seed);
+
+	CreateDerivedData();
 
 	LOG("Terrain Ready!\n");
 }
 
 // --------------------------------------------------------------------
-Landscape::Landscape(const char* FilePath):
-RestartIndex(0xFFFFFFFF), Offset(0.25f)
+Landscape::Landscape(Heightmap *argHeightData, int ClipmapRimWidth, float VerticesInterval):
+RestartIndex(0xFFFFFFFF), Offset(VerticesInterval), VBOSize(0), IBOSize(0), TBOSize(0), HeightData(argHeightData), HeightDataSize(0), StartIndexX(0), StartIndexY(0), HeightPyramid(0), HeightStats(0), HeightBounds(0), bQuantizedHeights(false), Edits(0)
 {
-    unsigned int DataByteSize;
+	CreateClipmapGeometry(ClipmapRimWidth);
 
-    HeightData = (float*)LandscapeEditor::FileRead(FilePath, DataByteSize);
-    ClipmapVBOWidth = sqrt((float)DataByteSize / 4.0);
+	HeightDataSize = HeightData->GetSize();
+	StartIndexX = StartIndexY = HeightDataSize / 2 + TBOSize / 2;
 
-    //CenterVBOData = new float[ClipmapVBOsWidth[0] * ClipmapVBOsWidth[0] * 2];
+	CreateDerivedData();
 
-    //for (unsigned int x = 0; x < ClipmapVBOsWidth[0]; x++)
-    //{
-    //    for (unsigned int z = 0; z < ClipmapVBOsWidth[0]; z++)
-    //    {
-    //        CenterVBOData[2 * (z * ClipmapVBOsWidth[0] + x)] = Offset * x;
-    //        CenterVBOData[2  * (z * ClipmapVBOsWidth[0] + x) + 1] = Offset * z;
-    //    }
-    //}
+	if (!HeightData->IsPaged())
+		return;
 
-    //CreateIndexBuffers();
+	LOG("Paged terrain " << HeightDataSize << " x " << HeightDataSize << ", " << HeightData->GetPagingStats().MaxResidentTiles << " tiles resident at most");
+
+	// Decode the finest clipmap levels' area up front in one batch - in parallel for compressed terrain files
+	int PrefetchHalf = min(int(HeightDataSize), int(TBOSize) * 4) / 2;
+	DWORD StartTime = GetTickCount();
+
+	HeightData->Prefetch(HeightmapRect(HeightDataSize / 2 - PrefetchHalf, HeightDataSize / 2 - PrefetchHalf, HeightDataSize / 2 + PrefetchHalf, HeightDataSize / 2 + PrefetchHalf));
+
+	unsigned long long Tiles = HeightData->GetPagingStats().Misses;
+	double Seconds = (GetTickCount() - StartTime + 1) / 1000.0;
+
+	LOG("Prefetched " << Tiles << " tiles, " << Tiles * HeightData->GetTileStride() * HeightData->GetTileStride() * sizeof(float) / double(1 << 20) / Seconds << " MB/s");
 }
 
 // --------------------------------------------------------------------
@@ -93,7 +130,121 @@ Landscape::~Landscape()
 	delete [] ClipmapIBOsData;
 	delete [] ClipmapVBOData;
 
-	delete [] HeightData;
+	if (Edits != 0)
+	{
+		Edits->Stop();
+		delete Edits;
+	}
+
+	delete HeightBounds;
+	delete HeightStats;
+	delete HeightPyramid;
+	delete HeightData;
+
+	if (!ScratchFilePath.empty())
+		DeleteFileA(ScratchFilePath.c_str());
+}
+
+// --------------------------------------------------------------------
+void Landscape::CreateClipmapGeometry(int ClipmapRimWidth)
+{
+	ClipmapIBOsData = new unsigned int*[IBO_MODES_AMOUNT];
+
+	IBOSize = new unsigned int[IBO_MODES_AMOUNT];
+
+	ClipmapVBOWidth = ClipmapRimWidth * 4 + 4;
+	TBOSize = ClipmapRimWidth * 4 + 5;
+
+	CreateVBO();
+
+	for (int i = 0; i < IBO_MODES_AMOUNT; ++i)
+		CreateIBO((ClipmapIBOMode)i);
+}
+
+// --------------------------------------------------------------------
+void Landscape::CreateDerivedData()
+{
+	// Clipmap samples lie at StartIndex - (TBOSize + 1) / 2 + k * ClipmapScale, levels are aligned to that grid
+	int OriginX = StartIndexX - int(TBOSize + 1) / 2;
+	int OriginY = StartIndexY - int(TBOSize + 1) / 2;
+
+	HeightPyramid = new HeightmapPyramid(HeightData, OriginX, OriginY, HeightmapPyramid::DefaultLevels, LandscapeEditor::Inst()->GetPagingBudget());
+
+	HeightStats = new HeightmapTileStats(HeightData);
+
+	// Paged maps get their tile ranges as rays reach them
+	if (!HeightData->IsPaged())
+		HeightStats->ComputeAll();
+
+	HeightBounds = new HeightmapQuadtree(HeightData, HeightStats);
+
+	// Mips before anything that could be derived from them, the quadtree reads stats
+	Changes.AddConsumer(HeightPyramid);
+	Changes.AddConsumer(HeightStats);
+	Changes.AddConsumer(HeightBounds);
+
+	LOG("Height mip pyramid: " << HeightPyramid->GetLevelsAmount() - 1 << " prefiltered levels");
+
+	// The edit worker copies only the tiles strokes touch, paged maps get one too - an eighth of the budget for those copies
+	Edits = new EditWorker(HeightData, LandscapeEditor::Inst()->GetPagingBudget() / 8);
+
+	if (!Edits->Start())
+	{
+		WARN("Can't start the edit worker, brushes are applied between frames");
+		delete Edits;
+		Edits = 0;
+	}
+}
+
+// --------------------------------------------------------------------
+void Landscape::Erode(const ErosionSettings &Settings)
+{
+	FinishEdits();
+
+	HydraulicErosion Erosion(HeightData, Settings);
+
+	LOG("Eroding " << Erosion.GetDropletsTotal() << " droplets in " << Erosion.GetRegionsPerRow() * Erosion.GetRegionsPerRow() << " regions...");
+
+	DWORD StartTime = GetTickCount();
+
+	while (!Erosion.IsFinished())
+	{
+		Erosion.Step(Erosion.GetDropletsTotal() / 10);
+		LOG("Progress: " << int(Erosion.GetProgress() * 100.0f) << "%");
+	}
+
+	double Seconds = (GetTickCount() - StartTime + 1) / 1000.0;
+
+	LOG("Eroded in " << Seconds << " s, " << Erosion.GetDropletsDone() / Seconds << " droplets/s");
+
+	Changes.MarkDirty(HeightmapRect(0, 0, HeightDataSize, HeightDataSize));
+
+	if (Edits != 0)
+		Edits->Sync();
+}
+
+// --------------------------------------------------------------------
+bool Landscape::PickTerrain(const vec3 &RayOrigin, const vec3 &RayDirection, float OffsetX, float OffsetY, float MaxDistance, vec3 &outPosition)
+{
+	// Heights are taken as they are, only x and z are in samples
+	vec2 Samples = WorldToSamples(vec2(RayOrigin.x, RayOrigin.z), OffsetX, OffsetY);
+	vec3 Origin(Samples.x, RayOrigin.y, Samples.y);
+	vec3 Direction(RayDirection.x / Offset, RayDirection.y, RayDirection.z / Offset);
+	float Length = length(RayDirection);
+	float HitT;
+
+	if (Length <= 0.0f || !HeightBounds->Raycast(Origin, Direction, MaxDistance / Length, HitT))
+		return false;
+
+	outPosition = RayOrigin + RayDirection * HitT;
+	return true;
+}
+
+// --------------------------------------------------------------------
+vec2 Landscape::WorldToSamples(const vec2 &WorldPosition, float OffsetX, float OffsetY) const
+{
+	// World x, z of the camera column map to samples StartIndex - (TBOSize + 1) / 2 + Offset
+	return vec2(StartIndexX - int(TBOSize + 1) / 2 + OffsetX + WorldPosition.x / Offset, StartIndexY - int(TBOSize + 1) / 2 + OffsetY + WorldPosition.y / Offset);
 }
 
 // --------------------------------------------------------------------
@@ -303,78 +454,166 @@ void Landscape::CreateIBO(ClipmapIBOMode Mode)
 }
 
 // --------------------------------------------------------------------
-bool Landscape::SaveToFile(const char* FilePath)
+bool Landscape::SaveToFile(const char* FilePath, TerrainEncoding Encoding)
 {
-    LandscapeEditor::FileWrite(FilePath, HeightData, ClipmapVBOWidth * ClipmapVBOWidth);
+    // Strokes still in the queue belong to the saved map
+    FinishEdits();
+
+    HeightmapOverlayStorage *Overlay = dynamic_cast<HeightmapOverlayStorage*>(HeightData->GetStorage());
+    TerrainFile *CurrentFile = (Overlay != 0) ? (dynamic_cast<TerrainFile*>(Overlay->GetBase())) : (0);
+
+    // Saving back to the file the map is paged from - only tiles changed since it was opened get written (and requantized)
+    if (CurrentFile != 0 && CurrentFile->GetFilePath() == FilePath)
+        return SaveToOpenedFile(Overlay, CurrentFile, Encoding);
+
+    TerrainFile *NewFile = new TerrainFile(FilePath, HeightDataSize, Offset, HeightData->GetTileSize(), Heightmap::Apron, Encoding);
+    DWORD StartTime = GetTickCount();
+
+    if (!NewFile->IsOpen() || !HeightData->SaveAs(NewFile))
+    {
+        delete NewFile;
+        return false;
+    }
+
+    if (Encoding == TERRAIN_ENCODING_COMPRESSED)
+    {
+        double RawBytes = double(HeightDataSize) * HeightDataSize * sizeof(float);
+        double Seconds = (GetTickCount() - StartTime + 1) / 1000.0;
+
+        LOG("Compressed " << RawBytes / (1 << 20) << " MB of heights at " << RawBytes / (1 << 20) / Seconds << " MB/s, ratio "
+            << RawBytes / NewFile->GetFileLength() << ":1");
+    }
+
+    if (Encoding == TERRAIN_ENCODING_UINT16)
+    {
+        float MaxError = 0.0f;
+        unsigned int TilesAmount = HeightData->GetTilesPerRow() * HeightData->GetTilesPerRow();
+
+        for (unsigned int i = 0; i < TilesAmount; ++i)
+            MaxError = max(MaxError, NewFile->GetTileError(i));
+
+        LOG("Heights quantized to 16 bits, max error " << MaxError);
+    }
+
+    delete NewFile;
 
     return true;
 }
 
 // --------------------------------------------------------------------
-void Landscape::UpdateHeightmap(Brush &AffectingBrush)
+bool Landscape::SaveToOpenedFile(HeightmapOverlayStorage *Overlay, TerrainFile *File, TerrainEncoding Encoding)
 {
-    vec2 CurrentVec;
-    vec2 BrushPosition = AffectingBrush.GetPosition();
-    float BrushRadius = AffectingBrush.GetRadius();
-    float Distance, DistanceFactor;
-    float HeightDifference;
-    float HeightAverage = 0, HeightSum = 0;
-    int Counter = 0;
-
-    if (AffectingBrush.GetMode())
+    // Dirty tiles still in memory join the ones already paged out to the overlay
+    if (!HeightData->Flush())
+        return false;
+
+    // Another encoding - the whole map goes to a new file, which then replaces the opened one
+    if (Encoding != File->GetEncoding())
     {
-        for (unsigned int x = 0; x < ClipmapVBOWidth; x++)
+        std::string TempPath = File->GetFilePath() + ".tmp";
+        TerrainFile *NewFile = new TerrainFile(TempPath.c_str(), HeightDataSize, Offset, HeightData->GetTileSize(), Heightmap::Apron, Encoding);
+
+        bool bConverted = NewFile->IsOpen() && HeightData->SaveAs(NewFile);
+        delete NewFile;
+
+        if (bConverted)
         {
-            for (unsigned int z = 0; z < ClipmapVBOWidth; z++)
-            {
-                CurrentVec.x = ClipmapVBOData[2 * (z * ClipmapVBOWidth + x)];
-                CurrentVec.y = ClipmapVBOData[2 * (z * ClipmapVBOWidth + x) + 1];
-
-                Distance = distance(CurrentVec, BrushPosition);
-                
-                if (Distance <= BrushRadius)
-                {
-                    Counter++;
-                    HeightSum += HeightData[z * ClipmapVBOWidth + x];
-                }
-            }
+            File->Close();
+            bConverted = MoveFileExA(TempPath.c_str(), File->GetFilePath().c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
         }
 
-        HeightAverage = HeightSum / Counter;
-    }
+        if (!bConverted)
+            DeleteFileA(TempPath.c_str());
 
-    for (unsigned int x = 0; x < ClipmapVBOWidth; x++)
-    {
-        for (unsigned int z = 0; z < ClipmapVBOWidth; z++)
+        // The converted file, or the old one if it couldn't be replaced - the changed tiles are still in the overlay then
+        if (!File->Reopen(false))
         {
-            CurrentVec.x = ClipmapVBOData[2 * (z * ClipmapVBOWidth + x)];
-            CurrentVec.y = ClipmapVBOData[2 * (z * ClipmapVBOWidth + x) + 1];
-
-            Distance = distance(CurrentVec, BrushPosition);
-
-            if (Distance <= BrushRadius)
-            {
-                DistanceFactor = 1.0f - Distance / BrushRadius;
-
-                switch (AffectingBrush.GetMode())
-                {
-                case 0:           
-                    HeightData[z * ClipmapVBOWidth + x] += 0.15f * ((DistanceFactor < 0.5f) ? (pow(DistanceFactor, 2)) : (0.5f - pow(1.0f - DistanceFactor, 2))); 
-                    break;
-                case 1:
-                    HeightData[z * ClipmapVBOWidth + x] -= 0.15f * ((DistanceFactor < 0.5f) ? (pow(DistanceFactor, 2)) : (0.5f - pow(1.0f - DistanceFactor, 2))); 
-                    break;
-                case 2:
-                    HeightDifference = HeightAverage - HeightData[z * ClipmapVBOWidth + x];
-                    HeightData[z * ClipmapVBOWidth + x] += 0.02f * HeightDifference;
-                    break;
-                case 3:
-                    HeightData[z * ClipmapVBOWidth + x] += 0.15f * ((DistanceFactor < 0.5f) ? (pow(DistanceFactor, 2)) : (pow(1.0f - DistanceFactor, 2))); 
-                    break;
-                }
-            }   
+            ERR("Can't reopen " << File->GetFilePath());
+            return false;
         }
+
+        if (!bConverted)
+            return false;
+
+        Overlay->ClearModified();
+        LOG("Converted " << File->GetFilePath() << " to encoding " << Encoding);
+
+        return true;
     }
+
+    unsigned int ChangedTiles = Overlay->GetModifiedTiles();
+
+    // The file is opened read-only, it accepts writes for the time of the save only
+    if (!File->Reopen(true))
+    {
+        ERR(File->GetFilePath() << " can't be opened for writing");
+        File->Reopen(false);
+        return false;
+    }
+
+    bool bCommitted = Overlay->Commit();
+
+    if (!File->Reopen(false) || !bCommitted)
+        return false;
+
+    LOG("Wrote " << ChangedTiles << " changed tiles back to " << File->GetFilePath());
+
+    return true;
+}
+
+// --------------------------------------------------------------------
+void Landscape::UpdateHeightmap(Brush &AffectingBrush)
+{
+    // Brush position and radius are expressed in heightmap samples, only the brush footprint is visited
+    BrushStamp Stamp(AffectingBrush.GetPosition().x, AffectingBrush.GetPosition().y, AffectingBrush.GetRadius(), AffectingBrush.GetMode());
+
+    ApplyStamps(std::vector<BrushStamp>(1, Stamp));
+}
+
+// --------------------------------------------------------------------
+void Landscape::ApplyStamps(const std::vector<BrushStamp> &Stamps)
+{
+    if (Stamps.empty())
+        return;
+
+    if (Edits != 0)
+    {
+        Edits->Queue(&Stamps[0], Stamps.size());
+        return;
+    }
+
+    BrushKernel::Apply(HeightData, &Stamps[0], Stamps.size());
+
+    // Footprints of a stroke overlap, this batch's are merged on their own and aprons get refreshed once per merged rect - the
+    // landscape's tracker still holds the rects of earlier batches, already refreshed
+    HeightmapChangeTracker Footprints;
+
+    for (unsigned int i = 0; i < Stamps.size(); ++i)
+        Footprints.MarkDirty(BrushKernel::GetFootprint(Stamps[i], HeightDataSize));
+
+    const std::vector<HeightmapRect> &Rects = Footprints.GetDirtyRects();
+
+    for (unsigned int i = 0; i < Rects.size(); ++i)
+    {
+        HeightData->UpdateAprons(Rects[i]);
+        Changes.MarkDirty(Rects[i]);
+    }
+}
+
+// --------------------------------------------------------------------
+bool Landscape::PublishEdits()
+{
+    return Edits != 0 && Edits->Publish(Changes);
+}
+
+// --------------------------------------------------------------------
+void Landscape::FinishEdits()
+{
+    if (Edits == 0)
+        return;
+
+    Edits->Finish();
+    Edits->Publish(Changes);
 }
 
 // --------------------------------------------------------------------
@@ -5,6 +5,14 @@
 #pragma once
 
 #include "Brush.h"
+#include "BrushKernel.h"
+#include "EditWorker.h"
+#include "Heightmap.h"
+#include "HeightmapPyramid.h"
+#include "HeightmapQuadtree.h"
+#include "HeightmapTileStats.h"
+#include "HydraulicErosion.h"
+#include "TerrainFile.h"
 
 enum ClipmapIBOMode		{IBO_CENTER_1,
 						IBO_CENTER_2,
@@ -29,16 +37,41 @@ public:
     /// Index used for primitive restart when drawing
     const unsigned int RestartIndex;
 
+    /// Terrain edge length in samples and clipmap rim width the editor starts with
+    static const unsigned int DefaultTerrainSize = 424;
+    static const int DefaultClipmapRimWidth = 9;
+
 protected:
     /// Distance between two adjacent vertices
     float Offset;
 
     /// HeightData
-    float *HeightData;
+    Heightmap *HeightData;
 	unsigned int HeightDataSize;
 	int StartIndexX;
 	int StartIndexY;
 
+	/// Prefiltered mip chain of HeightData the coarse clipmap levels are gathered from
+	HeightmapPyramid *HeightPyramid;
+
+	/// Per tile height ranges of HeightData
+	HeightmapTileStats *HeightStats;
+
+	/// Min/max quadtree over HeightStats, for picking
+	HeightmapQuadtree *HeightBounds;
+
+	/// Temporary terrain file paging generated maps too big for memory, deleted with the landscape. Empty if there is none
+	std::string ScratchFilePath;
+
+	/// Generated heights kept 16-bit quantized, asked for or chosen because float tiles didn't fit the budget
+	bool bQuantizedHeights;
+
+	/// Rects changed by edits since the last PropagateChanges(), and the derived data refreshed from them
+	HeightmapChangeTracker Changes;
+
+	/// Applies stroke batches off the UI thread, 0 if it couldn't start - batches are then applied in place
+	EditWorker *Edits;
+
 	/// VBO Data
 	float *ClipmapVBOData;
 	unsigned int VBOSize;
@@ -53,31 +86,72 @@ protected:
 
 public:
     /// Standard constructors and destructor
-    Landscape(int ClipmapRimWidth, float VerticesInterval);
-    Landscape(const char* FilePath);
+    /// Generated TerrainSize x TerrainSize map. It is kept as resident floats while they fit into the paging budget, as 16-bit
+    /// quantized tiles (bQuantized forces this) while those and the float tiles decoded from them fit, and paged from a scratch
+    /// terrain file otherwise
+    Landscape(unsigned int TerrainSize, int ClipmapRimWidth, float VerticesInterval, bool bQuantized = false);
+    /// Landscape over an existing (e.g. paged) heightmap, takes ownership of it
+    Landscape(Heightmap *argHeightData, int ClipmapRimWidth, float VerticesInterval);
     ~Landscape();
 
-    /// Save heightmap to file, return true if succeeded
-    bool SaveToFile(const char* FilePath);
+    /// Save heightmap to native terrain file, return true if succeeded. The heightmap keeps its own storage, saving back to the file it
+    /// was opened from writes the tiles changed since
+    bool SaveToFile(const char* FilePath, TerrainEncoding Encoding = TERRAIN_ENCODING_FLOAT32);
 
-    /// Change landscape height data
+    /// Change landscape height data. Derived data is refreshed by PropagateChanges()
     void UpdateHeightmap(Brush &AffectingBrush);
 
+    /// Apply a batch of stamps (e.g. a frame of a brush stroke) in one pass. With the edit worker running it's only queued,
+    /// the heights change once PublishEdits() picks the result up. Derived data is refreshed by PropagateChanges()
+    void ApplyStamps(const std::vector<BrushStamp> &Stamps);
+
+    /// Copy batches the edit worker finished into the heightmap, once per frame before PropagateChanges(). False if there were none.
+    /// Called with the heightmap's readers locked out, same as ApplyStamps() - both read or write it
+    bool PublishEdits();
+
+    /// Wait for every queued batch and publish it
+    void FinishEdits();
+
+    /// Heightmap sample coordinates of world position (x, z) seen from camera offset (OffsetX, OffsetY)
+    vec2 WorldToSamples(const vec2 &WorldPosition, float OffsetX, float OffsetY) const;
+
+    /// Refresh mips and stats inside the rects changed since the last call, once per frame. Changed rects are appended to outRects if given
+    void PropagateChanges(std::vector<HeightmapRect> *outRects = 0) {Changes.Propagate(outRects);};
+
+    /// Run droplet erosion over the whole map in place, logging progress. Derived data is refreshed by PropagateChanges()
+    void Erode(const ErosionSettings &Settings);
+
+    /// Intersect world space ray with the terrain seen from camera offset (OffsetX, OffsetY), return true and set outPosition at the hit.
+    /// Sees the heights as of the last PropagateChanges()
+    bool PickTerrain(const vec3 &RayOrigin, const vec3 &RayDirection, float OffsetX, float OffsetY, float MaxDistance, vec3 &outPosition);
+
     /// Getters
 	float * GetClipmapVBOData(int &outDataAmount);
 	unsigned int * GetClipmapIBOData(ClipmapIBOMode Mode, int &outDataAmount);
 	unsigned int GetTBOSize() {return TBOSize;};
-	float * GetHeightmap() {return HeightData;};
+	Heightmap * GetHeightmap() {return HeightData;};
+	HeightmapPyramid * GetHeightPyramid() {return HeightPyramid;};
+	HeightmapTileStats * GetHeightStats() {return HeightStats;};
+	HeightmapQuadtree * GetHeightBounds() {return HeightBounds;};
+	HeightmapChangeTracker & GetChangeTracker() {return Changes;};
+	EditWorker * GetEditWorker() {return Edits;};
 	unsigned int GetHeightDataSize() {return HeightDataSize;};
     float GetOffset() {return Offset;};
 	int GetStartIndexX() {return StartIndexX;};
 	int GetStartIndexY() {return StartIndexY;};
+	bool HasQuantizedHeights() const {return bQuantizedHeights;};
+	bool IsPagedFromScratch() const {return !ScratchFilePath.empty();};
 
 	// Not working assignment operator
 	Landscape & operator= (Landscape & other) {return other;};
    
 protected: 
+	void CreateClipmapGeometry(int ClipmapRimWidth);
+	void CreateDerivedData();
 	void CreateVBO();
 	void CreateIBO(ClipmapIBOMode Mode);
 	unsigned int * ConstructNiceIBOData(unsigned int Width, bool bOffsetX, bool bOffsetY, unsigned int CenterHoleWidth, unsigned int &DataSize);
+
+	/// Commit the overlay's changed tiles to the file the map was opened from, or rewrite the whole file when the encoding changes
+	bool SaveToOpenedFile(HeightmapOverlayStorage *Overlay, TerrainFile *File, TerrainEncoding Encoding);
 };
\ No newline at end of file
@@ -8,10 +8,10 @@
 #include <string.h>
 
 #include "LandscapeEditor.h"
+#include "Benchmark.h"
 
 IMPLEMENT_APP_CONSOLE(LandscapeEditor)
 
-int LandscapeEditor::InitTime;
 
 // --------------------------------------------------------------------
 LandGLContext& LandscapeEditor::GetContext(wxGLCanvas *canvas)
@@ -30,11 +30,15 @@ LandGLContext& LandscapeEditor::GetContext(wxGLCanvas *canvas)
 // --------------------------------------------------------------------
 bool LandscapeEditor::OnInit()
 {
-	InitTime = GetTickCount();
+	LogInitTime = GetTickCount();
 
     if (!wxApp::OnInit())
         return false;
 
+    // Benchmarks and replays run headless from OnRun()
+    if (!BenchmarkName.IsEmpty() || !StrokeReplayPath.IsEmpty())
+        return true;
+
     Frame = new LandscapeEditorFrame((wxFrame *) NULL, wxID_ANY, wxT("Landscape Editor"), wxPoint(100, 100), wxSize(WINDOW_WIDTH, WINDOW_HEIGHT), 
                                  wxDEFAULT_FRAME_STYLE | wxCLIP_CHILDREN | wxNO_FULL_REPAINT_ON_RESIZE);
     Frame->Show(true);
@@ -54,76 +58,85 @@ int LandscapeEditor::OnExit()
 }
 
 // --------------------------------------------------------------------
-char* LandscapeEditor::TextFileRead(const char* FilePath) 
+int LandscapeEditor::OnRun()
 {
-	FILE* File;
-	char* Content = NULL;
-	int Count = 0;
+    if (!BenchmarkName.IsEmpty())
+        return Benchmark::Run(std::string(BenchmarkName.mb_str())) ? 0 : 1;
 
-	if (FilePath != NULL) 
-    {
-		File = fopen(FilePath, "rt");
+    if (!StrokeReplayPath.IsEmpty())
+        return Benchmark::ReplayStrokes(std::string(StrokeReplayPath.mb_str())) ? 0 : 1;
 
-		if (File != NULL) 
-        {
-            fseek(File, 0, SEEK_END);
-            Count = ftell(File);
-            rewind(File);
+    return wxApp::OnRun();
+}
 
-			if (Count > 0) 
-            {
-				Content = (char*)malloc(sizeof(char) * (Count + 1));
-				Count = fread(Content, sizeof(char), Count, File);
-				Content[Count] = '\0';
-			}
-			fclose(File);
-		}
-	}
-	return Content;
+// --------------------------------------------------------------------
+void LandscapeEditor::OnInitCmdLine(wxCmdLineParser& Parser)
+{
+    wxApp::OnInitCmdLine(Parser);
+
+    Parser.AddOption(wxT("b"), wxT("bench"), wxT("run benchmark with given name (or \"all\") and exit"));
+    Parser.AddOption(wxT("p"), wxT("pagefile"), wxT("fly over paged heightmap stored in given file (created if missing)"));
+    Parser.AddOption(wxT("s"), wxT("mapsize"), wxT("edge length of the paged heightmap in samples"), wxCMD_LINE_VAL_NUMBER);
+    Parser.AddOption(wxT("m"), wxT("budget"), wxT("memory budget of the paged heightmap in MB"), wxCMD_LINE_VAL_NUMBER);
+    Parser.AddSwitch(wxT("q"), wxT("quantized"), wxT("store heights as 16-bit quantized tiles, only the budget is kept as floats"));
+    Parser.AddOption(wxT("r"), wxT("seed"), wxT("seed of generated terrain"), wxCMD_LINE_VAL_NUMBER);
+    Parser.AddOption(wxT("u"), wxT("clipmapbudget"), wxT("microseconds per frame clipmap levels may take to follow the camera, coarse ones lag behind beyond that (0 = no limit)"), wxCMD_LINE_VAL_NUMBER);
+    Parser.AddSwitch(wxT("t"), wxT("texturearray"), wxT("keep clipmap levels as layers of one 2D texture array instead of a texture buffer each"));
+    Parser.AddOption(wxT("c"), wxT("record"), wxT("record brush strokes painted on the generated terrain to given file"));
+    Parser.AddOption(wxT("y"), wxT("replay"), wxT("replay strokes recorded in given file headless, report timings and heightmap hash and exit"));
 }
 
 // --------------------------------------------------------------------
-int LandscapeEditor::TextFileWrite(const char* FilePath, char* Content) 
+bool LandscapeEditor::OnCmdLineParsed(wxCmdLineParser& Parser)
 {
-	FILE* File;
-	int status = 0;
-    
-	if (FilePath != NULL) 
+    Parser.Found(wxT("bench"), &BenchmarkName);
+    Parser.Found(wxT("pagefile"), &PageFilePath);
+    Parser.Found(wxT("mapsize"), &PagedMapSize);
+    Parser.Found(wxT("budget"), &PagingBudgetMB);
+    bQuantizedHeights = Parser.Found(wxT("quantized"));
+    Parser.Found(wxT("seed"), &TerrainSeed);
+    Parser.Found(wxT("clipmapbudget"), &ClipmapBudgetMicroseconds);
+    bClipmapTextureArray = Parser.Found(wxT("texturearray"));
+    Parser.Found(wxT("record"), &StrokeRecordPath);
+    Parser.Found(wxT("replay"), &StrokeReplayPath);
+
+    if (PagedMapSize < 64 || PagingBudgetMB < 1)
     {
-		File = fopen(FilePath, "w");
+        ERR("Invalid paged heightmap size or budget");
+        return false;
+    }
 
-		if (File != NULL) 
-        {
-			if (fwrite(Content, sizeof(char), strlen(Content), File) == strlen(Content))
-				status = 1;
+    if (ClipmapBudgetMicroseconds < 0)
+    {
+        ERR("Invalid clipmap budget");
+        return false;
+    }
 
-			fclose(File);
-		}
-	}
-	return(status);
+    return wxApp::OnCmdLineParsed(Parser);
 }
 
 // --------------------------------------------------------------------
-void* LandscapeEditor::FileRead(const char* FilePath, unsigned int &ByteSize) 
+char* LandscapeEditor::TextFileRead(const char* FilePath) 
 {
 	FILE* File;
-	void* Content = NULL;
-	ByteSize = 0;
+	char* Content = NULL;
+	int Count = 0;
 
 	if (FilePath != NULL) 
     {
-		File = fopen(FilePath, "rb");
-        
+		File = fopen(FilePath, "rt");
+
 		if (File != NULL) 
         {
             fseek(File, 0, SEEK_END);
-            ByteSize = ftell(File);
+            Count = ftell(File);
             rewind(File);
 
-			if (ByteSize > 0) 
+			if (Count > 0) 
             {
-				Content = malloc(sizeof(int) * ByteSize);
-				fread(Content, sizeof(int), ByteSize, File);
+				Content = (char*)malloc(sizeof(char) * (Count + 1));
+				Count = fread(Content, sizeof(char), Count, File);
+				Content[Count] = '\0';
 			}
 			fclose(File);
 		}
@@ -132,18 +145,18 @@ void* LandscapeEditor::FileRead(const char* FilePath, unsigned int &ByteSize)
 }
 
 // --------------------------------------------------------------------
-int LandscapeEditor::FileWrite(const char* FilePath, void* Content32b, unsigned int Size) 
+int LandscapeEditor::TextFileWrite(const char* FilePath, char* Content) 
 {
 	FILE* File;
 	int status = 0;
     
 	if (FilePath != NULL) 
     {
-		File = fopen(FilePath, "wb");
+		File = fopen(FilePath, "w");
 
 		if (File != NULL) 
         {
-			if (fwrite(Content32b, sizeof(int), Size, File) == Size)
+			if (fwrite(Content, sizeof(char), strlen(Content), File) == strlen(Content))
 				status = 1;
 
 			fclose(File);
@@ -7,45 +7,17 @@
 #include <GL/glew.h>
 #include "wx/wx.h"
 #include "wx/glcanvas.h"
+#include "wx/cmdline.h"
 #include <string.h>
 #include <iomanip>
 
+#include "Log.h"
 #include "LandGLContext.h"
 #include "LandscapeEditorFrame.h"
 
 #define WINDOW_WIDTH 1024
 #define WINDOW_HEIGHT 768
 
-#define LOG(X)																																		\
-	(																																				\
-		std::cout << "[" << std::fixed << std::setprecision(3) << (GetTickCount() - LandscapeEditor::InitTime) / 1000.0f << "] " << X << std::endl,	\
-		(void)0																																		\
-	)
-
-#define WARN(X)																																		\
-	(																																				\
-		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 14),																				\
-		std::cout << "[" << std::fixed << std::setprecision(3) << (GetTickCount() - LandscapeEditor::InitTime) / 1000.0f << "] " << X << std::endl,	\
-		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 7),																				\
-		(void)0																																		\
-	)
-
-#define ERR(X)																																		\
-	(																																				\
-		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 12),																				\
-		std::cout << "[" << std::fixed << std::setprecision(3) << (GetTickCount() - LandscapeEditor::InitTime) / 1000.0f << "] " << X << std::endl,	\
-		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 7),																				\
-		(void)0																																		\
-	)
-
-#define CONF(X)																																		\
-	(																																				\
-		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 10),																				\
-		std::cout << "[" << std::fixed << std::setprecision(3) << (GetTickCount() - LandscapeEditor::InitTime) / 1000.0f << "] " << X << std::endl,	\
-		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 7),																				\
-		(void)0																																		\
-	)
-
 /** Main application class, singleton */
 class LandscapeEditor : public wxApp
 {
@@ -53,15 +25,36 @@ protected:
     /// the GL context we use for all our windows
     LandGLContext *m_glContext;
 
-public: 
-	/// Saved program initialization time stamp
-	static int InitTime;
+    /// Name of benchmark passed with --bench, empty when running the editor
+    wxString BenchmarkName;
+
+    /// Paged heightmap given with --pagefile, its edge length (--mapsize) and memory budget in MB (--budget)
+    wxString PageFilePath;
+    long PagedMapSize;
+    long PagingBudgetMB;
+
+    /// Keep heights as 16-bit quantized tiles (--quantized)
+    bool bQuantizedHeights;
+
+    /// Seed of generated terrain (--seed)
+    long TerrainSeed;
 
+    /// Clipmap levels kept as layers of one 2D texture array instead of a texture buffer each (--texturearray)
+    bool bClipmapTextureArray;
+
+    /// Microseconds per frame the clipmap levels may take to follow the camera (--clipmapbudget), 0 for no limit
+    long ClipmapBudgetMicroseconds;
+
+    /// File the strokes of the session are recorded to (--record), and a recording to replay headless instead of running the editor (--replay)
+    wxString StrokeRecordPath;
+    wxString StrokeReplayPath;
+
+public: 
     /// Pointer to the main application frame (window)
     LandscapeEditorFrame* Frame;
 
     /// Standard constructor
-    LandscapeEditor() {m_glContext = NULL;}
+    LandscapeEditor(): PagedMapSize(65536), PagingBudgetMB(512), bQuantizedHeights(false), TerrainSeed(1), bClipmapTextureArray(false), ClipmapBudgetMicroseconds(1000) {m_glContext = NULL;}
 
     /// Returns the shared context used by all frames and sets it as current for the given canvas
     LandGLContext& GetContext(wxGLCanvas *canvas = 0);
@@ -72,18 +65,40 @@ public:
     /// Function called on application exit
     int OnExit();
 
+    /// Main loop, replaced by benchmark run or stroke replay when requested from command line
+    int OnRun();
+
+    /// Command line handling
+    void OnInitCmdLine(wxCmdLineParser& Parser);
+    bool OnCmdLineParsed(wxCmdLineParser& Parser);
+
+    /// Paged heightmap settings
+    const wxString & GetPageFilePath() const {return PageFilePath;};
+    unsigned int GetPagedMapSize() const {return (unsigned int)PagedMapSize;};
+    unsigned long long GetPagingBudget() const {return (unsigned long long)PagingBudgetMB << 20;};
+    unsigned int GetPagingBudgetMB() const {return (unsigned int)PagingBudgetMB;};
+    void SetPagingBudgetMB(unsigned int MB) {PagingBudgetMB = (long)MB;};
+    bool IsQuantized() const {return bQuantizedHeights;};
+
+    /// Generated terrain settings
+    unsigned int GetTerrainSeed() const {return (unsigned int)TerrainSeed;};
+    void SetTerrainSeed(unsigned int Seed) {TerrainSeed = (long)Seed;};
+
+    /// Clipmap update budget in seconds
+    double GetClipmapBudget() const {return ClipmapBudgetMicroseconds / 1e6;};
+
+    /// Clipmap rendering path
+    bool UsesClipmapTextureArray() const {return bClipmapTextureArray;};
+
+    /// Stroke recording settings
+    const wxString & GetStrokeRecordPath() const {return StrokeRecordPath;};
+
     /// Read text from file
     static char* TextFileRead(const char *FilePath);
 
     /// Write text to file
     static int TextFileWrite(const char *FilePath, char *Content);
 
-    /// Read data from file
-    static void* FileRead(const char *FilePath, unsigned int &ByteSize);
-
-    /// Write data to file
-    static int FileWrite(const char *FilePath, void *Content32b, unsigned int Size);
-
     /// Accessor
     static LandscapeEditor* Inst() {return (LandscapeEditor*)ms_appInstance;}
 };
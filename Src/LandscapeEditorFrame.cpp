@@ -15,10 +15,16 @@ enum
     ID_NEW = 11,
     ID_OPEN = 12,
     ID_SAVE = 13,
+    ID_ERODE = 14,
+    ID_IMAGE_MASK = 15,
     ID_BRUSH_1 = 100,
     ID_BRUSH_2 = 101,
     ID_BRUSH_3 = 102,
     ID_BRUSH_4 = 103,
+    ID_BRUSH_5 = 104,
+    ID_BRUSH_6 = 105,
+    ID_BRUSH_7 = 106,
+    ID_BRUSH_8 = 107,
     ID_COMBO = 1000
 };
 
@@ -28,10 +34,16 @@ BEGIN_EVENT_TABLE(LandscapeEditorFrame, wxFrame)
     EVT_MENU(ID_NEW, LandscapeEditorFrame::OnNew)
     EVT_MENU(ID_OPEN, LandscapeEditorFrame::OnOpen)
     EVT_MENU(ID_SAVE, LandscapeEditorFrame::OnSave)
+    EVT_MENU(ID_ERODE, LandscapeEditorFrame::OnErode)
+    EVT_MENU(ID_IMAGE_MASK, LandscapeEditorFrame::OnImageMask)
     EVT_MENU(ID_BRUSH_1, LandscapeEditorFrame::OnBrush1)
     EVT_MENU(ID_BRUSH_2, LandscapeEditorFrame::OnBrush2)
     EVT_MENU(ID_BRUSH_3, LandscapeEditorFrame::OnBrush3)
     EVT_MENU(ID_BRUSH_4, LandscapeEditorFrame::OnBrush4)
+    EVT_MENU(ID_BRUSH_5, LandscapeEditorFrame::OnBrush5)
+    EVT_MENU(ID_BRUSH_6, LandscapeEditorFrame::OnBrush6)
+    EVT_MENU(ID_BRUSH_7, LandscapeEditorFrame::OnBrush7)
+    EVT_MENU(ID_BRUSH_8, LandscapeEditorFrame::OnBrush8)
 END_EVENT_TABLE()
 
 // --------------------------------------------------------------------
@@ -48,10 +60,26 @@ wxFrame(parent, id, title, pos, size, style)
     wxMenu *fileMenu = new wxMenu;
     fileMenu->Append(wxID_EXIT, wxT("E&xit\tAlt-X"), wxT("Quit Editor") );
 
+    wxMenu *toolsMenu = new wxMenu;
+    toolsMenu->Append(ID_ERODE, wxT("Hydraulic &erosion..."), wxT("Erode the landscape with water droplets"));
+    toolsMenu->AppendCheckItem(ID_IMAGE_MASK, wxT("&Image brush"), wxT("Paint with the brush image instead of the circle, PgUp/PgDn rotate it"));
+
+    wxMenu *brushMenu = new wxMenu;
+    brushMenu->AppendRadioItem(ID_BRUSH_1, wxT("&Raise"), wxT("Raise the terrain under the brush"));
+    brushMenu->AppendRadioItem(ID_BRUSH_2, wxT("&Lower"), wxT("Lower the terrain under the brush"));
+    brushMenu->AppendRadioItem(ID_BRUSH_3, wxT("&Smooth"), wxT("Pull the terrain under the brush toward its average height"));
+    brushMenu->AppendRadioItem(ID_BRUSH_4, wxT("R&ing"), wxT("Raise a ring around the brush center"));
+    brushMenu->AppendRadioItem(ID_BRUSH_5, wxT("&Blur"), wxT("Blur small bumps under the brush"));
+    brushMenu->AppendRadioItem(ID_BRUSH_6, wxT("&Flatten"), wxT("Flatten features up to the brush size, following larger slopes"));
+    brushMenu->AppendRadioItem(ID_BRUSH_7, wxT("&Plateau"), wxT("Level the terrain toward the height under the brush center"));
+    brushMenu->AppendRadioItem(ID_BRUSH_8, wxT("&Noise"), wxT("Roughen the terrain under the brush"));
+
     wxMenu *helpMenu = new wxMenu;
     helpMenu->Append(wxID_HELP, wxT("&About"), wxT("About Edtior"));
 
     menuBar->Append(fileMenu, wxT("&File"));
+    menuBar->Append(toolsMenu, wxT("&Tools"));
+    menuBar->Append(brushMenu, wxT("&Brush"));
     menuBar->Append(helpMenu, wxT("&Help"));
 
     SetMenuBar(menuBar);
@@ -138,16 +166,23 @@ void LandscapeEditorFrame::OnAbout(wxCommandEvent& WXUNUSED(event))
 // --------------------------------------------------------------------
 void LandscapeEditorFrame::OnNew(wxCommandEvent& WXUNUSED(event)) 
 {
-    long Result = wxGetNumberFromUser(wxT("How big should be your terrain?"), wxT("Enter a number:"), wxT("Create new landscape"), 50, 2, 1000);
+    long TerrainSize = wxGetNumberFromUser(wxT("How big should be your terrain? Edge length in samples"), wxT("Enter a number:"), wxT("Create new landscape"),
+                                           4096, 64, 65536);
+
+    if (TerrainSize == -1)
+        return;
+
+    long RimWidth = wxGetNumberFromUser(wxT("How detailed should be the clipmap rings? Rim width in quads"), wxT("Enter a number:"), wxT("Create new landscape"),
+                                        Landscape::DefaultClipmapRimWidth, 2, 1000);
 
-    if (Result != -1 )
-        LandscapeEditor::Inst()->GetContext().CreateNewLandscape(Result);
+    if (RimWidth != -1)
+        LandscapeEditor::Inst()->GetContext().CreateNewLandscape(TerrainSize, RimWidth);
 }
 
 // --------------------------------------------------------------------
 void LandscapeEditorFrame::OnOpen(wxCommandEvent& WXUNUSED(event)) 
 {
-    wxFileDialog dialog(this, wxT("Open existing map"), wxEmptyString, wxEmptyString, wxT("Data files (*.raw)|*.raw"));
+    wxFileDialog dialog(this, wxT("Open existing map"), wxEmptyString, wxEmptyString, wxT("Terrain files (*.ter)|*.ter"));
 
     dialog.SetDirectory(wxStandardPaths::Get().GetDataDir());
 
@@ -158,35 +193,74 @@ void LandscapeEditorFrame::OnOpen(wxCommandEvent& WXUNUSED(event))
 // --------------------------------------------------------------------
 void LandscapeEditorFrame::OnSave(wxCommandEvent& WXUNUSED(event)) 
 {
-    wxFileDialog dialog(this, wxT("Save map"), wxEmptyString, wxT("MyTerrain.raw"),
-                        wxT("Data files (*.raw)|*.raw"), wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
+    wxFileDialog dialog(this, wxT("Save map"), wxEmptyString, wxT("MyTerrain.ter"),
+                        wxT("Terrain files (*.ter)|*.ter|Quantized 16-bit terrain files (*.ter)|*.ter|Compressed terrain files (*.ter)|*.ter"), wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
 
     dialog.SetDirectory(wxStandardPaths::Get().GetDataDir());
 
     if (dialog.ShowModal() == wxID_OK)
-        LandscapeEditor::Inst()->GetContext().SaveLandscape(dialog.GetPath().c_str().AsChar());
+        LandscapeEditor::Inst()->GetContext().SaveLandscape(dialog.GetPath().c_str().AsChar(), (TerrainEncoding)dialog.GetFilterIndex());
+}
+
+// --------------------------------------------------------------------
+void LandscapeEditorFrame::OnErode(wxCommandEvent& WXUNUSED(event)) 
+{
+    long Result = wxGetNumberFromUser(wxT("How many droplets (in thousands) should erode the terrain?"), wxT("Enter a number:"), wxT("Hydraulic erosion"), 200, 1, 100000);
+
+    if (Result != -1)
+        LandscapeEditor::Inst()->GetContext().ErodeLandscape((unsigned long long)Result * 1000);
+}
+
+// --------------------------------------------------------------------
+void LandscapeEditorFrame::OnImageMask(wxCommandEvent& event) 
+{
+    LandscapeEditor::Inst()->GetContext().SetBrushImageMask(event.IsChecked());
 }
 
 // --------------------------------------------------------------------
 void LandscapeEditorFrame::OnBrush1(wxCommandEvent& WXUNUSED(event)) 
 {
-    LandscapeEditor::Inst()->GetContext().ChangeBrushMode(0);
+    LandscapeEditor::Inst()->GetContext().ChangeBrushMode(BRUSH_ADD);
 }
 
 // --------------------------------------------------------------------
 void LandscapeEditorFrame::OnBrush2(wxCommandEvent& WXUNUSED(event)) 
 {
-    LandscapeEditor::Inst()->GetContext().ChangeBrushMode(1);
+    LandscapeEditor::Inst()->GetContext().ChangeBrushMode(BRUSH_SUBTRACT);
 }
 
 // --------------------------------------------------------------------
 void LandscapeEditorFrame::OnBrush3(wxCommandEvent& WXUNUSED(event)) 
 {
-    LandscapeEditor::Inst()->GetContext().ChangeBrushMode(2);
+    LandscapeEditor::Inst()->GetContext().ChangeBrushMode(BRUSH_SMOOTH);
 }
 
 // --------------------------------------------------------------------
 void LandscapeEditorFrame::OnBrush4(wxCommandEvent& WXUNUSED(event)) 
 {
-    LandscapeEditor::Inst()->GetContext().ChangeBrushMode(3);
+    LandscapeEditor::Inst()->GetContext().ChangeBrushMode(BRUSH_RING);
+}
+
+// --------------------------------------------------------------------
+void LandscapeEditorFrame::OnBrush5(wxCommandEvent& WXUNUSED(event)) 
+{
+    LandscapeEditor::Inst()->GetContext().ChangeBrushMode(BRUSH_BLUR);
+}
+
+// --------------------------------------------------------------------
+void LandscapeEditorFrame::OnBrush6(wxCommandEvent& WXUNUSED(event)) 
+{
+    LandscapeEditor::Inst()->GetContext().ChangeBrushMode(BRUSH_FLATTEN);
+}
+
+// --------------------------------------------------------------------
+void LandscapeEditorFrame::OnBrush7(wxCommandEvent& WXUNUSED(event)) 
+{
+    LandscapeEditor::Inst()->GetContext().ChangeBrushMode(BRUSH_PLATEAU);
+}
+
+// --------------------------------------------------------------------
+void LandscapeEditorFrame::OnBrush8(wxCommandEvent& WXUNUSED(event)) 
+{
+    LandscapeEditor::Inst()->GetContext().ChangeBrushMode(BRUSH_NOISE);
 }
\ No newline at end of file
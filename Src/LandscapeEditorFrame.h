@@ -32,10 +32,16 @@ public:
     void OnNew(wxCommandEvent& event);
     void OnOpen(wxCommandEvent& event);
     void OnSave(wxCommandEvent& event);
+    void OnErode(wxCommandEvent& event);
+    void OnImageMask(wxCommandEvent& event);
     void OnBrush1(wxCommandEvent& event);
     void OnBrush2(wxCommandEvent& event);
     void OnBrush3(wxCommandEvent& event);
     void OnBrush4(wxCommandEvent& event);
+    void OnBrush5(wxCommandEvent& event);
+    void OnBrush6(wxCommandEvent& event);
+    void OnBrush7(wxCommandEvent& event);
+    void OnBrush8(wxCommandEvent& event);
 
     DECLARE_EVENT_TABLE()
 };
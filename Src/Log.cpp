@@ -0,0 +1,3 @@
+#include "Log.h"
+
+int LogInitTime = GetTickCount();
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <windows.h>
+#include <iostream>
+#include <iomanip>
+
+/// Tick count the log time stamps are counted from, set once the program starts
+extern int LogInitTime;
+
+#define LOG(X)																																		\
+	(																																				\
+		std::cout << "[" << std::fixed << std::setprecision(3) << (GetTickCount() - LogInitTime) / 1000.0f << "] " << X << std::endl,				\
+		(void)0																																		\
+	)
+
+#define WARN(X)																																		\
+	(																																				\
+		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 14),																				\
+		std::cout << "[" << std::fixed << std::setprecision(3) << (GetTickCount() - LogInitTime) / 1000.0f << "] " << X << std::endl,				\
+		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 7),																				\
+		(void)0																																		\
+	)
+
+#define ERR(X)																																		\
+	(																																				\
+		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 12),																				\
+		std::cout << "[" << std::fixed << std::setprecision(3) << (GetTickCount() - LogInitTime) / 1000.0f << "] " << X << std::endl,				\
+		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 7),																				\
+		(void)0																																		\
+	)
+
+#define CONF(X)																																		\
+	(																																				\
+		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 10),																				\
+		std::cout << "[" << std::fixed << std::setprecision(3) << (GetTickCount() - LogInitTime) / 1000.0f << "] " << X << std::endl,				\
+		SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 7),																				\
+		(void)0																																		\
+	)
@@ -21,13 +21,13 @@ Shader::~Shader()
 }
 
 // --------------------------------------------------------------------
-bool Shader::Initialize(std::string argShadarName)
+bool Shader::Initialize(std::string argShadarName, std::string argFragmentShaderName)
 {
 	ShaderName = argShadarName;
     LOG("Preparing shader " << ShaderName << "...");
 
 	std::string VertexShaderName = "Src/Shaders/" + ShaderName + ".vs";
-	std::string FragmentShaderName = "Src/Shaders/" + ShaderName + ".fs";
+	std::string FragmentShaderName = "Src/Shaders/" + (argFragmentShaderName.empty() ? ShaderName : argFragmentShaderName) + ".fs";
 
 	const char* VertexShaderSrc = LandscapeEditor::TextFileRead(VertexShaderName.c_str());
 	const char* FragmentShaderSrc = LandscapeEditor::TextFileRead(FragmentShaderName.c_str());
@@ -86,6 +86,20 @@ bool Shader::Initialize(std::string argShadarName)
         return false;
     }
 
+    if (InitializeUniforms() == false)
+        return false;
+
+    LOG("Shader " << ShaderName << " ready to go!");
+
+    return true;
+}
+
+// --------------------------------------------------------------------
+bool Shader::Validate()
+{
+    GLint success = 0;
+    GLchar InfoLog[1024];
+
     glValidateProgram(ShaderProgram);
     glGetProgramiv(ShaderProgram, GL_VALIDATE_STATUS, &success);
     if (!success) {
@@ -94,11 +108,6 @@ bool Shader::Initialize(std::string argShadarName)
         return false;
     }
 
-    if (InitializeUniforms() == false)
-        return false;
-
-    LOG("Shader " << ShaderName << " ready to go!");
-
     return true;
 }
 
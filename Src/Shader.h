@@ -29,8 +29,13 @@ public:
     Shader();
     ~Shader();
 
-    /// Create, link, validates shader, return false when failure, true on success
-    bool Initialize(std::string argShadarName);
+    /// Create and link shader, return false when failure, true on success. Fragment shader is read from argFragmentShaderName
+    /// if given, for vertex shaders sharing one
+    bool Initialize(std::string argShadarName, std::string argFragmentShaderName = "");
+
+    /// Validate linked program, return false when failure. Call once sampler uniforms are set - samplers of different types
+    /// left on the default unit 0 make the program invalid
+    bool Validate();
 
     /// Call when you want to start using this shader
     void Use();
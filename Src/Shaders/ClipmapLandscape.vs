@@ -13,6 +13,8 @@ uniform samplerBuffer TBOSampler;
 uniform float CameraOffsetX;
 uniform float CameraOffsetY;
 uniform int ClipmapScale;
+uniform int ClipmapWindowX;
+uniform int ClipmapWindowY;
 
 
 int imod(in int x, in int y)
@@ -31,8 +33,9 @@ int CalculateTBOIndex(const in int PosX, const in int PosY, const in int CameraO
 	int ConvertedX = PosX + (ClipmapWidth - 3) / 2;				
 	int ConvertedY = PosY + (ClipmapWidth - 3) / 2;
 
-	int ModifiedX = ConvertedX + CameraOffsetX;
-	int ModifiedY = ConvertedY + CameraOffsetY;
+	// A level lagging behind the camera has texels of its window only, the ones it hasn't gathered yet repeat its edge
+	int ModifiedX = clamp(ConvertedX + CameraOffsetX, ClipmapWindowX, ClipmapWindowX + ClipmapWidth - 1);
+	int ModifiedY = clamp(ConvertedY + CameraOffsetY, ClipmapWindowY, ClipmapWindowY + ClipmapWidth - 1);
 
 	int ClippedY = imod(int(ModifiedY), ClipmapWidth);
 	int ClippedX = imod(int(ModifiedX), ClipmapWidth);
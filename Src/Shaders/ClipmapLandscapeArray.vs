@@ -0,0 +1,58 @@
+#version 330
+
+layout (location = 0) in vec2 Position;
+
+out vec2 UV;
+out vec2 UVBrush;
+out vec3 Normal;
+
+uniform int ClipmapWidth;
+uniform float LandscapeVertexOffset;
+uniform mat4 gWorld;
+uniform sampler2DArray ClipmapSampler;
+uniform int ClipmapLevel;
+uniform float CameraOffsetX;
+uniform float CameraOffsetY;
+uniform int ClipmapScale;
+uniform int ClipmapWindowX;
+uniform int ClipmapWindowY;
+
+
+float FetchHeight(const in ivec2 Pos, const in ivec2 CameraOffset)
+{
+	// Texel of the level, clamped to its window for levels lagging behind the camera. GL_REPEAT wraps it around the toroidal layer
+	ivec2 Window = ivec2(ClipmapWindowX, ClipmapWindowY);
+	ivec2 Texel = clamp(Pos + (ClipmapWidth - 3) / 2 + CameraOffset, Window, Window + ClipmapWidth - 1);
+
+	return textureLod(ClipmapSampler, vec3((vec2(Texel) + 0.5) / float(ClipmapWidth), float(ClipmapLevel)), 0.0).r;
+}
+
+void main()
+{
+	ivec2 iCameraOffset = ivec2(floor(vec2(CameraOffsetX, CameraOffsetY) / ClipmapScale));
+
+	float VertexOffsetX = mod(CameraOffsetX, ClipmapScale);
+	float VertexOffsetY = mod(CameraOffsetY, ClipmapScale);
+
+	float BaseX = Position.x * ClipmapScale;
+	float BaseY = Position.y * ClipmapScale;
+
+	ivec2 Pos = ivec2(Position);
+
+	float VertexHeight = FetchHeight(Pos, iCameraOffset);
+
+    gl_Position = gWorld * vec4((BaseX - VertexOffsetX) * LandscapeVertexOffset, VertexHeight, (BaseY - VertexOffsetY) * LandscapeVertexOffset, 1.0);
+
+	UVBrush = vec2(BaseY - VertexOffsetY, BaseX - VertexOffsetX);
+	UV = vec2(BaseY, BaseX);
+
+	float VH1 = FetchHeight(Pos + ivec2(1, 0), iCameraOffset);
+	float VH2 = FetchHeight(Pos - ivec2(1, 0), iCameraOffset);
+	float VH3 = FetchHeight(Pos + ivec2(0, 1), iCameraOffset);
+	float VH4 = FetchHeight(Pos - ivec2(0, 1), iCameraOffset);
+
+	vec3 V1 = normalize(vec3(0.0, VH1 - VH2, 2.0 * LandscapeVertexOffset * ClipmapScale));
+	vec3 V2 = normalize(vec3(2.0 * LandscapeVertexOffset * ClipmapScale, VH3 - VH4, 0.0));
+
+	Normal = normalize(cross(V1, V2));
+}
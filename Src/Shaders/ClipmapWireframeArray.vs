@@ -0,0 +1,42 @@
+#version 330
+
+layout (location = 0) in vec2 Position;
+
+out vec2 UV;
+
+uniform int ClipmapWidth;
+uniform float LandscapeVertexOffset;
+uniform mat4 gWorld;
+uniform sampler2DArray ClipmapSampler;
+uniform int ClipmapLevel;
+uniform float CameraOffsetX;
+uniform float CameraOffsetY;
+uniform int ClipmapScale;
+uniform int ClipmapWindowX;
+uniform int ClipmapWindowY;
+
+
+float FetchHeight(const in ivec2 Pos, const in ivec2 CameraOffset)
+{
+	// Texel of the level, clamped to its window for levels lagging behind the camera. GL_REPEAT wraps it around the toroidal layer
+	ivec2 Window = ivec2(ClipmapWindowX, ClipmapWindowY);
+	ivec2 Texel = clamp(Pos + (ClipmapWidth - 3) / 2 + CameraOffset, Window, Window + ClipmapWidth - 1);
+
+	return textureLod(ClipmapSampler, vec3((vec2(Texel) + 0.5) / float(ClipmapWidth), float(ClipmapLevel)), 0.0).r;
+}
+
+void main()
+{
+	float VertexOffsetX = mod(CameraOffsetX, ClipmapScale);
+	float VertexOffsetY = mod(CameraOffsetY, ClipmapScale);
+
+	float BaseX = Position.x * ClipmapScale;
+	float BaseY = Position.y * ClipmapScale;
+
+	ivec2 iCameraOffset = ivec2(floor(vec2(CameraOffsetX, CameraOffsetY) / ClipmapScale));
+
+	float VertexHeight = FetchHeight(ivec2(Position), iCameraOffset);
+
+    gl_Position = gWorld * vec4((BaseX - VertexOffsetX) * LandscapeVertexOffset, VertexHeight, (BaseY - VertexOffsetY) * LandscapeVertexOffset, 1.0);
+	UV = vec2(Position.x, Position.y);
+}
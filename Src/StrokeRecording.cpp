@@ -0,0 +1,134 @@
+#include <string.h>
+
+#include "StrokeRecording.h"
+#include "Log.h"
+#include "Timer.h"
+
+const char StrokeRecorder::Magic[8] = {'L', 'E', 'S', 'T', 'R', 'O', 'K', 'E'};
+
+// --------------------------------------------------------------------
+StrokeRecorder::StrokeRecorder():
+File(0), StartTime(0.0), EventsAmount(0), bBatchOpen(false)
+{
+}
+
+// --------------------------------------------------------------------
+StrokeRecorder::~StrokeRecorder()
+{
+	Close();
+}
+
+// --------------------------------------------------------------------
+bool StrokeRecorder::Open(const char *argFilePath, unsigned int MapSize, unsigned int Seed, unsigned int Flags, unsigned int PagingBudgetMB)
+{
+	Close();
+
+	File = fopen(argFilePath, "wb");
+
+	if (File == 0)
+		return false;
+
+	StrokeRecordingHeader Header;
+	memset(&Header, 0, sizeof(Header));
+	memcpy(Header.Magic, Magic, sizeof(Magic));
+	Header.Version = CurrentVersion;
+	Header.HeaderSize = sizeof(Header);
+	Header.MapSize = MapSize;
+	Header.Seed = Seed;
+	Header.Flags = Flags;
+	Header.PagingBudgetMB = PagingBudgetMB;
+
+	if (fwrite(&Header, sizeof(Header), 1, File) != 1)
+	{
+		Close();
+		return false;
+	}
+
+	FilePath = argFilePath;
+	StartTime = GetTime();
+	EventsAmount = 0;
+	bBatchOpen = false;
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+void StrokeRecorder::Record(float X, float Y, float Radius, float Rotation, BrushMode Mode, bool bImageMask, bool bBegin)
+{
+	if (File == 0)
+		return;
+
+	StrokeEvent Event;
+	Event.Time = float(GetTime() - StartTime);
+	Event.X = X;
+	Event.Y = Y;
+	Event.Radius = Radius;
+	Event.Rotation = Rotation;
+	Event.Mode = (unsigned char)Mode;
+	Event.Flags = (unsigned char)(((bBegin) ? (STROKE_EVENT_BEGIN) : (0)) | ((bImageMask) ? (STROKE_EVENT_IMAGE_MASK) : (0)));
+	Event.Reserved = 0;
+
+	// Buffered by the CRT, a frame costs a copy of the event
+	if (fwrite(&Event, sizeof(Event), 1, File) != 1)
+	{
+		ERR("Failed to record stroke to " << FilePath << ", recording stopped");
+		Close();
+		return;
+	}
+
+	EventsAmount++;
+	bBatchOpen = true;
+}
+
+// --------------------------------------------------------------------
+void StrokeRecorder::EndBatch()
+{
+	if (File == 0 || !bBatchOpen)
+		return;
+
+	StrokeEvent Event;
+	memset(&Event, 0, sizeof(Event));
+	Event.Time = float(GetTime() - StartTime);
+	Event.Flags = STROKE_EVENT_BATCH_END;
+
+	if (fwrite(&Event, sizeof(Event), 1, File) != 1)
+	{
+		ERR("Failed to record stroke to " << FilePath << ", recording stopped");
+		Close();
+		return;
+	}
+
+	bBatchOpen = false;
+}
+
+// --------------------------------------------------------------------
+void StrokeRecorder::Close()
+{
+	if (File == 0)
+		return;
+
+	fclose(File);
+	File = 0;
+}
+
+// --------------------------------------------------------------------
+bool StrokeRecorder::Load(const char *FilePath, StrokeRecordingHeader &outHeader, std::vector<StrokeEvent> &outEvents)
+{
+	FILE *Input = fopen(FilePath, "rb");
+
+	if (Input == 0)
+		return false;
+
+	bool bValid = fread(&outHeader, sizeof(outHeader), 1, Input) == 1 && memcmp(outHeader.Magic, Magic, sizeof(Magic)) == 0
+		&& outHeader.Version == CurrentVersion && outHeader.HeaderSize >= sizeof(outHeader) && fseek(Input, outHeader.HeaderSize, SEEK_SET) == 0;
+
+	StrokeEvent Event;
+	outEvents.clear();
+
+	// A session cut short may end with a partial event, it is dropped
+	while (bValid && fread(&Event, sizeof(Event), 1, Input) == 1)
+		outEvents.push_back(Event);
+
+	fclose(Input);
+	return bValid;
+}
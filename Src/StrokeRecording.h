@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "Brush.h"
+
+/** Stroke recording header, stored at offset 0 and followed by StrokeEvents up to the end of the file.
+	Strokes are recorded on generated maps only, MapSize, Seed and Flags are enough to generate the same one again */
+struct StrokeRecordingHeader
+{
+	char Magic[8];
+	unsigned int Version;
+	unsigned int HeaderSize;
+
+	/// Edge length of the generated map, the terrain seed, and StrokeRecordingFlags of the storage its heights got
+	unsigned int MapSize;
+	unsigned int Seed;
+	unsigned int Flags;
+
+	/// Paging budget (--budget) the storage was chosen with, the same map size and budget choose the same one again
+	unsigned int PagingBudgetMB;
+};
+
+/** Heights quantized to 16 bits - with --quantized, or because float tiles didn't fit the budget. Paged from a scratch file since
+	not even quantized tiles fit */
+enum StrokeRecordingFlags	{STROKE_RECORDING_QUANTIZED = 1,
+							STROKE_RECORDING_PAGED = 2};
+
+/** Cursor position of one painting frame, what BrushStroke::MoveTo() got. Position and radius in heightmap samples.
+	Events flagged STROKE_EVENT_BATCH_END only mark where the frame's stamps were applied, the events since the previous one make a batch */
+struct StrokeEvent
+{
+	/// Seconds since the recording started
+	float Time;
+
+	float X, Y;
+	float Radius;
+	float Rotation;
+	unsigned char Mode;
+
+	/// StrokeEventFlags
+	unsigned char Flags;
+	unsigned short Reserved;
+};
+
+enum StrokeEventFlags	{STROKE_EVENT_BEGIN = 1,
+						STROKE_EVENT_IMAGE_MASK = 2,
+						STROKE_EVENT_BATCH_END = 4};
+
+/** Appends the cursor positions of every painting frame to a recording file, 24 bytes a frame, so an editing session
+	can be replayed headless (Benchmark::ReplayStrokes()) with the same stamps in the same batches. Cursor positions come with every
+	mouse event, several of them may land in one frame's batch - EndBatch() marks where it was applied */
+class StrokeRecorder
+{
+public:
+	static const char Magic[8];
+	static const unsigned int CurrentVersion = 1;
+
+protected:
+	FILE *File;
+	std::string FilePath;
+
+	/// Time stamp the recording started at, and frames recorded
+	double StartTime;
+	unsigned long long EventsAmount;
+
+	/// Events recorded since the last batch end
+	bool bBatchOpen;
+
+public:
+	StrokeRecorder();
+	~StrokeRecorder();
+
+	/// Start a new recording of strokes on a generated map. False if the file can't be created
+	bool Open(const char *argFilePath, unsigned int MapSize, unsigned int Seed, unsigned int Flags, unsigned int PagingBudgetMB);
+
+	/// Record a painting frame's cursor position. bBegin starts a new stroke there
+	void Record(float X, float Y, float Radius, float Rotation, BrushMode Mode, bool bImageMask, bool bBegin);
+
+	/// Mark the stamps of the events recorded since the last call as applied in one batch. Nothing is written if there are none
+	void EndBatch();
+
+	/// Finish the recording
+	void Close();
+
+	/// Read a whole recording, false if it isn't one
+	static bool Load(const char *FilePath, StrokeRecordingHeader &outHeader, std::vector<StrokeEvent> &outEvents);
+
+	/// Getters
+	bool IsOpen() const {return File != 0;};
+	const std::string & GetFilePath() const {return FilePath;};
+	unsigned long long GetEventsAmount() const {return EventsAmount;};
+
+private:
+	StrokeRecorder(const StrokeRecorder &other);
+	StrokeRecorder & operator= (const StrokeRecorder &other);
+};
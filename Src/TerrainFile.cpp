@@ -0,0 +1,454 @@
+#include <string.h>
+#include <vector>
+
+#include "TerrainFile.h"
+#include "TileCodec.h"
+
+static const char TerrainFileMagic[8] = {'L', 'A', 'N', 'D', 'T', 'E', 'R', '\0'};
+
+// --------------------------------------------------------------------
+TerrainFile::TerrainFile(const char *argFilePath, bool bWritable):
+FilePath(argFilePath), bReadOnly(false), File(INVALID_HANDLE_VALUE), Mapping(0), FileLength(0), View(0), ViewOffset(0), ViewLength(0), Granularity(0), TileTable(0), TilesAmount(0)
+{
+	SYSTEM_INFO Info;
+	GetSystemInfo(&Info);
+	Granularity = Info.dwAllocationGranularity;
+
+	Open(bWritable);
+}
+
+// --------------------------------------------------------------------
+bool TerrainFile::Open(bool bWritable)
+{
+	memset(&Header, 0, sizeof(Header));
+
+	delete [] TileTable;
+	TileTable = 0;
+	TilesAmount = 0;
+
+	bReadOnly = !bWritable;
+	File = CreateFile(FilePath.c_str(), bReadOnly ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	LARGE_INTEGER Length;
+
+	if (File == INVALID_HANDLE_VALUE || !GetFileSizeEx(File, &Length) || Length.QuadPart < PageSize)
+	{
+		Close();
+		return false;
+	}
+
+	FileLength = Length.QuadPart;
+
+	if (!CreateMapping())
+		return false;
+
+	const unsigned char *HeaderData = MapRange(0, sizeof(Header));
+
+	if (HeaderData != 0)
+		memcpy(&Header, HeaderData, sizeof(Header));
+
+	if (HeaderData == 0 || !ValidateHeader())
+	{
+		Close();
+		return false;
+	}
+
+	TilesAmount = ((Header.Size + Header.TileSize - 1) / Header.TileSize) * ((Header.Size + Header.TileSize - 1) / Header.TileSize);
+
+	if (Header.Encoding == TERRAIN_ENCODING_COMPRESSED && !ReadTileTable())
+	{
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+bool TerrainFile::Reopen(bool bWritable)
+{
+	Close();
+	return Open(bWritable);
+}
+
+// --------------------------------------------------------------------
+TerrainFile::TerrainFile(const char *argFilePath, unsigned int Size, float Offset, unsigned int TileSize, unsigned int Apron, TerrainEncoding Encoding):
+FilePath(argFilePath), bReadOnly(false), File(INVALID_HANDLE_VALUE), Mapping(0), FileLength(0), View(0), ViewOffset(0), ViewLength(0), Granularity(0), TileTable(0), TilesAmount(0)
+{
+	SYSTEM_INFO Info;
+	GetSystemInfo(&Info);
+	Granularity = Info.dwAllocationGranularity;
+
+	unsigned int TilesPerRow = (Size + TileSize - 1) / TileSize;
+
+	TilesAmount = TilesPerRow * TilesPerRow;
+
+	memset(&Header, 0, sizeof(Header));
+	memcpy(Header.Magic, TerrainFileMagic, sizeof(Header.Magic));
+	Header.Version = CurrentVersion;
+	Header.HeaderSize = sizeof(Header);
+	Header.Size = Size;
+	Header.Offset = Offset;
+	Header.TileSize = TileSize;
+	Header.Apron = Apron;
+	Header.Encoding = Encoding;
+	Header.TileSlotBytes = (GetPayloadBytes() + SlotAlignment - 1) / SlotAlignment * SlotAlignment;
+	Header.PayloadOffset = PageSize;
+
+	FileLength = Header.PayloadOffset + (unsigned long long)TilesAmount * Header.TileSlotBytes;
+
+	// Compressed payloads are appended behind the (initially empty) tile table
+	if (Encoding == TERRAIN_ENCODING_COMPRESSED)
+	{
+		Header.TileSlotBytes = 0;
+		FileLength = Header.PayloadOffset + (unsigned long long)TilesAmount * sizeof(TerrainTileEntry);
+
+		TileTable = new TerrainTileEntry[TilesAmount];
+		memset(TileTable, 0, TilesAmount * sizeof(TerrainTileEntry));
+	}
+
+	File = CreateFile(argFilePath, GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+
+	if (File == INVALID_HANDLE_VALUE)
+		return;
+
+	// Mapping extends the file to its full length, never written slots read as zeros
+	if (!CreateMapping())
+		return;
+
+	unsigned char *HeaderData = MapRange(0, PageSize);
+
+	if (HeaderData == 0)
+	{
+		Close();
+		return;
+	}
+
+	memset(HeaderData, 0, PageSize);
+	memcpy(HeaderData, &Header, sizeof(Header));
+}
+
+// --------------------------------------------------------------------
+TerrainFile::~TerrainFile()
+{
+	Close();
+
+	delete [] TileTable;
+}
+
+// --------------------------------------------------------------------
+void TerrainFile::Close()
+{
+	if (View != 0)
+		UnmapViewOfFile(View);
+
+	if (Mapping != 0)
+		CloseHandle(Mapping);
+
+	if (File != INVALID_HANDLE_VALUE)
+		CloseHandle(File);
+
+	View = 0;
+	Mapping = 0;
+	File = INVALID_HANDLE_VALUE;
+}
+
+// --------------------------------------------------------------------
+bool TerrainFile::CreateMapping()
+{
+	Mapping = CreateFileMapping(File, NULL, bReadOnly ? PAGE_READONLY : PAGE_READWRITE, DWORD(FileLength >> 32), DWORD(FileLength & 0xFFFFFFFF), NULL);
+
+	if (Mapping == NULL)
+	{
+		Mapping = 0;
+		Close();
+		return false;
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+bool TerrainFile::Grow(unsigned long long NewLength)
+{
+	// Mapping size is fixed, so it has to be recreated over the longer file
+	if (View != 0)
+		UnmapViewOfFile(View);
+
+	CloseHandle(Mapping);
+
+	View = 0;
+	Mapping = 0;
+	FileLength = NewLength;
+
+	return CreateMapping();
+}
+
+// --------------------------------------------------------------------
+bool TerrainFile::ReadTileTable()
+{
+	const unsigned int ChunkEntries = ViewSize / 2 / sizeof(TerrainTileEntry);
+
+	TileTable = new TerrainTileEntry[TilesAmount];
+
+	for (unsigned int First = 0; First < TilesAmount; First += ChunkEntries)
+	{
+		unsigned int Amount = (TilesAmount - First < ChunkEntries) ? (TilesAmount - First) : (ChunkEntries);
+		const unsigned char *Entries = MapRange(Header.PayloadOffset + (unsigned long long)First * sizeof(TerrainTileEntry), Amount * sizeof(TerrainTileEntry));
+
+		if (Entries == 0)
+			return false;
+
+		memcpy(TileTable + First, Entries, Amount * sizeof(TerrainTileEntry));
+	}
+
+	for (unsigned int i = 0; i < TilesAmount; ++i)
+		if (TileTable[i].Offset + TileTable[i].ByteSize > FileLength)
+			return false;
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+bool TerrainFile::ValidateHeader() const
+{
+	if (memcmp(Header.Magic, TerrainFileMagic, sizeof(Header.Magic)) != 0 || Header.Version == 0 || Header.Version > CurrentVersion)
+		return false;
+
+	if (Header.Size == 0 || Header.TileSize == 0 || (Header.TileSize & (Header.TileSize - 1)) != 0 || Header.Encoding >= TERRAIN_ENCODING_AMOUNT)
+		return false;
+
+	unsigned long long TilesPerRow = (Header.Size + Header.TileSize - 1) / Header.TileSize;
+
+	if (Header.PayloadOffset < sizeof(Header))
+		return false;
+
+	if (Header.Encoding == TERRAIN_ENCODING_COMPRESSED)
+		return Header.PayloadOffset + TilesPerRow * TilesPerRow * sizeof(TerrainTileEntry) <= FileLength;
+
+	if (Header.TileSlotBytes < GetPayloadBytes())
+		return false;
+
+	return Header.PayloadOffset + TilesPerRow * TilesPerRow * Header.TileSlotBytes <= FileLength;
+}
+
+// --------------------------------------------------------------------
+unsigned char * TerrainFile::MapRange(unsigned long long Offset, unsigned int Length)
+{
+	if (View != 0 && Offset >= ViewOffset && Offset + Length <= ViewOffset + ViewLength)
+		return View + (Offset - ViewOffset);
+
+	if (View != 0)
+		UnmapViewOfFile(View);
+
+	// Views have to start at allocation granularity, keep the window big enough for many tiles in a row
+	ViewOffset = Offset / Granularity * Granularity;
+	ViewLength = ViewSize;
+
+	if (ViewLength < Offset + Length - ViewOffset)
+		ViewLength = (unsigned int)(Offset + Length - ViewOffset);
+
+	if (ViewOffset + ViewLength > FileLength)
+		ViewLength = (unsigned int)(FileLength - ViewOffset);
+
+	View = (unsigned char*)MapViewOfFile(Mapping, bReadOnly ? FILE_MAP_READ : FILE_MAP_WRITE, DWORD(ViewOffset >> 32), DWORD(ViewOffset & 0xFFFFFFFF), ViewLength);
+
+	if (View == 0)
+		return 0;
+
+	return View + (Offset - ViewOffset);
+}
+
+// --------------------------------------------------------------------
+unsigned int TerrainFile::GetPayloadBytes() const
+{
+	unsigned int TileStride = Header.TileSize + 2 * Header.Apron;
+
+	if (Header.Encoding == TERRAIN_ENCODING_UINT16)
+		return sizeof(QuantizedTileHeader) + TileStride * TileStride * sizeof(unsigned short);
+
+	if (Header.Encoding == TERRAIN_ENCODING_COMPRESSED)
+		return TileCodec::GetMaxCompressedSize(TileStride, TileStride);
+
+	return TileStride * TileStride * sizeof(float);
+}
+
+// --------------------------------------------------------------------
+bool TerrainFile::LoadTile(unsigned int TileIndex, float *Data)
+{
+	const unsigned int TileStride = Header.TileSize + 2 * Header.Apron;
+
+	if (Header.Encoding == TERRAIN_ENCODING_COMPRESSED)
+	{
+		const TerrainTileEntry &Entry = TileTable[TileIndex];
+		const unsigned char *Payload = (Entry.ByteSize > 0) ? (MapRange(Entry.Offset, Entry.ByteSize)) : (0);
+
+		return Payload != 0 && TileCodec::Decompress(Payload, Entry.ByteSize, TileStride, TileStride, Data);
+	}
+
+	const unsigned char *Payload = MapRange(Header.PayloadOffset + (unsigned long long)TileIndex * Header.TileSlotBytes, GetPayloadBytes());
+
+	if (Payload == 0)
+		return false;
+
+	switch (Header.Encoding)
+	{
+	case TERRAIN_ENCODING_FLOAT32:
+		memcpy(Data, Payload, GetTileSamples() * sizeof(float));
+		break;
+	case TERRAIN_ENCODING_UINT16:
+		DequantizeTile((const unsigned short*)(Payload + sizeof(QuantizedTileHeader)), GetTileSamples(), *(const QuantizedTileHeader*)Payload, Data);
+		break;
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+bool TerrainFile::LoadTiles(unsigned int Amount, const unsigned int *TileIndices, float * const *Data, bool *outLoaded)
+{
+	if (Header.Encoding != TERRAIN_ENCODING_COMPRESSED)
+		return HeightmapStorage::LoadTiles(Amount, TileIndices, Data, outLoaded);
+
+	const unsigned int TileStride = Header.TileSize + 2 * Header.Apron;
+
+	// Payloads are copied out of the single mapped window first, then decoded on all cores
+	std::vector<unsigned char> Payloads;
+	std::vector<unsigned int> PayloadStarts(Amount + 1, 0);
+
+	for (unsigned int i = 0; i < Amount; ++i)
+		PayloadStarts[i + 1] = PayloadStarts[i] + TileTable[TileIndices[i]].ByteSize;
+
+	Payloads.resize(PayloadStarts[Amount] + 1);
+
+	for (unsigned int i = 0; i < Amount; ++i)
+	{
+		const TerrainTileEntry &Entry = TileTable[TileIndices[i]];
+		const unsigned char *Payload = (Entry.ByteSize > 0) ? (MapRange(Entry.Offset, Entry.ByteSize)) : (0);
+
+		outLoaded[i] = (Payload != 0);
+
+		if (Payload != 0)
+			memcpy(&Payloads[PayloadStarts[i]], Payload, Entry.ByteSize);
+	}
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < int(Amount); ++i)
+		if (outLoaded[i])
+			outLoaded[i] = TileCodec::Decompress(&Payloads[PayloadStarts[i]], PayloadStarts[i + 1] - PayloadStarts[i], TileStride, TileStride, Data[i]);
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+bool TerrainFile::StoreTile(unsigned int TileIndex, const float *Data)
+{
+	if (bReadOnly)
+		return false;
+
+	if (Header.Encoding == TERRAIN_ENCODING_COMPRESSED)
+		return StoreTiles(1, &TileIndex, &Data);
+
+	unsigned char *Payload = MapRange(Header.PayloadOffset + (unsigned long long)TileIndex * Header.TileSlotBytes, GetPayloadBytes());
+
+	if (Payload == 0)
+		return false;
+
+	switch (Header.Encoding)
+	{
+	case TERRAIN_ENCODING_FLOAT32:
+		memcpy(Payload, Data, GetTileSamples() * sizeof(float));
+		break;
+	case TERRAIN_ENCODING_UINT16:
+		// Slots never written are zeroed, a zero header stands for no previous encode
+		QuantizeTile(Data, GetTileSamples(), (QuantizedTileHeader*)Payload, *(QuantizedTileHeader*)Payload, (unsigned short*)(Payload + sizeof(QuantizedTileHeader)));
+		break;
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+bool TerrainFile::StoreTiles(unsigned int Amount, const unsigned int *TileIndices, const float * const *Data)
+{
+	if (Header.Encoding != TERRAIN_ENCODING_COMPRESSED)
+		return HeightmapStorage::StoreTiles(Amount, TileIndices, Data);
+
+	if (bReadOnly)
+		return false;
+
+	const unsigned int TileStride = Header.TileSize + 2 * Header.Apron;
+	const unsigned int MaxBytes = TileCodec::GetMaxCompressedSize(TileStride, TileStride);
+
+	std::vector<unsigned char> Buffer((size_t)Amount * MaxBytes);
+	std::vector<unsigned int> Sizes(Amount, 0);
+
+	#pragma omp parallel for schedule(dynamic)
+	for (int i = 0; i < int(Amount); ++i)
+		Sizes[i] = TileCodec::Compress(Data[i], TileStride, TileStride, &Buffer[(size_t)i * MaxBytes]);
+
+	// Payloads are appended, space of overwritten tiles is only reclaimed by saving to a new file
+	unsigned long long Offset = FileLength;
+	unsigned long long TotalBytes = 0;
+
+	for (unsigned int i = 0; i < Amount; ++i)
+		TotalBytes += Sizes[i];
+
+	if (!Grow(FileLength + TotalBytes))
+		return false;
+
+	for (unsigned int i = 0; i < Amount; ++i)
+	{
+		unsigned char *Payload = MapRange(Offset, Sizes[i]);
+
+		if (Payload == 0)
+			return false;
+
+		memcpy(Payload, &Buffer[(size_t)i * MaxBytes], Sizes[i]);
+
+		TileTable[TileIndices[i]].Offset = Offset;
+		TileTable[TileIndices[i]].ByteSize = Sizes[i];
+		Offset += Sizes[i];
+	}
+
+	// Table entries go after all payloads, so the mapped window isn't moved back and forth
+	for (unsigned int i = 0; i < Amount; ++i)
+	{
+		unsigned char *Entry = MapRange(Header.PayloadOffset + (unsigned long long)TileIndices[i] * sizeof(TerrainTileEntry), sizeof(TerrainTileEntry));
+
+		if (Entry == 0)
+			return false;
+
+		memcpy(Entry, &TileTable[TileIndices[i]], sizeof(TerrainTileEntry));
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+float TerrainFile::GetTileError(unsigned int TileIndex)
+{
+	if (Header.Encoding != TERRAIN_ENCODING_UINT16)
+		return 0.0f;
+
+	const unsigned char *Payload = MapRange(Header.PayloadOffset + (unsigned long long)TileIndex * Header.TileSlotBytes, sizeof(QuantizedTileHeader));
+
+	return (Payload != 0) ? (((const QuantizedTileHeader*)Payload)->MaxError) : (0.0f);
+}
+
+// --------------------------------------------------------------------
+bool TerrainFile::Sync()
+{
+	if (Mapping == 0)
+		return false;
+
+	// Nothing can have been written
+	if (bReadOnly)
+		return true;
+
+	// Views unmapped earlier are written back by the system, only the current one has to be flushed
+	if (View != 0 && !FlushViewOfFile(View, ViewLength))
+		return false;
+
+	return FlushFileBuffers(File) != 0;
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <windows.h>
+#include <string>
+
+#include "HeightmapStorage.h"
+#include "TileQuantization.h"
+
+/** Height encodings of the tile payloads */
+enum TerrainEncoding	{TERRAIN_ENCODING_FLOAT32,
+						TERRAIN_ENCODING_UINT16,
+						TERRAIN_ENCODING_COMPRESSED,
+						TERRAIN_ENCODING_AMOUNT};
+
+/** Native terrain file header, stored at offset 0. Tile payloads start at PayloadOffset, one TileSlotBytes slot per tile, row-major.
+	Compressed files have a TerrainTileEntry table at PayloadOffset instead, followed by variable sized payloads */
+struct TerrainFileHeader
+{
+	char Magic[8];
+	unsigned int Version;
+	unsigned int HeaderSize;
+
+	/// Heightmap edge length in samples and distance between adjacent samples (Landscape::Offset)
+	unsigned int Size;
+	float Offset;
+
+	/// Tile edge length without aprons, apron width and payload encoding
+	unsigned int TileSize;
+	unsigned int Apron;
+	unsigned int Encoding;
+
+	/// Slot of a single tile (SlotAlignment aligned) and the first slot offset
+	unsigned int TileSlotBytes;
+	unsigned int Reserved;
+	unsigned long long PayloadOffset;
+};
+
+/** Location of a compressed tile, ByteSize 0 for tiles never stored */
+struct TerrainTileEntry
+{
+	unsigned long long Offset;
+	unsigned int ByteSize;
+	unsigned int Reserved;
+};
+
+/** Versioned terrain file accessed through memory mapping. Opening only reads the header,
+	tiles are mapped when the paged heightmap faults them in, and only dirty tiles are ever written */
+class TerrainFile : public HeightmapStorage
+{
+public:
+	static const unsigned int CurrentVersion = 1;
+
+	/// Header alignment - offset of the first tile slot
+	static const unsigned int PageSize = 4096;
+
+	/// Tile slot alignment
+	static const unsigned int SlotAlignment = 512;
+
+	/// Size of the window mapped at once, tiles are copied in and out of it
+	static const unsigned int ViewSize = 4 << 20;
+
+	/// Tiles coded at once by the parallel codec
+	static const unsigned int BatchSize = 256;
+
+protected:
+	TerrainFileHeader Header;
+	std::string FilePath;
+
+	/// Files opened are read-only unless asked otherwise, tiles can't be stored then
+	bool bReadOnly;
+
+	HANDLE File;
+	HANDLE Mapping;
+	unsigned long long FileLength;
+
+	/// Currently mapped window
+	unsigned char *View;
+	unsigned long long ViewOffset;
+	unsigned int ViewLength;
+	unsigned int Granularity;
+
+	/// Compressed tiles locations, 0 for fixed slot encodings
+	TerrainTileEntry *TileTable;
+	unsigned int TilesAmount;
+
+public:
+	/// Open existing terrain file, read-only unless bWritable is set. Check IsOpen() afterwards
+	TerrainFile(const char *argFilePath, bool bWritable = false);
+
+	/// Create (overwrite) terrain file for given heightmap dimensions
+	TerrainFile(const char *argFilePath, unsigned int Size, float Offset, unsigned int TileSize, unsigned int Apron, TerrainEncoding Encoding = TERRAIN_ENCODING_FLOAT32);
+
+	~TerrainFile();
+
+	/// True if file was opened (or created) and its header is valid
+	bool IsOpen() const {return Mapping != 0;};
+
+	/// Close the file and open it again, e.g. writable for a save or after it has been replaced. Returns IsOpen()
+	bool Reopen(bool bWritable);
+
+	/// Unmap and close the file, Reopen() opens it again
+	void Close();
+
+	bool LoadTile(unsigned int TileIndex, float *Data);
+	bool StoreTile(unsigned int TileIndex, const float *Data);
+	bool Sync();
+
+	/// Compressed files code the whole batch in parallel
+	bool LoadTiles(unsigned int Amount, const unsigned int *TileIndices, float * const *Data, bool *outLoaded);
+	bool StoreTiles(unsigned int Amount, const unsigned int *TileIndices, const float * const *Data);
+
+	/// Quantization error of the stored tile, 0 for float tiles
+	float GetTileError(unsigned int TileIndex);
+
+	/// Getters
+	const TerrainFileHeader & GetHeader() const {return Header;};
+	const std::string & GetFilePath() const {return FilePath;};
+	unsigned int GetSize() const {return Header.Size;};
+	unsigned int GetTileSize() const {return Header.TileSize;};
+	float GetOffset() const {return Header.Offset;};
+	TerrainEncoding GetEncoding() const {return (TerrainEncoding)Header.Encoding;};
+	unsigned long long GetFileLength() const {return FileLength;};
+
+protected:
+	/// Pointer to Length bytes of the file at Offset, remapping the view when needed
+	unsigned char * MapRange(unsigned long long Offset, unsigned int Length);
+
+	/// Bytes of encoded tile inside its slot
+	unsigned int GetPayloadBytes() const;
+
+	unsigned int GetTileSamples() const {return (Header.TileSize + 2 * Header.Apron) * (Header.TileSize + 2 * Header.Apron);};
+
+	bool CreateMapping();
+	bool Grow(unsigned long long NewLength);
+	bool ReadTileTable();
+	bool ValidateHeader() const;
+	bool Open(bool bWritable);
+
+private:
+	TerrainFile(const TerrainFile &other);
+	TerrainFile & operator= (const TerrainFile &other);
+};
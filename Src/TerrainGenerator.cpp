@@ -0,0 +1,414 @@
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "TerrainGenerator.h"
+#include "Log.h"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__SSE2__)
+#define TERRAIN_GENERATOR_SSE2
+#include <emmintrin.h>
+#endif
+
+/// Seed offsets decorrelating octaves and the two warp components
+static const unsigned int OctaveSeedStep = 0x9e3779b9u;
+static const unsigned int WarpSeedX = 0x68bc21ebu;
+static const unsigned int WarpSeedY = 0x02e5be93u;
+
+/// Octaves with lattice cells smaller than a quarter of a sample add nothing but aliasing
+static const unsigned int MaxCellsPerSample = 4;
+
+// --------------------------------------------------------------------
+static unsigned int GetOctavesAmount(unsigned int BaseCells, unsigned int Octaves, unsigned int Size)
+{
+	unsigned int Amount = 1;
+
+	while (Amount < Octaves && (BaseCells << Amount) <= Size * MaxCellsPerSample)
+		++Amount;
+
+	return Amount;
+}
+
+// --------------------------------------------------------------------
+static float GetInvNorm(float Gain, unsigned int Octaves)
+{
+	float Norm = 0.0f, Amplitude = 1.0f;
+
+	for (unsigned int o = 0; o < Octaves; ++o, Amplitude *= Gain)
+		Norm += Amplitude;
+
+	return 1.0f / Norm;
+}
+
+// --------------------------------------------------------------------
+static int WrapCoord(int Coord, unsigned int Size)
+{
+	Coord %= (int)Size;
+	return (Coord < 0) ? (Coord + Size) : (Coord);
+}
+
+// --------------------------------------------------------------------
+static unsigned int Hash(unsigned int X, unsigned int Y, unsigned int Seed)
+{
+	// Lattice coordinates are spread by odd constants, the rest is one xorshift-multiply round.
+	// Only the low bits are used, they are taken from the middle of the product
+	unsigned int H = Seed ^ (X * 0x27d4eb2du) ^ (Y * 0x165667b1u);
+
+	H ^= H >> 15;
+	H *= 0x2c1b3c6du;
+	H ^= H >> 16;
+
+	return H;
+}
+
+// --------------------------------------------------------------------
+static float Gradient(unsigned int H, float X, float Y)
+{
+	// One of the 8 directions (+-1, +-0.5), (+-0.5, +-1)
+	float A = (H & 4) ? (X) : (Y);
+	float B = (H & 4) ? (Y) : (X);
+
+	return ((H & 1) ? (-A) : (A)) + ((H & 2) ? (-(0.5f * B)) : (0.5f * B));
+}
+
+// --------------------------------------------------------------------
+static float Fade(float T)
+{
+	return T * T * T * (T * (T * 6.0f - 15.0f) + 10.0f);
+}
+
+// --------------------------------------------------------------------
+static float Noise(float U, float V, int Period, unsigned int Seed)
+{
+	// U and V lie within <0, Period>, lattice wraps at Period
+	int X0 = int(U);
+	int Y0 = int(V);
+	float FX = U - float(X0);
+	float FY = V - float(Y0);
+
+	X0 -= (X0 >= Period) ? (Period) : (0);
+	Y0 -= (Y0 >= Period) ? (Period) : (0);
+
+	int X1 = (X0 + 1 == Period) ? (0) : (X0 + 1);
+	int Y1 = (Y0 + 1 == Period) ? (0) : (Y0 + 1);
+
+	float N00 = Gradient(Hash(X0, Y0, Seed), FX, FY);
+	float N10 = Gradient(Hash(X1, Y0, Seed), FX - 1.0f, FY);
+	float N01 = Gradient(Hash(X0, Y1, Seed), FX, FY - 1.0f);
+	float N11 = Gradient(Hash(X1, Y1, Seed), FX - 1.0f, FY - 1.0f);
+
+	float SX = Fade(FX);
+	float N0 = N00 + SX * (N10 - N00);
+	float N1 = N01 + SX * (N11 - N01);
+
+	return N0 + Fade(FY) * (N1 - N0);
+}
+
+// --------------------------------------------------------------------
+static float FractalNoise(TerrainNoiseType Type, unsigned int BaseCells, unsigned int Octaves, float Gain, float InvNorm, unsigned int Seed,
+						  float PX, float PY, float InvSize)
+{
+	float Sum = 0.0f, Amplitude = 1.0f, Weight = 1.0f;
+
+	for (unsigned int o = 0; o < Octaves; ++o, Amplitude *= Gain)
+	{
+		int Period = int(BaseCells << o);
+		float Scale = float(Period) * InvSize;
+		float N = Noise(PX * Scale, PY * Scale, Period, Seed + o * OctaveSeedStep);
+
+		// Ridged multifractal - sharp crests, detail weighted by the crests of coarser octaves
+		if (Type == NOISE_RIDGED)
+		{
+			N = 1.0f - fabs(N);
+			N = N * N * Weight;
+			Weight = min(max(N * 2.0f, 0.0f), 1.0f);
+		}
+
+		Sum = Sum + N * Amplitude;
+	}
+
+	return (Type == NOISE_RIDGED) ? (Sum * InvNorm * 2.0f - 1.0f) : (Sum * InvNorm);
+}
+
+#ifdef TERRAIN_GENERATOR_SSE2
+
+// --------------------------------------------------------------------
+static __m128i MulLo32(__m128i A, __m128i B)
+{
+	// SSE2 has no 32-bit low multiply, even and odd lanes are multiplied separately
+	__m128i Even = _mm_mul_epu32(A, B);
+	__m128i Odd = _mm_mul_epu32(_mm_srli_epi64(A, 32), _mm_srli_epi64(B, 32));
+
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(Even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(Odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// --------------------------------------------------------------------
+static __m128 Select(__m128 Mask, __m128 A, __m128 B)
+{
+	return _mm_or_ps(_mm_and_ps(Mask, A), _mm_andnot_ps(Mask, B));
+}
+
+// --------------------------------------------------------------------
+static __m128i HashSSE(__m128i SpreadX, __m128i SpreadY, __m128i Seed)
+{
+	// Same as Hash(), with coordinates already multiplied by their constants
+	__m128i H = _mm_xor_si128(Seed, _mm_xor_si128(SpreadX, SpreadY));
+
+	H = _mm_xor_si128(H, _mm_srli_epi32(H, 15));
+	H = MulLo32(H, _mm_set1_epi32(0x2c1b3c6d));
+	H = _mm_xor_si128(H, _mm_srli_epi32(H, 16));
+
+	return H;
+}
+
+// --------------------------------------------------------------------
+static __m128 GradientSSE(__m128i H, __m128 X, __m128 Y)
+{
+	const __m128i Four = _mm_set1_epi32(4);
+	const __m128i SignMask = _mm_set1_epi32(0x80000000);
+
+	__m128 Swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(H, Four), Four));
+	__m128 A = Select(Swap, X, Y);
+	__m128 B = Select(Swap, Y, X);
+
+	// Bits 0 and 1 of the hash moved to the sign bit flip A and B
+	__m128 SignA = _mm_castsi128_ps(_mm_slli_epi32(H, 31));
+	__m128 SignB = _mm_castsi128_ps(_mm_and_si128(_mm_slli_epi32(H, 30), SignMask));
+
+	return _mm_add_ps(_mm_xor_ps(A, SignA), _mm_xor_ps(_mm_mul_ps(_mm_set1_ps(0.5f), B), SignB));
+}
+
+// --------------------------------------------------------------------
+static __m128 FadeSSE(__m128 T)
+{
+	__m128 Poly = _mm_add_ps(_mm_mul_ps(T, _mm_sub_ps(_mm_mul_ps(T, _mm_set1_ps(6.0f)), _mm_set1_ps(15.0f))), _mm_set1_ps(10.0f));
+
+	return _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(T, T), T), Poly);
+}
+
+// --------------------------------------------------------------------
+static __m128 NoiseSSE(__m128 U, __m128 V, int Period, unsigned int Seed)
+{
+	const __m128i One = _mm_set1_epi32(1);
+	const __m128i PeriodV = _mm_set1_epi32(Period);
+	const __m128i SeedV = _mm_set1_epi32((int)Seed);
+	const __m128 OneF = _mm_set1_ps(1.0f);
+
+	__m128i X0 = _mm_cvttps_epi32(U);
+	__m128i Y0 = _mm_cvttps_epi32(V);
+	__m128 FX = _mm_sub_ps(U, _mm_cvtepi32_ps(X0));
+	__m128 FY = _mm_sub_ps(V, _mm_cvtepi32_ps(Y0));
+
+	X0 = _mm_sub_epi32(X0, _mm_andnot_si128(_mm_cmplt_epi32(X0, PeriodV), PeriodV));
+	Y0 = _mm_sub_epi32(Y0, _mm_andnot_si128(_mm_cmplt_epi32(Y0, PeriodV), PeriodV));
+
+	// Spread coordinates of the next lattice line follow by adding the constant, or are 0 where the lattice wraps
+	const __m128i SpreadConstX = _mm_set1_epi32(0x27d4eb2d);
+	const __m128i SpreadConstY = _mm_set1_epi32(0x165667b1);
+	__m128i X0S = MulLo32(X0, SpreadConstX);
+	__m128i Y0S = MulLo32(Y0, SpreadConstY);
+	__m128i X1S = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_add_epi32(X0, One), PeriodV), _mm_add_epi32(X0S, SpreadConstX));
+	__m128i Y1S = _mm_andnot_si128(_mm_cmpeq_epi32(_mm_add_epi32(Y0, One), PeriodV), _mm_add_epi32(Y0S, SpreadConstY));
+
+	__m128 N00 = GradientSSE(HashSSE(X0S, Y0S, SeedV), FX, FY);
+	__m128 N10 = GradientSSE(HashSSE(X1S, Y0S, SeedV), _mm_sub_ps(FX, OneF), FY);
+	__m128 N01 = GradientSSE(HashSSE(X0S, Y1S, SeedV), FX, _mm_sub_ps(FY, OneF));
+	__m128 N11 = GradientSSE(HashSSE(X1S, Y1S, SeedV), _mm_sub_ps(FX, OneF), _mm_sub_ps(FY, OneF));
+
+	__m128 SX = FadeSSE(FX);
+	__m128 N0 = _mm_add_ps(N00, _mm_mul_ps(SX, _mm_sub_ps(N10, N00)));
+	__m128 N1 = _mm_add_ps(N01, _mm_mul_ps(SX, _mm_sub_ps(N11, N01)));
+
+	return _mm_add_ps(N0, _mm_mul_ps(FadeSSE(FY), _mm_sub_ps(N1, N0)));
+}
+
+// --------------------------------------------------------------------
+static __m128 FractalNoiseSSE(TerrainNoiseType Type, unsigned int BaseCells, unsigned int Octaves, float Gain, float InvNorm, unsigned int Seed,
+							  __m128 PX, __m128 PY, float InvSize)
+{
+	const __m128 AbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+	__m128 Sum = _mm_setzero_ps();
+	__m128 Weight = _mm_set1_ps(1.0f);
+	float Amplitude = 1.0f;
+
+	for (unsigned int o = 0; o < Octaves; ++o, Amplitude *= Gain)
+	{
+		int Period = int(BaseCells << o);
+		__m128 Scale = _mm_set1_ps(float(Period) * InvSize);
+		__m128 N = NoiseSSE(_mm_mul_ps(PX, Scale), _mm_mul_ps(PY, Scale), Period, Seed + o * OctaveSeedStep);
+
+		if (Type == NOISE_RIDGED)
+		{
+			N = _mm_sub_ps(_mm_set1_ps(1.0f), _mm_and_ps(N, AbsMask));
+			N = _mm_mul_ps(_mm_mul_ps(N, N), Weight);
+			Weight = _mm_min_ps(_mm_max_ps(_mm_mul_ps(N, _mm_set1_ps(2.0f)), _mm_setzero_ps()), _mm_set1_ps(1.0f));
+		}
+
+		Sum = _mm_add_ps(Sum, _mm_mul_ps(N, _mm_set1_ps(Amplitude)));
+	}
+
+	if (Type == NOISE_RIDGED)
+		return _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(Sum, _mm_set1_ps(InvNorm)), _mm_set1_ps(2.0f)), _mm_set1_ps(1.0f));
+
+	return _mm_mul_ps(Sum, _mm_set1_ps(InvNorm));
+}
+
+// --------------------------------------------------------------------
+static __m128 WrapSSE(__m128 P, float Size, float InvSize)
+{
+	// Floor of P / Size - truncation, minus one where it rounded up
+	__m128 Q = _mm_mul_ps(P, _mm_set1_ps(InvSize));
+	__m128 T = _mm_cvtepi32_ps(_mm_cvttps_epi32(Q));
+	__m128 Floor = _mm_sub_ps(T, _mm_and_ps(_mm_cmpgt_ps(T, Q), _mm_set1_ps(1.0f)));
+
+	return _mm_sub_ps(P, _mm_mul_ps(_mm_set1_ps(Size), Floor));
+}
+
+#endif
+
+// --------------------------------------------------------------------
+bool TerrainGenerator::HasSIMD()
+{
+#ifdef TERRAIN_GENERATOR_SSE2
+	return true;
+#else
+	return false;
+#endif
+}
+
+// --------------------------------------------------------------------
+void TerrainGenerator::GenerateRect(const TerrainNoiseSettings &Settings, unsigned int Size, int X, int Y, int Width, int Height, float *Out,
+									unsigned int OutStride, bool bSIMD)
+{
+	const float SizeF = float(Size);
+	const float InvSize = 1.0f / SizeF;
+	const unsigned int Octaves = GetOctavesAmount(Settings.BaseCells, Settings.Octaves, Size);
+	const unsigned int WarpOctaves = GetOctavesAmount(Settings.BaseCells, Settings.WarpOctaves, Size);
+	const float InvNorm = GetInvNorm(Settings.Gain, Octaves);
+	const float WarpInvNorm = GetInvNorm(Settings.Gain, WarpOctaves);
+	const bool bWarp = (Settings.WarpStrength > 0.0f);
+
+	// Wrapped column coordinates, padded to whole groups of four
+	std::vector<float> Columns(Width + 3);
+
+	for (int x = 0; x < Width + 3; ++x)
+		Columns[x] = float(WrapCoord(X + x, Size));
+
+	for (int y = 0; y < Height; ++y)
+	{
+		const float PY = float(WrapCoord(Y + y, Size));
+		float *Row = Out + y * OutStride;
+		int x = 0;
+
+#ifdef TERRAIN_GENERATOR_SSE2
+		// Every sample goes through the same path - the row tail is computed in full and only the valid part is kept
+		for (; bSIMD && x < Width; x += 4)
+		{
+			__m128 PXV = _mm_loadu_ps(&Columns[x]);
+			__m128 PYV = _mm_set1_ps(PY);
+
+			if (bWarp)
+			{
+				__m128 Strength = _mm_set1_ps(Settings.WarpStrength);
+				__m128 WX = FractalNoiseSSE(NOISE_FBM, Settings.BaseCells, WarpOctaves, Settings.Gain, WarpInvNorm, Settings.Seed ^ WarpSeedX, PXV, PYV, InvSize);
+				__m128 WY = FractalNoiseSSE(NOISE_FBM, Settings.BaseCells, WarpOctaves, Settings.Gain, WarpInvNorm, Settings.Seed ^ WarpSeedY, PXV, PYV, InvSize);
+
+				PXV = WrapSSE(_mm_add_ps(PXV, _mm_mul_ps(Strength, WX)), SizeF, InvSize);
+				PYV = WrapSSE(_mm_add_ps(PYV, _mm_mul_ps(Strength, WY)), SizeF, InvSize);
+			}
+
+			__m128 Value = FractalNoiseSSE(Settings.Type, Settings.BaseCells, Octaves, Settings.Gain, InvNorm, Settings.Seed, PXV, PYV, InvSize);
+			__m128 Heights = _mm_add_ps(_mm_set1_ps(Settings.BaseHeight), _mm_mul_ps(_mm_set1_ps(Settings.Amplitude), Value));
+
+			if (x + 4 <= Width)
+			{
+				_mm_storeu_ps(Row + x, Heights);
+			}
+			else
+			{
+				float Tail[4];
+
+				_mm_storeu_ps(Tail, Heights);
+				memcpy(Row + x, Tail, (Width - x) * sizeof(float));
+			}
+		}
+#endif
+
+		for (; x < Width; ++x)
+		{
+			float PX = Columns[x];
+			float PYW = PY;
+
+			if (bWarp)
+			{
+				float WX = FractalNoise(NOISE_FBM, Settings.BaseCells, WarpOctaves, Settings.Gain, WarpInvNorm, Settings.Seed ^ WarpSeedX, PX, PYW, InvSize);
+				float WY = FractalNoise(NOISE_FBM, Settings.BaseCells, WarpOctaves, Settings.Gain, WarpInvNorm, Settings.Seed ^ WarpSeedY, PX, PYW, InvSize);
+
+				PX = PX + Settings.WarpStrength * WX;
+				PYW = PYW + Settings.WarpStrength * WY;
+				PX = PX - SizeF * floor(PX * InvSize);
+				PYW = PYW - SizeF * floor(PYW * InvSize);
+			}
+
+			float Value = FractalNoise(Settings.Type, Settings.BaseCells, Octaves, Settings.Gain, InvNorm, Settings.Seed, PX, PYW, InvSize);
+
+			Row[x] = Settings.BaseHeight + Settings.Amplitude * Value;
+		}
+	}
+}
+
+// --------------------------------------------------------------------
+void TerrainGenerator::Generate(Heightmap *Target, const TerrainNoiseSettings &Settings)
+{
+	const unsigned int Size = Target->GetSize();
+	const unsigned int TileSize = Target->GetTileSize();
+	const unsigned int TilesPerRow = Target->GetTilesPerRow();
+	const int TilesAmount = TilesPerRow * TilesPerRow;
+
+	if (!Target->IsPaged())
+	{
+		// Resident tiles are independent memory blocks, written straight from all threads
+		#pragma omp parallel for schedule(dynamic)
+		for (int i = 0; i < TilesAmount; ++i)
+		{
+			unsigned int TileX = i % TilesPerRow;
+			unsigned int TileY = i / TilesPerRow;
+
+			GenerateRect(Settings, Size, TileX * TileSize, TileY * TileSize, Target->GetTileExtent(TileX), Target->GetTileExtent(TileY),
+						 Target->WriteTile(TileX, TileY), Target->GetTileStride());
+		}
+	}
+	else
+	{
+		// Paged tiles go through the shared cache - batches are generated in parallel and copied in one by one
+		std::vector<float> Batch(Heightmap::BatchSize * TileSize * TileSize);
+
+		for (int First = 0; First < TilesAmount; First += Heightmap::BatchSize)
+		{
+			const int Amount = min(int(Heightmap::BatchSize), TilesAmount - First);
+
+			#pragma omp parallel for schedule(dynamic)
+			for (int i = 0; i < Amount; ++i)
+			{
+				unsigned int TileX = (First + i) % TilesPerRow;
+				unsigned int TileY = (First + i) / TilesPerRow;
+
+				GenerateRect(Settings, Size, TileX * TileSize, TileY * TileSize, Target->GetTileExtent(TileX), Target->GetTileExtent(TileY),
+							 &Batch[i * TileSize * TileSize], TileSize);
+			}
+
+			for (int i = 0; i < Amount; ++i)
+			{
+				unsigned int TileX = (First + i) % TilesPerRow;
+				unsigned int TileY = (First + i) / TilesPerRow;
+				float *Tile = Target->WriteTile(TileX, TileY);
+
+				for (unsigned int y = 0; y < Target->GetTileExtent(TileY); ++y)
+					memcpy(Tile + y * Target->GetTileStride(), &Batch[(i * TileSize + y) * TileSize], Target->GetTileExtent(TileX) * sizeof(float));
+			}
+		}
+	}
+
+	Target->UpdateAllAprons();
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "Heightmap.h"
+
+enum TerrainNoiseType	{NOISE_FBM,
+						NOISE_RIDGED,
+						NOISE_TYPES_AMOUNT};
+
+/** Parameters of generated terrain. Same settings and map size always give the same heights */
+struct TerrainNoiseSettings
+{
+	unsigned int Seed;
+	TerrainNoiseType Type;
+
+	/// Amount of octaves, every one has twice the lattice cells and Gain times the amplitude of the previous one
+	unsigned int Octaves;
+	float Gain;
+
+	/// Gradient lattice cells across the whole map in the first octave. Integral, so the noise wraps with the map
+	unsigned int BaseCells;
+
+	/// Height = BaseHeight + Amplitude * noise, noise being roughly within <-1, 1>
+	float BaseHeight;
+	float Amplitude;
+
+	/// Samples are displaced by up to WarpStrength samples along a WarpOctaves fBm vector field before sampling, 0 disables warping
+	float WarpStrength;
+	unsigned int WarpOctaves;
+
+	TerrainNoiseSettings(): Seed(1), Type(NOISE_FBM), Octaves(8), Gain(0.5f), BaseCells(4), BaseHeight(100.0f), Amplitude(80.0f), WarpStrength(0.0f), WarpOctaves(4) {};
+};
+
+/** Seeded, tileable gradient noise terrain - fBm, ridged multifractal, optionally domain warped.
+	Four samples at a time with SSE2, tiles in parallel. Every sample is computed on its own, so the output does not depend
+	on the amount of threads or on how the map is split */
+class TerrainGenerator
+{
+public:
+	/// True if this build has the SSE2 path
+	static bool HasSIMD();
+
+	/// Fill the whole heightmap, aprons included
+	static void Generate(Heightmap *Target, const TerrainNoiseSettings &Settings);
+
+	/// Heights of Width x Height samples at map coordinates (X, Y) (wrapped) of a Size x Size map, rows OutStride floats apart.
+	/// bSIMD = false forces the scalar path, which may differ from the SSE2 one in the last bits
+	static void GenerateRect(const TerrainNoiseSettings &Settings, unsigned int Size, int X, int Y, int Width, int Height, float *Out,
+							 unsigned int OutStride, bool bSIMD = true);
+
+private:
+	TerrainGenerator();
+};
@@ -100,6 +100,60 @@ bool TextureManager::LoadTexture(const char* filename, const unsigned int texID,
 	return true;
 }
 
+bool TextureManager::LoadImageData(const char* filename, std::vector<float>& values, unsigned int& width, unsigned int& height)
+{
+	//image format
+	FREE_IMAGE_FORMAT fif = FIF_UNKNOWN;
+	//pointer to the image, once loaded
+	FIBITMAP *dib(0);
+	//pointer to the image converted to 32 bits
+	FIBITMAP *dib32(0);
+
+	//check the file signature and deduce its format
+	fif = FreeImage_GetFileType(filename, 0);
+	//if still unknown, try to guess the file format from the file extension
+	if(fif == FIF_UNKNOWN) 
+		fif = FreeImage_GetFIFFromFilename(filename);
+	//if still unkown, return failure
+	if(fif == FIF_UNKNOWN)
+		return false;
+
+	//check that the plugin has reading capabilities and load the file
+	if(FreeImage_FIFSupportsReading(fif))
+		dib = FreeImage_Load(fif, filename);
+	//if the image failed to load, return failure
+	if(!dib)
+		return false;
+
+	//bring every format to BGRA, images without alpha get an opaque one
+	dib32 = FreeImage_ConvertTo32Bits(dib);
+	FreeImage_Unload(dib);
+	if(!dib32)
+		return false;
+
+	width = FreeImage_GetWidth(dib32);
+	height = FreeImage_GetHeight(dib32);
+	values.resize(width * height);
+
+	//FreeImage keeps the bottom row first
+	for(unsigned int y = 0; y < height; ++y)
+	{
+		const BYTE* line = FreeImage_GetScanLine(dib32, height - 1 - y);
+
+		for(unsigned int x = 0; x < width; ++x, line += 4)
+		{
+			float luminance = (0.299f * line[FI_RGBA_RED] + 0.587f * line[FI_RGBA_GREEN] + 0.114f * line[FI_RGBA_BLUE]) / 255.0f;
+			values[y * width + x] = luminance * (line[FI_RGBA_ALPHA] / 255.0f);
+		}
+	}
+
+	//Free FreeImage's copy of the data
+	FreeImage_Unload(dib32);
+
+	//return success
+	return (width != 0) && (height != 0);
+}
+
 bool TextureManager::UnloadTexture(const unsigned int texID)
 {
 	bool result(true);
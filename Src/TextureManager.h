@@ -13,6 +13,7 @@
 #include <gl/gl.h>
 #include "FreeImage.h"
 #include <map>
+#include <vector>
 
 class TextureManager
 {
@@ -30,6 +31,13 @@ public:
 		GLint level = 0,					//mipmapping level
 		GLint border = 0);					//border size
 
+	//load an image into memory only, as one value per pixel - luminance times alpha, 0 to 1
+	//rows go top to bottom, no OpenGL calls are made
+	bool LoadImageData(const char* filename,	//where to load the file from
+		std::vector<float>& values,				//width * height values
+		unsigned int& width,					//image width
+		unsigned int& height);					//image height
+
 	//free the memory for a texture
 	bool UnloadTexture(const unsigned int texID);
 
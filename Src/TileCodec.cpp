@@ -0,0 +1,289 @@
+#include <string.h>
+
+#include "TileCodec.h"
+
+/// Longest unary prefix, values with bigger quotient are stored raw after it
+static const unsigned int EscapeLength = 24;
+
+/// Bits used to store Rice parameter of a row
+static const unsigned int ParameterBits = 5;
+
+// --------------------------------------------------------------------
+static inline unsigned int FloatToCode(float Value)
+{
+	unsigned int Bits;
+	memcpy(&Bits, &Value, sizeof(Bits));
+
+	// Negative floats are flipped whole, positive ones get the sign bit set - integer order matches float order
+	return (Bits & 0x80000000) ? (~Bits) : (Bits | 0x80000000);
+}
+
+// --------------------------------------------------------------------
+static inline float CodeToFloat(unsigned int Code)
+{
+	unsigned int Bits = (Code & 0x80000000) ? (Code & 0x7FFFFFFF) : (~Code);
+	float Value;
+	memcpy(&Value, &Bits, sizeof(Value));
+
+	return Value;
+}
+
+// --------------------------------------------------------------------
+static inline unsigned int Predict(const unsigned int *Codes, unsigned int x, unsigned int y, unsigned int Width)
+{
+	if (y == 0)
+		return (x == 0) ? (0x80000000) : (Codes[x - 1]);
+
+	unsigned int N = Codes[(y - 1) * Width + x];
+
+	if (x == 0)
+		return N;
+
+	unsigned int W = Codes[y * Width + x - 1];
+	unsigned int NW = Codes[(y - 1) * Width + x - 1];
+	unsigned int Min = (W < N) ? (W) : (N);
+	unsigned int Max = (W < N) ? (N) : (W);
+
+	if (NW >= Max)
+		return Min;
+	if (NW <= Min)
+		return Max;
+
+	// NW lies between W and N, so the planar prediction stays within them too
+	return W + N - NW;
+}
+
+// --------------------------------------------------------------------
+static inline unsigned int ZigZag(unsigned int Residual)
+{
+	return (Residual << 1) ^ (unsigned int)((int)Residual >> 31);
+}
+
+// --------------------------------------------------------------------
+static inline unsigned int UnZigZag(unsigned int Value)
+{
+	return (Value >> 1) ^ (0 - (Value & 1));
+}
+
+/** LSB first bit writer */
+struct BitWriter
+{
+	unsigned char *Out;
+	unsigned int Position;
+	unsigned long long Accumulator;
+	unsigned int BitsAmount;
+
+	BitWriter(unsigned char *argOut): Out(argOut), Position(0), Accumulator(0), BitsAmount(0) {};
+
+	void Write(unsigned int Value, unsigned int Bits)
+	{
+		Accumulator |= (unsigned long long)Value << BitsAmount;
+		BitsAmount += Bits;
+
+		while (BitsAmount >= 8)
+		{
+			Out[Position++] = (unsigned char)Accumulator;
+			Accumulator >>= 8;
+			BitsAmount -= 8;
+		}
+	};
+
+	unsigned int Finish()
+	{
+		if (BitsAmount > 0)
+			Out[Position++] = (unsigned char)Accumulator;
+
+		return Position;
+	};
+};
+
+/** LSB first bit reader, reading past the end yields zeros and sets bOverrun */
+struct BitReader
+{
+	const unsigned char *Data;
+	unsigned int ByteSize;
+	unsigned int Position;
+	unsigned long long Accumulator;
+	unsigned int BitsAmount;
+	bool bOverrun;
+
+	BitReader(const unsigned char *argData, unsigned int argByteSize): Data(argData), ByteSize(argByteSize), Position(0), Accumulator(0), BitsAmount(0), bOverrun(false) {};
+
+	void Refill()
+	{
+		while (BitsAmount <= 56)
+		{
+			if (Position < ByteSize)
+				Accumulator |= (unsigned long long)Data[Position] << BitsAmount;
+			else if (Position >= ByteSize + 8)
+				bOverrun = true;
+
+			Position++;
+			BitsAmount += 8;
+		}
+	};
+
+	unsigned int Read(unsigned int Bits)
+	{
+		if (Bits == 0)
+			return 0;
+
+		if (BitsAmount < Bits)
+			Refill();
+
+		unsigned int Value = (unsigned int)(Accumulator & ((1ull << Bits) - 1));
+		Accumulator >>= Bits;
+		BitsAmount -= Bits;
+
+		return Value;
+	};
+
+	unsigned int ReadUnary(unsigned int Limit)
+	{
+		// Limit ones or the terminating zero are always within the refilled accumulator
+		if (BitsAmount <= Limit)
+			Refill();
+
+		unsigned int Count = 0;
+
+		while (Count < Limit)
+		{
+			unsigned int Ones = TrailingOnes[Accumulator & 0xFF];
+
+			if (Count + Ones >= Limit)
+			{
+				Accumulator >>= Limit - Count;
+				BitsAmount -= Limit - Count;
+				return Limit;
+			}
+
+			Count += Ones;
+
+			if (Ones < 8)
+			{
+				Accumulator >>= Ones + 1;
+				BitsAmount -= Ones + 1;
+				return Count;
+			}
+
+			Accumulator >>= 8;
+			BitsAmount -= 8;
+		}
+
+		return Count;
+	};
+
+	/// Amount of consecutive set bits from the lowest one, per byte value
+	static unsigned char TrailingOnes[256];
+};
+
+unsigned char BitReader::TrailingOnes[256];
+
+/** Fills BitReader lookup table before main() */
+static struct TrailingOnesInitializer
+{
+	TrailingOnesInitializer()
+	{
+		for (unsigned int i = 0; i < 256; ++i)
+		{
+			unsigned int Ones = 0;
+
+			while (Ones < 8 && (i >> Ones) & 1)
+				Ones++;
+
+			BitReader::TrailingOnes[i] = (unsigned char)Ones;
+		}
+	};
+} TrailingOnesTable;
+
+// --------------------------------------------------------------------
+unsigned int TileCodec::GetMaxCompressedSize(unsigned int Width, unsigned int Height)
+{
+	return (Width * Height * (EscapeLength + 32) + Height * ParameterBits) / 8 + 1;
+}
+
+// --------------------------------------------------------------------
+unsigned int TileCodec::Compress(const float *Data, unsigned int Width, unsigned int Height, unsigned char *Out)
+{
+	unsigned int *Codes = new unsigned int[Width * Height];
+	unsigned int *Residuals = new unsigned int[Width];
+
+	for (unsigned int i = 0; i < Width * Height; ++i)
+		Codes[i] = FloatToCode(Data[i]);
+
+	BitWriter Writer(Out);
+
+	for (unsigned int y = 0; y < Height; ++y)
+	{
+		unsigned long long Sum = 0;
+
+		for (unsigned int x = 0; x < Width; ++x)
+		{
+			Residuals[x] = ZigZag(Codes[y * Width + x] - Predict(Codes, x, y, Width));
+			Sum += Residuals[x];
+		}
+
+		// Rice parameter close to log2 of the mean residual
+		unsigned int Parameter = 0;
+		unsigned long long Mean = Sum / Width;
+
+		while (Parameter < 31 && (1ull << (Parameter + 1)) <= Mean)
+			Parameter++;
+
+		Writer.Write(Parameter, ParameterBits);
+
+		for (unsigned int x = 0; x < Width; ++x)
+		{
+			unsigned int Quotient = Residuals[x] >> Parameter;
+
+			if (Quotient < EscapeLength)
+			{
+				Writer.Write((1u << Quotient) - 1, Quotient + 1);
+				Writer.Write(Residuals[x] & ((1u << Parameter) - 1), Parameter);
+			}
+			else
+			{
+				Writer.Write((1u << EscapeLength) - 1, EscapeLength);
+				Writer.Write(Residuals[x], 32);
+			}
+		}
+	}
+
+	delete [] Residuals;
+	delete [] Codes;
+
+	return Writer.Finish();
+}
+
+// --------------------------------------------------------------------
+bool TileCodec::Decompress(const unsigned char *Data, unsigned int ByteSize, unsigned int Width, unsigned int Height, float *Out)
+{
+	unsigned int *Codes = new unsigned int[Width * Height];
+
+	BitReader Reader(Data, ByteSize);
+
+	for (unsigned int y = 0; y < Height; ++y)
+	{
+		unsigned int Parameter = Reader.Read(ParameterBits);
+
+		for (unsigned int x = 0; x < Width; ++x)
+		{
+			unsigned int Quotient = Reader.ReadUnary(EscapeLength);
+			unsigned int Residual;
+
+			if (Quotient < EscapeLength)
+				Residual = (Quotient << Parameter) | Reader.Read(Parameter);
+			else
+				Residual = Reader.Read(32);
+
+			Codes[y * Width + x] = Predict(Codes, x, y, Width) + UnZigZag(Residual);
+		}
+	}
+
+	for (unsigned int i = 0; i < Width * Height; ++i)
+		Out[i] = CodeToFloat(Codes[i]);
+
+	delete [] Codes;
+
+	return !Reader.bOverrun;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+/** Lossless codec of float height tiles. Float bit patterns are mapped to order-preserving integers,
+	predicted from their W/N/NW neighbours (median edge detector) and residuals are Rice coded with
+	a parameter chosen per row. Every tile is independent, so tiles can be coded in parallel */
+class TileCodec
+{
+public:
+	/// Upper bound of compressed size of Width x Height tile
+	static unsigned int GetMaxCompressedSize(unsigned int Width, unsigned int Height);
+
+	/// Compress tile into Out (at least GetMaxCompressedSize() bytes), return compressed size
+	static unsigned int Compress(const float *Data, unsigned int Width, unsigned int Height, unsigned char *Out);
+
+	/// Decompress tile, return false if the data is corrupted
+	static bool Decompress(const unsigned char *Data, unsigned int ByteSize, unsigned int Width, unsigned int Height, float *Out);
+};
@@ -0,0 +1,89 @@
+#include <math.h>
+
+#include "TileQuantization.h"
+
+// --------------------------------------------------------------------
+void QuantizeTile(const float *Data, unsigned int Count, const QuantizedTileHeader *Previous, QuantizedTileHeader &Header, unsigned short *Out)
+{
+	float Min = Data[0], Max = Data[0];
+
+	for (unsigned int i = 1; i < Count; ++i)
+	{
+		if (Data[i] < Min)
+			Min = Data[i];
+		if (Data[i] > Max)
+			Max = Data[i];
+	}
+
+	// Header may alias Previous
+	QuantizedTileHeader Old;
+
+	if (Previous != 0)
+		Old = *Previous;
+	else
+		Old.Min = Old.Scale = Old.MaxError = 0.0f;
+
+	// Unchanged samples sit on the old grid and come back exactly, only edited ones get a new error - the bound doesn't grow with
+	// every eviction. Zeroed headers (never stored slots) only fit a tile of zeros
+	bool bKeepGrid = (Old.Scale > 0.0f) ? (Min >= Old.Min && Max <= Old.Min + float(QuantizationLevels - 1) * Old.Scale) : (Min == Old.Min && Max == Old.Min);
+
+	if (bKeepGrid)
+	{
+		Header.Min = Old.Min;
+		Header.Scale = Old.Scale;
+	}
+	else
+	{
+		Header.Min = Min;
+		Header.Scale = (Max - Min) / float(QuantizationLevels - 1);
+	}
+
+	Header.Reserved = 0;
+
+	float NewError = 0.0f;
+
+	// Flat tile - stored exactly
+	if (Header.Scale <= 0.0f)
+	{
+		Header.Scale = 0.0f;
+
+		for (unsigned int i = 0; i < Count; ++i)
+			Out[i] = 0;
+	}
+	else
+	{
+		const float InvScale = 1.0f / Header.Scale;
+
+		for (unsigned int i = 0; i < Count; ++i)
+		{
+			int Value = int((Data[i] - Header.Min) * InvScale + 0.5f);
+
+			if (Value > int(QuantizationLevels - 1))
+				Value = QuantizationLevels - 1;
+			else if (Value < 0)
+				Value = 0;
+
+			Out[i] = (unsigned short)Value;
+
+			// Measured with the decoder's own arithmetic, so the bound holds for what readers actually get
+			float Error = fabs(Header.Min + Value * Header.Scale - Data[i]);
+
+			if (Error > NewError)
+				NewError = Error;
+		}
+	}
+
+	// On the kept grid a sample is either unchanged (old error, re-encoded exactly) or edited (new error against its new height).
+	// A new grid moves every sample, both errors add up
+	Header.MaxError = (bKeepGrid) ? ((Old.MaxError > NewError) ? (Old.MaxError) : (NewError)) : (Old.MaxError + NewError);
+}
+
+// --------------------------------------------------------------------
+void DequantizeTile(const unsigned short *Data, unsigned int Count, const QuantizedTileHeader &Header, float *Out)
+{
+	const float Min = Header.Min;
+	const float Scale = Header.Scale;
+
+	for (unsigned int i = 0; i < Count; ++i)
+		Out[i] = Min + Data[i] * Scale;
+}
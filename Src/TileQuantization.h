@@ -0,0 +1,24 @@
+#pragma once
+
+/** Per tile parameters of 16-bit quantized heights. Height = Min + Value * Scale */
+struct QuantizedTileHeader
+{
+	float Min;
+	float Scale;
+
+	/// Bound of the absolute difference between the heights first stored and decoded ones, over all re-encodes of the tile
+	float MaxError;
+
+	unsigned int Reserved;
+};
+
+/// Amount of quantization levels of a sample
+static const unsigned int QuantizationLevels = 65536;
+
+/// Quantize Count heights, filling Header. Previous is the header the tile was stored with before (0 or zeroed the first time) - while the
+/// heights fit its grid it is kept, so samples decoded from it encode exactly again. Otherwise the full 16-bit range between the heights'
+/// min and max is used and the previous bound adds up with the new error. Header may be Previous itself
+void QuantizeTile(const float *Data, unsigned int Count, const QuantizedTileHeader *Previous, QuantizedTileHeader &Header, unsigned short *Out);
+
+/// Decode Count quantized heights
+void DequantizeTile(const unsigned short *Data, unsigned int Count, const QuantizedTileHeader &Header, float *Out);
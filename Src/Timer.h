@@ -0,0 +1,14 @@
+#pragma once
+
+#include <windows.h>
+
+/// High resolution time stamp in seconds, from the performance counter
+inline double GetTime()
+{
+	LARGE_INTEGER Frequency, Ticks;
+
+	QueryPerformanceFrequency(&Frequency);
+	QueryPerformanceCounter(&Ticks);
+
+	return Ticks.QuadPart / (double)Frequency.QuadPart;
+}
@@ -0,0 +1,198 @@
+#include <string.h>
+
+#include "UploadRing.h"
+#include "LandscapeEditor.h"
+#include "Timer.h"
+
+// --------------------------------------------------------------------
+UploadRing::UploadRing():
+Buffer(0), Mapped(0), RegionSize(0), Region(0), Head(0)
+{
+	for (unsigned int i = 0; i < RegionsAmount; ++i)
+		Fences[i] = 0;
+}
+
+// --------------------------------------------------------------------
+UploadRing::~UploadRing()
+{
+	Release();
+}
+
+// --------------------------------------------------------------------
+bool UploadRing::Init(unsigned int argRegionSize)
+{
+	Release();
+
+	if (!GLEW_ARB_buffer_storage || !GLEW_ARB_sync || !GLEW_ARB_copy_buffer)
+		return false;
+
+	RegionSize = argRegionSize;
+	Region = 0;
+	Head = 0;
+
+	// Coherent, staged bytes are visible to the copies issued after them without flushing
+	const GLbitfield Flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	glGenBuffers(1, &Buffer);
+	glBindBuffer(GL_COPY_READ_BUFFER, Buffer);
+	glBufferStorage(GL_COPY_READ_BUFFER, RegionsAmount * RegionSize, 0, Flags);
+	Mapped = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, RegionsAmount * RegionSize, Flags);
+
+	if (Mapped == 0)
+	{
+		Release();
+		return false;
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+void UploadRing::Release()
+{
+	for (unsigned int i = 0; i < RegionsAmount; ++i)
+	{
+		if (Fences[i] != 0)
+			glDeleteSync(Fences[i]);
+
+		Fences[i] = 0;
+	}
+
+	if (Buffer == 0)
+		return;
+
+	// Deleting a persistently mapped buffer unmaps it
+	glDeleteBuffers(1, &Buffer);
+	Buffer = 0;
+	Mapped = 0;
+}
+
+// --------------------------------------------------------------------
+void UploadRing::BeginFrame()
+{
+	Stats.FrameBytes = 0;
+	Stats.FrameCopies = 0;
+	Stats.FrameFenceWaitTime = 0.0;
+
+	if (Mapped == 0)
+		return;
+
+	Region = (Region + 1) % RegionsAmount;
+	Head = 0;
+
+	GLsync &Fence = Fences[Region];
+
+	if (Fence == 0)
+		return;
+
+	// Passed already, unless the GPU fell RegionsAmount - 1 frames behind
+	if (glClientWaitSync(Fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+	{
+		double Start = GetTime();
+		GLenum Result;
+
+		do
+		{
+			Result = glClientWaitSync(Fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+		}
+		while (Result == GL_TIMEOUT_EXPIRED);
+
+		Stats.FrameFenceWaitTime = GetTime() - Start;
+		Stats.TotalFenceWaitTime += Stats.FrameFenceWaitTime;
+		Stats.MaxFenceWaitTime = max(Stats.MaxFenceWaitTime, Stats.FrameFenceWaitTime);
+		Stats.FenceWaits++;
+	}
+
+	glDeleteSync(Fence);
+	Fence = 0;
+}
+
+// --------------------------------------------------------------------
+int UploadRing::Stage(const void *Data, unsigned int Size)
+{
+	Stats.FrameBytes += Size;
+	Stats.FrameCopies++;
+	Stats.TotalBytes += Size;
+
+	// The region is full, e.g. all levels refilled at once - better the driver's own copy than waiting for the next region
+	if (Mapped == 0 || Head + Size > RegionSize)
+	{
+		Stats.DirectBytes += Size;
+		return -1;
+	}
+
+	unsigned int Staged = Region * RegionSize + Head;
+	memcpy(Mapped + Staged, Data, Size);
+
+	Head += (Size + Alignment - 1) & ~(Alignment - 1);
+	return (int)Staged;
+}
+
+// --------------------------------------------------------------------
+void UploadRing::Upload(GLuint Target, unsigned int Offset, const void *Data, unsigned int Size)
+{
+	int Staged = Stage(Data, Size);
+
+	// Sent the way the TBOs were always updated, GL_COPY_WRITE_BUFFER needs ARB_copy_buffer which the direct path can't count on
+	if (Staged < 0)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, Target);
+		glBufferSubData(GL_TEXTURE_BUFFER, Offset, Size, Data);
+		return;
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, Target);
+	glBindBuffer(GL_COPY_READ_BUFFER, Buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, Staged, Offset, Size);
+}
+
+// --------------------------------------------------------------------
+void UploadRing::UploadTextureLayer(GLuint Texture, int Layer, int X, int Y, int Width, int Height, const float *Data)
+{
+	int Staged = Stage(Data, Width * Height * sizeof(float));
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, Texture);
+
+	if (Staged < 0)
+	{
+		glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, X, Y, Layer, Width, Height, 1, GL_RED, GL_FLOAT, Data);
+		return;
+	}
+
+	// Read on the GPU's timeline like the buffer copies, the fence covers it as well
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, Buffer);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, X, Y, Layer, Width, Height, 1, GL_RED, GL_FLOAT, (const GLvoid*)(size_t)Staged);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+// --------------------------------------------------------------------
+unsigned int UploadRing::UploadTextureSpan(GLuint Texture, int Layer, int Size, int Offset, int Count, const float *Texels)
+{
+	int End = Offset + Count;
+	unsigned int Rectangles = 0;
+
+	// The rest of the row the span starts in, the whole rows it covers and the start of its last row
+	while (Offset < End)
+	{
+		int Row = Offset / Size, Column = Offset % Size;
+		int Width = min(Size - Column, End - Offset), Rows = 1;
+
+		if (Column == 0 && End - Offset >= Size)
+			Rows = (End - Offset) / Size;
+
+		UploadTextureLayer(Texture, Layer, Column, Row, Width, Rows, Texels + Offset);
+		Offset += Width * Rows;
+		Rectangles++;
+	}
+
+	return Rectangles;
+}
+
+// --------------------------------------------------------------------
+void UploadRing::EndFrame()
+{
+	if (Mapped == 0 || Head == 0)
+		return;
+
+	Fences[Region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
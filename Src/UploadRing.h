@@ -0,0 +1,92 @@
+#pragma once
+
+#include <GL/glew.h>
+
+/** Upload counters - this frame's, and since the ring was initialized */
+struct UploadRingStats
+{
+	unsigned long long FrameBytes;
+	unsigned long long FrameCopies;
+	unsigned long long TotalBytes;
+
+	/// Bytes which didn't fit into the frame's region, or all of them without ARB_buffer_storage, sent with glBufferSubData
+	unsigned long long DirectBytes;
+
+	/// Frames whose region the GPU was still reading, and seconds spent waiting for it
+	unsigned long long FenceWaits;
+	double FrameFenceWaitTime;
+	double TotalFenceWaitTime;
+	double MaxFenceWaitTime;
+
+	UploadRingStats(): FrameBytes(0), FrameCopies(0), TotalBytes(0), DirectBytes(0), FenceWaits(0), FrameFenceWaitTime(0.0), TotalFenceWaitTime(0.0), MaxFenceWaitTime(0.0) {};
+};
+
+/** Streams data into GL buffers through a persistently mapped staging buffer (ARB_buffer_storage). The staging buffer is split into
+	RegionsAmount regions used a frame each, round robin - data is copied into the frame's region and from there into the target buffers
+	with glCopyBufferSubData, and a fence placed after the frame's copies tells when the region can be written again. The GPU has
+	RegionsAmount - 1 frames to catch up before BeginFrame() waits for it, no upload ever waits for the buffers being drawn from.
+	Without ARB_buffer_storage everything goes through glBufferSubData */
+class UploadRing
+{
+public:
+	static const unsigned int RegionsAmount = 3;
+	static const unsigned int DefaultRegionSize = 1 << 18;
+
+	/// Staged copies start at multiples of this
+	static const unsigned int Alignment = 16;
+
+protected:
+	GLuint Buffer;
+	unsigned char *Mapped;
+	unsigned int RegionSize;
+
+	/// Region of the current frame and bytes of it taken so far
+	unsigned int Region;
+	unsigned int Head;
+
+	/// Fences after the copies of every region's last frame, 0 once passed
+	GLsync Fences[RegionsAmount];
+
+	UploadRingStats Stats;
+
+public:
+	UploadRing();
+	~UploadRing();
+
+	/// Create the staging buffer, RegionsAmount regions of given size. False if persistent mapping isn't available, uploads are direct then.
+	/// Needs a current GL context with GLEW initialized
+	bool Init(unsigned int argRegionSize = DefaultRegionSize);
+
+	/// Delete the staging buffer and fences, while the context is still current
+	void Release();
+
+	/// Start the frame's uploads, waiting for its region if the GPU still reads it
+	void BeginFrame();
+
+	/// Copy Size bytes of Data to Offset of the Target buffer. Sent directly, it is bound to GL_TEXTURE_BUFFER
+	void Upload(GLuint Target, unsigned int Offset, const void *Data, unsigned int Size);
+
+	/// Copy Width x Height floats of Data, row after row, to (X, Y) of the layer of a GL_R32F GL_TEXTURE_2D_ARRAY. Staged data is unpacked
+	/// from the ring bound as GL_PIXEL_UNPACK_BUFFER
+	void UploadTextureLayer(GLuint Texture, int Layer, int X, int Y, int Width, int Height, const float *Data);
+
+	/// Copy the span of Count texels at row-major Offset of a Size x Size layer of Texels, as rectangles UploadTextureLayer() takes.
+	/// Returns the amount of them
+	unsigned int UploadTextureSpan(GLuint Texture, int Layer, int Size, int Offset, int Count, const float *Texels);
+
+	/// Fence the frame's copies
+	void EndFrame();
+
+	/// Getters
+	bool IsPersistent() const {return Mapped != 0;};
+	const UploadRingStats & GetStats() const {return Stats;};
+
+protected:
+	/// Copy Size bytes of Data into the frame's region and count them. Returns their offset in the staging buffer, or -1 if they have to
+	/// be sent directly
+	int Stage(const void *Data, unsigned int Size);
+
+private:
+	UploadRing(const UploadRing &other);
+	UploadRing & operator= (const UploadRing &other);
+};
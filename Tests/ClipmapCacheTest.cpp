@@ -0,0 +1,215 @@
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "ClipmapCache.h"
+#include "Tests.h"
+
+// --------------------------------------------------------------------
+static int Wrap(int Coord, int Size)
+{
+	Coord %= Size;
+	return (Coord < 0) ? (Coord + Size) : (Coord);
+}
+
+// --------------------------------------------------------------------
+static float ReferenceTexel(const HeightmapPyramid &Pyramid, int Level, int X, int Y)
+{
+	// Finest level the sample lies on, read by Get() one sample at a time - none of the gather paths of the cache
+	int Source = min(Level, (int)Pyramid.GetLevelsAmount() - 1);
+
+	while (Source > 0 && (((X - Pyramid.GetOriginX()) | (Y - Pyramid.GetOriginY())) & ((1 << Source) - 1)) != 0)
+		Source--;
+
+	if (Source == 0)
+		return Pyramid.GetLevel(0)->Get(X, Y);
+
+	return Pyramid.GetLevel(Source)->Get((X - Pyramid.GetOriginX()) / (1 << Source), (Y - Pyramid.GetOriginY()) / (1 << Source));
+}
+
+// --------------------------------------------------------------------
+static unsigned int CountMismatches(const ClipmapCache &Cache, const HeightmapPyramid &Pyramid)
+{
+	const int Size = Cache.GetSize();
+	unsigned int Mismatches = 0;
+
+	for (int lvl = 0; lvl < Cache.GetLevelsAmount(); ++lvl)
+	{
+		const float *Texels = Cache.GetTexels(lvl);
+		int FirstX, FirstY, TBOX, TBOY;
+
+		Cache.GetWindow(lvl, FirstX, FirstY, TBOX, TBOY);
+
+		for (int j = 0; j < Size; ++j)
+			for (int i = 0; i < Size; ++i)
+				if (Texels[Wrap(TBOY + j, Size) * Size + Wrap(TBOX + i, Size)] != ReferenceTexel(Pyramid, lvl, FirstX + i * (1 << lvl), FirstY + j * (1 << lvl)))
+					Mismatches++;
+	}
+
+	return Mismatches;
+}
+
+// --------------------------------------------------------------------
+static bool AreChangesInSpans(ClipmapCache &Cache, const std::vector<float> &Before)
+{
+	// Every texel written by the last scroll or refresh has to go up with one of the spans
+	const int LevelTexels = Cache.GetSize() * Cache.GetSize();
+
+	for (int lvl = 0; lvl < Cache.GetLevelsAmount(); ++lvl)
+	{
+		const float *Texels = Cache.GetTexels(lvl);
+		const std::vector<ClipmapSpan> &Spans = Cache.GetSpans(lvl);
+		std::vector<unsigned char> Covered(LevelTexels, 0);
+
+		for (unsigned int s = 0; s < Spans.size(); ++s)
+			for (int t = Spans[s].Offset; t < Spans[s].Offset + Spans[s].Count; ++t)
+				Covered[t] = 1;
+
+		for (int t = 0; t < LevelTexels; ++t)
+			if (Texels[t] != Before[lvl * LevelTexels + t] && !Covered[t])
+				return false;
+	}
+
+	return true;
+}
+
+// --------------------------------------------------------------------
+static std::vector<float> CopyTexels(const ClipmapCache &Cache)
+{
+	const int LevelTexels = Cache.GetSize() * Cache.GetSize();
+	std::vector<float> Copy(Cache.GetLevelsAmount() * LevelTexels);
+
+	for (int lvl = 0; lvl < Cache.GetLevelsAmount(); ++lvl)
+		memcpy(&Copy[lvl * LevelTexels], Cache.GetTexels(lvl), LevelTexels * sizeof(float));
+
+	return Copy;
+}
+
+// --------------------------------------------------------------------
+int TestClipmapCache()
+{
+	const int MapSize = 1024;
+	const int LevelsAmount = 6;
+	const int TBOSize = 4 * 15 + 5;
+	const int StartIndex = MapSize / 2 + TBOSize / 2;
+	const int Origin = StartIndex - (TBOSize + 1) / 2;
+	const int Frames = 300;
+	int Failures = 0;
+
+	Heightmap Map(MapSize);
+
+	for (int y = 0; y < MapSize; ++y)
+		for (int x = 0; x < MapSize; ++x)
+			Map.Set(x, y, 100.0f * sin(float(x) / 37.0f) + 60.0f * cos(float(y) / 23.0f) + float((x * 7 + y * 13) % 17));
+
+	Map.UpdateAllAprons();
+
+	// Point sampled levels and prefiltered mips, laid out like Landscape does it
+	for (int p = 0; p < 2; ++p)
+	{
+		HeightmapPyramid Pyramid(&Map, Origin, Origin, (p == 0) ? (0) : (HeightmapPyramid::DefaultLevels), 64ull << 20);
+		ClipmapCache Cache;
+
+		Cache.Reset(&Pyramid, LevelsAmount, TBOSize, StartIndex, StartIndex);
+		CHECK(CountMismatches(Cache, Pyramid) == 0);
+		Cache.ClearSpans();
+
+		// Wandering flight with a jump across the map halfway, wrapping around its edges
+		unsigned int Mismatches = 0;
+		bool bSpansCover = true;
+		int ScrolledFrames = 0;
+
+		for (int f = 0; f < Frames; ++f)
+		{
+			float OffsetX = 9.0f * f + 40.0f * sin(f / 15.0f) + ((f >= Frames / 2) ? (MapSize / 3) : (0)) + 0.0001f;
+			float OffsetY = -5.0f * f + 25.0f * cos(f / 11.0f) + 0.0001f;
+			std::vector<float> Before = CopyTexels(Cache);
+
+			if (Cache.Scroll(OffsetX, OffsetY) > 0)
+				ScrolledFrames++;
+
+			bSpansCover = bSpansCover && AreChangesInSpans(Cache, Before);
+			Cache.ClearSpans();
+
+			if (f % 10 == 0 || f == Frames / 2)
+				Mismatches += CountMismatches(Cache, Pyramid);
+		}
+
+		CHECK(ScrolledFrames > Frames / 2);
+		CHECK(Mismatches == 0);
+		CHECK(bSpansCover);
+
+		// Edits around the window, only what depends on them gathered again
+		HeightmapChangeTracker Changes;
+		Changes.AddConsumer(&Pyramid);
+
+		int FirstX, FirstY, TBOX, TBOY;
+		Cache.GetWindow(0, FirstX, FirstY, TBOX, TBOY);
+
+		for (int e = 0; e < 4; ++e)
+		{
+			HeightmapRect Dab(FirstX + 13 * e - 5, FirstY + 17 * e + 3, FirstX + 13 * e + 20, FirstY + 17 * e + 30);
+
+			for (int y = Dab.MinY; y < Dab.MaxY; ++y)
+				for (int x = Dab.MinX; x < Dab.MaxX; ++x)
+					Map.Set(x, y, Map.Get(x, y) + 3.0f);
+
+			Map.UpdateAprons(Dab);
+			Changes.MarkDirty(Dab);
+
+			std::vector<HeightmapRect> Changed;
+			Changes.Propagate(&Changed);
+
+			ClipmapCacheStats StatsBefore = Cache.GetStats();
+			std::vector<float> Before = CopyTexels(Cache);
+
+			Cache.Refresh(Changed);
+
+			CHECK(Cache.GetStats().RefreshedTexels > StatsBefore.RefreshedTexels);
+			CHECK(Cache.GetStats().RefreshedTexels - StatsBefore.RefreshedTexels < (unsigned long long)LevelsAmount * TBOSize * TBOSize);
+			CHECK(AreChangesInSpans(Cache, Before));
+			CHECK(CountMismatches(Cache, Pyramid) == 0);
+			Cache.ClearSpans();
+		}
+
+		// Blocks gathered ahead of the flight are copied in instead of gathered, with the same texels
+		std::vector<float> AheadX(20), AheadY(20);
+
+		for (int f = 0; f < 20; ++f)
+		{
+			AheadX[f] = 4000.0f + 6.0f * f + 0.0001f;
+			AheadY[f] = 300.0f + 3.0f * f + 0.0001f;
+		}
+
+		Cache.Scroll(AheadX[0], AheadY[0]);
+
+		std::vector<ClipmapBlock> Predicted;
+		std::vector<ClipmapBlock*> Gathered;
+
+		Cache.PredictBlocks(&AheadX[1], &AheadY[1], 19, Predicted);
+		CHECK(!Predicted.empty());
+
+		for (unsigned int b = 0; b < Predicted.size(); ++b)
+		{
+			ClipmapBlock *Block = new ClipmapBlock(Predicted[b]);
+			Block->Texels.resize(Block->Width * Block->Height);
+			Pyramid.GatherBlock(Block->Level, Block->X, Block->Y, Block->Width, Block->Height, &Block->Texels[0], Block->Width);
+			Gathered.push_back(Block);
+		}
+
+		Cache.Stage(Gathered);
+
+		ClipmapCacheStats StatsBefore = Cache.GetStats();
+
+		for (int f = 1; f < 20; ++f)
+			Cache.Scroll(AheadX[f], AheadY[f]);
+
+		CHECK(Cache.GetStats().PrefetchedTexels > StatsBefore.PrefetchedTexels);
+		CHECK(CountMismatches(Cache, Pyramid) == 0);
+
+		LOG((p == 0 ? "Point sampled" : "Mip") << " levels: " << ScrolledFrames << " frames scrolled, " << Cache.GetStats().GatheredTexels << " texels gathered, "
+			<< Cache.GetStats().PrefetchedTexels << " prefetched, " << Cache.GetStats().RefreshedTexels << " refreshed");
+	}
+
+	return Failures;
+}
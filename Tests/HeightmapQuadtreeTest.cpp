@@ -0,0 +1,115 @@
+#include <math.h>
+#include <vector>
+
+#include "HeightmapQuadtree.h"
+#include "Tests.h"
+
+// --------------------------------------------------------------------
+static bool IsNear(float T, float Expected)
+{
+	return fabs(T - Expected) <= 1e-3f * max(1.0f, fabs(Expected));
+}
+
+// --------------------------------------------------------------------
+static void CheckRay(HeightmapQuadtree &Quadtree, const vec3 &Origin, const vec3 &Direction, float MaxT, float ExpectedT, int &Failures)
+{
+	// Expected T below zero is a miss, both the tree and the reference have to agree with it
+	float T = -1.0f, ReferenceT = -1.0f;
+	bool bHit = Quadtree.Raycast(Origin, Direction, MaxT, T);
+	bool bReference = Quadtree.RaycastBruteForce(Origin, Direction, MaxT, ReferenceT);
+
+	if (ExpectedT < 0.0f)
+	{
+		CHECK(!bHit);
+		CHECK(!bReference);
+		return;
+	}
+
+	CHECK(bHit && IsNear(T, ExpectedT));
+	CHECK(bReference && IsNear(ReferenceT, ExpectedT));
+}
+
+// --------------------------------------------------------------------
+int TestHeightmapQuadtree()
+{
+	const int Size = 512;
+	const float Ground = 10.0f;
+	int Failures = 0;
+
+	Heightmap Map(Size);
+
+	for (int y = 0; y < Size; ++y)
+		for (int x = 0; x < Size; ++x)
+			Map.Set(x, y, Ground);
+
+	Map.UpdateAllAprons();
+
+	HeightmapTileStats Stats(&Map);
+	Stats.ComputeAll();
+
+	HeightmapQuadtree Quadtree(&Map, &Stats);
+	HeightmapChangeTracker Changes;
+
+	Changes.AddConsumer(&Stats);
+	Changes.AddConsumer(&Quadtree);
+
+	// Flat ground - straight down, oblique, parallel to it, pointing up and too short
+	CheckRay(Quadtree, vec3(100.5f, 50.0f, 200.25f), vec3(0.0f, -1.0f, 0.0f), 1000.0f, 40.0f, Failures);
+	CheckRay(Quadtree, vec3(30.0f, 110.0f, 40.0f), normalize(vec3(3.0f, -1.0f, 4.0f)), 1000.0f, 100.0f * sqrt(26.0f), Failures);
+	CheckRay(Quadtree, vec3(30.0f, 20.0f, 40.0f), vec3(1.0f, 0.0f, 0.0f), 1000.0f, -1.0f, Failures);
+	CheckRay(Quadtree, vec3(30.0f, 20.0f, 40.0f), normalize(vec3(1.0f, 1.0f, 0.0f)), 1000.0f, -1.0f, Failures);
+	CheckRay(Quadtree, vec3(100.5f, 50.0f, 200.25f), vec3(0.0f, -1.0f, 0.0f), 39.0f, -1.0f, Failures);
+
+	// A wall 40 high from column 300 on - samples 299 and 300 are joined by a slope, halfway up it at column 299.5
+	HeightmapRect Wall(300, 0, Size, Size);
+
+	for (int y = Wall.MinY; y < Wall.MaxY; ++y)
+		for (int x = Wall.MinX; x < Wall.MaxX; ++x)
+			Map.Set(x, y, Ground + 40.0f);
+
+	Map.UpdateAprons(Wall);
+	Changes.MarkDirty(Wall);
+	Changes.Propagate();
+
+	CheckRay(Quadtree, vec3(100.0f, Ground + 20.0f, 250.5f), vec3(1.0f, 0.0f, 0.0f), 1000.0f, 199.5f, Failures);
+	CheckRay(Quadtree, vec3(100.0f, Ground + 60.0f, 250.5f), vec3(1.0f, 0.0f, 0.0f), 1000.0f, -1.0f, Failures);
+	CheckRay(Quadtree, vec3(100.0f, Ground + 20.0f, 250.5f), vec3(1.0f, 0.0f, 0.0f), 150.0f, -1.0f, Failures);
+
+	// Tilted plane, every cell's triangles lie in it - hits from the plane equation, some rays crossing the wrapping edge
+	HeightmapRect Whole(0, 0, Size, Size);
+
+	for (int y = 0; y < Size; ++y)
+		for (int x = 0; x < Size; ++x)
+			Map.Set(x, y, 0.25f * x + 0.125f * y);
+
+	Map.UpdateAprons(Whole);
+	Changes.MarkDirty(Whole);
+	Changes.Propagate();
+
+	unsigned int Seed = 4321;
+
+	for (int r = 0; r < 200; ++r)
+	{
+		float Random[4];
+
+		for (int i = 0; i < 4; ++i)
+		{
+			Seed = Seed * 1664525u + 1013904223u;
+			Random[i] = (Seed >> 8) / float(1 << 24);
+		}
+
+		vec3 Origin(50.0f + Random[0] * 350.0f, 250.0f, 50.0f + Random[1] * 350.0f);
+		vec3 Direction = normalize(vec3(cos(Random[2] * 6.2832f), -(0.1f + Random[3]), sin(Random[2] * 6.2832f)));
+		float ExpectedT = (Origin.y - 0.25f * Origin.x - 0.125f * Origin.z) / (0.25f * Direction.x + 0.125f * Direction.z - Direction.y);
+
+		// Rays leaving the plane's single period before reaching it aren't known geometry
+		vec3 Hit = Origin + ExpectedT * Direction;
+
+		if (Hit.x < 0.0f || Hit.x >= Size - 1 || Hit.z < 0.0f || Hit.z >= Size - 1)
+			continue;
+
+		CheckRay(Quadtree, Origin, Direction, 5000.0f, ExpectedT, Failures);
+	}
+
+	return Failures;
+}
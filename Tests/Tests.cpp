@@ -0,0 +1,22 @@
+#include "Tests.h"
+
+/** Headless checks of the terrain code - links no GL or wx, returns non-zero exit code when any check fails */
+int main()
+{
+	int Failures = 0;
+
+	LOG("==== ClipmapCache ====");
+	Failures += TestClipmapCache();
+
+	LOG("==== HeightmapQuadtree ====");
+	Failures += TestHeightmapQuadtree();
+
+	if (Failures > 0)
+	{
+		ERR(Failures << " checks failed");
+		return 1;
+	}
+
+	CONF("All checks passed");
+	return 0;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "Log.h"
+
+/// Log a failed check with its place, and count it in the Failures variable of the calling test
+#define CHECK(X)																																	\
+	(																																				\
+		(X) ? (void)0 : (ERR("Check failed: " #X " (" << __FILE__ << ":" << __LINE__ << ")"), Failures++, (void)0)									\
+	)
+
+/// Checks of ClipmapCache against heights read sample by sample, returns the amount of failed checks
+int TestClipmapCache();
+
+/// Quadtree raycasts against heightfields with known intersections, returns the amount of failed checks
+int TestHeightmapQuadtree();